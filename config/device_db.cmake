@@ -0,0 +1,39 @@
+##===----------------------------------------------------------------------===//
+##
+##                         The Libhelper Project
+##
+##  This program is free software: you can redistribute it and/or modify
+##  it under the terms of the GNU General Public License as published by
+##  the Free Software Foundation, either version 3 of the License, or
+##  (at your option) any later version.
+##
+##  This program is distributed in the hope that it will be useful,
+##  but WITHOUT ANY WARRANTY; without even the implied warranty of
+##  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+##  GNU General Public License for more details.
+##
+##  You should have received a copy of the GNU General Public License
+##  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##
+##  Copyright (C) 2023, Is This On? Holdings Limited
+##  
+##  Harry Moulton <me@h3adsh0tzz.com>
+##
+##===----------------------------------------------------------------------===//
+
+
+cmake_minimum_required(VERSION 3.15)
+
+# The device table, and its perfect hash tables, are generated from src/darwin/devices.def
+set(DEVICE_DB_CMD "${CMAKE_CURRENT_SOURCE_DIR}/config/device_db_generator.py")
+set(DEVICE_DB_HEADER "${CMAKE_CURRENT_SOURCE_DIR}/include/darwin/darwin.h")
+set(DEVICE_DB_LIST "${CMAKE_CURRENT_SOURCE_DIR}/src/darwin/devices.def")
+set(DEVICE_DB_OUTFILE "${CMAKE_CURRENT_BINARY_DIR}/generated/darwin/device-db.c")
+
+add_custom_command(OUTPUT ${DEVICE_DB_OUTFILE}
+                COMMAND python3 ${DEVICE_DB_CMD} -d ${DEVICE_DB_HEADER} -l ${DEVICE_DB_LIST} -o ${DEVICE_DB_OUTFILE}
+                DEPENDS ${DEVICE_DB_CMD} ${DEVICE_DB_HEADER} ${DEVICE_DB_LIST}
+                COMMENT "Generating device database"
+)
+
+target_sources(htool PRIVATE ${DEVICE_DB_OUTFILE})
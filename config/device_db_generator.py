@@ -0,0 +1,186 @@
+##===----------------------------------------------------------------------===//
+##
+##                         === The HTool Project ===
+##
+##  This  document  is the property of "Is This On?" It is considered to be
+##  confidential and proprietary and may not be, in any form, reproduced or
+##  transmitted, in whole or in part, without express permission of Is This
+##  On?.
+##
+##  Copyright (C) 2023, Is This On? Holdings Limited
+##
+##  Harry Moulton <me@h3adsh0tzz.com>
+##
+##===----------------------------------------------------------------------===//
+
+#
+#   Generates the device database from src/darwin/devices.def: the device table,
+#   and a perfect hash table for each field a device can be looked up by (platform,
+#   board, SoC and identifier). The hash has to match _darwin_device_hash() in
+#   src/darwin/darwin.c.
+#
+
+import argparse
+import os
+import re
+import sys
+
+VERBOSE = False
+
+# Hashed fields, in darwin_device_key_t order, with their column in devices.def
+KEYS = [
+    ("platform",    "DARWIN_DEVICE_KEY_PLATFORM",   0),
+    ("board",       "DARWIN_DEVICE_KEY_BOARD",      1),
+    ("soc",         "DARWIN_DEVICE_KEY_SOC",        2),
+    ("identifier",  "DARWIN_DEVICE_KEY_IDENTIFIER", 4),
+]
+
+MAX_SEED = 0xffff
+
+def log(msg):
+    if VERBOSE:
+        print("LOG: {}".format(msg))
+
+def device_hash(key, seed):
+    h = (0x811c9dc5 ^ seed) & 0xffffffff
+    for c in key.encode():
+        if ord('A') <= c <= ord('Z'):
+            c |= 0x20
+        h = ((h ^ c) * 0x01000193) & 0xffffffff
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+    return h
+
+def parse_macros(header):
+    macros = {}
+    with open(header, "r") as f:
+        for m in re.finditer(r'^#define\s+(DARWIN_\w+)\s+(?:"([^"]*)"|(\d+))', f.read(), re.M):
+            macros[m.group(1)] = m.group(2) if m.group(2) is not None else int(m.group(3))
+    log("Found {} macros in {}".format(len(macros), header))
+    return macros
+
+def resolve(field, macros):
+    field = field.strip()
+    if field.startswith('"'):
+        return field.strip('"')
+    if field not in macros:
+        sys.exit("error: unknown macro '{}'".format(field))
+    return macros[field]
+
+def parse_devices(listfile, macros):
+    devices = []
+    with open(listfile, "r") as f:
+        for m in re.finditer(r'^DARWIN_DEVICE\s*\((.*)\)\s*$', f.read(), re.M):
+            fields = [x.strip() for x in re.findall(r'\s*("[^"]*"|[^,]+)', m.group(1))]
+            if len(fields) != 5:
+                sys.exit("error: malformed entry '{}'".format(m.group(0)))
+            devices.append((fields, [resolve(x, macros) for x in fields]))
+    log("Found {} devices in {}".format(len(devices), listfile))
+    return devices
+
+def build_perfect_hash(keys):
+    """
+    Hash-and-displace: keys are grouped into buckets by their seed 0 hash, and
+    the largest buckets are placed first, each with the first seed that puts all
+    of its keys into free slots. `keys` maps a lowercased key to a device index.
+    """
+    nslots = len(keys)
+    while True:
+        nbuckets = max(1, (len(keys) + 1) // 2)
+        buckets = [[] for _ in range(nbuckets)]
+        for k in keys:
+            buckets[device_hash(k, 0) % nbuckets].append(k)
+
+        disp = [0] * nbuckets
+        slots = [-1] * nslots
+        ok = True
+        for b in sorted(range(nbuckets), key=lambda i: -len(buckets[i])):
+            if not buckets[b]:
+                continue
+            for seed in range(1, MAX_SEED + 1):
+                pos = [device_hash(k, seed) % nslots for k in buckets[b]]
+                if len(set(pos)) == len(pos) and all(slots[p] < 0 for p in pos):
+                    for k, p in zip(buckets[b], pos):
+                        slots[p] = keys[k]
+                    disp[b] = seed
+                    break
+            else:
+                ok = False
+                break
+        if ok:
+            return disp, slots
+        nslots += 1
+        log("Retrying with {} slots".format(nslots))
+
+def format_array(values, per_line=12):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+def generate(devices, out, listfile):
+    src = []
+    src.append("/* Generated by config/device_db_generator.py from {}, do not edit. */".format(os.path.basename(listfile)))
+    src.append("")
+    src.append('#include "darwin/darwin.h"')
+    src.append("")
+    src.append("const darwin_device_t darwin_device_list[] =")
+    src.append("{")
+    for fields, _ in devices:
+        src.append("    {{ {} }},".format(", ".join(fields)))
+    src.append("};")
+    src.append("const uint32_t darwin_device_list_len = {};".format(len(devices)))
+
+    tables = []
+    for name, enum, column in KEYS:
+        keys = {}
+        for index, (_, values) in enumerate(devices):
+            # The first device with a given key wins
+            keys.setdefault(values[column].lower(), index)
+
+        disp, slots = build_perfect_hash(keys)
+        log("{}: {} keys, {} buckets, {} slots".format(name, len(keys), len(disp), len(slots)))
+
+        src.append("")
+        src.append("static const uint16_t _darwin_device_{}_disp[] = {{".format(name))
+        src.append(format_array(disp))
+        src.append("};")
+        src.append("static const int16_t _darwin_device_{}_slots[] = {{".format(name))
+        src.append(format_array(slots))
+        src.append("};")
+        tables.append("    [{}] = {{ _darwin_device_{}_disp, _darwin_device_{}_slots, {}, {} }},"
+                      .format(enum, name, name, len(disp), len(slots)))
+
+    src.append("")
+    src.append("const darwin_device_hash_t darwin_device_hashes[DARWIN_DEVICE_KEY_COUNT] =")
+    src.append("{")
+    src.extend(tables)
+    src.append("};")
+    src.append("")
+
+    os.makedirs(os.path.dirname(os.path.abspath(out)), exist_ok=True)
+    with open(out, "w") as f:
+        f.write("\n".join(src))
+    log("Written {}".format(out))
+
+def main():
+    global VERBOSE
+
+    parser = argparse.ArgumentParser(description="HTool Device Database Generator")
+    parser.add_argument("-d", "--header", required=True, help="darwin.h, with the device property macros")
+    parser.add_argument("-l", "--list", required=True, help="devices.def, with the device list")
+    parser.add_argument("-o", "--output", required=True, help="Generated source file")
+    parser.add_argument("-v", "--verbose", action="store_true", help="Verbose output")
+    args = parser.parse_args()
+
+    VERBOSE = args.verbose
+    devices = parse_devices(args.list, parse_macros(args.header))
+    if not devices:
+        sys.exit("error: no devices in {}".format(args.list))
+    generate(devices, args.output, args.list)
+
+if __name__ == "__main__":
+    main()
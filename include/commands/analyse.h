@@ -27,5 +27,19 @@ htool_return_t
 htool_analyse_list_all (htool_client_t *client);
 htool_return_t
 htool_analyse_extract (htool_client_t *client);
+htool_return_t
+htool_analyse_extract_all (htool_client_t *client);
+htool_return_t
+htool_analyse_diff (htool_client_t *client);
+htool_return_t
+htool_analyse_iokit_classes (htool_client_t *client);
+htool_return_t
+htool_analyse_patchfind (htool_client_t *client);
+htool_return_t
+htool_analyse_symbolicate (htool_client_t *client);
+htool_return_t
+htool_analyse_dependencies (htool_client_t *client);
+htool_return_t
+htool_analyse_kext_symbols (htool_client_t *client);
 
 #endif /* __htool_analyse_h__ */
\ No newline at end of file
@@ -20,6 +20,7 @@
 
 #include "htool.h"
 #include "htool-client.h"
+#include "disassembler/parser.h"
 
 typedef struct htool_disass_t
 {
@@ -28,9 +29,38 @@ typedef struct htool_disass_t
 
 };
 
+/**
+ * \brief       Disassemble `size` instructions from `data`, printing each one
+ *              without any annotations.
+ */
+htool_return_t
+htool_disassemble (unsigned char *data, uint32_t size, uint64_t base_address);
+
+/**
+ * \brief       Disassemble `size` instructions from `data`, as above, printing
+ *              symbol labels and annotating operands using `ann`.
+ */
+htool_return_t
+htool_disassemble_with_symbols (unsigned char *data, uint32_t size, uint64_t base_address, htool_disass_annotator_t *ann);
+
 htool_return_t
 htool_disassemble_binary_quick (htool_client_t *client);
 
+/**
+ * \brief       Disassemble every executable segment of a Mach-O, using the
+ *              code/data map to skip anything that isn't reachable code.
+ */
+htool_return_t
+htool_disassemble_binary_full (htool_client_t *client);
+
+/**
+ * \brief       Disassemble the single function given with --function, either by
+ *              address or by symbol name, using the discovered function table
+ *              to find where it starts and ends.
+ */
+htool_return_t
+htool_disassemble_function (htool_client_t *client);
+
 
 
 #endif /* __htool_disassembler_h__ */
\ No newline at end of file
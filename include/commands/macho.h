@@ -191,6 +191,17 @@ htool_print_dylinker_command (macho_t *macho, mach_load_command_info_t *info);
 void
 htool_print_linkedit_data_command (void *cmd);
 
+/**
+ *  \brief      Print a Mach-O Chained Fixups Load Command in a colour-coded
+ *              format, along with a summary of the decoded fixups.
+ *
+ *  \param macho    Mach-O struct containing the Load Command.
+ *  \param cmd      Pointer to the base of the load command within the
+ *                  Mach-O in memory.
+ */
+void
+htool_print_chained_fixups_command (macho_t *macho, void *cmd);
+
 /**
  *  \brief      Print a Mach-O DYLD Information Load Command in a colour-
  *              coded format.
@@ -234,136 +234,67 @@ typedef struct darwin_device_properties     darwin_device_t;
 #define DARWIN_DEVICE_TYPE_MAC              2
 
 /**
- *  List of all defined 64-bit iDevice's completely supported by HTool.
- *  macOS and other *OS devices are listed separately.
- * 
+ *  The device table itself is generated at build time from src/darwin/devices.def,
+ *  so there's only one copy of it, in one translation unit. Alongside it are
+ *  perfect hash tables for each of the fields a device can be looked up by.
+ *
  */
-static darwin_device_t device_list[] = 
+typedef enum darwin_device_key_t
 {
-    /* ==== MACOS DEVICES ==== */
-
-    /* M2 Macbook Pro 2023 */
-    { DARWIN_PLATFORM_T6021, DARWIN_BOARD_MACOS_J414CAP, DARWIN_SOC_M2_MAX, DARWIN_DEVICE_TYPE_MAC, "Mac14,5" },
-    { DARWIN_PLATFORM_T6021, DARWIN_BOARD_MACOS_J416CAP, DARWIN_SOC_M2_MAX, DARWIN_DEVICE_TYPE_MAC, "Mac14,6" },
-    { DARWIN_PLATFORM_T6020, DARWIN_BOARD_MACOS_J414SAP, DARWIN_SOC_M2_PRO, DARWIN_DEVICE_TYPE_MAC, "Mac14,9" },
-    { DARWIN_PLATFORM_T6020, DARWIN_BOARD_MACOS_J416SAP, DARWIN_SOC_M2_PRO, DARWIN_DEVICE_TYPE_MAC, "Mac14,10" },
-
-    /* M2 Mac mini 2023 */
-    { DARWIN_PLATFORM_T6020, DARWIN_BOARD_MACOS_J473AP, DARWIN_SOC_M2_PRO, DARWIN_DEVICE_TYPE_MAC, "Mac14,12" },
-    { DARWIN_PLATFORM_T8112, DARWIN_BOARD_MACOS_J473AP, DARWIN_SOC_M2, DARWIN_DEVICE_TYPE_MAC, "Mac14,3" },
-
-    /* M2 Macbook Air & Macbook Pro 2022 */
-    { DARWIN_PLATFORM_T8112, DARWIN_BOARD_MACOS_J493AP, DARWIN_SOC_M2, DARWIN_DEVICE_TYPE_MAC, "Mac14,7" },
-    { DARWIN_PLATFORM_T8112, DARWIN_BOARD_MACOS_J413AP, DARWIN_SOC_M2, DARWIN_DEVICE_TYPE_MAC, "Mac14,2" },
-
-    /* Apple Virtual Machine 1 */
-    { DARWIN_PLATFORM_VMAPPLE2, DARWIN_BOARD_MACOS_VMA2MACOSAP, DARWIN_SOC_GENERIC_ARM, DARWIN_DEVICE_TYPE_MAC, "VirtualMac2,1" },
-
-    /* M1 Mac Studio */
-    { DARWIN_PLATFORM_T6001, DARWIN_BOARD_MACOS_J375CAP, DARWIN_SOC_M1_MAX, DARWIN_DEVICE_TYPE_MAC, "Mac13,1" },
-    { DARWIN_PLATFORM_T6002, DARWIN_BOARD_MACOS_J375DAP, DARWIN_SOC_M1_ULTRA, DARWIN_DEVICE_TYPE_MAC, "Mac13,2" },
-
-    /* M1 Macbook Pro 2021 */
-    { DARWIN_PLATFORM_T6000, DARWIN_BOARD_MACOS_J316SAP, DARWIN_SOC_M1_PRO, DARWIN_DEVICE_TYPE_MAC, "MacBookPro18,1" },
-    { DARWIN_PLATFORM_T6000, DARWIN_BOARD_MACOS_J314SAP, DARWIN_SOC_M1_PRO, DARWIN_DEVICE_TYPE_MAC, "MacBookPro18,3" },
-    { DARWIN_PLATFORM_T6001, DARWIN_BOARD_MACOS_J316CAP, DARWIN_SOC_M1_MAX, DARWIN_DEVICE_TYPE_MAC, "MacBookPro18,2" },
-    { DARWIN_PLATFORM_T6001, DARWIN_BOARD_MACOS_J314CAP, DARWIN_SOC_M1_MAX, DARWIN_DEVICE_TYPE_MAC, "MacBookPro18,1" },
-
-    /* M1 iMac 2021 */
-    { DARWIN_PLATFORM_T8103, DARWIN_BOARD_MACOS_J457AP, DARWIN_SOC_M1,    DARWIN_DEVICE_TYPE_MAC, "iMac21,2" },
-    { DARWIN_PLATFORM_T8103, DARWIN_BOARD_MACOS_J456AP, DARWIN_SOC_M1,    DARWIN_DEVICE_TYPE_MAC, "iMac21,1" },
-
-    /* M1 Mac Mini 2020 */
-    { DARWIN_PLATFORM_T8103, DARWIN_BOARD_MACOS_J274AP,  DARWIN_SOC_M1,    DARWIN_DEVICE_TYPE_MAC, "MacMini9,1" },
-
-    /* M1 Macbook Air & Macbook Pro 2020 */
-    { DARWIN_PLATFORM_T8103, DARWIN_BOARD_MACOS_J313AP,  DARWIN_SOC_M1,   DARWIN_DEVICE_TYPE_MAC, "MacBookAir10,1" },
-    { DARWIN_PLATFORM_T8103, DARWIN_BOARD_MACOS_J293AP,  DARWIN_SOC_M1,   DARWIN_DEVICE_TYPE_MAC, "MacBookPro17,1" },
-
-    /* Developer Transition Kit */
-    { DARWIN_PLATFORM_T8020, DARWIN_BOARD_MACOS_J313AP,  DARWIN_SOC_A12Z, DARWIN_DEVICE_TYPE_MAC, "ADP3,2" },
-
-    /* ==== IOS DEVICES ==== */
-
-    /* iPhone 14, 14 Plus, 14 Pro, 14 Pro Max */
-    { DARWIN_PLATFORM_T8120, DARWIN_BOARD_D74AP,   DARWIN_SOC_A16_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone15,3 "},
-    { DARWIN_PLATFORM_T8120, DARWIN_BOARD_D73AP,   DARWIN_SOC_A16_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone15,2" },
-    { DARWIN_PLATFORM_T8120, DARWIN_BOARD_D28AP,   DARWIN_SOC_A16_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone14,8" },
-    { DARWIN_PLATFORM_T8120, DARWIN_BOARD_D27AP,   DARWIN_SOC_A16_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone14,7 "},
-
-    /* iPhone SE (3rd Generation) */
-    { DARWIN_PLATFORM_T8110, DARWIN_BOARD_D49AP,   DARWIN_SOC_A15_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone14,6 "},
-
-    /* iPhone 13 Pro, 13 Pro Max, 13 & 13 Mini */
-    { DARWIN_PLATFORM_T8110, DARWIN_BOARD_D17AP,   DARWIN_SOC_A15_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone14,5" },
-    { DARWIN_PLATFORM_T8110, DARWIN_BOARD_D16AP,   DARWIN_SOC_A15_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone14,4" },
-    { DARWIN_PLATFORM_T8110, DARWIN_BOARD_D64AP,   DARWIN_SOC_A15_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone14,3" },
-    { DARWIN_PLATFORM_T8110, DARWIN_BOARD_D63AP,   DARWIN_SOC_A15_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone14,2" },
-
-    /* iPhone 12 Pro, 12 Pro Max, 12 & 12 Mini */
-    { DARWIN_PLATFORM_T8101, DARWIN_BOARD_D54PAP,  DARWIN_SOC_A14_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone13,4" },
-    { DARWIN_PLATFORM_T8101, DARWIN_BOARD_D53PAP,  DARWIN_SOC_A14_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone13,3" },
-    { DARWIN_PLATFORM_T8101, DARWIN_BOARD_D53GAP,  DARWIN_SOC_A14_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone13,2" },
-    { DARWIN_PLATFORM_T8101, DARWIN_BOARD_D52GAP,  DARWIN_SOC_A14_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone13,1" },
-
-    /* iPhone SE (2nd Generation) 2020 */
-    { DARWIN_PLATFORM_T8030, DARWIN_BOARD_D79AP,   DARWIN_SOC_A13_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone12,8" },
-
-    /* iPhone 11 Pro Max, 11 Pro & 11 */
-    { DARWIN_PLATFORM_T8030, DARWIN_BOARD_D431AP,  DARWIN_SOC_A13_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone12,5" },
-    { DARWIN_PLATFORM_T8030, DARWIN_BOARD_D421AP,  DARWIN_SOC_A13_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone12,3" },
-    { DARWIN_PLATFORM_T8030, DARWIN_BOARD_N104AP,  DARWIN_SOC_A13_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone12,1" },
-
-    /* iPhone XS Max, XS & XR */
-    { DARWIN_PLATFORM_T8020, DARWIN_BOARD_D331PAP, DARWIN_SOC_A12_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone11,6" },
-    { DARWIN_PLATFORM_T8020, DARWIN_BOARD_D331AP,  DARWIN_SOC_A12_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone11,4" },
-    { DARWIN_PLATFORM_T8020, DARWIN_BOARD_D321AP,  DARWIN_SOC_A12_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone11,2" },
-    { DARWIN_PLATFORM_T8020, DARWIN_BOARD_N841AP,  DARWIN_SOC_A12_BIONIC, DARWIN_DEVICE_TYPE_MOBILE, "iPhone11,8" },
-
-    /* iPhone X*/
-    { DARWIN_PLATFORM_T8015, DARWIN_BOARD_D221AP,  DARWIN_SOC_A11, DARWIN_DEVICE_TYPE_MOBILE, "iPhone10,6" },
-    { DARWIN_PLATFORM_T8015, DARWIN_BOARD_D22AP,   DARWIN_SOC_A11, DARWIN_DEVICE_TYPE_MOBILE, "iPhone10,3" },
-
-    /* iPhone 8 Plus & 8 */
-    { DARWIN_PLATFORM_T8015, DARWIN_BOARD_D211AP,  DARWIN_SOC_A11, DARWIN_DEVICE_TYPE_MOBILE, "iPhone10,2" },
-    { DARWIN_PLATFORM_T8015, DARWIN_BOARD_D211AP,  DARWIN_SOC_A11, DARWIN_DEVICE_TYPE_MOBILE, "iPhone10,5" },
-    { DARWIN_PLATFORM_T8015, DARWIN_BOARD_D201AP,  DARWIN_SOC_A11, DARWIN_DEVICE_TYPE_MOBILE, "iPhone10,4" },
-    { DARWIN_PLATFORM_T8015, DARWIN_BOARD_D20AP,   DARWIN_SOC_A11, DARWIN_DEVICE_TYPE_MOBILE, "iPhone10,1" },
-
-    /* iPhone 7 Plus & 7 */
-    { DARWIN_PLATFORM_T8010, DARWIN_BOARD_D111AP,  DARWIN_SOC_A10, DARWIN_DEVICE_TYPE_MOBILE, "iPhone9,4" },
-    { DARWIN_PLATFORM_T8010, DARWIN_BOARD_D11AP,   DARWIN_SOC_A10, DARWIN_DEVICE_TYPE_MOBILE, "iPhone9,2" },
-    { DARWIN_PLATFORM_T8010, DARWIN_BOARD_D101AP,  DARWIN_SOC_A10, DARWIN_DEVICE_TYPE_MOBILE, "iPhone9,3" },
-    { DARWIN_PLATFORM_T8010, DARWIN_BOARD_D10AP,   DARWIN_SOC_A10, DARWIN_DEVICE_TYPE_MOBILE, "iPhone9,1" },
-
-    /* iPhone SE (1st Generation) */
-    { DARWIN_PLATFORM_S8000, DARWIN_BOARD_N69UAP,  DARWIN_SOC_A9,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone8,4" },
-    { DARWIN_PLATFORM_S8003, DARWIN_BOARD_N69AP,   DARWIN_SOC_A9,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone8,4" },
-
-    /* iPhone 6s Plus & 6s */
-    { DARWIN_PLATFORM_S8000, DARWIN_BOARD_N66AP,   DARWIN_SOC_A9,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone8,2" },
-    { DARWIN_PLATFORM_S8003, DARWIN_BOARD_N66MAP,  DARWIN_SOC_A9,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone8,2" },
-    { DARWIN_PLATFORM_S8000, DARWIN_BOARD_N71AP,   DARWIN_SOC_A9,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone8,1" },
-    { DARWIN_PLATFORM_S8003, DARWIN_BOARD_N71MAP,  DARWIN_SOC_A9,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone8,1" },
-
-    /* iPhone 6 Plus & 6 */
-    { DARWIN_PLATFORM_T7000, DARWIN_BOARD_N56AP,  DARWIN_SOC_A8,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone7,1" },
-    { DARWIN_PLATFORM_T7000, DARWIN_BOARD_N61AP,  DARWIN_SOC_A8,  DARWIN_DEVICE_TYPE_MOBILE, "iPhone7,2" },
-
-    /* iPhone 5s */
-    { DARWIN_PLATFORM_S5L8960, DARWIN_BOARD_N53AP, DARWIN_SOC_A7, DARWIN_DEVICE_TYPE_MOBILE, "iPhone6,2" },
-    { DARWIN_PLATFORM_S5L8960, DARWIN_BOARD_N51AP, DARWIN_SOC_A7, DARWIN_DEVICE_TYPE_MOBILE, "iPhone6,1" },
-
-    { NULL }
-};
+    DARWIN_DEVICE_KEY_PLATFORM = 0,
+    DARWIN_DEVICE_KEY_BOARD,
+    DARWIN_DEVICE_KEY_SOC,
+    DARWIN_DEVICE_KEY_IDENTIFIER,
+
+    DARWIN_DEVICE_KEY_COUNT
+} darwin_device_key_t;
+
+/**
+ * \brief       A perfect hash table over one field of the device table.
+ *
+ *              A key hashes with seed 0 to a bucket in `disp`, and then with the
+ *              bucket's seed to a slot in `slots`, holding the index of the first
+ *              device with that key, or -1. The hash has to match the one in
+ *              config/device_db_generator.py.
+ */
+typedef struct darwin_device_hash_t
+{
+    const uint16_t     *disp;
+    const int16_t      *slots;
+    uint32_t            nbuckets;
+    uint32_t            nslots;
+} darwin_device_hash_t;
 
-#define DARWIN_DEVICE_LIST_LEN              (sizeof (device_list) / sizeof (device_list[0])) - 1
-#define DOES_STRING_EXIST (a, b)               strstr(a, b) != NULL
+extern const darwin_device_t            darwin_device_list[];
+extern const uint32_t                   darwin_device_list_len;
+extern const darwin_device_hash_t       darwin_device_hashes[DARWIN_DEVICE_KEY_COUNT];
+
+/**
+ * \brief       Look up a device by one of its fields, ignoring case. Where several
+ *              devices share a key, e.g. an SoC, the first in the list is returned.
+ *
+ * \param   key     Field to match against.
+ * \param   str     String to look up, it doesn't need to be NUL-terminated.
+ * \param   len     Length of `str`.
+ *
+ * \returns     The device, or NULL if nothing matches. Nothing is allocated.
+ */
+const darwin_device_t *
+darwin_device_lookup (darwin_device_key_t key, const char *str, size_t len);
+
+/**
+ * \brief       Match a string, or each part of a "/"-separated string, against the
+ *              SoC, board and platform of every device, in that order.
+ *
+ * \returns     The first device that matches, or NULL. Nothing is allocated.
+ */
+const darwin_device_t *
+darwin_device_find (const char *string);
 
 /**
- *  Call with any string, and it will be matched with a defined device above. If this
- *  were to fail, the returned result would be "string (Unknown)", however if everything
- *  works, the result should be "A14 Bionic T8101 (D54PAP)".
+ *  Call with any string, and it will be matched with a device from the table above.
+ *  If this were to fail, the returned result would be "string (Unknown)", however if
+ *  everything works, the result should be "T8101 (A14 Bionic)".
  * 
  */
 char *darwin_get_device_from_string (char *string);
@@ -0,0 +1,106 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DEPENDENCIES_H__
+#define __HTOOL_DEPENDENCIES_H__
+
+#include "htool.h"
+#include "kext.h"
+
+/**
+ *  NOTE:   Every kext lists the bundles it links against under OSBundleLibraries
+ *          in its prelink info dictionary. The dependency graph has a node for
+ *          every bundle in the prelink info, including the ones without any code
+ *          (e.g. com.apple.kpi.*, which the kernel itself provides), and for any
+ *          bundle that's depended on but isn't there at all.
+ *
+ *          Edges are kept in CSR form both ways: the dependencies of node `i` are
+ *          `deps[deps_first[i]]` up to `deps[deps_first[i + 1]]`, and its
+ *          dependents are likewise in `rdeps`. The topological order puts every
+ *          node after its dependencies, which is the order the kernel would load
+ *          them in.
+ */
+
+#define XNU_KEXT_GRAPH_NONE             UINT32_MAX
+
+/* Depended on, but not in the prelink info */
+#define XNU_KEXT_NODE_FLAG_MISSING      (1 << 0)
+
+typedef struct xnu_kext_node_t
+{
+    char                   *bundle_id;
+    char                   *version;        /* CFBundleVersion, or NULL */
+    uint32_t                kext;           /* index into xnu->kext_array, or XNU_KEXT_GRAPH_NONE */
+    uint32_t                flags;
+} xnu_kext_node_t;
+
+typedef struct xnu_kext_graph_t
+{
+    xnu_kext_node_t        *nodes;
+    uint32_t                nnodes;
+
+    /* Dependencies and dependents, `nnodes + 1` offsets into `nedges` edges each */
+    uint32_t               *deps_first;
+    uint32_t               *deps;
+    uint32_t               *rdeps_first;
+    uint32_t               *rdeps;
+    uint32_t                nedges;
+
+    /* Dependencies first. Nodes that are part of a cycle are left out */
+    uint32_t               *order;
+    uint32_t                norder;
+
+    /* Open addressing over the bundle IDs. Each slot is a node index + 1, or 0 */
+    uint32_t               *slots;
+    uint32_t                mask;
+} xnu_kext_graph_t;
+
+
+/**
+ * \brief       Build the dependency graph from the kernelcache's prelink info.
+ *              The kexts must already have been parsed. Kexts that weren't given
+ *              their info dictionary by the loader get it here.
+ *
+ * \returns     The graph, or NULL if the kernelcache has no prelink info.
+ */
+xnu_kext_graph_t *
+xnu_kext_graph_build (xnu_t *xnu);
+
+/**
+ * \brief       Free a dependency graph.
+ */
+void
+xnu_kext_graph_free (xnu_kext_graph_t *graph);
+
+/**
+ * \brief       Find the node for a bundle ID.
+ *
+ * \returns     The node's index, or XNU_KEXT_GRAPH_NONE.
+ */
+uint32_t
+xnu_kext_graph_find (xnu_kext_graph_t *graph, const char *bundle_id);
+
+/**
+ * \brief       Every node `root` depends on, directly or not, and `root` itself,
+ *              in topological order. Nodes in a cycle come last.
+ *
+ * \param   nodes   Set to an array of node indexes, to be freed by the caller.
+ *
+ * \returns     The number of nodes.
+ */
+uint32_t
+xnu_kext_graph_closure (xnu_kext_graph_t *graph, uint32_t root, uint32_t **nodes);
+
+#endif /* __htool_dependencies_h__ */
@@ -0,0 +1,49 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DIFF_H__
+#define __HTOOL_DIFF_H__
+
+#include "htool.h"
+#include "kext.h"
+
+/**
+ *  NOTE:   Kernelcaches are compared kext by kext. Kexts are matched on their
+ *          bundle ID, and a kext that's in both is unchanged only if its UUID and
+ *          the content hash of each of its segments are the same.
+ *
+ *          Every segment of both caches is hashed in one go, in parallel, straight
+ *          from the mappings. __LINKEDIT is left out: on fileset caches it's shared
+ *          by every kext, so it would mark all of them as changed.
+ */
+
+typedef enum xnu_diff_status_t
+{
+    XNU_DIFF_UNCHANGED = 0,
+    XNU_DIFF_CHANGED,
+    XNU_DIFF_ADDED,
+    XNU_DIFF_REMOVED,
+} xnu_diff_status_t;
+
+/**
+ * \brief       Compare two kernelcaches, with their kexts already parsed, and print
+ *              the kernel and each added, removed and changed kext.
+ *
+ * \returns     Success if they were compared, whether or not they differ.
+ */
+htool_return_t
+xnu_kernel_diff (xnu_t *old, xnu_t *new);
+
+#endif /* __htool_diff_h__ */
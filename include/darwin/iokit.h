@@ -0,0 +1,93 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_IOKIT_H__
+#define __HTOOL_IOKIT_H__
+
+#include "htool.h"
+#include "kext.h"
+
+/**
+ *  NOTE:   Every IOKit class has a static OSMetaClass instance, built by a
+ *          static initialiser in the kext that defines the class. The
+ *          initialiser calls
+ *
+ *              OSMetaClass::OSMetaClass (this, className, superClass, classSize)
+ *
+ *          with the class's metaclass in x0, its name in x1, the superclass's
+ *          metaclass in x2 and the size of an instance in w3, and then stores
+ *          the metaclass's vtable into it.
+ *
+ *          Recovery runs the initialisers of each kext (from __mod_init_func or
+ *          __kmod_init) with a small register tracker, collecting every call
+ *          that looks like that. Kexts are independent, so they're done on the
+ *          worker pool. The constructor is then picked as the function with the
+ *          most of those calls, following any stub the kexts call it through,
+ *          and the classes are linked to their superclasses by metaclass.
+ *
+ *          A class's own vtable is found through its metaclass. Every MetaClass
+ *          overrides alloc(), which news an instance and stores the class's
+ *          vtable into it, so alloc() is run from the metaclass vtable slot
+ *          that most classes agree on.
+ */
+
+#define XNU_IOKIT_CLASS_NONE            UINT32_MAX
+
+typedef struct xnu_iokit_class_t
+{
+    const char         *name;           /* points into the kernelcache */
+    uint64_t            metaclass;
+    uint64_t            super_metaclass;
+    uint64_t            vtable;             /* 0 for abstract classes, or if it wasn't found */
+    uint64_t            metaclass_vtable;   /* 0 if it wasn't found */
+    uint32_t            size;
+
+    uint32_t            kext;           /* index into xnu->kext_array, or XNU_IOKIT_CLASS_NONE for the kernel */
+    uint32_t            superclass;     /* index into the classes, or XNU_IOKIT_CLASS_NONE */
+} xnu_iokit_class_t;
+
+typedef struct xnu_iokit_classes_t
+{
+    /* Sorted by metaclass address */
+    xnu_iokit_class_t  *classes;
+    uint32_t            nclasses;
+
+    uint64_t            constructor;    /* OSMetaClass::OSMetaClass */
+} xnu_iokit_classes_t;
+
+
+/**
+ * \brief       Recover every IOKit class defined by the kernel and its kexts.
+ *              The kexts must already have been parsed.
+ *
+ * \returns     The classes, which are empty if the constructor couldn't be
+ *              found.
+ */
+xnu_iokit_classes_t *
+xnu_iokit_classes_recover (xnu_t *xnu);
+
+/**
+ * \brief       Print the classes as a tree, each under its superclass.
+ */
+void
+xnu_iokit_classes_print (xnu_t *xnu, xnu_iokit_classes_t *classes);
+
+/**
+ * \brief       Free recovered classes.
+ */
+void
+xnu_iokit_classes_free (xnu_iokit_classes_t *classes);
+
+#endif /* __htool_iokit_h__ */
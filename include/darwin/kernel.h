@@ -56,11 +56,19 @@ typedef enum xnu_kernel_type_t {
 
 typedef struct xnu_version_t
 {
+    char        *banner;                //  Full Banner:    e.g. Darwin Kernel Version 19.2.0: Mon Nov ...
     char        *darwin_vers;           //  Darwin Version  e.g. 19.2.0  
     char        *xnu_vers;              //  XNU Version     e.g. xnu-6153.60.66~39
     char        *build_time;            //  Build Time:     e.g. Mon Nov  4 17:46:45 PST 2019
+    char        *build_tag;             //  Build Tag:      e.g. RELEASE_ARM64_T8030
+    char        *soc;                   //  SoC:            e.g. T8030
     char        *device_type;           //  Device Type:    e.g. A13 (T8030)
     char        *cache_style;           //  Cache Style:    e.g. Merged (New-Style)
+
+    /* Darwin version, split up, e.g. 19, 2, 0 */
+    uint32_t     major;
+    uint32_t     minor;
+    uint32_t     patch;
 } xnu_version_t;
 
 #define HTOOL_XNU_FLAG_FILESET_ENTRY        (1 << 1)
@@ -74,6 +82,11 @@ typedef struct xnu_t
     macho_t                 *macho;
     macho_t                 *kern;      /* only if HTOOL_XNU_FLAG_FILESET_ENTRY is set */
     HSList                  *kexts;
+    struct kext_t          **kext_array;    /* same order as `kexts` */
+    uint32_t                 nkexts;
+    struct kext_index_t     *kext_index;    /* lookup by bundle ID */
+    struct plist_t          *prelink_info;  /* see xnu_prelink_info_fetch() */
+    struct kext_symbol_table_t  *symbol_table;  /* see xnu_kext_symbols() */
 
     /* Non-string types */
     xnu_kernel_type_t       type;
@@ -95,4 +108,27 @@ xnu_kernel_type_get_string (xnu_kernel_type_t type);
 char *
 xnu_kernel_soc_string (char *buffer);
 
+/**
+ * \brief   Find the kernel's version banner in __TEXT.__const, or __TEXT.__cstring on
+ *          older kernels. The section offsets are relative to `file`, which is the
+ *          whole fileset when `kern` is its com.apple.kernel entry.
+ *
+ * \param   len     Set to the length of the banner, not including its NUL.
+ *
+ * \returns     The banner, inside `file`, or NULL if it wasn't found.
+ */
+const char *
+xnu_kernel_find_banner (macho_t *file, macho_t *kern, size_t *len);
+
+/**
+ * \brief   Parse the kernel's version banner, e.g.
+ * 
+ *          "Darwin Kernel Version 22.1.0: Thu Oct  6 19:34:16 PDT 2022; root:xnu-8792.42.7~1/RELEASE_ARM64_T8110"
+ * 
+ *          The banner is only searched for in __TEXT.__const and __TEXT.__cstring of the
+ *          kernel, or of the com.apple.kernel fileset entry.
+ */
+xnu_version_t *
+xnu_kernel_parse_version (xnu_t *xnu);
+
 #endif /* __htool_kernel_h__ */
\ No newline at end of file
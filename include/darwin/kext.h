@@ -20,6 +20,7 @@
 #include "htool-loader.h"
 
 #include "kernel.h"
+#include "plist.h"
 
 #define MIN(a, b)               (((a) < (b)) ? (a) : (b))
 
@@ -66,6 +67,7 @@ typedef struct kext_t
 
     /* Split type properties */
     uint64_t         vmaddr;
+    const plist_dict_t  *info;      /* Entry in _PrelinkInfoDictionary */
 
 
     /* Merged type properties */
@@ -73,6 +75,8 @@ typedef struct kext_t
     uint64_t         info_table;
     uint64_t         __text_vmaddr;
     uint64_t         kernel_ptr;
+    const struct kext_symbol_t  *symbols;   /* Slice of xnu->symbol_table, see xnu_kext_symbols() */
+    uint32_t         nsymbols;
 
 
     /* Fileset type properties */
@@ -116,8 +120,135 @@ typedef struct partial_kmod_info_64_t {
 
 } partial_kmod_info_64_t;
 
+/**
+ *  \brief      A defined symbol from the kernel's LC_SYMTAB. The name points
+ *              straight into the kernel's string table.
+ */
+typedef struct kext_symbol_t
+{
+    uint64_t         vmaddr;
+    const char      *name;
+} kext_symbol_t;
+
+/**
+ *  \brief      The kernel's defined symbols, sorted by address.
+ *
+ *              Merged-style kexts don't have a symbol table of their own, their
+ *              symbols are in the kernel's. Every kext's __TEXT_EXEC covers a run
+ *              of the sorted table, so each kext just points at its run.
+ */
+typedef struct kext_symbol_table_t
+{
+    kext_symbol_t   *symbols;
+    uint32_t         nsymbols;
+} kext_symbol_table_t;
+
+/**
+ *  \brief      Lookup index over the parsed kexts, built once they've all been
+ *              parsed.
+ *
+ *              Exact bundle IDs are found through an open-addressed hash table,
+ *              and prefixes and glob patterns through a copy of the kext indexes
+ *              sorted by bundle ID, so only the range sharing a pattern's literal
+ *              prefix is matched against it.
+ */
+typedef struct kext_index_t
+{
+    /* Slots hold an index into xnu->kext_array, plus one. Zero is empty */
+    uint32_t        *slots;
+    uint32_t         mask;
+
+    /* Indexes into xnu->kext_array, sorted by name */
+    uint32_t        *sorted;
+    uint32_t         count;
+} kext_index_t;
+
 
 htool_return_t
 xnu_parse_kernel_extensions (xnu_t *xnu);
 
+/**
+ * \brief       The Mach-O a kext's file offsets are relative to. That's the whole
+ *              fileset for fileset entries, and the kernel otherwise.
+ */
+macho_t *
+xnu_kext_source_macho (xnu_t *xnu, kext_t *kext);
+
+/**
+ * \brief       The parsed __PRELINK_INFO plist. Split-style caches parse it while
+ *              loading their kexts, and for the others it's parsed the first time
+ *              this is called.
+ *
+ * \returns     The plist, or NULL if there isn't one or it's malformed.
+ */
+plist_t *
+xnu_prelink_info_fetch (xnu_t *xnu);
+
+/**
+ * \brief       The kext's own Mach-O. Fileset kexts are only parsed, and their
+ *              version and UUID filled in, the first time this is called, so use
+ *              it rather than `kext->macho`. Safe to call from several threads.
+ *
+ * \returns     The kext's Mach-O, or NULL if it couldn't be parsed.
+ */
+macho_t *
+xnu_kext_macho (xnu_t *xnu, kext_t *kext);
+
+/**
+ * \brief       The symbols in a merged-style kext's __TEXT_EXEC, sorted by
+ *              address, as a slice of the kernel's symbol table. The first call
+ *              sorts the table and gives every merged kext its slice. Safe to call
+ *              from several threads.
+ *
+ * \param   count   Set to the number of symbols.
+ *
+ * \returns     The symbols, or NULL if there are none or the kext isn't merged.
+ */
+const kext_symbol_t *
+xnu_kext_symbols (xnu_t *xnu, kext_t *kext, uint32_t *count);
+
+/**
+ * \brief       Read the defined symbols from an image's LC_SYMTAB, in table order.
+ *              The table's offsets are relative to `source`, which is the whole
+ *              kernelcache for a kext, and the names point straight into its
+ *              string table.
+ *
+ * \param   count   Set to the number of symbols.
+ *
+ * \returns     The symbols, which should be freed by the caller, or NULL if the
+ *              image has no usable symbol table.
+ */
+kext_symbol_t *
+xnu_symtab_read (macho_t *macho, macho_t *source, uint32_t *count);
+
+/**
+ * \brief       Index into xnu->kext_array of the kext with this exact bundle ID.
+ *              If the ID is repeated, it's the first kext with it.
+ *
+ * \returns     The index, or UINT32_MAX if there isn't one.
+ */
+uint32_t
+xnu_kext_find_index (xnu_t *xnu, const char *bundleid);
+
+/**
+ * \brief       Find a kext by its exact bundle ID.
+ *
+ * \returns     The kext, or NULL if there isn't one with that name.
+ */
+kext_t *
+xnu_kext_find (xnu_t *xnu, const char *bundleid);
+
+/**
+ * \brief       Find every kext whose bundle ID matches `pattern`. A pattern with
+ *              `*`, `?` or `[` in it is matched as a glob (e.g. "com.apple.iokit.*"),
+ *              otherwise it has to match exactly.
+ *
+ * \param   matches     Set to an array of indexes into xnu->kext_array, in bundle
+ *                      ID order. It should be freed by the caller.
+ *
+ * \returns     The number of matches.
+ */
+uint32_t
+xnu_kext_match (xnu_t *xnu, const char *pattern, uint32_t **matches);
+
 #endif /* __htool_kext_h__ */
\ No newline at end of file
@@ -0,0 +1,134 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_PATCHFINDER_H__
+#define __HTOOL_PATCHFINDER_H__
+
+#include "htool.h"
+#include "kernel.h"
+
+/**
+ *  NOTE:   A patchfinder rule locates something in the kernel by the usual route:
+ *          find a string, find the code that references it, then find an
+ *          instruction near that reference and take something from it. Rules are
+ *          read from a file, one per line:
+ *
+ *              allproc  string="shutdownwait" match=ldr window=16 extract=target
+ *
+ *          with these fields, all but `string` optional:
+ *
+ *              string=     The anchor, the exact contents of a C-string.
+ *              match=      An instruction to look for near the reference, either
+ *                          by name (bl, b, b.cond, cbz, cbnz, tbz, tbnz, adrp, adr,
+ *                          add, ldr, str, movz, ret) or as VALUE/MASK in hex.
+ *              direction=  forward (the default) or backward from the reference.
+ *              window=     How many instructions to look through, up to 256.
+ *              nth=        Take the nth match in the window, rather than the first.
+ *              extract=    What the rule resolves to: xref, the referencing
+ *                          instruction; match, the matched instruction; target,
+ *                          the address the matched instruction branches to or
+ *                          builds; imm, its immediate; function, the start of the
+ *                          function containing the reference.
+ *
+ *          Rather than searching for each rule in turn, the anchors of every rule
+ *          are found in one pass over the string sections, and then all of the
+ *          rules are evaluated in a single sweep over the executable segments,
+ *          split into chunks for the worker pool.
+ */
+
+#define XNU_PATCHFIND_MAX_WINDOW        256
+
+typedef enum xnu_patchfind_extract_t
+{
+    XNU_PATCHFIND_EXTRACT_XREF = 0,
+    XNU_PATCHFIND_EXTRACT_MATCH,
+    XNU_PATCHFIND_EXTRACT_TARGET,
+    XNU_PATCHFIND_EXTRACT_IMM,
+    XNU_PATCHFIND_EXTRACT_FUNCTION,
+} xnu_patchfind_extract_t;
+
+typedef enum xnu_patchfind_status_t
+{
+    XNU_PATCHFIND_STATUS_NO_ANCHOR = 0,     /* the string isn't in the kernelcache */
+    XNU_PATCHFIND_STATUS_NO_XREF,           /* nothing references the string */
+    XNU_PATCHFIND_STATUS_NO_MATCH,          /* no reference had a matching instruction */
+    XNU_PATCHFIND_STATUS_RESOLVED,
+    XNU_PATCHFIND_STATUS_AMBIGUOUS,         /* resolved, but references disagree on the value */
+} xnu_patchfind_status_t;
+
+typedef struct xnu_patchfind_rule_t
+{
+    char                       *name;
+    char                       *anchor;
+    uint32_t                    anchor_len;
+    uint32_t                    line;
+
+    /* Instructions with (opcode & match_mask) == match_value. No pattern if the mask is 0 */
+    uint32_t                    match_mask;
+    uint32_t                    match_value;
+    uint32_t                    window;
+    uint32_t                    nth;
+    int                         backward;
+    xnu_patchfind_extract_t     extract;
+
+    /* Set by xnu_patchfind_run(). The value is from the lowest reference that resolved */
+    xnu_patchfind_status_t      status;
+    uint64_t                    value;
+    uint64_t                    xref;
+    uint32_t                    nanchors;
+    uint32_t                    nxrefs;
+    uint32_t                    nresolved;
+} xnu_patchfind_rule_t;
+
+typedef struct xnu_patchfind_t
+{
+    xnu_patchfind_rule_t       *rules;
+    uint32_t                    nrules;
+} xnu_patchfind_t;
+
+
+/**
+ * \brief       Load a rules file.
+ *
+ * \param   path    Path to the rules file.
+ *
+ * \returns     The rules, or NULL if the file can't be read or a rule is invalid.
+ */
+xnu_patchfind_t *
+xnu_patchfind_load (const char *path);
+
+/**
+ * \brief       Evaluate every rule against a kernelcache, setting each rule's
+ *              status and value.
+ *
+ * \returns     Success, or Failure if the kernelcache has no executable segments.
+ */
+htool_return_t
+xnu_patchfind_run (xnu_t *xnu, xnu_patchfind_t *pf);
+
+/**
+ * \brief       Print a table of the results, with the file offset of each value
+ *              that is an address in the kernelcache.
+ */
+void
+xnu_patchfind_print (xnu_t *xnu, xnu_patchfind_t *pf);
+
+/**
+ * \brief       Free loaded rules.
+ */
+void
+xnu_patchfind_free (xnu_patchfind_t *pf);
+
+#endif /* __htool_patchfinder_h__ */
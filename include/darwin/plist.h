@@ -0,0 +1,188 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_PLIST_H__
+#define __HTOOL_PLIST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   The kernelcache describes its kexts in a property list, stored in the
+ *          __PRELINK_INFO segment. It's large (several MB on recent kernels), so
+ *          rather than building a whole document tree, the parser makes a single
+ *          pass over it and produces one dictionary for each kext in the
+ *          `_PrelinkInfoDictionary` array.
+ *
+ *          Nothing is copied: keys and values point straight into the plist,
+ *          which has to stay mapped for as long as the dictionaries are used.
+ *          Values that are containers (a kext's OSBundleLibraries, for example)
+ *          cover the container's whole span, so they can be parsed again with
+ *          plist_value_parse_dict() or walked with plist_array_iterate().
+ *
+ *          In an XML plist, a value can be given an ID="n" attribute, and later
+ *          values with IDREF="n" repeat it. References are resolved while parsing,
+ *          so a dictionary never contains an IDREF.
+ *
+ *          A binary plist (`bplist00`) is read through its offset table instead,
+ *          which locates every object directly. Only the objects on the way to
+ *          the kext dictionaries are decoded up front, and nested containers are
+ *          decoded when they're parsed or iterated.
+ */
+
+typedef enum plist_type_t
+{
+    PLIST_TYPE_NONE = 0,
+    PLIST_TYPE_STRING,
+    PLIST_TYPE_INTEGER,
+    PLIST_TYPE_REAL,
+    PLIST_TYPE_BOOL,
+    PLIST_TYPE_DATE,
+    PLIST_TYPE_DATA,
+    PLIST_TYPE_ARRAY,
+    PLIST_TYPE_DICT,
+} plist_type_t;
+
+typedef enum plist_format_t
+{
+    PLIST_FORMAT_XML = 0,
+    PLIST_FORMAT_BINARY,
+} plist_format_t;
+
+/**
+ * \brief       A value in a plist.
+ *
+ *              For an XML plist, `data` points at the text between the value's
+ *              tags, or at the opening tag of a container, for `size` bytes. The
+ *              integer and bool types are decoded into `integer` while parsing.
+ *
+ *              For a binary plist, `data` points at the object's payload: the
+ *              characters of a string, the big-endian bytes of a real or date, or
+ *              the object references of a container. A string's `integer` is the
+ *              size of its characters, 1 for ASCII or 2 for UTF-16.
+ */
+typedef struct plist_value_t
+{
+    plist_type_t        type;
+    plist_format_t      format;
+    const char         *data;
+    uint32_t            size;
+    uint64_t            integer;
+} plist_value_t;
+
+typedef struct plist_entry_t
+{
+    const char         *key;
+    uint32_t            key_len;
+    plist_value_t       value;
+} plist_entry_t;
+
+typedef struct plist_dict_t
+{
+    plist_entry_t      *entries;
+    uint32_t            nentries;
+    uint32_t            capacity;
+} plist_dict_t;
+
+/**
+ * \brief       A parsed __PRELINK_INFO plist.
+ *
+ *              `ids` holds every value that was given an ID, indexed by the ID,
+ *              so references inside a container can still be resolved when it's
+ *              parsed again later.
+ */
+typedef struct plist_t
+{
+    plist_format_t      format;
+    const char         *data;
+    size_t              size;
+
+    plist_value_t      *ids;
+    uint32_t            nids;
+
+    /* One dictionary for each entry in `_PrelinkInfoDictionary` */
+    plist_dict_t       *kexts;
+    uint32_t            nkexts;
+} plist_t;
+
+typedef void (*plist_array_fn_t) (void *ctx, const plist_value_t *elem);
+
+
+/**
+ * \brief       Parse a __PRELINK_INFO plist, collecting one dictionary for each
+ *              kext in `_PrelinkInfoDictionary`, in the order they appear.
+ *
+ * \param   data    Start of the plist, either XML or binary.
+ * \param   size    Size of the plist, it doesn't need to be NUL-terminated.
+ *
+ * \returns     The parsed plist, or NULL if it's malformed.
+ */
+plist_t *
+plist_parse_prelink_info (const char *data, size_t size);
+
+/**
+ * \brief       Free a parsed plist. The plist data itself isn't owned by it.
+ */
+void
+plist_free (plist_t *plist);
+
+/**
+ * \brief       Parse a dictionary value from `plist` into `dict`. The entries
+ *              should be freed with plist_dict_free().
+ */
+htool_return_t
+plist_value_parse_dict (const plist_t *plist, const plist_value_t *value, plist_dict_t *dict);
+
+/**
+ * \brief       Call `fn` with each element of an array value from `plist`.
+ */
+htool_return_t
+plist_array_iterate (const plist_t *plist, const plist_value_t *value, plist_array_fn_t fn, void *ctx);
+
+/**
+ * \brief       Free the entries of a dictionary.
+ */
+void
+plist_dict_free (plist_dict_t *dict);
+
+/**
+ * \brief       Find the value for `key` in a dictionary.
+ *
+ * \returns     The value, or NULL if the key isn't there.
+ */
+const plist_value_t *
+plist_dict_get (const plist_dict_t *dict, const char *key);
+
+/**
+ * \brief       Copy a string value into a new NUL-terminated string, decoding
+ *              any XML entities, or UTF-16 from a binary plist into UTF-8.
+ *
+ * \returns     The string, or NULL if the value isn't a string.
+ */
+char *
+plist_value_copy_string (const plist_value_t *value);
+
+/**
+ * \brief       Compare a string value to `str`, without copying it unless it
+ *              has entities to decode.
+ *
+ * \returns     1 if they're equal, 0 otherwise.
+ */
+int
+plist_value_string_equals (const plist_value_t *value, const char *str);
+
+#endif /* __htool_plist_h__ */
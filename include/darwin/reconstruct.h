@@ -0,0 +1,56 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_RECONSTRUCT_H__
+#define __HTOOL_RECONSTRUCT_H__
+
+#include "htool.h"
+#include "kext.h"
+
+/**
+ *  NOTE:   A kext inside a merged or fileset kernelcache isn't a Mach-O on its
+ *          own. Its segments are spread across the cache, and the file offsets
+ *          in its load commands are offsets into the whole cache.
+ *
+ *          Reconstruction lays the segments out one after the other, page
+ *          aligned, and rewrites every file offset in the load commands (segments,
+ *          sections, symbol tables and other __LINKEDIT data) to match. Only the
+ *          header and load commands are copied; the segment data is written
+ *          straight from the cache with writev().
+ */
+
+/* Output segments are aligned to the arm64 page size */
+#define HTOOL_RECONSTRUCT_PAGE_SIZE         0x4000
+
+/**
+ * \brief       Write a kext out of `xnu` as a standalone Mach-O.
+ *
+ * \param   xnu     Kernelcache the kext was parsed from.
+ * \param   kext    Kext to write.
+ * \param   fd      File to write to, from its current position.
+ *
+ * \returns     Success, or Failure if the kext's header is invalid or the write
+ *              fails.
+ */
+htool_return_t
+xnu_kext_reconstruct_write (xnu_t *xnu, kext_t *kext, int fd);
+
+/**
+ * \brief       Reconstruct a kext into a new file at `path`.
+ */
+htool_return_t
+xnu_kext_reconstruct_to_file (xnu_t *xnu, kext_t *kext, const char *path);
+
+#endif /* __htool_reconstruct_h__ */
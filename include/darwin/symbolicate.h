@@ -0,0 +1,116 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_SYMBOLICATE_H__
+#define __HTOOL_SYMBOLICATE_H__
+
+#include "htool.h"
+#include "kext.h"
+
+/**
+ *  NOTE:   Symbolication maps an address to the kext it belongs to, and the
+ *          nearest symbol at or below it. Both are predecessor searches over
+ *          sorted arrays: one of the disjoint address ranges owned by each kext
+ *          (and the kernel), and one of every symbol from the kernel's and the
+ *          kexts' symbol tables. Kernelcaches are mostly stripped, so the starts
+ *          of the functions found by the prologue scan are added as `sub_`
+ *          symbols wherever there isn't a real one.
+ *
+ *          A panic log is symbolicated in one batch, so the arrays are kept in
+ *          Eytzinger (BFS) order, where the search is a short branch-free loop
+ *          and the first few levels share a handful of cache lines.
+ */
+
+/* Owner of an address outside every kext, in a non-fileset kernelcache */
+#define XNU_SYMBOLICATE_KERNEL          (UINT32_MAX - 1)
+#define XNU_SYMBOLICATE_NONE            UINT32_MAX
+
+/**
+ * \brief       A sorted array of keys, laid out for predecessor searches. `keys`
+ *              and `order` are 1-based, and `order` maps a slot back to the
+ *              key's position in sorted order.
+ */
+typedef struct xnu_eytzinger_t
+{
+    uint64_t               *keys;
+    uint32_t               *order;
+    uint32_t                n;
+} xnu_eytzinger_t;
+
+typedef struct xnu_symbolicator_t
+{
+    xnu_t                  *xnu;
+
+    /* Disjoint ranges, sorted by start, and the kext that owns each one */
+    xnu_eytzinger_t         owners;
+    uint64_t               *owner_start;
+    uint64_t               *owner_end;
+    uint32_t               *owner_kext;
+
+    /* Symbols, sorted by address. A NULL name is a function from the prologue scan */
+    xnu_eytzinger_t         symbols;
+    uint64_t               *symbol_addr;
+    const char            **symbol_name;
+} xnu_symbolicator_t;
+
+typedef struct xnu_symbolication_t
+{
+    uint64_t                address;        /* unslid */
+    uint32_t                kext;           /* index into xnu->kext_array, or one of the above */
+    uint32_t                symbol;         /* index into the symbols, or XNU_SYMBOLICATE_NONE */
+} xnu_symbolication_t;
+
+
+/**
+ * \brief       Build the owner and symbol indexes for a kernelcache. The kexts
+ *              must already have been parsed.
+ */
+xnu_symbolicator_t *
+xnu_symbolicator_create (xnu_t *xnu);
+
+/**
+ * \brief       Free a symbolicator.
+ */
+void
+xnu_symbolicator_free (xnu_symbolicator_t *sym);
+
+/**
+ * \brief       Symbolicate a single unslid address.
+ */
+void
+xnu_symbolicate (xnu_symbolicator_t *sym, uint64_t address, xnu_symbolication_t *out);
+
+/**
+ * \brief       Symbolicate `count` addresses, subtracting `slide` from each one
+ *              first. Large batches are split across the worker pool.
+ */
+void
+xnu_symbolicate_batch (xnu_symbolicator_t *sym, const uint64_t *addresses, uint32_t count, uint64_t slide,
+                       xnu_symbolication_t *out);
+
+/**
+ * \brief       Symbolicate every address in a panic log, or a list of addresses,
+ *              and print the results in the order they appear.
+ *
+ * \param   xnu         Kernelcache the addresses are from.
+ * \param   path        Panic log or address list.
+ * \param   slide       KASLR slide to remove from each address.
+ * \param   has_slide   Whether `slide` was given. If not, it's taken from the
+ *                      log's "Kernel slide:" line, or is zero.
+ */
+htool_return_t
+xnu_symbolicate_file (xnu_t *xnu, const char *path, uint64_t slide, int has_slide);
+
+#endif /* __htool_symbolicate_h__ */
@@ -0,0 +1,343 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DISASSEMBLER_A64_H__
+#define __HTOOL_DISASSEMBLER_A64_H__
+
+#include <stdint.h>
+
+/**
+ *  NOTE:   Libarch decodes an opcode into a complete `instruction_t`, which is
+ *          what we want when printing, but the analysis passes only need to know
+ *          a few things about an instruction (does it branch, where to, does it
+ *          stop execution). These helpers pull that straight from the encoding,
+ *          without allocating anything, so they can be used in tight loops.
+ */
+
+/**
+ * \brief       Classes of control-flow that the analysis passes care about.
+ */
+typedef enum a64_flow_t
+{
+    A64_FLOW_NONE = 0,          /* falls through to the next instruction */
+    A64_FLOW_BRANCH,            /* B, unconditional and direct */
+    A64_FLOW_BRANCH_COND,       /* B.cond, CBZ/CBNZ, TBZ/TBNZ */
+    A64_FLOW_CALL,              /* BL */
+    A64_FLOW_CALL_INDIRECT,     /* BLR, BLRAA, ... */
+    A64_FLOW_BRANCH_INDIRECT,   /* BR, BRAA, ... */
+    A64_FLOW_RETURN,            /* RET, RETAA, ERET, ... */
+    A64_FLOW_TRAP,              /* UDF, BRK, HLT */
+} a64_flow_t;
+
+/**
+ * \brief       Sign-extend the lower `bits` bits of `value`.
+ */
+static inline int64_t
+a64_sign_extend (uint64_t value, unsigned bits)
+{
+    uint64_t m = UINT64_C(1) << (bits - 1);
+    value &= (UINT64_C(1) << bits) - 1;
+    return (int64_t) ((value ^ m) - m);
+}
+
+/**
+ * \brief       Classify the control-flow of an opcode, and if it is a direct
+ *              branch, write the destination to `target`.
+ *
+ * \param   opcode  Raw little-endian opcode.
+ * \param   pc      Address of the opcode.
+ * \param   target  Set to the branch destination for direct branches.
+ *
+ * \returns     The control-flow class of the opcode.
+ */
+static inline a64_flow_t
+a64_classify_flow (uint32_t opcode, uint64_t pc, uint64_t *target)
+{
+    /* B / BL: imm26 */
+    if ((opcode & 0x7c000000) == 0x14000000) {
+        *target = pc + (a64_sign_extend (opcode, 26) << 2);
+        return (opcode & 0x80000000) ? A64_FLOW_CALL : A64_FLOW_BRANCH;
+    }
+
+    /* B.cond: imm19 */
+    if ((opcode & 0xff000010) == 0x54000000) {
+        *target = pc + (a64_sign_extend (opcode >> 5, 19) << 2);
+        return A64_FLOW_BRANCH_COND;
+    }
+
+    /* CBZ / CBNZ: imm19 */
+    if ((opcode & 0x7e000000) == 0x34000000) {
+        *target = pc + (a64_sign_extend (opcode >> 5, 19) << 2);
+        return A64_FLOW_BRANCH_COND;
+    }
+
+    /* TBZ / TBNZ: imm14 */
+    if ((opcode & 0x7e000000) == 0x36000000) {
+        *target = pc + (a64_sign_extend (opcode >> 5, 14) << 2);
+        return A64_FLOW_BRANCH_COND;
+    }
+
+    /* Unconditional branch (register): BR, BLR, RET, ERET and the PAC variants */
+    if ((opcode & 0xfe000000) == 0xd6000000) {
+        switch ((opcode >> 21) & 0xf) {
+            case 0x0: return A64_FLOW_BRANCH_INDIRECT;
+            case 0x1: return A64_FLOW_CALL_INDIRECT;
+            case 0x2: return A64_FLOW_RETURN;
+            case 0x4: return A64_FLOW_RETURN;   /* ERET */
+            case 0x8: return A64_FLOW_BRANCH_INDIRECT;  /* BRAA/BRAB */
+            case 0x9: return A64_FLOW_CALL_INDIRECT;    /* BLRAA/BLRAB */
+            default: break;
+        }
+    }
+
+    /* UDF, BRK, HLT */
+    if ((opcode & 0xffff0000) == 0x00000000 ||
+        (opcode & 0xffe0001f) == 0xd4200000 ||
+        (opcode & 0xffe0001f) == 0xd4400000)
+        return A64_FLOW_TRAP;
+
+    return A64_FLOW_NONE;
+}
+
+/**
+ * \brief       Whether execution can continue to the next instruction after
+ *              an instruction of the given class.
+ */
+static inline int
+a64_flow_falls_through (a64_flow_t flow)
+{
+    return !(flow == A64_FLOW_BRANCH || flow == A64_FLOW_BRANCH_INDIRECT ||
+             flow == A64_FLOW_RETURN || flow == A64_FLOW_TRAP);
+}
+
+/**
+ * \brief       Decode an ADRP, writing the destination register and the page
+ *              address it is set to.
+ */
+static inline int
+a64_decode_adrp (uint32_t opcode, uint64_t pc, unsigned *rd, uint64_t *page)
+{
+    if ((opcode & 0x9f000000) != 0x90000000) return 0;
+    uint64_t imm = ((uint64_t) ((opcode >> 5) & 0x7ffff) << 2) | ((opcode >> 29) & 0x3);
+    *rd = opcode & 0x1f;
+    *page = (pc & ~UINT64_C(0xfff)) + (a64_sign_extend (imm, 21) << 12);
+    return 1;
+}
+
+/**
+ * \brief       Decode an ADR, writing the destination register and address.
+ */
+static inline int
+a64_decode_adr (uint32_t opcode, uint64_t pc, unsigned *rd, uint64_t *target)
+{
+    if ((opcode & 0x9f000000) != 0x10000000) return 0;
+    uint64_t imm = ((uint64_t) ((opcode >> 5) & 0x7ffff) << 2) | ((opcode >> 29) & 0x3);
+    *rd = opcode & 0x1f;
+    *target = pc + a64_sign_extend (imm, 21);
+    return 1;
+}
+
+/**
+ * \brief       Decode a 64-bit ADD (immediate), as used to add a page offset to
+ *              the result of an ADRP.
+ */
+static inline int
+a64_decode_add_imm (uint32_t opcode, unsigned *rd, unsigned *rn, uint64_t *imm)
+{
+    if ((opcode & 0xff800000) != 0x91000000) return 0;
+    *rd = opcode & 0x1f;
+    *rn = (opcode >> 5) & 0x1f;
+    *imm = (uint64_t) ((opcode >> 10) & 0xfff) << ((opcode & 0x00400000) ? 12 : 0);
+    return 1;
+}
+
+/**
+ * \brief       Decode an LDR (immediate, unsigned offset) of a W or X register,
+ *              writing the byte offset from the base register.
+ */
+static inline int
+a64_decode_ldr_imm (uint32_t opcode, unsigned *rt, unsigned *rn, uint64_t *offset)
+{
+    if ((opcode & 0xbfc00000) != 0xb9400000) return 0;
+    unsigned scale = (opcode & 0x40000000) ? 3 : 2;
+    *rt = opcode & 0x1f;
+    *rn = (opcode >> 5) & 0x1f;
+    *offset = (uint64_t) ((opcode >> 10) & 0xfff) << scale;
+    return 1;
+}
+
+/**
+ * \brief       Decode an LDR (literal) of a W or X register, writing the address
+ *              that is loaded from.
+ */
+static inline int
+a64_decode_ldr_literal (uint32_t opcode, uint64_t pc, unsigned *rt, uint64_t *target)
+{
+    if ((opcode & 0xbf000000) != 0x18000000) return 0;
+    *rt = opcode & 0x1f;
+    *target = pc + (a64_sign_extend (opcode >> 5, 19) << 2);
+    return 1;
+}
+
+/**
+ * \brief       Decode a MOVZ of a W or X register, writing the value it sets.
+ */
+static inline int
+a64_decode_movz (uint32_t opcode, unsigned *rd, uint64_t *imm)
+{
+    if ((opcode & 0x7f800000) != 0x52800000) return 0;
+    *rd = opcode & 0x1f;
+    *imm = (uint64_t) ((opcode >> 5) & 0xffff) << (((opcode >> 21) & 0x3) * 16);
+    return 1;
+}
+
+/**
+ * \brief       Decode a MOV between X registers, which is an ORR with XZR.
+ */
+static inline int
+a64_decode_mov_reg (uint32_t opcode, unsigned *rd, unsigned *rm)
+{
+    if ((opcode & 0xffe0ffe0) != 0xaa0003e0) return 0;
+    *rd = opcode & 0x1f;
+    *rm = (opcode >> 16) & 0x1f;
+    return 1;
+}
+
+/**
+ * \brief       Decode an STR (immediate, unsigned offset) of an X register,
+ *              writing the byte offset from the base register.
+ */
+static inline int
+a64_decode_str_imm (uint32_t opcode, unsigned *rt, unsigned *rn, uint64_t *offset)
+{
+    if ((opcode & 0xffc00000) != 0xf9000000) return 0;
+    *rt = opcode & 0x1f;
+    *rn = (opcode >> 5) & 0x1f;
+    *offset = (uint64_t) ((opcode >> 10) & 0xfff) << 3;
+    return 1;
+}
+
+/**
+ * \brief       Whether an opcode is one of the PAC or AUT instructions that sign
+ *              or authenticate a register in place, e.g. PACDA or AUTIZA. They
+ *              don't change the address the register holds.
+ */
+static inline int
+a64_is_pac_in_place (uint32_t opcode)
+{
+    return (opcode & 0xffffc000) == 0xdac10000;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/* Registers not preserved across a call, x0 - x18 */
+#define A64_CALLER_SAVED_MASK       0x0007ffff
+
+/**
+ * \brief       Values known to be held in the general registers, and a bitmask
+ *              of which are valid. Used by the passes that follow ADRP/ADD pairs
+ *              to work out the addresses an instruction refers to.
+ */
+typedef struct a64_regs_t
+{
+    uint64_t            x[32];
+    uint32_t            valid;
+} a64_regs_t;
+
+static inline int
+a64_regs_valid (const a64_regs_t *regs, unsigned n)
+{
+    return (regs->valid >> n) & 1;
+}
+
+/**
+ * \brief       Set a register's value. Register 31 is SP or XZR, depending on the
+ *              instruction, so it's never tracked.
+ */
+static inline void
+a64_regs_set (a64_regs_t *regs, unsigned n, uint64_t value)
+{
+    if (n == 31) return;
+    regs->x[n] = value;
+    regs->valid |= (1u << n);
+}
+
+static inline void
+a64_regs_clear (a64_regs_t *regs, unsigned n)
+{
+    regs->valid &= ~(1u << n);
+}
+
+/**
+ * \brief       Every general register an opcode may write, as a bitmask. This is
+ *              Rd/Rt (bits 0-4) for any instruction, plus the second register of
+ *              a load pair, the base register of a pre- or post-indexed access, the
+ *              status and compare registers of the exclusives and CAS, and the
+ *              registers a CPY/SET updates.
+ *
+ *              It over-estimates, e.g. Rt of a store, so a value is sometimes
+ *              forgotten when it didn't need to be, but never kept when it's
+ *              been overwritten.
+ */
+static inline uint32_t
+a64_written_registers (uint32_t opcode)
+{
+    unsigned rt = opcode & 0x1f, rn = (opcode >> 5) & 0x1f;
+    unsigned rt2 = (opcode >> 10) & 0x1f, rs = (opcode >> 16) & 0x1f;
+    uint32_t mask = (1u << rt);
+
+    /* LDP, LDNP, LDPSW and STP. Bits 24:23 are 01 for post-index, and 11 for pre-index */
+    if ((opcode & 0x3a000000) == 0x28000000) {
+        if (opcode & (1 << 22)) mask |= (1u << rt2);
+        if (opcode & (1 << 23)) mask |= (1u << rn);
+        return mask;
+    }
+
+    /* Single register, immediate and register offset: post and pre-index, and LDRAA/LDRAB with writeback */
+    if ((opcode & 0x3b000000) == 0x38000000) {
+        if ((opcode & 0x00200400) == 0x00000400 || (opcode & 0x00200c00) == 0x00200c00) mask |= (1u << rn);
+        return mask;
+    }
+
+    /* Exclusives, LDXP and CAS/CASP */
+    if ((opcode & 0x3f000000) == 0x08000000)
+        return mask | (1u << rs) | (1u << ((rs + 1) & 0x1f)) | (1u << rt2) | (1u << ((rt + 1) & 0x1f));
+
+    /* SIMD structure loads and stores, post-index */
+    if ((opcode & 0xbe800000) == 0x0c800000)
+        return mask | (1u << rn);
+
+    /* CPY and SET update the destination, source and size */
+    if ((opcode & 0x3f200c00) == 0x19000400)
+        return mask | (1u << rs) | (1u << rn);
+
+    return mask;
+}
+
+/**
+ * \brief       Update `regs` for an instruction that the caller doesn't model
+ *              itself: calls forget the caller-saved registers, nothing survives
+ *              into whatever follows an unconditional branch or return, and
+ *              anything else forgets the registers it writes.
+ */
+static inline void
+a64_regs_clobber (a64_regs_t *regs, uint32_t opcode, a64_flow_t flow)
+{
+    if (flow == A64_FLOW_CALL || flow == A64_FLOW_CALL_INDIRECT) regs->valid &= ~A64_CALLER_SAVED_MASK;
+    else if (!a64_flow_falls_through (flow)) regs->valid = 0;
+    else if (flow == A64_FLOW_NONE) regs->valid &= ~a64_written_registers (opcode);
+}
+
+#endif /* __htool_disassembler_a64_h__ */
@@ -0,0 +1,90 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DISASSEMBLER_CODEMAP_H__
+#define __HTOOL_DISASSEMBLER_CODEMAP_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <libhelper-macho.h>
+
+#include "htool.h"
+
+/**
+ *  \brief      An executable region of an image, and a bitmap with one bit for
+ *              every 4-byte word in the region. A bit is set if the word was
+ *              reached as an instruction while following control-flow, and is
+ *              clear for anything else (literal pools, jump tables, padding).
+ */
+typedef struct htool_code_region_t
+{
+    uint64_t         vmaddr;
+    uint64_t         size;
+    unsigned char   *data;
+    uint64_t        *bitmap;
+} htool_code_region_t;
+
+/**
+ *  \brief      The code/data map of an image, built by recursive-descent from
+ *              the entry point, LC_FUNCTION_STARTS and the symbol table.
+ */
+typedef struct htool_codemap_t
+{
+    htool_code_region_t     *regions;
+    uint32_t                 nregions;
+
+    /* Statistics from building the map */
+    uint64_t                 nseeds;
+    uint64_t                 ncode;
+} htool_codemap_t;
+
+
+/**
+ * \brief       Fetch the code/data map for a given Mach-O. The map is built the
+ *              first time it's requested, and is then cached against the Mach-O
+ *              so other passes can reuse it.
+ *
+ * \param   macho   The Mach-O to map.
+ *
+ * \returns     The code/data map, or NULL if the Mach-O has no executable
+ *              segments.
+ */
+htool_codemap_t *
+htool_codemap_fetch (macho_t *macho);
+
+/**
+ * \brief       Find the executable region containing `addr`.
+ */
+htool_code_region_t *
+htool_codemap_find_region (htool_codemap_t *map, uint64_t addr);
+
+/**
+ * \brief       Check whether the word at `addr` within `region` is code.
+ */
+static inline int
+htool_code_region_is_code (htool_code_region_t *region, uint64_t addr)
+{
+    uint64_t idx = (addr - region->vmaddr) >> 2;
+    return (region->bitmap[idx >> 6] >> (idx & 63)) & 1;
+}
+
+/**
+ * \brief       Check whether the word at `addr` is code, anywhere in the map.
+ */
+int
+htool_codemap_is_code (htool_codemap_t *map, uint64_t addr);
+
+#endif /* __htool_disassembler_codemap_h__ */
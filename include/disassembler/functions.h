@@ -0,0 +1,94 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DISASSEMBLER_FUNCTIONS_H__
+#define __HTOOL_DISASSEMBLER_FUNCTIONS_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <libhelper-macho.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   Kernelcaches are stripped, so there's no symbol table or function
+ *          starts to say where functions are. Instead, every executable segment
+ *          is scanned for the instructions functions begin with (PACIBSP, a
+ *          pre-indexed STP of a register pair to the stack, or SUB SP, SP, #n),
+ *          while collecting the destination of every BL in the same pass.
+ *
+ *          Those instructions also appear in the middle of a prologue, so a
+ *          candidate is only kept if it's a PACIBSP, if something calls it, or
+ *          if it directly follows the end of another function. Functions without
+ *          a prologue at all are found from their callers, as long as there's
+ *          more than one of them.
+ */
+
+/* How a function start was found */
+#define HTOOL_FUNCTION_FLAG_PROLOGUE        (1 << 0)
+#define HTOOL_FUNCTION_FLAG_PAC             (1 << 1)
+#define HTOOL_FUNCTION_FLAG_CALLED          (1 << 2)
+
+/**
+ * \brief       A discovered function. `size` runs up to the next function, or
+ *              the end of the segment, without any trailing zero padding.
+ *
+ *              `hash` is an XXH64 of the function's instructions with the
+ *              PC-relative immediates of B, BL, ADR and ADRP masked out, so the
+ *              same function hashes the same when it's moved.
+ */
+typedef struct htool_function_t
+{
+    uint64_t            vmaddr;
+    uint64_t            hash;
+    uint32_t            size;
+    uint32_t            flags;
+} htool_function_t;
+
+typedef struct htool_functions_t
+{
+    /* Sorted by vmaddr */
+    htool_function_t   *functions;
+    uint32_t            nfunctions;
+
+    /* Statistics from the scan */
+    uint64_t            ncandidates;
+    uint64_t            ncalls;
+} htool_functions_t;
+
+
+/**
+ * \brief       Fetch the discovered functions for a given Mach-O. The scan is
+ *              run the first time they're requested, and the table is then
+ *              cached against the Mach-O.
+ *
+ * \param   macho   The Mach-O to scan.
+ *
+ * \returns     The function table, or NULL if the Mach-O has no executable
+ *              segments.
+ */
+htool_functions_t *
+htool_functions_fetch (macho_t *macho);
+
+/**
+ * \brief       Find the function containing `addr`.
+ *
+ * \returns     The function, or NULL if `addr` isn't inside one.
+ */
+const htool_function_t *
+htool_functions_find (htool_functions_t *functions, uint64_t addr);
+
+#endif /* __htool_disassembler_functions_h__ */
@@ -29,20 +29,41 @@
 #include <libhelper-hlibc.h>
 #include <libhelper-macho.h>
 
+#include "disassembler/a64.h"
+#include "disassembler/strings.h"
+#include "disassembler/symmap.h"
+#include "htool-fixups.h"
+
 #define SWAP_INT(a)     ( ((a) << 24) | \
                         (((a) << 8) & 0x00ff0000) | \
                         (((a) >> 8) & 0x0000ff00) | \
                         ((unsigned int)(a) >> 24) )
 
 /**
- * \brief       Structure to represent an inline symbol, whether that be
- *              a function name or the start location of a section.
+ * \brief       State carried between instructions so that operands can be
+ *              resolved to the string or symbol they point to. ADRP only
+ *              loads a page address, so the page each register holds is
+ *              tracked until the following ADD or LDR completes the address.
+ */
+typedef struct htool_disass_annotator_t
+{
+    htool_string_index_t    *strings;
+    htool_symmap_t          *symbols;
+    htool_fixups_t          *fixups;
+
+    /* Known register values */
+    a64_regs_t               regs;
+} htool_disass_annotator_t;
+
+/**
+ * \brief       Forget all tracked register values, e.g. at the start of a new
+ *              function.
  */
-typedef struct inline_symbol_t {
-    uint64_t    virt_addr;
-    char       *name;
-    char       *type;       // method, section
-} inline_symbol_t;
+static inline void
+htool_disass_annotator_reset (htool_disass_annotator_t *ann)
+{
+    if (ann) ann->regs.valid = 0;
+}
 
 
 /**
@@ -56,5 +77,17 @@ typedef struct inline_symbol_t {
 htool_return_t
 htool_disassembler_parse_instruction (instruction_t *instr);
 
+/**
+ * \brief       Disassemble a given `instruction_t`, as above, and annotate any
+ *              address it resolves with the string or symbol at that address.
+ *
+ * \param   instr   Instruction to parse and print.
+ * \param   ann     Annotation state, carried over from previous instructions.
+ *
+ * \return      Success or Failure based on the result of the parsing.
+ */
+htool_return_t
+htool_disassembler_parse_instruction_annotated (instruction_t *instr, htool_disass_annotator_t *ann);
+
 
 #endif /* __htool_disassembler_parser_h__ */
\ No newline at end of file
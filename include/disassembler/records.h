@@ -0,0 +1,120 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DISASSEMBLER_RECORDS_H__
+#define __HTOOL_DISASSEMBLER_RECORDS_H__
+
+#include <stdint.h>
+#include <instruction.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   The records format is a compact binary form of the disassembly, for
+ *          tools that would otherwise have to parse the coloured text output. The
+ *          file is laid out so it can be mmap'd and read in place:
+ *
+ *              +--------------------------+  0x0
+ *              | htool_records_header_t   |
+ *              +--------------------------+  header->records_offset
+ *              | htool_record_t[nrecords] |
+ *              +--------------------------+  header->strtab_offset
+ *              | uint32_t[nmnemonics]     |  offset of each name, or ~0 if unused
+ *              | char names[]             |  NUL-terminated mnemonic names
+ *              +--------------------------+
+ *
+ *          Every field is little-endian. The mnemonic id of a record indexes the
+ *          string table offsets.
+ */
+
+#define HTOOL_RECORDS_MAGIC                 0x43525448      /* "HTRC" */
+#define HTOOL_RECORDS_VERSION               1
+
+#define HTOOL_RECORD_MAX_OPERANDS           5
+#define HTOOL_RECORD_FLAG_TRUNCATED         (1 << 0)        /* more operands than would fit */
+#define HTOOL_RECORDS_STRTAB_UNUSED         0xffffffff
+
+typedef struct htool_records_header_t
+{
+    uint32_t        magic;
+    uint16_t        version;
+    uint16_t        record_size;
+    uint64_t        nrecords;
+    uint64_t        records_offset;
+    uint64_t        strtab_offset;
+    uint64_t        strtab_size;
+    uint32_t        nmnemonics;
+    uint32_t        reserved;
+} htool_records_header_t;
+
+/**
+ *  \brief      An operand, taken straight from Libarch's `operand_t`. The meaning
+ *              of `subtype`, `reg` and `value` depends on `type`:
+ *
+ *                  register:   subtype = register type, size = register size,
+ *                              reg = register number.
+ *                  immediate:  subtype = immediate type, value = immediate.
+ *                  shift:      subtype = shift type, value = shift amount.
+ *                  other:      reg = the operand's `extra` value.
+ */
+typedef struct htool_record_operand_t
+{
+    uint8_t         type;
+    uint8_t         subtype;
+    uint8_t         size;
+    uint8_t         reserved;
+    uint32_t        reg;
+    uint64_t        value;
+} htool_record_operand_t;
+
+typedef struct htool_record_t
+{
+    uint64_t                    addr;
+    uint32_t                    opcode;
+    uint16_t                    mnemonic;
+    int8_t                      cond;
+    int8_t                      spec;
+    uint8_t                     noperands;
+    uint8_t                     flags;
+    uint8_t                     reserved[6];
+    htool_record_operand_t      operands[HTOOL_RECORD_MAX_OPERANDS];
+} htool_record_t;
+
+typedef struct htool_records_writer_t htool_records_writer_t;
+
+
+/**
+ * \brief       Create a records file at `path`.
+ *
+ * \returns     A writer, or NULL if the file couldn't be created.
+ */
+htool_records_writer_t *
+htool_records_open (const char *path);
+
+/**
+ * \brief       Append a decoded instruction to the records file.
+ */
+void
+htool_records_append (htool_records_writer_t *writer, instruction_t *instr);
+
+/**
+ * \brief       Write the string table and header, and close the file.
+ *
+ * \returns     Success, or Failure if any write failed.
+ */
+htool_return_t
+htool_records_close (htool_records_writer_t *writer);
+
+#endif /* __htool_disassembler_records_h__ */
@@ -0,0 +1,72 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DISASSEMBLER_STRINGS_H__
+#define __HTOOL_DISASSEMBLER_STRINGS_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <libhelper-macho.h>
+
+#include "htool.h"
+
+/**
+ *  \brief      A section of an image that contains C-strings.
+ */
+typedef struct htool_string_range_t
+{
+    uint64_t         vmaddr;
+    uint64_t         size;
+    unsigned char   *data;
+    int              strict;    /* may contain non-string data, e.g. __TEXT.__const */
+} htool_string_range_t;
+
+/**
+ *  \brief      Sorted index of all the C-string sections of an image, so an
+ *              address can be resolved to a string with a binary search.
+ */
+typedef struct htool_string_index_t
+{
+    htool_string_range_t    *ranges;
+    uint32_t                 nranges;
+} htool_string_index_t;
+
+
+/**
+ * \brief       Fetch the string index for a given Mach-O, building and caching
+ *              it on first use. Fileset entries are included.
+ *
+ * \param   macho   The Mach-O to index.
+ *
+ * \returns     The string index. This is never NULL, but may have no ranges.
+ */
+htool_string_index_t *
+htool_string_index_fetch (macho_t *macho);
+
+/**
+ * \brief       Resolve an address to the C-string it points to.
+ *
+ * \param   index   String index to search.
+ * \param   addr    Virtual address to resolve.
+ * \param   len     Set to the length of the string, excluding the terminator.
+ *
+ * \returns     A pointer to the string within the image, or NULL if `addr`
+ *              isn't within a string section or doesn't point to a string.
+ */
+const char *
+htool_string_index_lookup (htool_string_index_t *index, uint64_t addr, uint32_t *len);
+
+#endif /* __htool_disassembler_strings_h__ */
@@ -0,0 +1,126 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_DISASSEMBLER_SYMMAP_H__
+#define __HTOOL_DISASSEMBLER_SYMMAP_H__
+
+#include <stdint.h>
+
+#include "htool.h"
+
+/**
+ * \brief       Structure to represent an inline symbol, whether that be
+ *              a function name or the start location of a section.
+ */
+typedef struct inline_symbol_t {
+    uint64_t    virt_addr;
+    char       *name;
+    char       *type;       // method, section
+} inline_symbol_t;
+
+/**
+ *  NOTE:   The symbol map is looked up for every instruction that's disassembled,
+ *          so it's an open-addressed table keyed directly on the address. The keys
+ *          are kept in their own array so a probe only touches the keys, and each
+ *          slot points at the first symbol for that address. Further symbols at the
+ *          same address (e.g. a section and the function at its start) are chained
+ *          in the order they were inserted.
+ *
+ *          Address 0 marks an empty slot, so it can't be stored.
+ */
+
+#define HTOOL_SYMMAP_NONE           UINT32_MAX
+
+typedef struct htool_symmap_t
+{
+    /* Slots, `mask + 1` of them */
+    uint64_t            *keys;
+    uint32_t            *heads;
+    uint32_t             mask;
+    uint32_t             shift;
+    uint32_t             nkeys;
+
+    /* Symbols, in insertion order, with the next symbol at the same address */
+    inline_symbol_t     *syms;
+    uint32_t            *next;
+    uint32_t             nsyms;
+    uint32_t             capsyms;
+} htool_symmap_t;
+
+
+/**
+ * \brief       Create a symbol map with room for `nsyms` symbols before it has
+ *              to grow.
+ */
+htool_symmap_t *
+htool_symmap_create (uint32_t nsyms);
+
+/**
+ * \brief       Free a symbol map. The names aren't owned by the map.
+ */
+void
+htool_symmap_free (htool_symmap_t *map);
+
+/**
+ * \brief       Add a symbol. Symbols at an address that's already in the map are
+ *              kept after the existing ones.
+ */
+void
+htool_symmap_insert (htool_symmap_t *map, uint64_t addr, char *name, char *type);
+
+/**
+ * \brief       Add `count` symbols at once, growing the map a single time.
+ */
+void
+htool_symmap_insert_bulk (htool_symmap_t *map, const inline_symbol_t *syms, uint32_t count);
+
+/**
+ * \brief       Fibonacci hash of an address to a slot. Addresses are at least
+ *              4-byte aligned, and this takes the high bits of the product, so
+ *              the alignment doesn't matter.
+ */
+static inline uint32_t
+htool_symmap_slot (const htool_symmap_t *map, uint64_t addr)
+{
+    return (uint32_t) ((addr * UINT64_C(0x9e3779b97f4a7c15)) >> map->shift);
+}
+
+/**
+ * \brief       Find the first symbol at `addr`.
+ *
+ * \returns     The symbol, or NULL if there isn't one.
+ */
+static inline const inline_symbol_t *
+htool_symmap_lookup (const htool_symmap_t *map, uint64_t addr)
+{
+    if (!addr) return NULL;
+    for (uint32_t i = htool_symmap_slot (map, addr);; i = (i + 1) & map->mask) {
+        uint64_t key = map->keys[i];
+        if (key == addr) return &map->syms[map->heads[i]];
+        if (!key) return NULL;
+    }
+}
+
+/**
+ * \brief       Next symbol at the same address as `sym`, or NULL.
+ */
+static inline const inline_symbol_t *
+htool_symmap_next (const htool_symmap_t *map, const inline_symbol_t *sym)
+{
+    uint32_t n = map->next[sym - map->syms];
+    return (n == HTOOL_SYMMAP_NONE) ? NULL : &map->syms[n];
+}
+
+#endif /* __htool_disassembler_symmap_h__ */
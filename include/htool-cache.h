@@ -0,0 +1,71 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_CACHE_H__
+#define __HTOOL_CACHE_H__
+
+#include "htool.h"
+
+/**
+ *  NOTE:   Several analysis passes build a structure that describes an entire
+ *          image, for example the code/data map built by the disassembler. These
+ *          are expensive to build, so rather than each pass building their own
+ *          copy, they are stored here against the image (usually a `macho_t`) they
+ *          describe, and any later pass can fetch the same copy.
+ */
+
+/**
+ * \brief       Kinds of object that can be cached against an image. An image can
+ *              have at most one object of each kind.
+ */
+typedef enum htool_cache_kind_t
+{
+    HTOOL_CACHE_KIND_CODEMAP = 0,
+    HTOOL_CACHE_KIND_STRINGS,
+    HTOOL_CACHE_KIND_VMMAP,
+    HTOOL_CACHE_KIND_FILESET,
+    HTOOL_CACHE_KIND_FIXUPS,
+    HTOOL_CACHE_KIND_FUNCTIONS,
+
+    HTOOL_CACHE_KIND_MAX
+} htool_cache_kind_t;
+
+/**
+ * \brief       Fetch the object of the given `kind` that was cached against
+ *              `image`.
+ *
+ * \param   image   The image the object describes.
+ * \param   kind    The kind of object to fetch.
+ *
+ * \returns     The cached object, or NULL if nothing has been cached.
+ */
+void *
+htool_cache_fetch (const void *image, htool_cache_kind_t kind);
+
+/**
+ * \brief       Cache an object against `image`. If another thread has already
+ *              cached an object of the same kind, that object is kept and
+ *              returned instead, and the caller should free theirs.
+ *
+ * \param   image   The image the object describes.
+ * \param   kind    The kind of object being stored.
+ * \param   object  The object to store.
+ *
+ * \returns     The object that is now cached for `image` and `kind`.
+ */
+void *
+htool_cache_store (const void *image, htool_cache_kind_t kind, void *object);
+
+#endif /* __htool_cache_h__ */
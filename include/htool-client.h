@@ -46,11 +46,21 @@ typedef struct htool_client_t
     uint32_t             opts;      // command options
     char                *arch;      // --arch value.
     char                *extract;   // --extract value (analyse only)
+    char                *extract_dir;   // --extract-all value (analyse only)
+    char                *diff;      // --diff value (analyse only)
+    char                *patchfind; // --patchfind value (analyse only)
+    char                *symbolicate;   // --symbolicate value (analyse only)
+    uint64_t             slide;     // --slide value (analyse only)
+    char                *deps;      // --deps value (analyse only)
+    char                *deps_root; // --deps-root value (analyse only)
+    char                *kext_symbols;  // --kext-symbols value (analyse only)
 
     /* `disass` options */
     uint64_t            base_address;
     uint64_t            stop_address;
     uint64_t            size;
+    char                *output;    // --output value
+    char                *function;  // --function value
 
     /* Parsed binary */
     htool_binary_t      *bin;       // parsed `filename`
@@ -103,6 +113,14 @@ struct command {
 #define HTOOL_CLIENT_ANALYSE_OPT_ANALYSE                (1 << 1)
 #define HTOOL_CLIENT_ANALYSE_OPT_LIST_ALL               (1 << 2)
 #define HTOOL_CLIENT_ANALYSE_OPT_EXTRACT                (1 << 3)
+#define HTOOL_CLIENT_ANALYSE_OPT_EXTRACT_ALL            (1 << 4)
+#define HTOOL_CLIENT_ANALYSE_OPT_DIFF                   (1 << 5)
+#define HTOOL_CLIENT_ANALYSE_OPT_IOKIT_CLASSES          (1 << 6)
+#define HTOOL_CLIENT_ANALYSE_OPT_PATCHFIND              (1 << 7)
+#define HTOOL_CLIENT_ANALYSE_OPT_SYMBOLICATE            (1 << 8)
+#define HTOOL_CLIENT_ANALYSE_OPT_SLIDE                  (1 << 9)
+#define HTOOL_CLIENT_ANALYSE_OPT_DEPS                   (1 << 10)
+#define HTOOL_CLIENT_ANALYSE_OPT_KEXT_SYMBOLS           (1 << 11)
 
 #define HTOOL_CLIENT_CMDFLAG_DISASS                     0x40000000
 #define HTOOL_CLIENT_DISASS_OPT_DISASSEMBLE_QUICK       (1 << 1)
@@ -110,5 +128,7 @@ struct command {
 #define HTOOL_CLIENT_DISASS_OPT_BASE_ADDRESS            (1 << 3)
 #define HTOOL_CLIENT_DISASS_OPT_STOP_ADDRESS            (1 << 4)
 #define HTOOL_CLIENT_DISASS_OPT_COUNT                   (1 << 5)
+#define HTOOL_CLIENT_DISASS_OPT_FORMAT_RECORDS          (1 << 6)
+#define HTOOL_CLIENT_DISASS_OPT_FUNCTION                (1 << 7)
 
 #endif /* __htool_htool_client_h__ */
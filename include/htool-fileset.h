@@ -0,0 +1,95 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_FILESET_H__
+#define __HTOOL_FILESET_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <libhelper-macho.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   A Fileset Mach-O (MH_FILESET) is a container of other Mach-O's, one
+ *          for each LC_FILESET_ENTRY, such as the kernel and every kext in a
+ *          fileset-style kernelcache.
+ *
+ *          The fileset index is built once per Fileset and cached against it, so
+ *          every pass that needs the entries (kernel detection, kext loading,
+ *          the VM map, the disassembler) shares one copy. It's read straight from
+ *          the Fileset's load commands, and uses the Mach-O libhelper parsed for
+ *          each entry when it loaded the Fileset. An entry libhelper didn't parse
+ *          is parsed the first time htool_fileset_entry_macho() is called for it.
+ *
+ *          Entries are kept in load command order, and can be looked up by their
+ *          entry ID with a hash table. As with everything else in a Fileset, entry
+ *          file offsets are relative to the start of the Fileset.
+ */
+
+typedef struct htool_fileset_entry_t
+{
+    const char                     *entry_id;       /* e.g. "com.apple.kernel" */
+    uint64_t                        vmaddr;
+    uint64_t                        fileoff;
+    uint32_t                        cmd_offset;     /* of the LC_FILESET_ENTRY */
+
+    /* libhelper's Mach-O, or parsed on first use, see htool_fileset_entry_macho() */
+    macho_t                        *macho;
+    int                             failed;
+    pthread_mutex_t                 lock;           /* held while the entry is parsed */
+} htool_fileset_entry_t;
+
+typedef struct htool_fileset_index_t
+{
+    macho_t                        *fileset;
+
+    htool_fileset_entry_t          *entries;
+    uint32_t                        nentries;
+
+    /* Open addressing over the entry IDs. Each slot is an entry index + 1, or 0 */
+    uint32_t                       *slots;
+    uint32_t                        mask;
+} htool_fileset_index_t;
+
+
+/**
+ * \brief       Fetch the fileset index for a Mach-O, building it the first time.
+ *
+ * \param   macho   The Fileset Mach-O.
+ *
+ * \returns     The cached index, or NULL if `macho` isn't a Fileset.
+ */
+htool_fileset_index_t *
+htool_fileset_index_fetch (macho_t *macho);
+
+/**
+ * \brief       Find a Fileset entry by its entry ID.
+ *
+ * \returns     The entry, or NULL if there isn't one with that ID.
+ */
+htool_fileset_entry_t *
+htool_fileset_index_find (htool_fileset_index_t *index, const char *entry_id);
+
+/**
+ * \brief       Fetch the parsed Mach-O for a Fileset entry, parsing it the first
+ *              time. Safe to call from several threads at once.
+ *
+ * \returns     The entry's Mach-O, or NULL if it can't be parsed.
+ */
+macho_t *
+htool_fileset_entry_macho (htool_fileset_index_t *index, htool_fileset_entry_t *entry);
+
+#endif /* __htool_fileset_h__ */
@@ -0,0 +1,156 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_FIXUPS_H__
+#define __HTOOL_FIXUPS_H__
+
+#include <stdint.h>
+#include <libhelper-macho.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   Pointers in arm64e binaries, and in every kernelcache since iOS 12, aren't
+ *          stored as plain addresses. Each one is packed with its pointer
+ *          authentication info and the distance to the next pointer, forming chains
+ *          that dyld (or the kernel itself) walks to fix the pointers up at load
+ *          time. The chains are described either by LC_DYLD_CHAINED_FIXUPS, with a
+ *          chain start for each page, or, in older kernelcaches, by the list of
+ *          chain starts in __TEXT.__thread_starts.
+ *
+ *          The fixup table decodes every chain in one go, on the worker pool, into
+ *          a table sorted by the pointer's address. A pointer can then be resolved
+ *          with a binary search, rather than each caller untagging pointers one at a
+ *          time and hoping the format is the one they expect.
+ *
+ *          For a Fileset, the fixups belong to the Fileset itself and cover every
+ *          entry. Rebase targets are always virtual addresses.
+ */
+
+/* Pointer formats, from <mach-o/fixup-chains.h> */
+#define DYLD_CHAINED_PTR_ARM64E                 1
+#define DYLD_CHAINED_PTR_64                     2
+#define DYLD_CHAINED_PTR_32                     3
+#define DYLD_CHAINED_PTR_32_CACHE               4
+#define DYLD_CHAINED_PTR_32_FIRMWARE            5
+#define DYLD_CHAINED_PTR_64_OFFSET              6
+#define DYLD_CHAINED_PTR_ARM64E_KERNEL          7
+#define DYLD_CHAINED_PTR_64_KERNEL_CACHE        8
+#define DYLD_CHAINED_PTR_ARM64E_USERLAND        9
+#define DYLD_CHAINED_PTR_ARM64E_FIRMWARE        10
+#define DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE    11
+#define DYLD_CHAINED_PTR_ARM64E_USERLAND24      12
+
+typedef enum htool_fixup_kind_t
+{
+    HTOOL_FIXUP_REBASE = 0,
+    HTOOL_FIXUP_AUTH_REBASE,
+    HTOOL_FIXUP_BIND,
+    HTOOL_FIXUP_AUTH_BIND,
+} htool_fixup_kind_t;
+
+typedef enum htool_fixups_source_t
+{
+    HTOOL_FIXUPS_SOURCE_NONE = 0,
+    HTOOL_FIXUPS_SOURCE_CHAINED,            /* LC_DYLD_CHAINED_FIXUPS */
+    HTOOL_FIXUPS_SOURCE_THREAD_STARTS,      /* __TEXT.__thread_starts */
+} htool_fixups_source_t;
+
+/**
+ * \brief       A single decoded pointer.
+ *
+ *              For a rebase, `target` is the address the pointer points to. For a
+ *              bind, it's the addend, and `ordinal` is the index of the import.
+ */
+typedef struct htool_fixup_t
+{
+    uint64_t            vmaddr;         /* where the pointer is */
+    uint64_t            target;
+    uint32_t            ordinal;
+    uint16_t            diversity;
+    uint8_t             kind;           /* htool_fixup_kind_t */
+    uint8_t             key : 2;        /* IA, IB, DA, DB */
+    uint8_t             addr_div : 1;
+} htool_fixup_t;
+
+typedef struct htool_fixup_import_t
+{
+    const char         *name;
+    int64_t             addend;
+    int32_t             lib_ordinal;
+    uint8_t             weak;
+} htool_fixup_import_t;
+
+typedef struct htool_fixups_t
+{
+    htool_fixups_source_t   source;
+    uint16_t                format;         /* of the first segment with fixups */
+    uint32_t                version;        /* chained fixups header version */
+    uint64_t                base;           /* rebase offsets are relative to this */
+
+    /* Sorted by vmaddr */
+    htool_fixup_t          *fixups;
+    uint64_t                nfixups;
+    uint64_t                nrebases;
+    uint64_t                nbinds;
+
+    htool_fixup_import_t   *imports;
+    uint32_t                nimports;
+} htool_fixups_t;
+
+
+/**
+ * \brief       Fetch the fixup table for a Mach-O, decoding it the first time.
+ *
+ * \param   macho   The Mach-O, or Fileset, to decode.
+ *
+ * \returns     The cached fixup table. This is never NULL, but may be empty if the
+ *              Mach-O has no chained fixups.
+ */
+htool_fixups_t *
+htool_fixups_fetch (macho_t *macho);
+
+/**
+ * \brief       Find the fixup for the pointer stored at `vmaddr`.
+ *
+ * \returns     The fixup, or NULL if there isn't a pointer at that address.
+ */
+const htool_fixup_t *
+htool_fixups_lookup (htool_fixups_t *fixups, uint64_t vmaddr);
+
+/**
+ * \brief       Resolve the pointer stored at `vmaddr`, whose raw value is `raw`.
+ *
+ * \returns     The rebase target if there's a rebase at `vmaddr`, otherwise `raw`,
+ *              so plain pointers in binaries without fixups pass straight through.
+ */
+uint64_t
+htool_fixups_resolve (htool_fixups_t *fixups, uint64_t vmaddr, uint64_t raw);
+
+/**
+ * \brief       The import a bind fixup refers to.
+ *
+ * \returns     The import, or NULL if `fixup` isn't a bind or its ordinal is invalid.
+ */
+const htool_fixup_import_t *
+htool_fixups_import (htool_fixups_t *fixups, const htool_fixup_t *fixup);
+
+/**
+ * \brief       Name of a pointer format, e.g. "PTR_64_KERNEL_CACHE".
+ */
+const char *
+htool_fixups_format_string (uint16_t format);
+
+#endif /* __htool_fixups_h__ */
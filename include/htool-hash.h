@@ -0,0 +1,60 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_HASH_H__
+#define __HTOOL_HASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   Content hashes are 64-bit xxHash (XXH64). It's not cryptographic, but
+ *          it runs at memory bandwidth, which is what comparing large kernelcaches
+ *          needs.
+ *
+ *          htool_hash_ranges() splits each range into HTOOL_HASH_CHUNK_SIZE chunks,
+ *          hashes the chunks on the worker pool, and then hashes the list of chunk
+ *          hashes. The result depends only on the bytes, so two ranges with the
+ *          same contents hash the same wherever they are.
+ */
+
+#define HTOOL_HASH_CHUNK_SIZE       (1024 * 1024)
+
+/**
+ * \brief       XXH64 of `len` bytes at `data`.
+ */
+uint64_t
+htool_hash64 (const void *data, size_t len, uint64_t seed);
+
+/**
+ *  A range of memory to hash with htool_hash_ranges(). `hash` is filled in.
+ */
+typedef struct htool_hash_range_t
+{
+    const unsigned char    *data;
+    uint64_t                size;
+    uint64_t                hash;
+} htool_hash_range_t;
+
+/**
+ * \brief       Hash every range in `ranges`, in parallel. Large ranges are split
+ *              into chunks so they're spread over the workers too.
+ */
+void
+htool_hash_ranges (htool_hash_range_t *ranges, uint32_t count);
+
+#endif /* __htool_hash_h__ */
@@ -0,0 +1,51 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_PARALLEL_H__
+#define __HTOOL_PARALLEL_H__
+
+#include <stdint.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   Work that splits into many independent items (kexts in a kernelcache,
+ *          files to extract, ...) is run with htool_parallel_for(). Items are handed
+ *          out to a pool of threads one at a time, so uneven items balance out.
+ *          The callback should write its result into a slot indexed by `index`
+ *          in a preallocated array, which keeps the output in the same order no
+ *          matter how the items were scheduled.
+ *
+ *          The number of threads defaults to the number of online CPUs, and can
+ *          be set with the HTOOL_THREADS environment variable. HTOOL_THREADS=1
+ *          runs everything on the calling thread.
+ */
+
+typedef void (*htool_parallel_fn_t) (void *ctx, uint32_t index);
+
+/**
+ * \brief       Number of threads htool_parallel_for() will use.
+ */
+uint32_t
+htool_parallel_nthreads ();
+
+/**
+ * \brief       Call `fn (ctx, i)` for every `i` in [0, count), spread across the
+ *              worker threads, and wait for them all to finish.
+ */
+void
+htool_parallel_for (uint32_t count, htool_parallel_fn_t fn, void *ctx);
+
+#endif /* __htool_parallel_h__ */
@@ -0,0 +1,125 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef __HTOOL_VMMAP_H__
+#define __HTOOL_VMMAP_H__
+
+#include <stdint.h>
+#include <libhelper-macho.h>
+
+#include "htool.h"
+
+/**
+ *  NOTE:   The VM map is a sorted table of an image's segments, so translating a
+ *          virtual address to a file offset (or back) is a binary search rather
+ *          than a walk of the segment list.
+ *
+ *          A Fileset's own segments span the segments of every entry, so the two
+ *          can't share a table. Entry segments are kept in a separate table that
+ *          is searched first, which also tells the caller which entry an address
+ *          belongs to. As with everything else in a Fileset, entry file offsets
+ *          are relative to the start of the Fileset.
+ */
+
+typedef struct htool_vm_segment_t
+{
+    uint64_t            vmaddr;
+    uint64_t            vmsize;
+    uint64_t            fileoff;
+    uint64_t            filesize;
+    char                segname[17];
+
+    /* The image the segment was loaded from, NULL for a raw header */
+    macho_t            *image;
+} htool_vm_segment_t;
+
+typedef struct htool_vm_table_t
+{
+    htool_vm_segment_t     *segments;       /* sorted by vmaddr */
+    uint32_t               *by_fileoff;     /* file-backed segments, sorted by fileoff */
+    uint32_t                nsegments;
+    uint32_t                nfile;
+} htool_vm_table_t;
+
+typedef struct htool_vmmap_t
+{
+    htool_vm_table_t        image;          /* the image's own segments */
+    htool_vm_table_t        entries;        /* Fileset entry segments, if any */
+
+    /* End of the furthest file-backed segment */
+    uint64_t                file_end;
+} htool_vmmap_t;
+
+
+/**
+ * \brief       Fetch the VM map for a Mach-O, building it the first time.
+ *
+ * \param   macho   Mach-O to map. For a Fileset, the entries are mapped too.
+ *
+ * \returns     The cached VM map.
+ */
+htool_vmmap_t *
+htool_vmmap_fetch (macho_t *macho);
+
+/**
+ * \brief       Build a VM map by reading the load commands of a 32 or 64-bit
+ *              Mach-O header directly, for images that libhelper can't parse
+ *              (e.g. the SEPOS kernel and apps). The map isn't cached.
+ *
+ * \param   data    Start of the Mach-O header.
+ * \param   size    Bytes available from `data`.
+ *
+ * \returns     A new VM map, or NULL if `data` isn't a Mach-O.
+ */
+htool_vmmap_t *
+htool_vmmap_create_from_header (unsigned char *data, uint64_t size);
+
+/**
+ * \brief       Free a VM map returned by htool_vmmap_create_from_header().
+ */
+void
+htool_vmmap_free (htool_vmmap_t *map);
+
+/**
+ * \brief       Find the segment containing a virtual address. Fileset entry
+ *              segments are preferred to the Fileset's own.
+ */
+const htool_vm_segment_t *
+htool_vmmap_find_vmaddr (htool_vmmap_t *map, uint64_t vmaddr);
+
+/**
+ * \brief       Find the file-backed segment containing a file offset.
+ */
+const htool_vm_segment_t *
+htool_vmmap_find_offset (htool_vmmap_t *map, uint64_t offset);
+
+/**
+ * \brief       Translate a virtual address to a file offset.
+ *
+ * \returns     1 if the address is backed by the file, otherwise 0 (including
+ *              zero-fill memory at the end of a segment).
+ */
+int
+htool_vmmap_vmaddr_to_offset (htool_vmmap_t *map, uint64_t vmaddr, uint64_t *offset);
+
+/**
+ * \brief       Translate a file offset to a virtual address.
+ *
+ * \returns     1 if the offset is mapped by a segment, otherwise 0.
+ */
+int
+htool_vmmap_offset_to_vmaddr (htool_vmmap_t *map, uint64_t offset, uint64_t *vmaddr);
+
+#endif /* __htool_vmmap_h__ */
@@ -13,7 +13,14 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include "htool.h"
+#include "htool-parallel.h"
 
 #include "commands/analyse.h"
 
@@ -23,6 +30,34 @@
 #include "darwin/darwin.h"
 #include "darwin/kernel.h"
 #include "darwin/kext.h"
+#include "darwin/reconstruct.h"
+#include "darwin/diff.h"
+#include "darwin/iokit.h"
+#include "darwin/patchfinder.h"
+#include "darwin/symbolicate.h"
+#include "darwin/dependencies.h"
+
+/**
+ * \brief   Format a string into a new allocation, like asprintf(), which isn't
+ *          declared without _GNU_SOURCE.
+ */
+static char *
+_analyse_format (const char *fmt, ...)
+{
+    va_list args;
+    char *str;
+    int len;
+
+    va_start (args, fmt);
+    len = vsnprintf (NULL, 0, fmt, args);
+    va_end (args);
+
+    str = malloc (len + 1);
+    va_start (args, fmt);
+    vsnprintf (str, len + 1, fmt, args);
+    va_end (args);
+    return str;
+}
 
 
 htool_return_t
@@ -115,14 +150,14 @@ htool_analyse_list_all (htool_client_t *client)
          *  it's as simple as printing out each kext_t from a HSList.
          */
         xnu_t *xnu = (xnu_t *) client->bin->firmware;
-        uint32_t k_size = h_slist_length (xnu->kexts);
+        uint32_t k_size = xnu->nkexts;
         
         if (!k_size) goto no_embedded_bin;
 
         printf (ANSI_COLOR_GREEN "[*]" RESET ANSI_COLOR_GREEN " KEXT List:\n" RESET);
         printf (BOLD DARK_YELLOW "  %-12s%-10s\n", "Offset", "Bundle ID" RESET);
         for (int i = 0; i < k_size; i++) {
-            kext_t *kext = (kext_t *) h_slist_nth_data (xnu->kexts, i);
+            kext_t *kext = xnu->kext_array[i];
             printf (BOLD DARK_WHITE "  0x%-10llx" RESET DARK_GREY "%s\n" RESET,
                 kext->offset, kext->name);
         }
@@ -154,10 +189,36 @@ no_embedded_bin:
     return HTOOL_RETURN_SUCCESS;
 }
 
+/**
+ * \brief   Split the comma-separated names given to `--extract`.
+ */
+static char **
+_analyse_names_split (const char *list, uint32_t *count)
+{
+    char *copy = strdup (list), *save = NULL, *tok;
+    char **names = calloc (strlen (list) / 2 + 1, sizeof (char *));
+
+    *count = 0;
+    for (tok = strtok_r (copy, ",", &save); tok; tok = strtok_r (NULL, ",", &save))
+        names[(*count)++] = strdup (tok);
+
+    free (copy);
+    return names;
+}
+
+static void
+_analyse_names_free (char **names, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) free (names[i]);
+    free (names);
+}
+
 htool_return_t
 htool_analyse_extract (htool_client_t *client)
 {
-    char *name = client->extract;
+    htool_return_t ret = HTOOL_RETURN_SUCCESS;
+    uint32_t nnames;
+    char **names = _analyse_names_split (client->extract, &nnames);
 
     if (HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_IBOOT)) {
 
@@ -166,55 +227,79 @@ htool_analyse_extract (htool_client_t *client)
 
         if (!len) goto no_embedded_bin;
 
-        printf (ANSI_COLOR_GREEN "[*] Searching binary for %s\n" RESET, name);
-        for (int i = 0; i < len; i++) {
-            iboot_payload_t *payload = (iboot_payload_t *) h_slist_nth_data (iboot->payloads, i);
-            if (strcmp (payload->name, name)) continue;
-
-            printf (ANSI_COLOR_GREEN "[*] Extracting Embedded payload:\n" RESET);
-
-            uint32_t payload_size;
-            unsigned char *payload_data;
-
-            if (payload->type == IBOOT_EMBEDDED_IMAGE_TYPE_LZFSE) {
-                payload_data = payload->decomp;
-                payload_size = payload->decomp_size;
-            } else {
-                payload_data = (unsigned char *) (iboot->data + payload->start);
-                payload_size = payload->size;
+        /* iBoot only has a handful of payloads, so they're matched by exact name */
+        uint32_t extracted = 0;
+        for (uint32_t n = 0; n < nnames; n++) {
+            printf (ANSI_COLOR_GREEN "[*] Searching binary for %s\n" RESET, names[n]);
+            for (int i = 0; i < len; i++) {
+                iboot_payload_t *payload = (iboot_payload_t *) h_slist_nth_data (iboot->payloads, i);
+                if (strcmp (payload->name, names[n])) continue;
+
+                printf (ANSI_COLOR_GREEN "[*] Extracting Embedded payload:\n" RESET);
+
+                uint32_t payload_size;
+                unsigned char *payload_data;
+
+                if (payload->type == IBOOT_EMBEDDED_IMAGE_TYPE_LZFSE) {
+                    payload_data = payload->decomp;
+                    payload_size = payload->decomp_size;
+                } else {
+                    payload_data = (unsigned char *) (iboot->data + payload->start);
+                    payload_size = payload->size;
+                }
+
+                FILE *fp = fopen (payload->name, "w+");
+                fwrite (payload_data, payload_size, 1, fp);
+                fclose (fp);
+
+                extracted++;
+                break;
             }
+        }
 
-            FILE *fp = fopen (payload->name, "w+");
-            fwrite (payload_data, payload_size, 1, fp);
-            fclose (fp);
-
-            return HTOOL_RETURN_SUCCESS;
+        if (!extracted) {
+            printf (YELLOW "[*] Could not find embedded firmware with given name\n");
+            ret = HTOOL_RETURN_FAILURE;
         }
-        printf (YELLOW "[*] Could not find embedded firmware with given name\n");
-        return HTOOL_RETURN_FAILURE;
+        goto out;
 
 
     } else if (HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
         xnu_t *xnu = (xnu_t *) client->bin->firmware;
-        uint32_t k_size = h_slist_length (xnu->kexts);
+        uint32_t k_size = xnu->nkexts, extracted = 0;
 
         if (!k_size) goto no_embedded_bin;
 
-        printf ("[*] Searching binary for %s\n", name);
-        for (int i = 0; i < k_size; i++) {
-            kext_t *kext = (kext_t *) h_slist_nth_data (xnu->kexts, i);
-            if (strcmp (kext->name, name)) continue;
-
-            printf ("[*] Extracting KEXT:\n");
+        /**
+         *  Each name can be a bundle ID or a glob pattern, and a kext matched by more
+         *  than one of them is only written once.
+         */
+        uint8_t *seen = calloc (k_size, sizeof (uint8_t));
+        for (uint32_t n = 0; n < nnames; n++) {
+            uint32_t *matches, nmatches;
+
+            printf ("[*] Searching binary for %s\n", names[n]);
+            if (!(nmatches = xnu_kext_match (xnu, names[n], &matches))) {
+                printf (YELLOW "[*] Could not find embedded firmware matching %s\n" RESET, names[n]);
+                continue;
+            }
 
-            FILE *fp = fopen (kext->name, "w+");
-            fwrite (kext->macho->data, kext->macho->size, 1, fp);
-            fclose (fp);
+            for (uint32_t i = 0; i < nmatches; i++) {
+                kext_t *kext = xnu->kext_array[matches[i]];
+                if (seen[matches[i]]) continue;
+                seen[matches[i]] = 1;
 
-            return HTOOL_RETURN_SUCCESS;
+                /* The kext's segments are spread over the cache, so they're gathered into a standalone Mach-O */
+                printf ("[*] Extracting KEXT: %s\n", kext->name);
+                if (xnu_kext_reconstruct_to_file (xnu, kext, kext->name) == HTOOL_RETURN_SUCCESS) extracted++;
+            }
+            free (matches);
         }
-        printf (YELLOW "[*] Could not find embedded firmware with given name\n");
-        return HTOOL_RETURN_FAILURE;
+        free (seen);
+
+        if (extracted) printf (ANSI_COLOR_GREEN "[*] Extracted %d Kernel Extensions\n" RESET, extracted);
+        else ret = HTOOL_RETURN_FAILURE;
+        goto out;
 
     } else if (HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_SEP)) {
 
@@ -227,7 +312,8 @@ htool_analyse_extract (htool_client_t *client)
         sep_t *sep = (sep_t *) client->bin->firmware;
         if (sep->type != SEP_FIRMWARE_TYPE_OS_32) {
             printf (YELLOW "[*] Cannot split a SEP ROM file, 32-bit Compressed SEPOS, or 64-bit SEPOS.\n" RESET);
-            return HTOOL_RETURN_FAILURE;
+            ret = HTOOL_RETURN_FAILURE;
+            goto out;
         }
 
         /* First extract the bootloader */
@@ -253,8 +339,8 @@ htool_analyse_extract (htool_client_t *client)
             sep_app_t *app = (sep_app_t *) h_slist_nth_data (sep->apps, i);
 
             char *name;
-            if (!strcmp (app->name, "Unknown")) asprintf (&name, "sepos_app%d", i);
-            else asprintf (&name, "sepos_app%d_%s", i, app->name);
+            if (!strcmp (app->name, "Unknown")) name = _analyse_format ("sepos_app%d", i);
+            else name = _analyse_format ("sepos_app%d_%s", i, app->name);
 
             printf ("[*] Extracting SEPOS App: %s...\n", name);
 
@@ -264,15 +350,437 @@ htool_analyse_extract (htool_client_t *client)
             fp = fopen (name, "w+");
             fwrite (data, app->size, 1, fp);
             fclose (fp);
-            
-            name = NULL;
+
             free (name);
         }
-
-        return HTOOL_RETURN_SUCCESS;
+        goto out;
     }
 
 no_embedded_bin:
     printf (YELLOW "[*] Firmware file contains zero embedded binaries.\n");
+out:
+    _analyse_names_free (names, nnames);
+    return ret;
+}
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ * \brief   Turn a bundle ID into a safe file name. Anything other than letters,
+ *          digits, '.', '-' and '_' becomes '_', and a name can't start with '.'.
+ */
+static char *
+_analyse_sanitise_name (const char *name)
+{
+    char *out;
+
+    if (!name || !*name) return strdup ("kext");
+
+    out = strdup (name);
+    for (char *c = out; *c; c++) {
+        if ((*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') ||
+            *c == '.' || *c == '-' || *c == '_')
+            continue;
+        *c = '_';
+    }
+    if (out[0] == '.') out[0] = '_';
+    return out;
+}
+
+/**
+ * \brief   Write a JSON string, or null if there isn't one.
+ */
+static void
+_analyse_json_string (FILE *fp, const char *str)
+{
+    if (!str) {
+        fputs ("null", fp);
+        return;
+    }
+
+    fputc ('"', fp);
+    for (; *str; str++) {
+        unsigned char c = (unsigned char) *str;
+        if (c == '"' || c == '\\') fprintf (fp, "\\%c", c);
+        else if (c < 0x20) fprintf (fp, "\\u%04x", c);
+        else fputc (c, fp);
+    }
+    fputc ('"', fp);
+}
+
+typedef struct extract_name_key_t
+{
+    char            *name;
+    uint32_t         index;
+} extract_name_key_t;
+
+static int
+_analyse_name_key_compare (const void *a, const void *b)
+{
+    const extract_name_key_t *ka = a, *kb = b;
+    int r = strcmp (ka->name, kb->name);
+    return r ? r : (ka->index > kb->index) - (ka->index < kb->index);
+}
+
+typedef struct extract_all_job_t
+{
+    xnu_t           *xnu;
+    int              dirfd;
+    char           **files;
+    uint64_t        *sizes;
+    uint8_t         *ok;
+} extract_all_job_t;
+
+static void
+_analyse_extract_all_worker (void *ctx, uint32_t index)
+{
+    extract_all_job_t *job = (extract_all_job_t *) ctx;
+    kext_t *kext = job->xnu->kext_array[index];
+    int fd;
+
+    if ((fd = openat (job->dirfd, job->files[index], O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        warningf ("Could not open %s for writing: %s\n", job->files[index], strerror (errno));
+        return;
+    }
+
+    if (xnu_kext_reconstruct_write (job->xnu, kext, fd) == HTOOL_RETURN_SUCCESS) {
+        off_t size = lseek (fd, 0, SEEK_CUR);
+        job->sizes[index] = (size > 0) ? (uint64_t) size : 0;
+        job->ok[index] = 1;
+    }
+    close (fd);
+}
+
+htool_return_t
+htool_analyse_extract_all (htool_client_t *client)
+{
+    extract_all_job_t job;
+    extract_name_key_t *keys;
+    uint32_t count, extracted = 0;
+    xnu_t *xnu;
+    FILE *fp;
+    int fd;
+
+    if (!HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "--extract-all is only supported for Kernelcaches\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    xnu = (xnu_t *) client->bin->firmware;
+    if (!(count = xnu->nkexts)) {
+        printf (YELLOW "[*] Firmware file contains zero embedded binaries.\n" RESET);
+        return HTOOL_RETURN_SUCCESS;
+    }
+
+    if (mkdir (client->extract_dir, 0755) && errno != EEXIST) {
+        errorf ("Could not create %s: %s\n", client->extract_dir, strerror (errno));
+        return HTOOL_RETURN_FAILURE;
+    }
+    if ((job.dirfd = open (client->extract_dir, O_RDONLY | O_DIRECTORY)) < 0) {
+        errorf ("Could not open %s: %s\n", client->extract_dir, strerror (errno));
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    job.xnu = xnu;
+    job.files = calloc (count, sizeof (char *));
+    job.sizes = calloc (count, sizeof (uint64_t));
+    job.ok = calloc (count, sizeof (uint8_t));
+
+    /**
+     *  Work out every file name up front. Bundle IDs can repeat, and sanitising can
+     *  make two different IDs the same, so names are sorted and anything after the
+     *  first in a run gets the kext's index added.
+     */
+    keys = malloc (count * sizeof (extract_name_key_t));
+    for (uint32_t i = 0; i < count; i++)
+        keys[i] = (extract_name_key_t) { .name = _analyse_sanitise_name (xnu->kext_array[i]->name), .index = i };
+    qsort (keys, count, sizeof (extract_name_key_t), _analyse_name_key_compare);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (i && !strcmp (keys[i].name, keys[i - 1].name)) {
+            job.files[keys[i].index] = _analyse_format ("%s-%d", keys[i].name, keys[i].index);
+        } else {
+            job.files[keys[i].index] = keys[i].name;
+            keys[i].name = NULL;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) free (keys[i].name);
+    free (keys);
+
+    /* Each kext goes to its own file, so they're written on the worker pool */
+    printf ("[*] Extracting %d KEXTs to %s\n", count, client->extract_dir);
+    htool_parallel_for (count, _analyse_extract_all_worker, &job);
+
+    /* The manifest describes every kext, including any that failed */
+    if ((fd = openat (job.dirfd, "manifest.json", O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 || !(fp = fdopen (fd, "w"))) {
+        errorf ("Could not write manifest.json: %s\n", strerror (errno));
+        if (fd >= 0) close (fd);
+    } else {
+        fprintf (fp, "{\n  \"kernel\": ");
+        _analyse_json_string (fp, client->filename);
+        fprintf (fp, ",\n  \"type\": ");
+        _analyse_json_string (fp, xnu_kernel_type_get_string (xnu->type));
+        fprintf (fp, ",\n  \"kexts\": [\n");
+
+        for (uint32_t i = 0; i < count; i++) {
+            kext_t *kext = xnu->kext_array[i];
+            xnu_kext_macho (xnu, kext);
+
+            fprintf (fp, "    { \"bundle_id\": ");
+            _analyse_json_string (fp, kext->name);
+            fprintf (fp, ", \"file\": ");
+            _analyse_json_string (fp, job.ok[i] ? job.files[i] : NULL);
+            fprintf (fp, ", \"version\": ");
+            _analyse_json_string (fp, kext->version);
+            fprintf (fp, ", \"uuid\": ");
+            _analyse_json_string (fp, kext->uuid);
+            fprintf (fp, ", \"offset\": %llu, \"size\": %llu, \"extracted\": %s }%s\n",
+                     (unsigned long long) kext->offset, (unsigned long long) job.sizes[i],
+                     job.ok[i] ? "true" : "false", (i + 1 < count) ? "," : "");
+
+            extracted += job.ok[i];
+        }
+        fprintf (fp, "  ]\n}\n");
+        fclose (fp);
+    }
+
+    for (uint32_t i = 0; i < count; i++) free (job.files[i]);
+    free (job.files);
+    free (job.sizes);
+    free (job.ok);
+    close (job.dirfd);
+
+    printf (ANSI_COLOR_GREEN "[*] Extracted %d of %d KEXTs\n" RESET, extracted, count);
+    return (extracted == count) ? HTOOL_RETURN_SUCCESS : HTOOL_RETURN_FAILURE;
+}
+
+htool_return_t
+htool_analyse_diff (htool_client_t *client)
+{
+    htool_binary_t *other;
+
+    if (!HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "--diff is only supported for Kernelcaches\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (!client->bin->firmware && htool_analyse_kernel (client->bin) != HTOOL_RETURN_SUCCESS)
+        return HTOOL_RETURN_FAILURE;
+
+    /* Load and parse the other kernelcache the same way */
+    if ((other = htool_binary_load_and_parse (client->diff)) == HTOOL_RETURN_FAILURE) {
+        htool_error_throw (HTOOL_ERROR_INVALID_FILENAME, "%s", client->diff);
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (!HTOOL_CLIENT_CHECK_FLAG (other->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "%s is not a Kernelcache\n", client->diff);
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (htool_analyse_kernel (other) != HTOOL_RETURN_SUCCESS) return HTOOL_RETURN_FAILURE;
+
+    printf (BOLD RED "[*] Comparing:" RESET DARK_GREY " %s -> %s\n" RESET, client->filename, client->diff);
+    return xnu_kernel_diff ((xnu_t *) client->bin->firmware, (xnu_t *) other->firmware);
+}
+
+htool_return_t
+htool_analyse_iokit_classes (htool_client_t *client)
+{
+    xnu_iokit_classes_t *classes;
+
+    if (!HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "--iokit-classes is only supported for Kernelcaches\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (!client->bin->firmware && htool_analyse_kernel (client->bin) != HTOOL_RETURN_SUCCESS)
+        return HTOOL_RETURN_FAILURE;
+
+    classes = xnu_iokit_classes_recover ((xnu_t *) client->bin->firmware);
+    xnu_iokit_classes_print ((xnu_t *) client->bin->firmware, classes);
+    xnu_iokit_classes_free (classes);
+
     return HTOOL_RETURN_SUCCESS;
-}
\ No newline at end of file
+}
+
+htool_return_t
+htool_analyse_patchfind (htool_client_t *client)
+{
+    xnu_patchfind_t *pf;
+    htool_return_t res;
+
+    if (!HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "--patchfind is only supported for Kernelcaches\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (!client->bin->firmware && htool_analyse_kernel (client->bin) != HTOOL_RETURN_SUCCESS)
+        return HTOOL_RETURN_FAILURE;
+    if (!(pf = xnu_patchfind_load (client->patchfind)))
+        return HTOOL_RETURN_FAILURE;
+
+    if ((res = xnu_patchfind_run ((xnu_t *) client->bin->firmware, pf)) == HTOOL_RETURN_SUCCESS)
+        xnu_patchfind_print ((xnu_t *) client->bin->firmware, pf);
+
+    xnu_patchfind_free (pf);
+    return res;
+}
+
+htool_return_t
+htool_analyse_symbolicate (htool_client_t *client)
+{
+    if (!HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "--symbolicate is only supported for Kernelcaches\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (!client->bin->firmware && htool_analyse_kernel (client->bin) != HTOOL_RETURN_SUCCESS)
+        return HTOOL_RETURN_FAILURE;
+
+    return xnu_symbolicate_file ((xnu_t *) client->bin->firmware, client->symbolicate, client->slide,
+                                 (client->opts & HTOOL_CLIENT_ANALYSE_OPT_SLIDE) != 0);
+}
+
+HTOOL_PRIVATE void
+_analyse_deps_print_text (xnu_kext_graph_t *graph, const uint32_t *nodes, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        const xnu_kext_node_t *node = &graph->nodes[nodes[i]];
+
+        printf (BOLD DARK_WHITE "%s" RESET DARK_GREY " (%s)", node->bundle_id, (node->version) ? node->version : "-");
+        if (node->flags & XNU_KEXT_NODE_FLAG_MISSING) printf (RED " [missing]");
+        else if (node->kext == XNU_KEXT_GRAPH_NONE) printf (YELLOW " [no code]");
+        printf (RESET "\n");
+
+        for (uint32_t e = graph->deps_first[nodes[i]]; e < graph->deps_first[nodes[i] + 1]; e++)
+            printf (DARK_GREY "    -> %s\n" RESET, graph->nodes[graph->deps[e]].bundle_id);
+    }
+}
+
+HTOOL_PRIVATE void
+_analyse_deps_print_dot (xnu_kext_graph_t *graph, const uint32_t *nodes, uint32_t count)
+{
+    printf ("digraph kexts {\n    rankdir=LR;\n    node [shape=box];\n");
+    for (uint32_t i = 0; i < count; i++) {
+        const xnu_kext_node_t *node = &graph->nodes[nodes[i]];
+        if (node->flags & XNU_KEXT_NODE_FLAG_MISSING)
+            printf ("    \"%s\" [style=dashed];\n", node->bundle_id);
+        else if (node->kext == XNU_KEXT_GRAPH_NONE)
+            printf ("    \"%s\" [shape=ellipse];\n", node->bundle_id);
+    }
+
+    /* Only nodes in the closure have their dependencies listed, so every edge is inside it */
+    for (uint32_t i = 0; i < count; i++)
+        for (uint32_t e = graph->deps_first[nodes[i]]; e < graph->deps_first[nodes[i] + 1]; e++)
+            printf ("    \"%s\" -> \"%s\";\n", graph->nodes[nodes[i]].bundle_id, graph->nodes[graph->deps[e]].bundle_id);
+    printf ("}\n");
+}
+
+HTOOL_PRIVATE void
+_analyse_deps_print_json (xnu_kext_graph_t *graph, const uint32_t *nodes, uint32_t count)
+{
+    printf ("{\n  \"kexts\": [\n");
+    for (uint32_t i = 0; i < count; i++) {
+        const xnu_kext_node_t *node = &graph->nodes[nodes[i]];
+
+        printf ("    { \"bundle_id\": ");
+        _analyse_json_string (stdout, node->bundle_id);
+        printf (", \"version\": ");
+        _analyse_json_string (stdout, node->version);
+        printf (", \"has_code\": %s, \"missing\": %s, \"depends_on\": [",
+                (node->kext != XNU_KEXT_GRAPH_NONE) ? "true" : "false",
+                (node->flags & XNU_KEXT_NODE_FLAG_MISSING) ? "true" : "false");
+        for (uint32_t e = graph->deps_first[nodes[i]]; e < graph->deps_first[nodes[i] + 1]; e++) {
+            if (e != graph->deps_first[nodes[i]]) printf (", ");
+            _analyse_json_string (stdout, graph->nodes[graph->deps[e]].bundle_id);
+        }
+        printf ("] }%s\n", (i + 1 < count) ? "," : "");
+    }
+    printf ("  ]\n}\n");
+}
+
+htool_return_t
+htool_analyse_dependencies (htool_client_t *client)
+{
+    xnu_kext_graph_t *graph;
+    uint32_t *nodes, count;
+    int format;
+
+    if (!HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "--deps is only supported for Kernelcaches\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    if (!strcmp (client->deps, "text")) format = 0;
+    else if (!strcmp (client->deps, "dot")) format = 1;
+    else if (!strcmp (client->deps, "json")) format = 2;
+    else {
+        htool_error_throw (HTOOL_ERROR_GENERAL, "Unknown --deps format '%s', expected text, dot or json\n", client->deps);
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    if (!client->bin->firmware && htool_analyse_kernel (client->bin) != HTOOL_RETURN_SUCCESS)
+        return HTOOL_RETURN_FAILURE;
+    if (!(graph = xnu_kext_graph_build ((xnu_t *) client->bin->firmware))) {
+        errorf ("Kernelcache has no prelink info to read dependencies from\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    if (client->deps_root) {
+        uint32_t root = xnu_kext_graph_find (graph, client->deps_root);
+        if (root == XNU_KEXT_GRAPH_NONE) {
+            errorf ("No KEXT with Bundle ID '%s'\n", client->deps_root);
+            xnu_kext_graph_free (graph);
+            return HTOOL_RETURN_FAILURE;
+        }
+        count = xnu_kext_graph_closure (graph, root, &nodes);
+    } else {
+        /* The whole graph, in load order, with any cycles at the end */
+        uint8_t *listed = calloc (graph->nnodes ? graph->nnodes : 1, 1);
+        nodes = malloc ((graph->nnodes ? graph->nnodes : 1) * sizeof (uint32_t));
+        memcpy (nodes, graph->order, graph->norder * sizeof (uint32_t));
+        for (count = 0; count < graph->norder; count++) listed[nodes[count]] = 1;
+        for (uint32_t i = 0; i < graph->nnodes; i++) if (!listed[i]) nodes[count++] = i;
+        free (listed);
+    }
+
+    if (format == 0) _analyse_deps_print_text (graph, nodes, count);
+    else if (format == 1) _analyse_deps_print_dot (graph, nodes, count);
+    else _analyse_deps_print_json (graph, nodes, count);
+
+    free (nodes);
+    xnu_kext_graph_free (graph);
+    return HTOOL_RETURN_SUCCESS;
+}
+
+htool_return_t
+htool_analyse_kext_symbols (htool_client_t *client)
+{
+    const kext_symbol_t *symbols;
+    uint32_t count;
+    kext_t *kext;
+    xnu_t *xnu;
+
+    if (!HTOOL_CLIENT_CHECK_FLAG (client->bin->flags, HTOOL_BINARY_FIRMWARETYPE_KERNEL)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "--kext-symbols is only supported for Kernelcaches\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (!client->bin->firmware && htool_analyse_kernel (client->bin) != HTOOL_RETURN_SUCCESS)
+        return HTOOL_RETURN_FAILURE;
+
+    xnu = (xnu_t *) client->bin->firmware;
+    if (!(kext = xnu_kext_find (xnu, client->kext_symbols))) {
+        errorf ("No KEXT with Bundle ID '%s'\n", client->kext_symbols);
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (kext->type != KERNEL_EXTENSION_FLAG_MERGED_KEXT) {
+        errorf ("--kext-symbols is only supported for Merged-style KEXTs, use `macho --symbols` on an extracted KEXT\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    symbols = xnu_kext_symbols (xnu, kext, &count);
+    printf (BOLD RED "Symbols (%s):\n" RESET, kext->name);
+    if (!count) {
+        printf (BLUE "  No Symbol Information\n" RESET);
+        return HTOOL_RETURN_SUCCESS;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+        printf (BOLD DARK_WHITE "0x%016llx" RESET BOLD DARK_YELLOW "  T  " RESET DARK_GREY "%s\n" RESET,
+                (unsigned long long) symbols[i].vmaddr, symbols[i].name);
+    return HTOOL_RETURN_SUCCESS;
+}
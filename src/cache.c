@@ -0,0 +1,82 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "htool-cache.h"
+
+/**
+ *  Each image that has something cached against it gets one of these. There
+ *  are only ever a handful of images loaded at once (the file, and maybe a
+ *  kernel fileset entry or a second file for comparison), so a simple list is
+ *  more than fast enough.
+ */
+typedef struct htool_cache_entry_t
+{
+    const void                      *image;
+    void                            *objects[HTOOL_CACHE_KIND_MAX];
+    struct htool_cache_entry_t      *next;
+} htool_cache_entry_t;
+
+static htool_cache_entry_t *cache_list = NULL;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+HTOOL_PRIVATE htool_cache_entry_t *
+_htool_cache_find_entry (const void *image)
+{
+    for (htool_cache_entry_t *e = cache_list; e; e = e->next)
+        if (e->image == image) return e;
+    return NULL;
+}
+
+void *
+htool_cache_fetch (const void *image, htool_cache_kind_t kind)
+{
+    htool_cache_entry_t *entry;
+    void *object = NULL;
+
+    if (kind >= HTOOL_CACHE_KIND_MAX) return NULL;
+
+    pthread_mutex_lock (&cache_lock);
+    if ((entry = _htool_cache_find_entry (image)))
+        object = entry->objects[kind];
+    pthread_mutex_unlock (&cache_lock);
+
+    return object;
+}
+
+void *
+htool_cache_store (const void *image, htool_cache_kind_t kind, void *object)
+{
+    htool_cache_entry_t *entry;
+
+    if (kind >= HTOOL_CACHE_KIND_MAX) return object;
+
+    pthread_mutex_lock (&cache_lock);
+    if (!(entry = _htool_cache_find_entry (image))) {
+        entry = calloc (1, sizeof (htool_cache_entry_t));
+        entry->image = image;
+        entry->next = cache_list;
+        cache_list = entry;
+    }
+
+    /* first one in wins, so every pass sees the same object */
+    if (!entry->objects[kind]) entry->objects[kind] = object;
+    object = entry->objects[kind];
+    pthread_mutex_unlock (&cache_lock);
+
+    return object;
+}
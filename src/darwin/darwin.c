@@ -20,45 +20,109 @@
 #include "darwin/darwin.h"
 #include "darwin/kernel.h"
 #include "htool-loader.h"
+#include "htool-fileset.h"
 
 
+/**
+ *  FNV-1a over the lowercased key, with a final avalanche so the low bits used for
+ *  the bucket and slot are well mixed. config/device_db_generator.py uses the same
+ *  hash to build the tables.
+ */
+static uint32_t
+_darwin_device_hash (const char *str, size_t len, uint32_t seed)
+{
+    uint32_t h = 0x811c9dc5 ^ seed;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t) str[i];
+        if (c >= 'A' && c <= 'Z') c |= 0x20;
+        h = (h ^ c) * 0x01000193;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static const char *
+_darwin_device_field (const darwin_device_t *device, darwin_device_key_t key)
+{
+    switch (key) {
+        case DARWIN_DEVICE_KEY_PLATFORM:    return device->platform;
+        case DARWIN_DEVICE_KEY_BOARD:       return device->board;
+        case DARWIN_DEVICE_KEY_SOC:         return device->soc;
+        case DARWIN_DEVICE_KEY_IDENTIFIER:  return device->identifier;
+        default:                            return NULL;
+    }
+}
+
+const darwin_device_t *
+darwin_device_lookup (darwin_device_key_t key, const char *str, size_t len)
+{
+    const darwin_device_hash_t *hash;
+    const darwin_device_t *device;
+    const char *field;
+    uint32_t bucket;
+    int16_t slot;
+
+    if (key >= DARWIN_DEVICE_KEY_COUNT || !str || !len) return NULL;
+    hash = &darwin_device_hashes[key];
+
+    bucket = _darwin_device_hash (str, len, 0) % hash->nbuckets;
+    slot = hash->slots[_darwin_device_hash (str, len, hash->disp[bucket]) % hash->nslots];
+    if (slot < 0) return NULL;
+
+    /* Every string hashes to some slot, so check it's actually the key */
+    device = &darwin_device_list[slot];
+    field = _darwin_device_field (device, key);
+    return (field && strlen (field) == len && !strncasecmp (field, str, len)) ? device : NULL;
+}
+
+const darwin_device_t *
+darwin_device_find (const char *string)
+{
+    static const darwin_device_key_t order[] = {
+        DARWIN_DEVICE_KEY_SOC, DARWIN_DEVICE_KEY_BOARD, DARWIN_DEVICE_KEY_PLATFORM
+    };
+    const darwin_device_t *device;
+    const char *part, *end;
+
+    if (!string) return NULL;
+
+    /**
+     *  NOTE: We cannot determine the board type as some devices share the
+     *      same SoC or Platform identifier. 
+     */
+    for (part = string; ; part = end + 1) {
+        end = strchr (part, '/');
+        size_t len = end ? (size_t) (end - part) : strlen (part);
+
+        for (int i = 0; i < (int) (sizeof (order) / sizeof (order[0])); i++)
+            if ((device = darwin_device_lookup (order[i], part, len)))
+                return device;
+
+        if (!end) break;
+    }
+    return NULL;
+}
+
 char *darwin_get_device_from_string (char *string)
 {
-    darwin_device_t *device = malloc (sizeof(darwin_device_t));
+    const darwin_device_t *device;
+    const char *soc;
     uint32_t size;
     char *ret;
 
-    StringList *socs = strsplit (string, "/");
-
-    for (int i = 0; i < DARWIN_DEVICE_LIST_LEN; i++) {
-        device = &device_list[i];
-
-        /**
-         *  NOTE: We cannot determine the board type as some devices share the
-         *      same SoC or Platform identifier. 
-         */
-        for (int i = 0; i < socs->count; i++) {
-            char *a = socs->ptrs[i];
-            //printf ("checking: %s, %s.%s.%s\n", a, device->soc, device->board, device->platform);
-            if ( !strncasecmp (device->soc, string, strlen (string)) ||
-                 !strncasecmp (device->board, string, strlen (string)) ||
-                 !strncasecmp (device->platform, string, strlen (string))) {
-
-                size = strlen (string) + strlen (device->soc) + 5;
-                ret = malloc (size);
-
-                // E.g. "M1/A14 Bionic (T8101)"
-                snprintf (ret, size, "%s (%s)", string, device->soc);
-                return ret;
-            }
-        }
-    }
-    
-    // E.g. "<string> (Unknown)"
-    size = strlen (string) + 11;
-    ret = malloc (size);
+    if (!string) return NULL;
+
+    device = darwin_device_find (string);
+    soc = (device) ? device->soc : DARWIN_PROPERTY_UNKNOWN;
 
-    snprintf (ret, size, "%s (Unknown)", string);
+    // E.g. "T8101 (A14 Bionic)", or "<string> (Unknown)"
+    size = strlen (string) + strlen (soc) + 4;
+    ret = malloc (size);
+    snprintf (ret, size, "%s (%s)", string, soc);
     return ret;
 }
 
@@ -82,15 +146,20 @@ darwin_detect_firmware_component_kernel (htool_binary_t *bin)
     if (!kern_prelink_info) return HTOOL_RETURN_FAILURE;
 
     /**
-     *  The bh_memmem function, from libhelper, is a fast way of searching a buffer
-     *  for a given string, or 'needle'. If it doesn't exist, then return a failure
-     *  code.
+     *  The banner is only looked for where xnu_kernel_parse_version() reads it from,
+     *  rather than searching the whole file. A Fileset keeps it in the com.apple.kernel
+     *  entry, which is parsed here and reused once the kernel is loaded.
      */
-    char *needle = "Darwin Kernel Version ";
-    unsigned char *uname = (unsigned char *) bh_memmem ((unsigned char *) bin->data, bin->size,
-        (unsigned char *) needle, strlen (needle));
+    macho_t *kern = kern_macho;
+    size_t len;
+
+    if (kern_macho->header->filetype == MACH_TYPE_FILESET) {
+        htool_fileset_index_t *fileset = htool_fileset_index_fetch (kern_macho);
+        kern = htool_fileset_entry_macho (fileset, htool_fileset_index_find (fileset, "com.apple.kernel"));
+        if (!kern) return HTOOL_RETURN_FAILURE;
+    }
 
-    return (uname) ? HTOOL_RETURN_SUCCESS : HTOOL_RETURN_FAILURE;
+    return (xnu_kernel_find_banner (kern_macho, kern, &len)) ? HTOOL_RETURN_SUCCESS : HTOOL_RETURN_FAILURE;
 }
 
 /** TODO: move to iboot.c and rename */
@@ -0,0 +1,286 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libhelper.h>
+
+#include "darwin/dependencies.h"
+#include "darwin/plist.h"
+#include "htool-hash.h"
+
+typedef struct graph_edge_t
+{
+    uint32_t            from;
+    uint32_t            to;
+} graph_edge_t;
+
+typedef struct graph_builder_t
+{
+    xnu_kext_graph_t   *graph;
+    uint32_t            capnodes;
+
+    graph_edge_t       *edges;
+    uint32_t            nedges;
+    uint32_t            capedges;
+} graph_builder_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  The slot for a bundle ID: either the one holding it, or the empty slot it
+ *  would go in. The table is kept at most half full, so there's always one.
+ */
+HTOOL_PRIVATE uint32_t *
+_graph_slot (xnu_kext_graph_t *graph, const char *name, size_t len)
+{
+    for (uint32_t i = htool_hash64 (name, len, 0) & graph->mask;; i = (i + 1) & graph->mask) {
+        uint32_t slot = graph->slots[i];
+        if (!slot) return &graph->slots[i];
+
+        const char *other = graph->nodes[slot - 1].bundle_id;
+        if (!strncmp (other, name, len) && !other[len]) return &graph->slots[i];
+    }
+}
+
+/**
+ *  Double the table. Missing dependencies add nodes the prelink info doesn't
+ *  account for, so it can't be sized once up front.
+ */
+HTOOL_PRIVATE void
+_graph_grow (xnu_kext_graph_t *graph)
+{
+    graph->mask = graph->mask * 2 + 1;
+    free (graph->slots);
+    graph->slots = calloc (graph->mask + 1, sizeof (uint32_t));
+
+    for (uint32_t i = 0; i < graph->nnodes; i++) {
+        const char *name = graph->nodes[i].bundle_id;
+        *_graph_slot (graph, name, strlen (name)) = i + 1;
+    }
+}
+
+HTOOL_PRIVATE uint32_t
+_graph_add_node (graph_builder_t *b, const char *name, size_t len, uint32_t flags)
+{
+    xnu_kext_graph_t *graph = b->graph;
+    uint32_t *slot = _graph_slot (graph, name, len);
+
+    if (*slot) return *slot - 1;
+    if ((graph->nnodes + 1) * 2 > graph->mask + 1) {
+        _graph_grow (graph);
+        slot = _graph_slot (graph, name, len);
+    }
+
+    if (graph->nnodes == b->capnodes) {
+        b->capnodes = (b->capnodes) ? b->capnodes * 2 : 256;
+        graph->nodes = realloc (graph->nodes, b->capnodes * sizeof (xnu_kext_node_t));
+    }
+    graph->nodes[graph->nnodes] = (xnu_kext_node_t) {
+        .bundle_id = strndup (name, len),
+        .kext = XNU_KEXT_GRAPH_NONE,
+        .flags = flags,
+    };
+    *slot = ++graph->nnodes;
+    return graph->nnodes - 1;
+}
+
+HTOOL_PRIVATE void
+_graph_add_edge (graph_builder_t *b, uint32_t from, uint32_t to)
+{
+    if (b->nedges == b->capedges) {
+        b->capedges = (b->capedges) ? b->capedges * 2 : 1024;
+        b->edges = realloc (b->edges, b->capedges * sizeof (graph_edge_t));
+    }
+    b->edges[b->nedges++] = (graph_edge_t) { .from = from, .to = to };
+}
+
+/**
+ *  Lay out edges in CSR form, grouped by `from` when `reverse` is 0, and by `to`
+ *  otherwise. A counting sort keeps each node's edges in the order they were
+ *  listed.
+ */
+HTOOL_PRIVATE void
+_graph_build_csr (const graph_edge_t *edges, uint32_t nedges, uint32_t nnodes, int reverse,
+                  uint32_t **first_out, uint32_t **adj_out)
+{
+    uint32_t *first = calloc (nnodes + 1, sizeof (uint32_t));
+    uint32_t *fill = calloc (nnodes + 1, sizeof (uint32_t));
+    uint32_t *adj = malloc ((nedges ? nedges : 1) * sizeof (uint32_t));
+
+    for (uint32_t i = 0; i < nedges; i++) first[(reverse ? edges[i].to : edges[i].from) + 1]++;
+    for (uint32_t i = 0; i < nnodes; i++) first[i + 1] += first[i];
+    for (uint32_t i = 0; i < nedges; i++) {
+        uint32_t key = reverse ? edges[i].to : edges[i].from;
+        adj[first[key] + fill[key]++] = reverse ? edges[i].from : edges[i].to;
+    }
+
+    free (fill);
+    *first_out = first;
+    *adj_out = adj;
+}
+
+/**
+ *  Kahn's algorithm: a node is ready once all of its dependencies are in the
+ *  order. Anything that never becomes ready is in, or depends on, a cycle.
+ */
+HTOOL_PRIVATE void
+_graph_topological_sort (xnu_kext_graph_t *graph)
+{
+    uint32_t n = graph->nnodes, head = 0;
+    uint32_t *pending = malloc ((n ? n : 1) * sizeof (uint32_t));
+
+    graph->order = malloc ((n ? n : 1) * sizeof (uint32_t));
+    for (uint32_t i = 0; i < n; i++) {
+        pending[i] = graph->deps_first[i + 1] - graph->deps_first[i];
+        if (!pending[i]) graph->order[graph->norder++] = i;
+    }
+
+    /* The order doubles as the queue */
+    while (head < graph->norder) {
+        uint32_t node = graph->order[head++];
+        for (uint32_t e = graph->rdeps_first[node]; e < graph->rdeps_first[node + 1]; e++)
+            if (!--pending[graph->rdeps[e]]) graph->order[graph->norder++] = graph->rdeps[e];
+    }
+    free (pending);
+}
+
+xnu_kext_graph_t *
+xnu_kext_graph_build (xnu_t *xnu)
+{
+    plist_t *plist = xnu_prelink_info_fetch (xnu);
+    xnu_kext_graph_t *graph;
+    graph_builder_t b = { 0 };
+    uint32_t *nodes, nslots = 16;
+
+    if (!plist) return NULL;
+
+    /* Room for every bundle in the prelink info, and some missing ones, before it grows */
+    graph = calloc (1, sizeof (xnu_kext_graph_t));
+    while (nslots < plist->nkexts * 4) nslots <<= 1;
+    graph->slots = calloc (nslots, sizeof (uint32_t));
+    graph->mask = nslots - 1;
+    b.graph = graph;
+
+    /* Every bundle gets its node first, so dependency order doesn't matter */
+    nodes = malloc ((plist->nkexts ? plist->nkexts : 1) * sizeof (uint32_t));
+    for (uint32_t i = 0; i < plist->nkexts; i++) {
+        const plist_dict_t *info = &plist->kexts[i];
+        char *bundle_id = plist_value_copy_string (plist_dict_get (info, "CFBundleIdentifier"));
+        uint32_t count = graph->nnodes, index;
+
+        nodes[i] = XNU_KEXT_GRAPH_NONE;
+        if (!bundle_id) continue;
+
+        /* A repeated bundle ID keeps its first dictionary */
+        index = _graph_add_node (&b, bundle_id, strlen (bundle_id), 0);
+        free (bundle_id);
+        if (graph->nnodes == count) continue;
+
+        xnu_kext_node_t *node = &graph->nodes[index];
+        node->version = plist_value_copy_string (plist_dict_get (info, "CFBundleVersion"));
+        node->kext = xnu_kext_find_index (xnu, node->bundle_id);
+        if (node->kext != XNU_KEXT_GRAPH_NONE && !xnu->kext_array[node->kext]->info)
+            xnu->kext_array[node->kext]->info = info;
+        nodes[i] = index;
+    }
+
+    for (uint32_t i = 0; i < plist->nkexts; i++) {
+        const plist_value_t *libraries = plist_dict_get (&plist->kexts[i], "OSBundleLibraries");
+        plist_dict_t dict = { 0 };
+
+        if (nodes[i] == XNU_KEXT_GRAPH_NONE || !libraries || libraries->type != PLIST_TYPE_DICT) continue;
+        if (plist_value_parse_dict (plist, libraries, &dict) != HTOOL_RETURN_SUCCESS) {
+            warningf ("Could not parse OSBundleLibraries for %s\n", graph->nodes[nodes[i]].bundle_id);
+            continue;
+        }
+        for (uint32_t e = 0; e < dict.nentries; e++) {
+            uint32_t to = _graph_add_node (&b, dict.entries[e].key, dict.entries[e].key_len, XNU_KEXT_NODE_FLAG_MISSING);
+            if (to != nodes[i]) _graph_add_edge (&b, nodes[i], to);
+        }
+        plist_dict_free (&dict);
+    }
+    free (nodes);
+
+    graph->nedges = b.nedges;
+    _graph_build_csr (b.edges, b.nedges, graph->nnodes, 0, &graph->deps_first, &graph->deps);
+    _graph_build_csr (b.edges, b.nedges, graph->nnodes, 1, &graph->rdeps_first, &graph->rdeps);
+    free (b.edges);
+
+    _graph_topological_sort (graph);
+    if (graph->norder != graph->nnodes)
+        warningf ("%u kexts are part of a dependency cycle\n", graph->nnodes - graph->norder);
+    return graph;
+}
+
+void
+xnu_kext_graph_free (xnu_kext_graph_t *graph)
+{
+    if (!graph) return;
+    for (uint32_t i = 0; i < graph->nnodes; i++) {
+        free (graph->nodes[i].bundle_id);
+        free (graph->nodes[i].version);
+    }
+    free (graph->nodes);
+    free (graph->deps_first);
+    free (graph->deps);
+    free (graph->rdeps_first);
+    free (graph->rdeps);
+    free (graph->order);
+    free (graph->slots);
+    free (graph);
+}
+
+uint32_t
+xnu_kext_graph_find (xnu_kext_graph_t *graph, const char *bundle_id)
+{
+    uint32_t slot = *_graph_slot (graph, bundle_id, strlen (bundle_id));
+    return (slot) ? slot - 1 : XNU_KEXT_GRAPH_NONE;
+}
+
+uint32_t
+xnu_kext_graph_closure (xnu_kext_graph_t *graph, uint32_t root, uint32_t **nodes)
+{
+    uint8_t *seen = calloc (graph->nnodes ? graph->nnodes : 1, 1);
+    uint32_t *stack = malloc ((graph->nnodes ? graph->nnodes : 1) * sizeof (uint32_t));
+    uint32_t *out = malloc ((graph->nnodes ? graph->nnodes : 1) * sizeof (uint32_t));
+    uint32_t top = 0, count = 0;
+
+    seen[root] = 1;
+    stack[top++] = root;
+    while (top) {
+        uint32_t node = stack[--top];
+        for (uint32_t e = graph->deps_first[node]; e < graph->deps_first[node + 1]; e++) {
+            if (seen[graph->deps[e]]) continue;
+            seen[graph->deps[e]] = 1;
+            stack[top++] = graph->deps[e];
+        }
+    }
+
+    /* Take them in topological order, then any that are in a cycle */
+    for (uint32_t i = 0; i < graph->norder; i++)
+        if (seen[graph->order[i]] == 1) {
+            out[count++] = graph->order[i];
+            seen[graph->order[i]] = 2;
+        }
+    for (uint32_t i = 0; i < graph->nnodes; i++)
+        if (seen[i] == 1) out[count++] = i;
+
+    free (stack);
+    free (seen);
+    *nodes = out;
+    return count;
+}
@@ -0,0 +1,239 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "htool.h"
+#include "htool-hash.h"
+#include "darwin/diff.h"
+
+/* A segment of the kernel or a kext, and where its hash ends up */
+typedef struct diff_segment_t
+{
+    char                segname[17];
+    uint32_t            range;      /* index into the hash ranges, or UINT32_MAX if empty */
+} diff_segment_t;
+
+/* The kernel, or a kext, on one side of the diff */
+typedef struct diff_image_t
+{
+    const char         *name;
+    const char         *version;
+    const char         *uuid;
+    diff_segment_t     *segments;
+    uint32_t            nsegments;
+} diff_image_t;
+
+typedef struct diff_side_t
+{
+    xnu_t              *xnu;
+    diff_image_t        kernel;
+    diff_image_t       *kexts;      /* same order as xnu->kext_array */
+} diff_side_t;
+
+typedef struct diff_ranges_t
+{
+    htool_hash_range_t *ranges;
+    uint32_t            count;
+    uint32_t            cap;
+} diff_ranges_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Collect the segments of `image`. Their file offsets are relative to `source`.
+ */
+HTOOL_PRIVATE void
+_diff_image_segments (diff_image_t *image, macho_t *image_macho, macho_t *source, diff_ranges_t *ranges)
+{
+    uint32_t n = h_slist_length (image_macho->scmds);
+
+    image->segments = calloc (n ? n : 1, sizeof (diff_segment_t));
+    for (uint32_t i = 0; i < n; i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (image_macho->scmds, i);
+        mach_segment_command_64_t *seg = info->segcmd;
+        diff_segment_t *out;
+
+        if (!strncmp (seg->segname, "__LINKEDIT", 16)) continue;
+
+        out = &image->segments[image->nsegments++];
+        strncpy (out->segname, seg->segname, 16);
+        out->range = UINT32_MAX;
+
+        if (!seg->filesize || seg->fileoff > source->size || seg->filesize > source->size - seg->fileoff)
+            continue;
+
+        if (ranges->count == ranges->cap) {
+            ranges->cap = ranges->cap ? ranges->cap * 2 : 1024;
+            ranges->ranges = realloc (ranges->ranges, ranges->cap * sizeof (htool_hash_range_t));
+        }
+        out->range = ranges->count;
+        ranges->ranges[ranges->count++] = (htool_hash_range_t) {
+            .data = (const unsigned char *) source->data + seg->fileoff,
+            .size = seg->filesize,
+        };
+    }
+}
+
+HTOOL_PRIVATE void
+_diff_side_build (diff_side_t *side, xnu_t *xnu, diff_ranges_t *ranges)
+{
+    macho_t *kern = (xnu->flags & HTOOL_XNU_FLAG_FILESET_ENTRY) ? xnu->kern : xnu->macho;
+
+    side->xnu = xnu;
+    side->kernel.name = "com.apple.kernel";
+    side->kernel.version = (xnu->version) ? xnu->version->xnu_vers : NULL;
+    side->kernel.uuid = mach_load_command_uuid_string_from_macho (kern);
+    _diff_image_segments (&side->kernel, kern, xnu->macho, ranges);
+
+    side->kexts = calloc (xnu->nkexts ? xnu->nkexts : 1, sizeof (diff_image_t));
+    for (uint32_t i = 0; i < xnu->nkexts; i++) {
+        kext_t *kext = xnu->kext_array[i];
+        diff_image_t *image = &side->kexts[i];
+
+        macho_t *macho = xnu_kext_macho (xnu, kext);
+
+        image->name = kext->name;
+        image->version = kext->version;
+        image->uuid = kext->uuid;
+        if (macho) _diff_image_segments (image, macho, xnu_kext_source_macho (xnu, kext), ranges);
+    }
+}
+
+HTOOL_PRIVATE void
+_diff_side_free (diff_side_t *side)
+{
+    free (side->kernel.segments);
+    for (uint32_t i = 0; i < side->xnu->nkexts; i++)
+        free (side->kexts[i].segments);
+    free (side->kexts);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE uint64_t
+_diff_segment_hash (diff_ranges_t *ranges, const diff_segment_t *seg)
+{
+    return (seg->range == UINT32_MAX) ? 0 : ranges->ranges[seg->range].hash;
+}
+
+HTOOL_PRIVATE const diff_segment_t *
+_diff_image_find_segment (const diff_image_t *image, const char *segname)
+{
+    for (uint32_t i = 0; i < image->nsegments; i++)
+        if (!strcmp (image->segments[i].segname, segname)) return &image->segments[i];
+    return NULL;
+}
+
+HTOOL_PRIVATE int
+_diff_str_equal (const char *a, const char *b)
+{
+    if (!a || !b) return a == b;
+    return !strcmp (a, b);
+}
+
+/**
+ *  Compare two versions of an image, printing it if it changed.
+ */
+HTOOL_PRIVATE xnu_diff_status_t
+_diff_image_compare (diff_ranges_t *ranges, const diff_image_t *old, const diff_image_t *new)
+{
+    char changed[512] = { 0 };
+    size_t len = 0;
+
+    /* Segments that changed or went away, then segments that are new */
+    for (uint32_t i = 0; i < old->nsegments; i++) {
+        const diff_segment_t *seg = &old->segments[i];
+        const diff_segment_t *other = _diff_image_find_segment (new, seg->segname);
+
+        if (other && _diff_segment_hash (ranges, seg) == _diff_segment_hash (ranges, other)) continue;
+        if (len < sizeof (changed))
+            len += snprintf (changed + len, sizeof (changed) - len, "%s%s%s", len ? ", " : "", other ? "" : "-", seg->segname);
+    }
+    for (uint32_t i = 0; i < new->nsegments; i++) {
+        if (_diff_image_find_segment (old, new->segments[i].segname)) continue;
+        if (len < sizeof (changed))
+            len += snprintf (changed + len, sizeof (changed) - len, "%s+%s", len ? ", " : "", new->segments[i].segname);
+    }
+
+    if (!len && _diff_str_equal (old->uuid, new->uuid)) return XNU_DIFF_UNCHANGED;
+
+    printf (BOLD YELLOW "  ~ " RESET DARK_WHITE "%s" RESET, old->name);
+    if (!_diff_str_equal (old->version, new->version))
+        printf (DARK_GREY " (%s -> %s)" RESET, old->version ? old->version : "?", new->version ? new->version : "?");
+    printf (DARK_GREY " [%s]\n" RESET, len ? changed : "UUID only");
+    return XNU_DIFF_CHANGED;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_return_t
+xnu_kernel_diff (xnu_t *old, xnu_t *new)
+{
+    diff_ranges_t ranges = { 0 };
+    diff_side_t a = { 0 }, b = { 0 };
+    uint32_t counts[4] = { 0 };
+
+    if (!old->kext_index || !new->kext_index) {
+        errorf ("Both kernelcaches need their kexts parsed before they can be compared\n");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    /* Gather every segment from both sides, so they're all hashed in one parallel pass */
+    _diff_side_build (&a, old, &ranges);
+    _diff_side_build (&b, new, &ranges);
+    htool_hash_ranges (ranges.ranges, ranges.count);
+
+    printf (ANSI_COLOR_GREEN "[*] Kernel:\n" RESET);
+    if (old->version && new->version && !_diff_str_equal (old->version->banner, new->version->banner))
+        printf (DARK_GREY "    %s\n -> %s\n" RESET, old->version->banner, new->version->banner);
+    if (_diff_image_compare (&ranges, &a.kernel, &b.kernel) == XNU_DIFF_UNCHANGED)
+        printf (DARK_GREY "    unchanged\n" RESET);
+
+    /* Walk both sides in bundle ID order so the output is stable */
+    printf (ANSI_COLOR_GREEN "[*] Kernel Extensions:\n" RESET);
+    for (uint32_t i = 0; i < old->kext_index->count; i++) {
+        uint32_t k = old->kext_index->sorted[i];
+        uint32_t j = xnu_kext_find_index (new, old->kext_array[k]->name);
+
+        /* Only the first of any duplicate bundle IDs is compared */
+        if (xnu_kext_find_index (old, old->kext_array[k]->name) != k) continue;
+
+        if (j == UINT32_MAX) {
+            printf (BOLD RED "  - " RESET DARK_WHITE "%s\n" RESET, a.kexts[k].name);
+            counts[XNU_DIFF_REMOVED]++;
+            continue;
+        }
+        counts[_diff_image_compare (&ranges, &a.kexts[k], &b.kexts[j])]++;
+    }
+    for (uint32_t i = 0; i < new->kext_index->count; i++) {
+        uint32_t k = new->kext_index->sorted[i];
+        if (xnu_kext_find_index (old, new->kext_array[k]->name) != UINT32_MAX) continue;
+        if (xnu_kext_find_index (new, new->kext_array[k]->name) != k) continue;
+
+        printf (BOLD ANSI_COLOR_GREEN "  + " RESET DARK_WHITE "%s" DARK_GREY " (%s)\n" RESET, b.kexts[k].name,
+                b.kexts[k].version ? b.kexts[k].version : "?");
+        counts[XNU_DIFF_ADDED]++;
+    }
+
+    printf (ANSI_COLOR_GREEN "[*] %d added, %d removed, %d changed, %d unchanged\n" RESET,
+            counts[XNU_DIFF_ADDED], counts[XNU_DIFF_REMOVED], counts[XNU_DIFF_CHANGED], counts[XNU_DIFF_UNCHANGED]);
+
+    _diff_side_free (&a);
+    _diff_side_free (&b);
+    free (ranges.ranges);
+    return HTOOL_RETURN_SUCCESS;
+}
@@ -0,0 +1,623 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "darwin/iokit.h"
+#include "disassembler/a64.h"
+#include "htool-vmmap.h"
+#include "htool-fixups.h"
+#include "htool-parallel.h"
+
+/* Upper limit on the instructions run for a single initialiser */
+#define IOKIT_MAX_INSTRUCTIONS          0x10000
+
+/* Longest class name that's accepted */
+#define IOKIT_MAX_NAME_LEN              256
+
+/* The vtable pointer stored in an object is past the offset-to-top and RTTI */
+#define IOKIT_VTABLE_HEADER_SIZE        0x10
+
+/* Metaclass vtable slots searched for alloc(), and the instructions run for each */
+#define IOKIT_MAX_ALLOC_SLOTS           32
+#define IOKIT_MAX_ALLOC_INSTRUCTIONS    256
+
+/* How deep alloc()'s calls to the class's constructors are followed */
+#define IOKIT_MAX_CONSTRUCTOR_DEPTH     2
+
+#define IOKIT_SLOT_NONE                 UINT32_MAX
+
+/**
+ *  A call made by an initialiser with a metaclass-looking `this` in x0 and a class
+ *  name in x1. Only the calls to the constructor end up as classes.
+ */
+typedef struct iokit_call_t
+{
+    uint64_t            target;
+    uint64_t            metaclass;
+    uint64_t            name;
+    uint64_t            super_metaclass;
+    uint64_t            metaclass_vtable;
+    uint32_t            size;
+    uint32_t            kext;
+} iokit_call_t;
+
+typedef struct iokit_calls_t
+{
+    iokit_call_t       *items;
+    uint32_t            count;
+    uint32_t            cap;
+} iokit_calls_t;
+
+typedef struct iokit_job_t
+{
+    xnu_t              *xnu;
+    macho_t            *source;         /* every address is translated through this image */
+    htool_vmmap_t      *vmmap;
+    htool_fixups_t     *fixups;
+
+    /* One list for each kext, and one more for the kernel if it isn't a kext */
+    iokit_calls_t      *calls;
+    uint32_t            nimages;
+
+    /* The metaclass vtable slot each class's alloc() was found in, see _iokit_vtable_worker() */
+    xnu_iokit_classes_t *classes;
+    uint32_t           *alloc_slots;
+} iokit_job_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE const unsigned char *
+_iokit_read (iokit_job_t *job, uint64_t vmaddr, uint64_t size)
+{
+    uint64_t offset;
+
+    if (!htool_vmmap_vmaddr_to_offset (job->vmmap, vmaddr, &offset)) return NULL;
+    if (offset + size > job->source->size) return NULL;
+    return job->source->data + offset;
+}
+
+HTOOL_PRIVATE int
+_iokit_read_pointer (iokit_job_t *job, uint64_t vmaddr, uint64_t *value)
+{
+    const unsigned char *p = _iokit_read (job, vmaddr, sizeof (uint64_t));
+    uint64_t raw;
+
+    if (!p) return 0;
+    memcpy (&raw, p, sizeof (raw));
+    *value = htool_fixups_resolve (job->fixups, vmaddr, raw);
+    return 1;
+}
+
+HTOOL_PRIVATE int
+_iokit_read_opcode (iokit_job_t *job, uint64_t vmaddr, uint32_t *opcode)
+{
+    const unsigned char *p = _iokit_read (job, vmaddr, sizeof (uint32_t));
+    if (!p) return 0;
+    memcpy (opcode, p, sizeof (uint32_t));
+    return 1;
+}
+
+/**
+ *  Whether `vmaddr` points at something that could be a class name: a short,
+ *  NUL-terminated C++ identifier.
+ */
+HTOOL_PRIVATE const char *
+_iokit_class_name (iokit_job_t *job, uint64_t vmaddr)
+{
+    const char *name = (const char *) _iokit_read (job, vmaddr, 1);
+    uint64_t offset;
+
+    if (!name || !htool_vmmap_vmaddr_to_offset (job->vmmap, vmaddr, &offset)) return NULL;
+
+    for (uint64_t i = 0; i < IOKIT_MAX_NAME_LEN && offset + i < job->source->size; i++) {
+        char c = name[i];
+        if (!c) return (i) ? name : NULL;
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == ':'))
+            return NULL;
+    }
+    return NULL;
+}
+
+/**
+ *  Calls from a fileset kext to the kernel go through a stub that loads the real
+ *  address from the kext's GOT:
+ *
+ *      adrp    x16, GOT@PAGE
+ *      ldr     x16, [x16, GOT@PAGEOFF]
+ *      br      x16                         (or braa x16, x17)
+ *
+ *  Follow it, so every kext's calls to the constructor end up at the same place.
+ */
+HTOOL_PRIVATE uint64_t
+_iokit_resolve_stub (iokit_job_t *job, uint64_t target)
+{
+    uint32_t adrp, ldr;
+    uint64_t page, offset, resolved;
+    unsigned rd, rt, rn;
+
+    if (!_iokit_read_opcode (job, target, &adrp) || !_iokit_read_opcode (job, target + 4, &ldr)) return target;
+    if (!a64_decode_adrp (adrp, target, &rd, &page) || rd != 16) return target;
+    if (!a64_decode_ldr_imm (ldr, &rt, &rn, &offset) || rt != 16 || rn != 16 || !(ldr & 0x40000000)) return target;
+
+    return (_iokit_read_pointer (job, page + offset, &resolved)) ? resolved : target;
+}
+
+/**
+ *  Track the address built by an ADRP, ADR, MOVZ, ADD, pointer load or MOV. Returns
+ *  0 for any other instruction, which is left to the caller.
+ */
+HTOOL_PRIVATE int
+_iokit_track (iokit_job_t *job, a64_regs_t *regs, uint32_t opcode, uint64_t pc)
+{
+    uint64_t value, target;
+    unsigned rd, rn;
+
+    if (a64_decode_adrp (opcode, pc, &rd, &value) || a64_decode_adr (opcode, pc, &rd, &value) ||
+        a64_decode_movz (opcode, &rd, &value)) {
+        a64_regs_set (regs, rd, value);
+
+    } else if (a64_decode_add_imm (opcode, &rd, &rn, &value)) {
+        if (rn != 31 && a64_regs_valid (regs, rn)) a64_regs_set (regs, rd, regs->x[rn] + value);
+        else a64_regs_clear (regs, rd);
+
+    } else if (a64_decode_ldr_imm (opcode, &rd, &rn, &value)) {
+        /* Only pointer loads from the image, e.g. a superclass from the GOT */
+        if ((opcode & 0x40000000) && rn != 31 && a64_regs_valid (regs, rn) && _iokit_read_pointer (job, regs->x[rn] + value, &target))
+            a64_regs_set (regs, rd, target);
+        else
+            a64_regs_clear (regs, rd);
+
+    } else if (a64_decode_ldr_literal (opcode, pc, &rd, &value)) {
+        if ((opcode & 0x40000000) && _iokit_read_pointer (job, value, &target)) a64_regs_set (regs, rd, target);
+        else a64_regs_clear (regs, rd);
+
+    } else if (a64_decode_mov_reg (opcode, &rd, &rn)) {
+        if (rn != 31 && a64_regs_valid (regs, rn)) a64_regs_set (regs, rd, regs->x[rn]);
+        else a64_regs_clear (regs, rd);
+
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+HTOOL_PRIVATE void
+_iokit_calls_push (iokit_calls_t *calls, iokit_call_t *call)
+{
+    if (calls->count == calls->cap) {
+        calls->cap = (calls->cap) ? calls->cap * 2 : 64;
+        calls->items = realloc (calls->items, calls->cap * sizeof (iokit_call_t));
+    }
+    calls->items[calls->count++] = *call;
+}
+
+/**
+ *  Run an initialiser from `pc` to its first return, tracking the addresses built
+ *  in registers, and collect every call that passes a class name in x1.
+ */
+HTOOL_PRIVATE void
+_iokit_run_initialiser (iokit_job_t *job, uint32_t kext, uint64_t pc, iokit_calls_t *calls)
+{
+    a64_regs_t regs = { 0 };
+    int64_t pending = -1;       /* the last call, until its vtable is stored */
+
+    for (uint32_t n = 0; n < IOKIT_MAX_INSTRUCTIONS; n++, pc += 4) {
+        uint64_t value, target;
+        unsigned rd, rn;
+        uint32_t opcode;
+
+        if (!_iokit_read_opcode (job, pc, &opcode)) break;
+        if (_iokit_track (job, &regs, opcode, pc)) continue;
+
+        if (a64_decode_str_imm (opcode, &rd, &rn, &value)) {
+            /* The first pointer stored at the start of the metaclass is its vtable */
+            iokit_call_t *call = (pending >= 0) ? &calls->items[pending] : NULL;
+            if (call && !value && rn != 31 && a64_regs_valid (&regs, rn) && a64_regs_valid (&regs, rd) && regs.x[rn] == call->metaclass) {
+                call->metaclass_vtable = regs.x[rd] - IOKIT_VTABLE_HEADER_SIZE;
+                pending = -1;
+            }
+
+        } else if (!a64_is_pac_in_place (opcode)) {
+            a64_flow_t flow = a64_classify_flow (opcode, pc, &target);
+
+            if (flow == A64_FLOW_CALL) {
+                uint64_t x0 = regs.x[0];
+                int x0_valid = a64_regs_valid (&regs, 0);
+
+                pending = -1;
+                if (x0_valid && a64_regs_valid (&regs, 1) && _iokit_class_name (job, regs.x[1])) {
+                    iokit_call_t call = {
+                        .target = _iokit_resolve_stub (job, target),
+                        .metaclass = x0,
+                        .name = regs.x[1],
+                        .super_metaclass = a64_regs_valid (&regs, 2) ? regs.x[2] : 0,
+                        .size = a64_regs_valid (&regs, 3) ? (uint32_t) regs.x[3] : 0,
+                        .kext = kext,
+                    };
+                    _iokit_calls_push (calls, &call);
+                    pending = calls->count - 1;
+                }
+
+                /* Constructors return `this` */
+                regs.valid &= ~A64_CALLER_SAVED_MASK;
+                if (x0_valid) a64_regs_set (&regs, 0, x0);
+
+            } else if (!a64_flow_falls_through (flow)) {
+                break;
+
+            } else {
+                a64_regs_clobber (&regs, opcode, flow);
+            }
+        }
+    }
+}
+
+HTOOL_PRIVATE void
+_iokit_image_worker (void *ctx, uint32_t index)
+{
+    iokit_job_t *job = (iokit_job_t *) ctx;
+    uint32_t kext = (index < job->xnu->nkexts) ? index : XNU_IOKIT_CLASS_NONE;
+    macho_t *macho = (kext != XNU_IOKIT_CLASS_NONE) ? xnu_kext_macho (job->xnu, job->xnu->kext_array[kext]) : job->source;
+
+    if (!macho) return;
+
+    /* Every initialiser pointer, in __mod_init_func or, on newer kernels, __kmod_init */
+    for (int i = 0; i < h_slist_length (macho->scmds); i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, i);
+
+        for (int j = 0; j < h_slist_length (info->sections); j++) {
+            mach_section_64_t *sect = (mach_section_64_t *) h_slist_nth_data (info->sections, j);
+            if (strncmp (sect->sectname, "__mod_init_func", 16) && strncmp (sect->sectname, "__kmod_init", 16)) continue;
+
+            for (uint64_t off = 0; off + sizeof (uint64_t) <= sect->size; off += sizeof (uint64_t)) {
+                uint64_t init;
+                if (_iokit_read_pointer (job, sect->addr + off, &init) && init)
+                    _iokit_run_initialiser (job, kext, init, &job->calls[index]);
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Run a function with the new object in the registers of `object`, and find the
+ *  vtable stored at its start. alloc() is run with no object, and the object is
+ *  whatever its first call (operator new) returns.
+ *
+ *  Calls made with the object in x0 are followed, in case the constructor isn't
+ *  inlined. A constructor calls its superclass's constructor, which stores the
+ *  superclass's vtable, before it stores its own, so the last store at the
+ *  shallowest depth is the class's vtable.
+ */
+HTOOL_PRIVATE uint64_t
+_iokit_run_constructor (iokit_job_t *job, uint64_t pc, uint32_t object, int depth)
+{
+    a64_regs_t regs = { 0 };
+    uint64_t vtable = 0, nested = 0;
+    int allocated = (object != 0);
+
+    for (uint32_t n = 0; n < IOKIT_MAX_ALLOC_INSTRUCTIONS; n++, pc += 4) {
+        uint64_t offset, target;
+        unsigned rt, rn;
+        uint32_t opcode;
+
+        if (!_iokit_read_opcode (job, pc, &opcode)) break;
+
+        if (a64_decode_mov_reg (opcode, &rt, &rn)) {
+            object = (object & ~(1u << rt)) | (((object >> rn) & 1) << rt);
+            _iokit_track (job, &regs, opcode, pc);
+            continue;
+        }
+        if (_iokit_track (job, &regs, opcode, pc)) {
+            object &= ~a64_written_registers (opcode);
+            continue;
+        }
+        if (a64_decode_str_imm (opcode, &rt, &rn, &offset)) {
+            if (!offset && ((object >> rn) & 1) && a64_regs_valid (&regs, rt) && regs.x[rt] > IOKIT_VTABLE_HEADER_SIZE &&
+                _iokit_read (job, regs.x[rt], sizeof (uint64_t)))
+                vtable = regs.x[rt] - IOKIT_VTABLE_HEADER_SIZE;
+            continue;
+        }
+        if (a64_is_pac_in_place (opcode)) continue;
+
+        a64_flow_t flow = a64_classify_flow (opcode, pc, &target);
+
+        /* A call, or tail call, that's given the object */
+        if ((flow == A64_FLOW_CALL || flow == A64_FLOW_BRANCH) && (object & 1) && !nested && depth < IOKIT_MAX_CONSTRUCTOR_DEPTH)
+            nested = _iokit_run_constructor (job, _iokit_resolve_stub (job, target), 1, depth + 1);
+
+        if (flow == A64_FLOW_CALL || flow == A64_FLOW_CALL_INDIRECT) {
+            /* operator new returns the object, and constructors return `this` */
+            object = (!allocated || (object & 1)) ? ((object & ~A64_CALLER_SAVED_MASK) | 1) : (object & ~A64_CALLER_SAVED_MASK);
+            allocated = 1;
+        } else if (!a64_flow_falls_through (flow)) {
+            break;
+        } else {
+            object &= ~a64_written_registers (opcode);
+        }
+        a64_regs_clobber (&regs, opcode, flow);
+    }
+    return (vtable) ? vtable : nested;
+}
+
+/**
+ *  Find alloc() in a class's metaclass vtable, and the class's own vtable from
+ *  the object it constructs. Every class's MetaClass overrides alloc(), so it's
+ *  in the same slot for all of them. Each class records the first slot it finds
+ *  one in, and the slot most of them agree on is used in the end.
+ */
+HTOOL_PRIVATE uint64_t
+_iokit_class_vtable (iokit_job_t *job, xnu_iokit_class_t *class, uint32_t first, uint32_t last, uint32_t *slot)
+{
+    *slot = IOKIT_SLOT_NONE;
+    if (!class->metaclass_vtable) return 0;
+
+    for (uint32_t s = first; s < last; s++) {
+        uint64_t alloc, vtable;
+
+        if (!_iokit_read_pointer (job, class->metaclass_vtable + IOKIT_VTABLE_HEADER_SIZE + s * sizeof (uint64_t), &alloc)) break;
+        if (alloc && (vtable = _iokit_run_constructor (job, alloc, 0, 0))) {
+            *slot = s;
+            return vtable;
+        }
+    }
+    return 0;
+}
+
+HTOOL_PRIVATE void
+_iokit_vtable_worker (void *ctx, uint32_t index)
+{
+    iokit_job_t *job = (iokit_job_t *) ctx;
+    xnu_iokit_class_t *class = &job->classes->classes[index];
+
+    class->vtable = _iokit_class_vtable (job, class, 0, IOKIT_MAX_ALLOC_SLOTS, &job->alloc_slots[index]);
+}
+
+HTOOL_PRIVATE void
+_iokit_find_vtables (iokit_job_t *job, xnu_iokit_classes_t *classes)
+{
+    uint32_t *votes = calloc (IOKIT_MAX_ALLOC_SLOTS, sizeof (uint32_t)), best = 0, slot;
+
+    job->classes = classes;
+    job->alloc_slots = malloc ((classes->nclasses ? classes->nclasses : 1) * sizeof (uint32_t));
+    htool_parallel_for (classes->nclasses, _iokit_vtable_worker, job);
+
+    for (uint32_t i = 0; i < classes->nclasses; i++)
+        if (job->alloc_slots[i] != IOKIT_SLOT_NONE) votes[job->alloc_slots[i]]++;
+    for (uint32_t s = 1; s < IOKIT_MAX_ALLOC_SLOTS; s++)
+        if (votes[s] > votes[best]) best = s;
+
+    /* Anything found in another slot wasn't alloc(), so only trust alloc()'s slot */
+    for (uint32_t i = 0; i < classes->nclasses; i++)
+        if (job->alloc_slots[i] != IOKIT_SLOT_NONE && job->alloc_slots[i] != best)
+            classes->classes[i].vtable = _iokit_class_vtable (job, &classes->classes[i], best, best + 1, &slot);
+
+    free (job->alloc_slots);
+    free (votes);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE int
+_iokit_u64_compare (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+HTOOL_PRIVATE int
+_iokit_class_compare (const void *a, const void *b)
+{
+    const xnu_iokit_class_t *ca = a, *cb = b;
+    return (ca->metaclass > cb->metaclass) - (ca->metaclass < cb->metaclass);
+}
+
+/**
+ *  The constructor is the function called with a class name the most. Anything
+ *  else that happens to take a string in x1 is called far less.
+ */
+HTOOL_PRIVATE uint64_t
+_iokit_find_constructor (iokit_calls_t *calls, uint32_t nimages)
+{
+    uint64_t *targets, best = 0, total = 0;
+    uint32_t n = 0, best_count = 0;
+
+    for (uint32_t i = 0; i < nimages; i++) total += calls[i].count;
+    if (!total) return 0;
+
+    targets = malloc (total * sizeof (uint64_t));
+    for (uint32_t i = 0; i < nimages; i++)
+        for (uint32_t j = 0; j < calls[i].count; j++) targets[n++] = calls[i].items[j].target;
+    qsort (targets, n, sizeof (uint64_t), _iokit_u64_compare);
+
+    for (uint32_t i = 0, run; i < n; i += run) {
+        for (run = 1; i + run < n && targets[i + run] == targets[i]; run++);
+        if (run > best_count) {
+            best = targets[i];
+            best_count = run;
+        }
+    }
+
+    free (targets);
+    return best;
+}
+
+HTOOL_PRIVATE uint32_t
+_iokit_find_metaclass (xnu_iokit_classes_t *classes, uint64_t metaclass)
+{
+    uint32_t lo = 0, hi = classes->nclasses;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (classes->classes[mid].metaclass < metaclass) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < classes->nclasses && classes->classes[lo].metaclass == metaclass) ? lo : XNU_IOKIT_CLASS_NONE;
+}
+
+xnu_iokit_classes_t *
+xnu_iokit_classes_recover (xnu_t *xnu)
+{
+    xnu_iokit_classes_t *classes = calloc (1, sizeof (xnu_iokit_classes_t));
+    int fileset = (xnu->macho->header->filetype == MACH_TYPE_FILESET);
+    iokit_job_t job = { .xnu = xnu };
+    uint32_t cap = 0;
+
+    /**
+     *  Fileset kexts are addressed through the whole fileset, and the kernel is one of
+     *  the entries. Otherwise, everything is in the kernel's own image, and the kernel
+     *  is run as an extra image after the kexts.
+     */
+    job.source = (fileset || !(xnu->flags & HTOOL_XNU_FLAG_FILESET_ENTRY)) ? xnu->macho : xnu->kern;
+    job.nimages = xnu->nkexts + (fileset ? 0 : 1);
+    job.calls = calloc (job.nimages ? job.nimages : 1, sizeof (iokit_calls_t));
+
+    /* Build the shared maps before the workers start */
+    job.vmmap = htool_vmmap_fetch (job.source);
+    job.fixups = htool_fixups_fetch (job.source);
+
+    htool_parallel_for (job.nimages, _iokit_image_worker, &job);
+
+    /* Only the constructor calls are classes. Kexts can repeat a class, keep the first */
+    classes->constructor = _iokit_find_constructor (job.calls, job.nimages);
+    for (uint32_t i = 0; i < job.nimages; i++) {
+        for (uint32_t j = 0; classes->constructor && j < job.calls[i].count; j++) {
+            iokit_call_t *call = &job.calls[i].items[j];
+            if (call->target != classes->constructor) continue;
+
+            if (classes->nclasses == cap) {
+                cap = (cap) ? cap * 2 : 256;
+                classes->classes = realloc (classes->classes, cap * sizeof (xnu_iokit_class_t));
+            }
+
+            classes->classes[classes->nclasses++] = (xnu_iokit_class_t) {
+                .name = _iokit_class_name (&job, call->name),
+                .metaclass = call->metaclass,
+                .super_metaclass = call->super_metaclass,
+                .metaclass_vtable = call->metaclass_vtable,
+                .size = call->size,
+                .kext = call->kext,
+            };
+        }
+        free (job.calls[i].items);
+    }
+    free (job.calls);
+
+    qsort (classes->classes, classes->nclasses, sizeof (xnu_iokit_class_t), _iokit_class_compare);
+
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < classes->nclasses; i++)
+        if (!n || classes->classes[i].metaclass != classes->classes[n - 1].metaclass)
+            classes->classes[n++] = classes->classes[i];
+    classes->nclasses = n;
+
+    for (uint32_t i = 0; i < classes->nclasses; i++)
+        classes->classes[i].superclass = _iokit_find_metaclass (classes, classes->classes[i].super_metaclass);
+
+    _iokit_find_vtables (&job, classes);
+    return classes;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct iokit_print_ctx_t
+{
+    xnu_t                  *xnu;
+    xnu_iokit_classes_t    *classes;
+    uint32_t               *children;       /* CSR: children of class i are children[first[i] .. first[i + 1]) */
+    uint32_t               *first;
+} iokit_print_ctx_t;
+
+typedef struct iokit_name_key_t
+{
+    const char         *name;
+    uint32_t            index;
+} iokit_name_key_t;
+
+HTOOL_PRIVATE int
+_iokit_name_compare (const void *a, const void *b)
+{
+    return strcmp (((const iokit_name_key_t *) a)->name, ((const iokit_name_key_t *) b)->name);
+}
+
+HTOOL_PRIVATE void
+_iokit_print_class (iokit_print_ctx_t *ctx, uint32_t index, int depth)
+{
+    xnu_iokit_class_t *class = &ctx->classes->classes[index];
+    const char *owner = (class->kext == XNU_IOKIT_CLASS_NONE) ? "kernel" : ctx->xnu->kext_array[class->kext]->name;
+
+    printf ("%*s" BOLD DARK_WHITE "%s" RESET DARK_GREY " (size: 0x%x, vtable: 0x%llx, metaclass vtable: 0x%llx, %s)" RESET,
+            depth * 2, "", class->name, class->size, class->vtable, class->metaclass_vtable, owner);
+    if (class->superclass == XNU_IOKIT_CLASS_NONE && class->super_metaclass)
+        printf (YELLOW " [superclass 0x%llx not found]" RESET, class->super_metaclass);
+    printf ("\n");
+
+    for (uint32_t i = ctx->first[index]; i < ctx->first[index + 1]; i++)
+        _iokit_print_class (ctx, ctx->children[i], depth + 1);
+}
+
+void
+xnu_iokit_classes_print (xnu_t *xnu, xnu_iokit_classes_t *classes)
+{
+    uint32_t n = classes->nclasses, *fill;
+    iokit_name_key_t *order;
+    iokit_print_ctx_t ctx = { .xnu = xnu, .classes = classes };
+
+    if (!classes->constructor) {
+        warningf ("Could not find OSMetaClass::OSMetaClass\n");
+        return;
+    }
+    printf (BOLD RED "[*] IOKit Classes:" RESET DARK_GREY " %d (OSMetaClass::OSMetaClass at 0x%llx)\n" RESET,
+            n, classes->constructor);
+
+    /* Sort by name, so each class's children come out in name order */
+    order = malloc ((n ? n : 1) * sizeof (iokit_name_key_t));
+    for (uint32_t i = 0; i < n; i++) order[i] = (iokit_name_key_t) { .name = classes->classes[i].name, .index = i };
+    qsort (order, n, sizeof (iokit_name_key_t), _iokit_name_compare);
+
+    ctx.first = calloc (n + 1, sizeof (uint32_t));
+    ctx.children = malloc ((n ? n : 1) * sizeof (uint32_t));
+    fill = calloc (n + 1, sizeof (uint32_t));
+
+    for (uint32_t i = 0; i < n; i++)
+        if (classes->classes[i].superclass != XNU_IOKIT_CLASS_NONE) ctx.first[classes->classes[i].superclass + 1]++;
+    for (uint32_t i = 0; i < n; i++) ctx.first[i + 1] += ctx.first[i];
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t c = order[i].index, parent = classes->classes[c].superclass;
+        if (parent != XNU_IOKIT_CLASS_NONE) ctx.children[ctx.first[parent] + fill[parent]++] = c;
+    }
+
+    /* A class that's its own ancestor would never be reached from a root, and is dropped */
+    for (uint32_t i = 0; i < n; i++)
+        if (classes->classes[order[i].index].superclass == XNU_IOKIT_CLASS_NONE) _iokit_print_class (&ctx, order[i].index, 0);
+
+    free (fill);
+    free (ctx.children);
+    free (ctx.first);
+    free (order);
+}
+
+void
+xnu_iokit_classes_free (xnu_iokit_classes_t *classes)
+{
+    if (!classes) return;
+    free (classes->classes);
+    free (classes);
+}
@@ -14,6 +14,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "darwin/kernel.h"
+#include "htool-fileset.h"
 
 /***********************************************************************
 * XNU Cache version, build style, and other properties.
@@ -38,17 +39,14 @@ xnu_kernel_fetch_type (xnu_t *xnu)
      */
     tmp_macho = xnu->macho;
     if (xnu->macho->header->filetype == MACH_TYPE_FILESET) {
-        for (int i = 0; i < h_slist_length (xnu->macho->fileset); i++) {
-            mach_fileset_entry_info_t *info = (mach_fileset_entry_info_t *) h_slist_nth_data (xnu->macho->fileset, i);
-            char *entry_name = mach_load_command_load_string (xnu->macho, info->cmd->cmdsize, 
-                sizeof (mach_fileset_entry_command_t), info->offset, info->cmd->entry_id.offset);
-
-            if (!strcmp (entry_name, "com.apple.kernel")) {
-                xnu->kern = info->macho;
-                xnu->flags |= HTOOL_XNU_FLAG_FILESET_ENTRY;
-                tmp_macho = xnu->kern;
-                break;
-            }
+        htool_fileset_index_t *fileset = htool_fileset_index_fetch (xnu->macho);
+        macho_t *kern = htool_fileset_entry_macho (fileset, htool_fileset_index_find (fileset, "com.apple.kernel"));
+
+        /* Only the kernel's entry is parsed here, the kexts are left until they're used */
+        if (kern) {
+            xnu->kern = kern;
+            xnu->flags |= HTOOL_XNU_FLAG_FILESET_ENTRY;
+            tmp_macho = xnu->kern;
         }
     }
 
@@ -188,106 +186,127 @@ xnu_kernel_type_get_string (xnu_kernel_type_t type)
 char *
 xnu_kernel_soc_string (char *buffer)
 {
-    darwin_device_t *dev;
-    HSList *matches = NULL;
-
-    /* Iterate through the entire device database until a platform match */
-    for (int i = 0; i < DARWIN_DEVICE_LIST_LEN; i++) {
-        dev = &device_list[i];
-        if (!strcmp (buffer, dev->platform)) {
-            matches = h_slist_append (matches, dev);
-        }
-    }
+    const darwin_device_t *dev;
 
-    darwin_device_t *ret = (darwin_device_t *) h_slist_nth_data (matches, 0);
-    return ret->platform;
+    if (!buffer) return NULL;
+    dev = darwin_device_lookup (DARWIN_DEVICE_KEY_PLATFORM, buffer, strlen (buffer));
+    return (dev) ? dev->platform : NULL;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 
-char *
-xnu_search_needle_haystack (unsigned char *needle, uint32_t needle_len, unsigned char *haystack, uint32_t size, char *split, uint32_t adjust)
-{
-    char *result;
-    char *ret;
-    
-    result = (char *) bh_memmem (haystack, size, needle, needle_len) + adjust;
-    if (!result) return NULL;
-
-    if (split) {
-        if ((ret = (char *) strsplit (result, split)->ptrs[0]))
-            return ret;
-    }
-    
-    return result;
-}
+#define XNU_BANNER_PREFIX           "Darwin Kernel Version "
 
-char *
-xnu_find_uname_string (unsigned char *data, uint32_t size)
+/**
+ * \brief   Find the version banner in one section of the kernel. The section offsets
+ *          are relative to the file that was loaded, which for a fileset entry is the
+ *          whole fileset.
+ */
+static const char *
+_xnu_find_banner_in_section (macho_t *file, macho_t *kern, const char *segname, const char *sectname, size_t *len)
 {
-    char *needle = "Darwin Kernel Version ";
-    return xnu_search_needle_haystack (needle, strlen (needle), data, size, NULL, 0);   
-}
+    mach_section_64_t *sect = mach_section_64_search (kern->scmds, (char *) segname, (char *) sectname);
+    const char *start, *banner, *end;
 
-char *
-xnu_find_darwin_version (unsigned char *data, uint32_t size)
-{
-    char *needle = "Version ";
-    return xnu_search_needle_haystack (needle, 6, data, size, ":", 8);
+    if (!sect || !sect->offset || sect->offset > file->size || sect->size > file->size - sect->offset)
+        return NULL;
+
+    start = (const char *) file->data + sect->offset;
+    banner = (const char *) bh_memmem ((unsigned char *) start, sect->size,
+                                       (unsigned char *) XNU_BANNER_PREFIX, strlen (XNU_BANNER_PREFIX));
+    if (!banner) return NULL;
+
+    /* The banner ends at its NUL, or the end of the section if that's missing */
+    end = memchr (banner, '\0', (start + sect->size) - banner);
+    *len = (end ? end : start + sect->size) - banner;
+    return banner;
 }
 
-char *
-xnu_find_xnu_version (unsigned char *data, uint32_t size)
+const char *
+xnu_kernel_find_banner (macho_t *file, macho_t *kern, size_t *len)
 {
-    char *needle = "; root: ";
-    return xnu_search_needle_haystack (needle, 6, data, size, "/", 7);
+    const char *banner;
+
+    /* Newer kernels keep `version[]` in __const, older ones in __cstring */
+    if ((banner = _xnu_find_banner_in_section (file, kern, "__TEXT", "__const", len)))
+        return banner;
+    return _xnu_find_banner_in_section (file, kern, "__TEXT", "__cstring", len);
 }
 
-char *
-xnu_find_build_time (unsigned char *data, uint32_t size)
+static char *
+_xnu_version_field (const char *start, const char *end)
 {
-    char *needle = xnu_find_darwin_version (data, size);
-    return xnu_search_needle_haystack (needle, 6, data, size, ";", 8);
+    while (start < end && *start == ' ') start++;
+    while (end > start && end[-1] == ' ') end--;
+    return (end > start) ? strndup (start, end - start) : NULL;
 }
 
-char *
-xnu_find_device_type (unsigned char *data, uint32_t size)
+xnu_version_t *
+xnu_kernel_parse_version (xnu_t *xnu)
 {
-    char *device, *brand, *ret;
+    macho_t *kern = (xnu->flags & HTOOL_XNU_FLAG_FILESET_ENTRY) ? xnu->kern : xnu->macho;
+    xnu_version_t *version = calloc (1, sizeof (xnu_version_t));
+    const char *banner, *p, *end, *colon = NULL, *semi = NULL, *root = NULL, *slash = NULL;
+    size_t len = 0;
 
-    /* Grab the part of the string after "ARM64_" */
-    device = (char *) strstr ((char *) data, "ARM64_");
+    version->cache_style = xnu_kernel_type_get_string (xnu->type);
+
+    if (!(banner = xnu_kernel_find_banner (xnu->macho, kern, &len))) {
+        warningf ("Could not find the kernel version banner\n");
+        return version;
+    }
+    end = banner + len;
+    version->banner = strndup (banner, len);
 
     /**
-     *  If the device does not have a value, it's possible this is an x86
-     *  kernel, and therefore would use the x86_64 tag.
+     *  A single pass over the banner finds each separator, and the version numbers
+     *  are read on the way past.
      */
-    if (!device) {
-        if ((char *) strstr ((char *) data, "X86_64"))
-            return "x86_64";
+    p = banner + strlen (XNU_BANNER_PREFIX);
+    for (uint32_t *num = &version->major; p < end && *p != ':'; p++) {
+        if (*p >= '0' && *p <= '9') *num = *num * 10 + (*p - '0');
+        else if (*p == '.' && num < &version->patch) num++;
+    }
+    for (; p < end; p++) {
+        if (*p == ':' && !colon) colon = p;
+        else if (*p == ';' && colon && !semi) semi = p;
+        else if (*p == ':' && semi && !root) root = p;
+        else if (*p == '/' && root && !slash) slash = p;
     }
 
-    /* Load the cpu brand string from the device string */
-    brand = xnu_kernel_soc_string (device + 6);
-
-    /* Make sure the brand has a value, return NULL otherwise */
-    if (!brand) return NULL;
+    if (colon) version->darwin_vers = _xnu_version_field (banner + strlen (XNU_BANNER_PREFIX), colon);
+    if (colon && semi) version->build_time = _xnu_version_field (colon + 1, semi);
+    if (root) version->xnu_vers = _xnu_version_field (root + 1, slash ? slash : end);
+    if (slash) version->build_tag = _xnu_version_field (slash + 1, end);
 
-    //debug
-    ret = darwin_get_device_from_string (brand);
-    return (ret) ? ret : NULL;
-}  
+    /**
+     *  The build tag ends in the SoC for arm64 kernels, e.g. RELEASE_ARM64_T8110, whereas
+     *  Intel kernels are just RELEASE_X86_64.
+     */
+    if (version->build_tag) {
+        char *arm64 = strstr (version->build_tag, "ARM64_");
+        if (arm64 && arm64[6]) {
+            version->soc = strdup (arm64 + 6);
+            version->device_type = darwin_get_device_from_string (version->soc);
+        } else if (strstr (version->build_tag, "X86_64")) {
+            version->device_type = "x86_64";
+        }
+    }
+    return version;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 
+#define XNU_VERSION_STR(s)          ((s) ? (s) : "Unknown")
+
 void xnu_version_info_print (xnu_t *xnu, char *padding)
 {
     xnu_version_t *version = xnu->version;
-    printf ( BOLD DARK_WHITE "%sDarwin Version:  " RESET DARK_GREY "%s\n" RESET, padding, version->darwin_vers);
-    printf ( BOLD DARK_WHITE "%sXNU Version:     " RESET DARK_GREY "%s\n" RESET, padding, version->xnu_vers);
-    printf ( BOLD DARK_WHITE "%sCompile Time:    " RESET DARK_GREY "%s\n" RESET, padding, version->build_time);
-    printf ( BOLD DARK_WHITE "%sDevice Type:     " RESET DARK_GREY "%s\n" RESET, padding, version->device_type);
-    printf ( BOLD DARK_WHITE "%sXNU Type:        " RESET DARK_GREY "%s\n" RESET, padding, version->cache_style);
+    printf ( BOLD DARK_WHITE "%sDarwin Version:  " RESET DARK_GREY "%s\n" RESET, padding, XNU_VERSION_STR (version->darwin_vers));
+    printf ( BOLD DARK_WHITE "%sXNU Version:     " RESET DARK_GREY "%s\n" RESET, padding, XNU_VERSION_STR (version->xnu_vers));
+    printf ( BOLD DARK_WHITE "%sCompile Time:    " RESET DARK_GREY "%s\n" RESET, padding, XNU_VERSION_STR (version->build_time));
+    printf ( BOLD DARK_WHITE "%sDevice Type:     " RESET DARK_GREY "%s\n" RESET, padding, XNU_VERSION_STR (version->device_type));
+    printf ( BOLD DARK_WHITE "%sXNU Type:        " RESET DARK_GREY "%s\n" RESET, padding, XNU_VERSION_STR (version->cache_style));
 
     if (xnu->flags & HTOOL_XNU_FLAG_FILESET_ENTRY)
         printf ( BOLD DARK_WHITE "%sFileset:         " RESET DARK_GREY "Yes\n" RESET, padding);
@@ -307,24 +326,10 @@ xnu_kernel_load_kernel_cache (htool_binary_t *bin)
     xnu->type = xnu_kernel_fetch_type (xnu);
 
     /**
-     *  Fetch the `uname` string from the provided kernel binary as this gives us
-     *  most of the information needed to determine a range of properties of the
-     *  kernel.
-     */    
-    unsigned char *uname = (unsigned char *) xnu_find_uname_string (bin->data, bin->size);
-    uint32_t u_len = strlen ((char *) uname);
-
-    /**
-     *  Find the version of the given kernel mach-o.
+     *  The version banner, the kernel's `uname` string, gives us most of the information
+     *  needed to determine a range of properties of the kernel.
      */
-    xnu_version_t *version = calloc (1, sizeof (xnu_version_t));
-    version->darwin_vers = xnu_find_darwin_version (uname, u_len);
-    version->xnu_vers = xnu_find_xnu_version (uname, u_len);
-    version->build_time = xnu_find_build_time (uname, u_len);
-    version->device_type = xnu_find_device_type (uname, u_len);
-    version->cache_style = xnu_kernel_type_get_string (xnu->type);
-
-    xnu->version = version;
+    xnu->version = xnu_kernel_parse_version (xnu);
     printf (ANSI_COLOR_GREEN "[*]" RESET ANSI_COLOR_GREEN " Detected Kernelcache\n" RESET);
     xnu_version_info_print (xnu, "   ");
 
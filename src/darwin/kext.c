@@ -13,36 +13,20 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <fnmatch.h>
+#include <pthread.h>
+
 #include "htool.h"
 #include "darwin/kext.h"
 #include "commands/macho.h"
+#include "htool-vmmap.h"
+#include "htool-parallel.h"
+#include "htool-fileset.h"
+#include "htool-fixups.h"
+#include "darwin/plist.h"
 
 #define KEXT_DEBUG 0
 
-#ifndef __APPLE__
-/* Temporary, should move to libhelper */
-char *
-strnstr(const char *s, const char *find, size_t slen)
-{
-	char c, sc;
-	size_t len;
-
-	if ((c = *find++) != '\0') {
-		len = strlen(find);
-		do {
-			do {
-				if (slen-- < 1 || (sc = *s++) == '\0')
-					return (NULL);
-			} while (sc != c);
-			if (len > slen)
-				return (NULL);
-		} while (strncmp(s, find, len) != 0);
-		s--;
-	}
-	return ((char *)s);
-}
-#endif
-
 /**
  * \brief   Select the com.apple.kernel Mach-O from an `xnu_t`, as on Fileset-style
  *          kernel caches the kernel is stored in `xnu->kern`, whereas with others it
@@ -57,6 +41,25 @@ _xnu_select_macho (xnu_t *xnu)
     return macho;
 }
 
+/**
+ * \brief   Build the kext list from an array of parsed kexts, skipping any slot that
+ *          failed to parse. The list keeps the order of the array.
+ */
+static HSList *
+_xnu_kext_list_from_slots (kext_t **slots, uint32_t count)
+{
+    HSList *kext_list = NULL;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!slots[i]) {
+            warningf ("There was an error parsing the KEXT at index: %d\n", i);
+            continue;
+        }
+        kext_list = h_slist_append (kext_list, slots[i]);
+    }
+    return kext_list;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 /**
  *  These functions deal with parsing each individual KEXT from whatever
@@ -64,73 +67,41 @@ _xnu_select_macho (xnu_t *xnu)
  */
 
 kext_t *
-xnu_parse_split_style_kext (macho_t *macho, char *load_addr_str, char *bundleid)
+xnu_parse_split_style_kext (macho_t *macho, uint64_t addr, const plist_dict_t *info)
 {
     macho_t *mem_macho;
     kext_t *kext ;
-    uint64_t addr;
-
-    /* Calculate KEXT load address */
-    int rc = sscanf (load_addr_str, "%llx", &addr);
-    if (!rc) {
-        warningf ("[*] Unable to parse KEXT at load address: 0x%s\n", load_addr_str);
-        return NULL;
-    }
 
     /**
      *  For the Kernel's Mach-O, the segment addresses are kernel pointers, so they can be mapped
      *  into the correct area of memory. For example, an address for a segment within a kernel
      *  Mach-O would look like 0xffffff80044ec000. 
      * 
-     *  This makes it annoying to find where these KEXTs are within the file. We already have the
-     *  kernel virtual address of the KEXT, which is listed in the XML, and will look something
-     *  like 0xffffff8004614000.
-     * 
-     *  To determine the "offset" of the KEXT within the file, we must first get the offset of the
-     *  first segment within the kernel Mach-O. 
+     *  The plist only gives us the kernel virtual address of the KEXT, which will look something
+     *  like 0xffffff8004614000, so the kernel's VM map is used to translate it to an offset in
+     *  the file.
      */
-    mach_segment_info_t *segment = (mach_segment_info_t *) mach_segment_info_search (macho->scmds, "__PRELINK_TEXT");
-    mach_segment_command_64_t *seg64 = (mach_segment_command_64_t *) segment->segcmd;
-    uint64_t base = seg64->fileoff;
-
-    /**
-     *  The offset of the KEXT can be calculate by taking the base offset, and subtracting the
-     *  first segments virtual memory address from the virtual address of the kext. So we have
-     *  something that looks like this:
-     * 
-     *      base            = 0x6a8000
-     *      addr            = 0xfffffff0059f8180
-     *      seg64->vmaddr   = 0xfffffff0059f8000
-     * 
-     *      offset          = (addr - seg64->vmaddr)
-     *                      = 0xfffffff0059f8180 - 0xfffffff0059f8000
-     *                      = 0x180
-     * 
-     *      KEXT            = macho->data + (base + offset)
-     *                      = macho->data + (0x6a8180)
-     * 
-     */
-    uint64_t offset = (addr - seg64->vmaddr);
+    uint64_t offset;
+    if (!htool_vmmap_vmaddr_to_offset (htool_vmmap_fetch (macho), addr, &offset)) {
+        warningf ("[*] KEXT load address is not mapped by the kernel: 0x%llx\n", addr);
+        return NULL;
+    }
 
     /**
-     *  We can then calculate the pointer to the KEXT as macho->data + (base + offset), and
-     *  then call macho_64_create_from_buffer() to create a macho_t.
+     *  We can then calculate the pointer to the KEXT as macho->data + offset, and then call
+     *  macho_64_create_from_buffer() to create a macho_t.
      * 
      *  This isn't creating a copy of this data, it's just creating a struct that points to
      *  the correct area in the kernel Mach-O.
      */
-    unsigned char *kext_data = (unsigned char *) (macho->data + (base + offset));
+    unsigned char *kext_data = (unsigned char *) (macho->data + offset);
     mem_macho = macho_64_create_from_buffer (kext_data);
 
 #if KEXT_DEBUG
     printf ("\n");
-    printf ("          Bundle ID: %s\n", bundleid);
     printf ("  KEXT Load Address: 0x%llx\n", addr);
-    printf ("Mach-O Segment Base: 0x%llx\n", base);
-    printf (" Segment VM Address: 0x%llx\n", seg64->vmaddr);
     printf ("        KEXT Offset: 0x%llx\n", offset);
     printf ("          KEXT Size: %d bytes\n", mem_macho->size);
-    printf ("       Final Offset: 0x%llx\n", (base + offset));
 #endif
 
     /**
@@ -140,9 +111,10 @@ xnu_parse_split_style_kext (macho_t *macho, char *load_addr_str, char *bundleid)
     memset (kext, '\0', sizeof (kext_t));
 
     kext->macho = mem_macho;
-    kext->name = strdup (bundleid);
-    kext->offset = (base + offset);
+    kext->name = plist_value_copy_string (plist_dict_get (info, "CFBundleIdentifier"));
+    kext->offset = offset;
     kext->vmaddr = addr;
+    kext->info = info;
 
     /* Find and set the source version of the KEXT */
     mach_source_version_command_t *svc = mach_load_command_find_source_version_command (kext->macho);
@@ -160,6 +132,7 @@ xnu_parse_split_style_kext (macho_t *macho, char *load_addr_str, char *bundleid)
      */
 
 #if KEXT_DEBUG
+    printf ("          Bundle ID: %s\n", kext->name);
     printf ("       KEXT Version: %s\n", kext->version);
     printf ("          KEXT UUID: %s\n", kext->uuid);
 
@@ -187,17 +160,25 @@ xnu_parse_merged_style_kext (macho_t *macho, mach_segment_command_64_t *__TEXT,
     kext->info_table = info_table[i];
     kext->__text_vmaddr = __TEXT->vmaddr;
 
-    /* Set tagged pointer and calculate the kext offset */
-    kext->kernel_ptr = (UNTAG_PTR (kext->kext_table - kext->__text_vmaddr) | 0xFFFFFFFFF0000000);
-    kext->offset = ((kext->kernel_ptr - 0xf0000000) & 0xffffffff);
+    /**
+     *  The tables have already had their fixups resolved, so they hold plain kernel
+     *  virtual addresses, which the kernel's VM map translates to offsets in the file.
+     */
+    htool_vmmap_t *vmmap = htool_vmmap_fetch (macho);
+    uint64_t kmod_offset;
+
+    kext->kernel_ptr = kext->kext_table;
+    if (!htool_vmmap_vmaddr_to_offset (vmmap, kext->kernel_ptr, &kext->offset) ||
+        !htool_vmmap_vmaddr_to_offset (vmmap, kext->info_table, &kmod_offset)) {
+        free (kext);
+        return NULL;
+    }
     
     /* Create the Mach-O */
     kext_data = (unsigned char *) (macho->data + kext->offset);
     kext->macho = macho_64_create_from_buffer (kext_data);
 
-    /* Create the kmod struct */
-    kmod = calloc (1, sizeof (partial_kmod_info_64_t));
-    uint64_t kmod_offset = UNTAG_PTR(info_table[i]) - __TEXT->vmaddr;
+    /* The kmod info is read in place */
     kmod = (partial_kmod_info_64_t *) (macho->data + kmod_offset);
 
     kext->name = kmod->name;
@@ -230,6 +211,22 @@ xnu_parse_merged_style_kext (macho_t *macho, mach_segment_command_64_t *__TEXT,
  *  created.
  */
 
+typedef struct merged_kext_job_t
+{
+    macho_t                     *macho;
+    mach_segment_command_64_t   *__TEXT;
+    uint64_t                    *kext_table;
+    uint64_t                    *info_table;
+    kext_t                     **slots;
+} merged_kext_job_t;
+
+static void
+_xnu_parse_merged_style_kext_worker (void *ctx, uint32_t index)
+{
+    merged_kext_job_t *job = (merged_kext_job_t *) ctx;
+    job->slots[index] = xnu_parse_merged_style_kext (job->macho, job->__TEXT, job->kext_table, job->info_table, index, 0);
+}
+
 HSList *
 xnu_load_kext_list_merged_style (xnu_t *xnu)
 {
@@ -279,173 +276,221 @@ xnu_load_kext_list_merged_style (xnu_t *xnu)
     HSList *kext_list = NULL;
     int i, n_kmod;
 
-    /* Load pointers to kext and info tables */
-    kext_table = (uint64_t *) ((uintptr_t) data + __kmod_start->offset);
-    info_table = (uint64_t *) ((uintptr_t) data + __kmod_info->offset);
-
     n_kmod = MIN (__kmod_start->size, __kmod_info->size) / sizeof (uint64_t);
 
-    /* Go through all the kmod kexts */
-    for (int i = 0; i < n_kmod; i++) {
-        
-        kext_t *kext = xnu_parse_merged_style_kext (macho, __TEXT, kext_table, info_table, i, 0);
-        if (!kext) {
-            warningf ("There was an error parsing the KEXT at index: %d\n", i);
-            continue;
-        }
-        kext_list = h_slist_append (kext_list, kext);
+    /**
+     *  Both tables hold pointers that are fixed up when the kernel boots. Resolve them
+     *  all up front, so the workers only see plain kernel virtual addresses. Kernels
+     *  without __thread_starts or LC_DYLD_CHAINED_FIXUPS have no rebase for the slot,
+     *  and their pointers are just tagged, so those are untagged instead.
+     */
+    htool_fixups_t *fixups = htool_fixups_fetch (macho);
+    uint64_t *raw_kext_table = (uint64_t *) ((uintptr_t) data + __kmod_start->offset);
+    uint64_t *raw_info_table = (uint64_t *) ((uintptr_t) data + __kmod_info->offset);
+
+    kext_table = calloc (n_kmod ? n_kmod : 1, sizeof (uint64_t));
+    info_table = calloc (n_kmod ? n_kmod : 1, sizeof (uint64_t));
+    for (i = 0; i < n_kmod; i++) {
+        kext_table[i] = UNTAG_PTR (htool_fixups_resolve (fixups, __kmod_start->addr + i * sizeof (uint64_t), raw_kext_table[i]));
+        info_table[i] = UNTAG_PTR (htool_fixups_resolve (fixups, __kmod_info->addr + i * sizeof (uint64_t), raw_info_table[i]));
     }
 
+    /**
+     *  Each kext is independent of the others, so they're parsed on the worker pool. Every
+     *  kext has its own slot, so the list comes out in __kmod_start order. The VM map is
+     *  built first so the workers share it.
+     */
+    htool_vmmap_fetch (macho);
+
+    merged_kext_job_t job = {
+        .macho = macho,
+        .__TEXT = __TEXT,
+        .kext_table = kext_table,
+        .info_table = info_table,
+        .slots = calloc (n_kmod ? n_kmod : 1, sizeof (kext_t *)),
+    };
+    htool_parallel_for (n_kmod, _xnu_parse_merged_style_kext_worker, &job);
+
+    kext_list = _xnu_kext_list_from_slots (job.slots, n_kmod);
+    free (job.slots);
+    free (kext_table);
+    free (info_table);
+
     printf (ANSI_COLOR_GREEN "[*] Successfully parsed Kernel Extensions (%d)\n" RESET, h_slist_length (kext_list));
     return kext_list;
 }
 
+typedef struct split_kext_job_t
+{
+    macho_t                     *macho;
+    plist_t                     *plist;
+    uint32_t                    *indices;
+    kext_t                     **slots;
+} split_kext_job_t;
+
+static void
+_xnu_parse_split_style_kext_worker (void *ctx, uint32_t index)
+{
+    split_kext_job_t *job = (split_kext_job_t *) ctx;
+    const plist_dict_t *info = &job->plist->kexts[job->indices[index]];
+    const plist_value_t *load_addr = plist_dict_get (info, "_PrelinkExecutableLoadAddr");
+
+    if (!load_addr || load_addr->type != PLIST_TYPE_INTEGER || !plist_dict_get (info, "CFBundleIdentifier")) {
+        warningf ("[*] Cannot determine Kernel Extension Load Address (%d)\n", index);
+        return;
+    }
+    job->slots[index] = xnu_parse_split_style_kext (job->macho, load_addr->integer, info);
+}
+
 HSList *
 xnu_load_kext_list_split_style (xnu_t *xnu)
 {
     macho_t *macho = _xnu_select_macho (xnu);
 
     mach_segment_command_64_t *prelink_info_segment;
-    unsigned char *xml, *xml_PrelinkExecutableLoa_str;
-    int k_count = 0, k_failed = 0;
     HSList *kext_list = NULL;
-
-    mach_segment_info_t *base_segment = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, 0);
-    mach_section_64_t *base_section = (mach_section_64_t *) base_segment->segcmd;
-    uint64_t base_address = base_section->addr;
+    uint32_t count = 0;
 
     /**
-     *  The __PRELINK_INFO segment contains an XML that maps the Kernel Extensions in the
-     *  Mach-O. If we search for this segment and then check it's valid before trying to
-     *  parse the XML inside it.
-     * 
-     *  This is a bit of a crappy way to parse XML, but it saves writing an XML parsing
-     *  or adding another library. This should be quite quick.
-     * 
+     *  The __PRELINK_INFO segment contains a plist that maps the Kernel Extensions in the
+     *  Mach-O. The plist is parsed in place, in a single pass, giving a dictionary for each
+     *  entry in `_PrelinkInfoDictionary`.
      */
     prelink_info_segment = mach_segment_command_64_from_info (mach_segment_info_search (macho->scmds, "__PRELINK_INFO"));
-    if (prelink_info_segment) {
-        printf ("[*] Found Segment: __PRELINK_INFO\n");
-
-        /**
-         *  Copy the contents of the __PRELINK_INFO segment into the xml string.
-         */
-        xml = malloc (prelink_info_segment->filesize);
-        memcpy (xml, macho->data + prelink_info_segment->fileoff, prelink_info_segment->filesize);
-
-        /**
-         *  Check that the "PrelinkExecutableLoa" string exists in the XML. This is the
-         *  start of the dictionary that contains the KEXT mapping.
-         */
-        xml_PrelinkExecutableLoa_str = strstr (xml, "PrelinkExecutableLoa");
-        if (xml_PrelinkExecutableLoa_str) {
-
-            char *kext_name, load_addr[24];
-            unsigned char *load_addr_ptr, *kext_name_ptr;
-            unsigned char *prelink_addr;
-
-            /* Look for the first CFBundleName key */
-            kext_name_ptr = strstr (xml, "CFBundleName</key>");
-
-            /**
-             *  While the kext_name_ptr still has a value, keep trying to advance to the
-             *  next occurrence of CFBundleName.
-             */
-            while (kext_name_ptr) {
-
-                /* Reset the xml pointer to the first occurrence of </string> */
-                xml = strstr (kext_name_ptr, "</string>");
-
-                /* Set the prelink_addr to the _PrelinkExecutableLoadAddr */
-                prelink_addr = strstr (kext_name_ptr, "_PrelinkExecutableLoadAddr");
-                if (!prelink_addr) {
-                    warningf ("[*] Cannot determine Kernel Extension Load Address (%d)\n", k_count);
-                    continue;
-                }
-
-                /* Find the start of the KEXT load address */
-                load_addr_ptr = strstr (prelink_addr, "0x");
-
-                /* Initialise 256 bytes in the kext_name to avoid something going wrong */
-                kext_name = calloc (1, 256);
-                memset (kext_name, '\0', 256);
-
-                /* Fix for "ID=" */
-                unsigned char *idFix = NULL;
-                if (!(idFix = strnstr (kext_name_ptr, "ID=\"", xml - kext_name_ptr)))
-                    idFix = kext_name_ptr;
-                else
-                    idFix = strstr (idFix + 5, "\">") + 2;
-
-                /* Copy idFix to kext_name */
-                strncpy (kext_name, idFix, xml - idFix);
-
-                /* Set and copy bytes */
-                memset (load_addr, '\0', 24);
-                strncpy (load_addr, load_addr_ptr, 18);
-
-                /* Advance the xml past the kext */
-                xml += 10;
-
-                /* Look for the next CFBundleIdentifier */
-                kext_name_ptr = strstr (xml, "CFBundleIdentifier");
-                if (kext_name_ptr) {
-
-                    /* Look for the end of the string */
-                    xml = strstr (kext_name_ptr, "</string>");
-                    memset (kext_name, '\0', 256);
-
-                    /* Reset the idFix */
-                    if (!(idFix = strnstr (kext_name_ptr, "ID=\"", xml - kext_name_ptr)))
-                        idFix = kext_name_ptr + 32;
-                    else
-                        idFix = strstr (idFix + 5, "\">") + 2;
-
-                    /* Copy some bytes to the kext name */
-                    strncpy (kext_name, idFix, xml - idFix);
-                }
-
-                /* Parse the individual kext and add it to the list */
-                kext_t *kext = xnu_parse_split_style_kext (macho, load_addr, kext_name);
-                kext_list = h_slist_append (kext_list, kext);
-                
-                /* Look for the next CFBundleName */
-                kext_name_ptr = strstr (xml, "CFBundleName</key>");
-                kext_name = NULL;
-                free (kext_name);
-                k_count++;
-            }
-            printf (ANSI_COLOR_GREEN "[*] Successfully parsed Kernel Extensions (%d)\n" RESET, h_slist_length (kext_list));
-        }
+    if (!prelink_info_segment) return NULL;
+    printf ("[*] Found Segment: __PRELINK_INFO\n");
+
+    if (prelink_info_segment->fileoff + prelink_info_segment->filesize > macho->size) {
+        warningf ("[*] __PRELINK_INFO extends past the end of the file\n");
+        return NULL;
     }
+
+    xnu->prelink_info = plist_parse_prelink_info ((const char *) macho->data + prelink_info_segment->fileoff,
+                                                  prelink_info_segment->filesize);
+    if (!xnu->prelink_info) return NULL;
+
+    /**
+     *  Kexts without any code (e.g. those that only carry IOKit personalities) don't have
+     *  a load address, so only the ones that do are handed to the parser.
+     */
+    plist_t *plist = xnu->prelink_info;
+    uint32_t *indices = calloc (plist->nkexts ? plist->nkexts : 1, sizeof (uint32_t));
+    for (uint32_t i = 0; i < plist->nkexts; i++)
+        if (plist_dict_get (&plist->kexts[i], "_PrelinkExecutableLoadAddr")) indices[count++] = i;
+    debugf ("prelink info: %d kexts, %d with code\n", plist->nkexts, count);
+
+    /* The VM map is built first so the workers share it */
+    htool_vmmap_fetch (macho);
+
+    split_kext_job_t job = {
+        .macho = macho,
+        .plist = plist,
+        .indices = indices,
+        .slots = calloc (count ? count : 1, sizeof (kext_t *)),
+    };
+    htool_parallel_for (count, _xnu_parse_split_style_kext_worker, &job);
+
+    kext_list = _xnu_kext_list_from_slots (job.slots, count);
+    free (job.indices);
+    free (job.slots);
+
+    printf (ANSI_COLOR_GREEN "[*] Successfully parsed Kernel Extensions (%d)\n" RESET, h_slist_length (kext_list));
     return kext_list;
 }
 
 HSList *
 xnu_load_kext_list_fileset_style (xnu_t *xnu)
 {
+    htool_fileset_index_t *fileset = htool_fileset_index_fetch (xnu->macho);
+    uint32_t count = (fileset) ? fileset->nentries : 0;
     HSList *kext_list = NULL;
 
-    debugf ("fileset size: %d\n", h_slist_length(xnu->macho->fileset));
-    for (int i = 0; i < h_slist_length (xnu->macho->fileset); i++) {
-        mach_fileset_entry_info_t *entry = (mach_fileset_entry_info_t *) h_slist_nth_data (xnu->macho->fileset, i);
-        
-        kext_t *kext = calloc (1, sizeof (kext_t));
-        kext->macho = entry->macho;
-        kext->offset = entry->offset;
-        kext->name = entry->entry_id;
+    debugf ("fileset size: %d\n", count);
 
-#if KEXT_DEBUG
-        printf ("\n--------\nKEXT Bundle ID: %s (%d bytes)\n", kext->name, kext->macho->size);
-        htool_print_macho_header_from_struct (kext->macho->header);
-#endif
+    /**
+     *  Fileset kexts only take their ID and offsets from the fileset index here. Their
+     *  Mach-O, version and UUID are filled in by xnu_kext_macho() when something first
+     *  needs them, so listing the kexts doesn't parse every one.
+     */
+    for (uint32_t i = 0; i < count; i++) {
+        htool_fileset_entry_t *entry = &fileset->entries[i];
+        if (!entry->entry_id) continue;
 
+        kext_t *kext = calloc (1, sizeof (kext_t));
+        kext->type = KERNEL_EXTENSION_FLAG_FILESET_KEXT;
+        kext->offset = entry->fileoff;
+        kext->vmaddr = entry->vmaddr;
+        kext->name = (char *) entry->entry_id;
         kext_list = h_slist_append (kext_list, kext);
     }
+
     printf (ANSI_COLOR_GREEN "[*] Successfully parsed Kernel Extensions (%d)\n" RESET, h_slist_length (kext_list));
     return kext_list;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+/**
+ *  Bundle ID index, so `analyse -e` and anything else looking kexts up by name
+ *  doesn't have to walk the whole list.
+ */
+
+static uint64_t
+_xnu_kext_hash (const char *name)
+{
+    /* FNV-1a */
+    uint64_t h = UINT64_C(0xcbf29ce484222325);
+    while (*name) h = (h ^ (uint8_t) *name++) * UINT64_C(0x100000001b3);
+    return h;
+}
+
+typedef struct kext_name_key_t
+{
+    const char      *name;
+    uint32_t         index;
+} kext_name_key_t;
+
+static int
+_xnu_kext_name_compare (const void *a, const void *b)
+{
+    return strcmp (((const kext_name_key_t *) a)->name, ((const kext_name_key_t *) b)->name);
+}
+
+static kext_index_t *
+_xnu_kext_index_build (xnu_t *xnu)
+{
+    kext_index_t *index = calloc (1, sizeof (kext_index_t));
+    kext_name_key_t *keys;
+    uint32_t nslots = 16;
+
+    while (nslots < xnu->nkexts * 2) nslots <<= 1;
+    index->slots = calloc (nslots, sizeof (uint32_t));
+    index->mask = nslots - 1;
+    index->sorted = malloc ((xnu->nkexts ? xnu->nkexts : 1) * sizeof (uint32_t));
+    keys = malloc ((xnu->nkexts ? xnu->nkexts : 1) * sizeof (kext_name_key_t));
+
+    for (uint32_t k = 0; k < xnu->nkexts; k++) {
+        if (!xnu->kext_array[k]->name) continue;
+        keys[index->count++] = (kext_name_key_t) { .name = xnu->kext_array[k]->name, .index = k };
+
+        /* If a bundle ID shows up more than once, the first kext keeps it */
+        for (uint32_t i = _xnu_kext_hash (xnu->kext_array[k]->name) & index->mask;; i = (i + 1) & index->mask) {
+            uint32_t slot = index->slots[i];
+            if (!slot) {
+                index->slots[i] = k + 1;
+                break;
+            }
+            if (!strcmp (xnu->kext_array[slot - 1]->name, xnu->kext_array[k]->name)) break;
+        }
+    }
+
+    qsort (keys, index->count, sizeof (kext_name_key_t), _xnu_kext_name_compare);
+    for (uint32_t i = 0; i < index->count; i++)
+        index->sorted[i] = keys[i].index;
+    free (keys);
+
+    return index;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 htool_return_t
@@ -463,6 +508,263 @@ xnu_parse_kernel_extensions (xnu_t *xnu)
         return HTOOL_RETURN_FAILURE;
     }
 
+    /* Keep an array of the kexts too, so they can be indexed directly */
+    xnu->nkexts = h_slist_length (xnu->kexts);
+    xnu->kext_array = calloc (xnu->nkexts ? xnu->nkexts : 1, sizeof (kext_t *));
+    for (uint32_t i = 0; i < xnu->nkexts; i++)
+        xnu->kext_array[i] = (kext_t *) h_slist_nth_data (xnu->kexts, i);
 
+    xnu->kext_index = _xnu_kext_index_build (xnu);
     return HTOOL_RETURN_SUCCESS;
 }
+
+macho_t *
+xnu_kext_source_macho (xnu_t *xnu, kext_t *kext)
+{
+    if (kext->type == KERNEL_EXTENSION_FLAG_FILESET_KEXT) return xnu->macho;
+    return _xnu_select_macho (xnu);
+}
+
+plist_t *
+xnu_prelink_info_fetch (xnu_t *xnu)
+{
+    macho_t *images[2] = { xnu->macho, _xnu_select_macho (xnu) };
+
+    if (xnu->prelink_info) return xnu->prelink_info;
+
+    /* A fileset keeps it at the top level, rather than in the kernel entry */
+    for (int i = 0; i < 2 && !xnu->prelink_info; i++) {
+        mach_segment_command_64_t *seg = mach_segment_command_64_from_info (mach_segment_info_search (images[i]->scmds, "__PRELINK_INFO"));
+
+        if (!seg || !seg->filesize || seg->fileoff + seg->filesize > images[i]->size) continue;
+        xnu->prelink_info = plist_parse_prelink_info ((const char *) images[i]->data + seg->fileoff, seg->filesize);
+    }
+    return xnu->prelink_info;
+}
+
+/* Only held while a parsed kext Mach-O is published, never while parsing one */
+static pthread_mutex_t kext_macho_lock = PTHREAD_MUTEX_INITIALIZER;
+
+macho_t *
+xnu_kext_macho (xnu_t *xnu, kext_t *kext)
+{
+    htool_fileset_index_t *fileset;
+    macho_t *macho;
+
+    if (kext->type != KERNEL_EXTENSION_FLAG_FILESET_KEXT) return kext->macho;
+    if ((macho = __atomic_load_n (&kext->macho, __ATOMIC_ACQUIRE))) return macho;
+
+    /* The fileset index parses the entry itself, and hands every caller the same Mach-O */
+    if (!(fileset = htool_fileset_index_fetch (xnu->macho)) ||
+        !(macho = htool_fileset_entry_macho (fileset, htool_fileset_index_find (fileset, kext->name))))
+        return NULL;
+
+    pthread_mutex_lock (&kext_macho_lock);
+    if (!kext->macho) {
+        /* Find and set the source version of the KEXT */
+        mach_source_version_command_t *svc = mach_load_command_find_source_version_command (macho);
+        if (svc) kext->version = mach_load_command_get_source_version_string (svc);
+        else kext->version = "0.0.0";
+
+        /* Find and set the UUID */
+        kext->uuid = mach_load_command_uuid_string_from_macho (macho);
+        __atomic_store_n (&kext->macho, macho, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock (&kext_macho_lock);
+
+    return macho;
+}
+
+/* An nlist_64, read straight from the symbol table */
+typedef struct kext_nlist_t
+{
+    uint32_t        strx;
+    uint8_t         type;
+    uint8_t         sect;
+    uint16_t        desc;
+    uint64_t        value;
+} kext_nlist_t;
+
+typedef struct kext_text_range_t
+{
+    uint64_t        start;
+    uint64_t        end;
+    kext_t         *kext;
+} kext_text_range_t;
+
+static int
+_xnu_kext_symbol_compare (const void *a, const void *b)
+{
+    const kext_symbol_t *x = a, *y = b;
+    if (x->vmaddr != y->vmaddr) return (x->vmaddr < y->vmaddr) ? -1 : 1;
+    return strcmp (x->name, y->name);
+}
+
+static int
+_xnu_kext_range_compare (const void *a, const void *b)
+{
+    const kext_text_range_t *x = a, *y = b;
+    if (x->start != y->start) return (x->start < y->start) ? -1 : 1;
+    return 0;
+}
+
+kext_symbol_t *
+xnu_symtab_read (macho_t *macho, macho_t *source, uint32_t *count)
+{
+    mach_load_command_info_t *info = mach_load_command_find_command_by_type (macho, LC_SYMTAB);
+    mach_symtab_command_t *symtab;
+    kext_symbol_t *symbols;
+    const char *strings;
+
+    *count = 0;
+    if (!info) return NULL;
+    symtab = (mach_symtab_command_t *) info->lc;
+    if (!symtab->nsyms || (uint64_t) symtab->symoff + (uint64_t) symtab->nsyms * sizeof (kext_nlist_t) > source->size ||
+        (uint64_t) symtab->stroff + symtab->strsize > source->size)
+        return NULL;
+
+    strings = (const char *) source->data + symtab->stroff;
+    symbols = malloc (symtab->nsyms * sizeof (kext_symbol_t));
+    for (uint32_t i = 0; i < symtab->nsyms; i++) {
+        kext_nlist_t sym;
+        memcpy (&sym, source->data + symtab->symoff + (uint64_t) i * sizeof (sym), sizeof (sym));
+
+        if ((sym.type & N_STAB) || (sym.type & N_TYPE) != N_SECT || !sym.value) continue;
+        if (!sym.strx || sym.strx >= symtab->strsize || !strings[sym.strx]) continue;
+        if (!memchr (strings + sym.strx, '\0', symtab->strsize - sym.strx)) continue;
+
+        symbols[(*count)++] = (kext_symbol_t) { .vmaddr = sym.value, .name = strings + sym.strx };
+    }
+    return symbols;
+}
+
+/**
+ * \brief   Collect and sort the defined symbols in the kernel's LC_SYMTAB. Names
+ *          aren't copied, so the table stays valid as long as the kernel is loaded.
+ */
+static kext_symbol_table_t *
+_xnu_kernel_symbol_table_build (macho_t *macho)
+{
+    kext_symbol_table_t *table = calloc (1, sizeof (kext_symbol_table_t));
+
+    table->symbols = xnu_symtab_read (macho, macho, &table->nsymbols);
+    if (table->nsymbols) qsort (table->symbols, table->nsymbols, sizeof (kext_symbol_t), _xnu_kext_symbol_compare);
+    return table;
+}
+
+/**
+ * \brief   Give every merged kext its run of the kernel's symbol table. Both the
+ *          symbols and the kexts' __TEXT_EXEC ranges are sorted by address, so a
+ *          single pass over each assigns every symbol.
+ */
+static void
+_xnu_kext_symbols_assign (xnu_t *xnu)
+{
+    kext_symbol_table_t *table = _xnu_kernel_symbol_table_build (_xnu_select_macho (xnu));
+    kext_text_range_t *ranges = calloc (xnu->nkexts ? xnu->nkexts : 1, sizeof (kext_text_range_t));
+    uint32_t nranges = 0, sym = 0;
+
+    for (uint32_t i = 0; i < xnu->nkexts; i++) {
+        kext_t *kext = xnu->kext_array[i];
+        mach_segment_info_t *seg_info;
+        mach_segment_command_64_t *seg;
+
+        if (kext->type != KERNEL_EXTENSION_FLAG_MERGED_KEXT || !kext->macho) continue;
+        if (!(seg_info = mach_segment_info_search (kext->macho->scmds, "__TEXT_EXEC"))) continue;
+
+        seg = mach_segment_command_64_from_info (seg_info);
+        if (seg && seg->vmsize) ranges[nranges++] = (kext_text_range_t) { seg->vmaddr, seg->vmaddr + seg->vmsize, kext };
+    }
+    qsort (ranges, nranges, sizeof (kext_text_range_t), _xnu_kext_range_compare);
+
+    for (uint32_t r = 0; r < nranges; r++) {
+        uint32_t end;
+
+        /* Kexts don't overlap, but if one did, `sym` still never passes a later start */
+        while (sym < table->nsymbols && table->symbols[sym].vmaddr < ranges[r].start) sym++;
+        for (end = sym; end < table->nsymbols && table->symbols[end].vmaddr < ranges[r].end; end++);
+
+        ranges[r].kext->symbols = (end > sym) ? &table->symbols[sym] : NULL;
+        ranges[r].kext->nsymbols = end - sym;
+    }
+
+    free (ranges);
+    xnu->symbol_table = table;
+}
+
+static pthread_mutex_t kext_symbols_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const kext_symbol_t *
+xnu_kext_symbols (xnu_t *xnu, kext_t *kext, uint32_t *count)
+{
+    *count = 0;
+    if (kext->type != KERNEL_EXTENSION_FLAG_MERGED_KEXT) return NULL;
+
+    pthread_mutex_lock (&kext_symbols_lock);
+    if (!xnu->symbol_table) _xnu_kext_symbols_assign (xnu);
+    pthread_mutex_unlock (&kext_symbols_lock);
+
+    *count = kext->nsymbols;
+    return kext->symbols;
+}
+
+uint32_t
+xnu_kext_find_index (xnu_t *xnu, const char *bundleid)
+{
+    kext_index_t *index = xnu->kext_index;
+    if (!index) return UINT32_MAX;
+
+    for (uint32_t i = _xnu_kext_hash (bundleid) & index->mask;; i = (i + 1) & index->mask) {
+        uint32_t slot = index->slots[i];
+        if (!slot) return UINT32_MAX;
+        if (!strcmp (xnu->kext_array[slot - 1]->name, bundleid)) return slot - 1;
+    }
+}
+
+kext_t *
+xnu_kext_find (xnu_t *xnu, const char *bundleid)
+{
+    uint32_t k;
+    if ((k = xnu_kext_find_index (xnu, bundleid)) == UINT32_MAX) return NULL;
+    return xnu->kext_array[k];
+}
+
+uint32_t
+xnu_kext_match (xnu_t *xnu, const char *pattern, uint32_t **matches)
+{
+    kext_index_t *index = xnu->kext_index;
+    uint32_t count = 0;
+    size_t prefix;
+
+    *matches = NULL;
+    if (!index) return 0;
+
+    /* Without any wildcards it's a straight lookup */
+    prefix = strcspn (pattern, "*?[");
+    if (!pattern[prefix]) {
+        uint32_t k = xnu_kext_find_index (xnu, pattern);
+        if (k == UINT32_MAX) return 0;
+
+        *matches = malloc (sizeof (uint32_t));
+        (*matches)[count++] = k;
+        return count;
+    }
+
+    /* Only the kexts sharing the literal prefix can match the pattern */
+    uint32_t lo = 0, hi = index->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (strncmp (xnu->kext_array[index->sorted[mid]]->name, pattern, prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (uint32_t i = lo; i < index->count; i++) {
+        uint32_t k = index->sorted[i];
+        if (strncmp (xnu->kext_array[k]->name, pattern, prefix)) break;
+        if (fnmatch (pattern, xnu->kext_array[k]->name, 0)) continue;
+
+        if (!*matches) *matches = malloc ((index->count - lo) * sizeof (uint32_t));
+        (*matches)[count++] = k;
+    }
+    return count;
+}
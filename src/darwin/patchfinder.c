@@ -0,0 +1,805 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "darwin/patchfinder.h"
+#include "disassembler/a64.h"
+#include "disassembler/strings.h"
+#include "disassembler/functions.h"
+#include "htool-vmmap.h"
+#include "htool-hash.h"
+#include "htool-parallel.h"
+
+#define VM_PROT_EXECUTE_BIT         0x4
+
+#ifndef MIN
+#define MIN(a, b)                   (((a) < (b)) ? (a) : (b))
+#endif
+
+/* Executable segments are split into chunks of this many bytes for the sweep */
+#define PATCHFIND_CHUNK_SIZE        (1024 * 1024)
+
+/* Default number of instructions searched either side of a reference */
+#define PATCHFIND_DEFAULT_WINDOW    32
+
+/* Longest line accepted in a rules file */
+#define PATCHFIND_MAX_LINE          4096
+
+static const struct {
+    const char         *name;
+    uint32_t            mask;
+    uint32_t            value;
+} patchfind_patterns[] = {
+    { "bl",         0xfc000000,     0x94000000 },
+    { "b",          0xfc000000,     0x14000000 },
+    { "b.cond",     0xff000010,     0x54000000 },
+    { "cbz",        0x7f000000,     0x34000000 },
+    { "cbnz",       0x7f000000,     0x35000000 },
+    { "tbz",        0x7f000000,     0x36000000 },
+    { "tbnz",       0x7f000000,     0x37000000 },
+    { "adrp",       0x9f000000,     0x90000000 },
+    { "adr",        0x9f000000,     0x10000000 },
+    { "add",        0x7f800000,     0x11000000 },   /* ADD (immediate), W or X */
+    { "ldr",        0xbfc00000,     0xb9400000 },   /* LDR (immediate, unsigned offset), W or X */
+    { "str",        0xbfc00000,     0xb9000000 },   /* STR (immediate, unsigned offset), W or X */
+    { "movz",       0x7f800000,     0x52800000 },
+    { "ret",        0xfffffc1f,     0xd65f0000 },
+};
+
+static const char *patchfind_extract_names[] = {
+    [XNU_PATCHFIND_EXTRACT_XREF]        = "xref",
+    [XNU_PATCHFIND_EXTRACT_MATCH]       = "match",
+    [XNU_PATCHFIND_EXTRACT_TARGET]      = "target",
+    [XNU_PATCHFIND_EXTRACT_IMM]         = "imm",
+    [XNU_PATCHFIND_EXTRACT_FUNCTION]    = "function",
+};
+
+/**
+ *  The compiled plan: the address of every anchor string, each paired with a rule
+ *  that uses it, sorted by address. A string used by more than one rule, or found
+ *  in more than one place, has more than one entry.
+ */
+typedef struct patchfind_anchor_t
+{
+    uint64_t            vmaddr;
+    uint32_t            rule;
+} patchfind_anchor_t;
+
+typedef struct patchfind_hit_t
+{
+    uint64_t            xref;
+    uint64_t            value;
+    uint32_t            rule;
+} patchfind_hit_t;
+
+/* A forward search that's still looking for its instruction */
+typedef struct patchfind_armed_t
+{
+    uint64_t            xref;
+    uint32_t            rule;
+    uint32_t            left;
+    uint32_t            seen;
+} patchfind_armed_t;
+
+typedef struct patchfind_plan_t
+{
+    xnu_patchfind_t        *pf;
+    patchfind_anchor_t     *anchors;
+    uint32_t                nanchors;
+    htool_functions_t      *functions;
+} patchfind_plan_t;
+
+/**
+ *  One chunk of an executable segment. References are only collected from inside
+ *  [start, end), but decoding starts a window early so the registers and the
+ *  backward history are already filled in, and carries on past the end until
+ *  every forward search has finished.
+ */
+typedef struct patchfind_chunk_t
+{
+    patchfind_plan_t       *plan;
+    const unsigned char    *data;           /* the region */
+    uint64_t                vmaddr;
+    uint64_t                size;
+    uint64_t                start;
+    uint64_t                end;
+
+    patchfind_hit_t        *hits;
+    uint32_t                nhits;
+    uint32_t                caphits;
+    uint32_t               *nxrefs;         /* per rule */
+} patchfind_chunk_t;
+
+///////////////////////////////////////////////////////////////////////////////
+HTOOL_PRIVATE uint32_t
+_patchfind_rd32 (const unsigned char *p)
+{
+    uint32_t v;
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+/**
+ *  Split the next token off a rule line: either `name`, or `key=value` where the
+ *  value may be quoted, with \", \\, \n and \t escapes. The token is rewritten in
+ *  place and `key` and `value` point into it.
+ *
+ *  Returns 1 for a token, 0 at the end of the line, -1 for an unterminated quote.
+ */
+HTOOL_PRIVATE int
+_patchfind_next_token (char **cursor, char **key, char **value)
+{
+    char *p = *cursor, *out;
+
+    while (*p && isspace ((unsigned char) *p)) p++;
+    if (!*p || *p == '#') return 0;
+
+    *key = p, *value = NULL;
+    while (*p && !isspace ((unsigned char) *p) && *p != '=') p++;
+    if (*p != '=') {
+        if (*p) *p++ = '\0';
+        *cursor = p;
+        return 1;
+    }
+    *p++ = '\0';
+
+    *value = out = p;
+    if (*p != '"') {
+        while (*p && !isspace ((unsigned char) *p)) p++;
+        if (*p) *p++ = '\0';
+        *cursor = p;
+        return 1;
+    }
+
+    for (p++; *p && *p != '"'; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            *out++ = (*p == 'n') ? '\n' : (*p == 't') ? '\t' : *p;
+        } else {
+            *out++ = *p;
+        }
+    }
+    if (*p != '"') return -1;
+    *out = '\0';
+    *cursor = p + 1;
+    return 1;
+}
+
+HTOOL_PRIVATE int
+_patchfind_parse_pattern (const char *str, uint32_t *mask, uint32_t *value)
+{
+    char *end;
+
+    for (size_t i = 0; i < sizeof (patchfind_patterns) / sizeof (patchfind_patterns[0]); i++) {
+        if (!strcmp (str, patchfind_patterns[i].name)) {
+            *mask = patchfind_patterns[i].mask;
+            *value = patchfind_patterns[i].value;
+            return 1;
+        }
+    }
+
+    *value = (uint32_t) strtoul (str, &end, 16);
+    if (end == str || *end != '/') return 0;
+    str = end + 1;
+    *mask = (uint32_t) strtoul (str, &end, 16);
+    if (end == str || *end || !*mask) return 0;
+
+    *value &= *mask;
+    return 1;
+}
+
+HTOOL_PRIVATE int
+_patchfind_parse_rule (xnu_patchfind_rule_t *rule, char *line, const char *path, uint32_t lineno)
+{
+    char *cursor = line, *key, *value, *end;
+    int res, has_extract = 0;
+
+    rule->line = lineno;
+    rule->window = PATCHFIND_DEFAULT_WINDOW;
+    rule->nth = 1;
+
+    while ((res = _patchfind_next_token (&cursor, &key, &value)) > 0) {
+        if (!value) {
+            if (rule->name) {
+                errorf ("%s:%u: unexpected '%s', fields are key=value\n", path, lineno, key);
+                return 0;
+            }
+            rule->name = strdup (key);
+
+        } else if (!strcmp (key, "string")) {
+            rule->anchor = strdup (value);
+            rule->anchor_len = (uint32_t) strlen (value);
+
+        } else if (!strcmp (key, "match")) {
+            if (!_patchfind_parse_pattern (value, &rule->match_mask, &rule->match_value)) {
+                errorf ("%s:%u: invalid pattern '%s', expected a name or VALUE/MASK\n", path, lineno, value);
+                return 0;
+            }
+
+        } else if (!strcmp (key, "direction")) {
+            if (strcmp (value, "forward") && strcmp (value, "backward")) {
+                errorf ("%s:%u: direction must be forward or backward\n", path, lineno);
+                return 0;
+            }
+            rule->backward = !strcmp (value, "backward");
+
+        } else if (!strcmp (key, "window") || !strcmp (key, "nth")) {
+            unsigned long n = strtoul (value, &end, 0);
+            if (end == value || *end || !n || n > XNU_PATCHFIND_MAX_WINDOW) {
+                errorf ("%s:%u: %s must be between 1 and %d\n", path, lineno, key, XNU_PATCHFIND_MAX_WINDOW);
+                return 0;
+            }
+            if (*key == 'w') rule->window = (uint32_t) n;
+            else rule->nth = (uint32_t) n;
+
+        } else if (!strcmp (key, "extract")) {
+            uint32_t n = sizeof (patchfind_extract_names) / sizeof (patchfind_extract_names[0]), i;
+            for (i = 0; i < n && strcmp (value, patchfind_extract_names[i]); i++);
+            if (i == n) {
+                errorf ("%s:%u: unknown extract '%s'\n", path, lineno, value);
+                return 0;
+            }
+            rule->extract = (xnu_patchfind_extract_t) i;
+            has_extract = 1;
+
+        } else {
+            errorf ("%s:%u: unknown field '%s'\n", path, lineno, key);
+            return 0;
+        }
+    }
+
+    if (res < 0) {
+        errorf ("%s:%u: unterminated string\n", path, lineno);
+        return 0;
+    }
+    if (!rule->name || !rule->anchor || !rule->anchor_len) {
+        errorf ("%s:%u: a rule needs a name and a non-empty string\n", path, lineno);
+        return 0;
+    }
+
+    /* Without a pattern there's only the reference itself to take a value from */
+    if (!rule->match_mask) {
+        if (has_extract && rule->extract != XNU_PATCHFIND_EXTRACT_XREF && rule->extract != XNU_PATCHFIND_EXTRACT_FUNCTION) {
+            errorf ("%s:%u: extract=%s needs a match= pattern\n", path, lineno, patchfind_extract_names[rule->extract]);
+            return 0;
+        }
+    } else if (!has_extract) {
+        rule->extract = XNU_PATCHFIND_EXTRACT_MATCH;
+    }
+    return 1;
+}
+
+xnu_patchfind_t *
+xnu_patchfind_load (const char *path)
+{
+    xnu_patchfind_t *pf;
+    char line[PATCHFIND_MAX_LINE];
+    uint32_t lineno = 0, cap = 0;
+    FILE *fp;
+
+    if (!(fp = fopen (path, "r"))) {
+        errorf ("Could not open rules file: %s\n", path);
+        return NULL;
+    }
+
+    pf = calloc (1, sizeof (xnu_patchfind_t));
+    while (fgets (line, sizeof (line), fp)) {
+        char *p = line;
+        size_t n = strlen (line);
+        lineno++;
+
+        if (n && line[n - 1] != '\n' && !feof (fp)) {
+            errorf ("%s:%u: line is too long\n", path, lineno);
+            goto fail;
+        }
+
+        /* Skip blank lines and comments */
+        while (*p && isspace ((unsigned char) *p)) p++;
+        if (!*p || *p == '#') continue;
+
+        if (pf->nrules == cap) {
+            cap = (cap) ? cap * 2 : 32;
+            pf->rules = realloc (pf->rules, cap * sizeof (xnu_patchfind_rule_t));
+        }
+
+        xnu_patchfind_rule_t *rule = &pf->rules[pf->nrules++];
+        memset (rule, 0, sizeof (xnu_patchfind_rule_t));
+        if (!_patchfind_parse_rule (rule, p, path, lineno)) goto fail;
+    }
+    fclose (fp);
+
+    if (!pf->nrules) warningf ("No rules in %s\n", path);
+    return pf;
+
+fail:
+    fclose (fp);
+    xnu_patchfind_free (pf);
+    return NULL;
+}
+
+void
+xnu_patchfind_free (xnu_patchfind_t *pf)
+{
+    if (!pf) return;
+    for (uint32_t i = 0; i < pf->nrules; i++) {
+        free (pf->rules[i].name);
+        free (pf->rules[i].anchor);
+    }
+    free (pf->rules);
+    free (pf);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct patchfind_key_t
+{
+    uint64_t            hash;
+    uint32_t            rule;
+} patchfind_key_t;
+
+HTOOL_PRIVATE int
+_patchfind_key_compare (const void *a, const void *b)
+{
+    const patchfind_key_t *x = a, *y = b;
+    if (x->hash != y->hash) return (x->hash > y->hash) - (x->hash < y->hash);
+    return (x->rule > y->rule) - (x->rule < y->rule);
+}
+
+HTOOL_PRIVATE int
+_patchfind_anchor_compare (const void *a, const void *b)
+{
+    const patchfind_anchor_t *x = a, *y = b;
+    if (x->vmaddr != y->vmaddr) return (x->vmaddr > y->vmaddr) - (x->vmaddr < y->vmaddr);
+    return (x->rule > y->rule) - (x->rule < y->rule);
+}
+
+HTOOL_PRIVATE void
+_patchfind_push_anchor (patchfind_plan_t *plan, uint32_t *cap, uint64_t vmaddr, uint32_t rule)
+{
+    if (plan->nanchors == *cap) {
+        *cap = (*cap) ? *cap * 2 : 64;
+        plan->anchors = realloc (plan->anchors, *cap * sizeof (patchfind_anchor_t));
+    }
+    plan->anchors[plan->nanchors++] = (patchfind_anchor_t) { .vmaddr = vmaddr, .rule = rule };
+    plan->pf->rules[rule].nanchors++;
+}
+
+/**
+ *  Find every anchor in one pass over the string sections. Each string is hashed
+ *  and looked up in the sorted hashes of the anchors, but only if its length is
+ *  one that some anchor has.
+ *
+ *  The linker merges a string into the tail of a longer one that ends the same
+ *  way, so an anchor that isn't found as a whole string is searched for again as
+ *  the end of one.
+ */
+HTOOL_PRIVATE void
+_patchfind_compile (patchfind_plan_t *plan, htool_string_index_t *strings)
+{
+    xnu_patchfind_t *pf = plan->pf;
+    patchfind_key_t *keys = malloc (pf->nrules * sizeof (patchfind_key_t));
+    uint32_t minlen = UINT32_MAX, maxlen = 0, cap = 0;
+
+    for (uint32_t i = 0; i < pf->nrules; i++) {
+        keys[i] = (patchfind_key_t) { .hash = htool_hash64 (pf->rules[i].anchor, pf->rules[i].anchor_len, 0), .rule = i };
+        if (pf->rules[i].anchor_len < minlen) minlen = pf->rules[i].anchor_len;
+        if (pf->rules[i].anchor_len > maxlen) maxlen = pf->rules[i].anchor_len;
+    }
+    qsort (keys, pf->nrules, sizeof (patchfind_key_t), _patchfind_key_compare);
+
+    for (uint32_t r = 0; r < strings->nranges; r++) {
+        const unsigned char *data = strings->ranges[r].data, *p = data, *limit = data + strings->ranges[r].size;
+
+        while (p < limit) {
+            const unsigned char *nul = memchr (p, '\0', limit - p);
+            if (!nul) break;
+
+            size_t len = nul - p;
+            if (len >= minlen && len <= maxlen) {
+                uint64_t hash = htool_hash64 (p, len, 0);
+                uint32_t lo = 0, hi = pf->nrules;
+
+                while (lo < hi) {
+                    uint32_t mid = (lo + hi) / 2;
+                    if (keys[mid].hash < hash) lo = mid + 1;
+                    else hi = mid;
+                }
+                for (; lo < pf->nrules && keys[lo].hash == hash; lo++) {
+                    xnu_patchfind_rule_t *rule = &pf->rules[keys[lo].rule];
+                    if (rule->anchor_len == len && !memcmp (rule->anchor, p, len))
+                        _patchfind_push_anchor (plan, &cap, strings->ranges[r].vmaddr + (p - data), keys[lo].rule);
+                }
+            }
+            p = nul + 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < pf->nrules; i++) {
+        xnu_patchfind_rule_t *rule = &pf->rules[i];
+        if (rule->nanchors) continue;
+
+        for (uint32_t r = 0; r < strings->nranges; r++) {
+            const unsigned char *data = strings->ranges[r].data, *p = data;
+            uint64_t size = strings->ranges[r].size;
+
+            if (strings->ranges[r].strict) continue;
+            while ((uint64_t) (p - data) + rule->anchor_len < size) {
+                const unsigned char *hit = bh_memmem (p, size - (p - data), (const unsigned char *) rule->anchor, rule->anchor_len + 1);
+                if (!hit) break;
+                _patchfind_push_anchor (plan, &cap, strings->ranges[r].vmaddr + (hit - data), i);
+                p = hit + rule->anchor_len + 1;
+            }
+        }
+    }
+
+    qsort (plan->anchors, plan->nanchors, sizeof (patchfind_anchor_t), _patchfind_anchor_compare);
+    free (keys);
+}
+
+/**
+ *  The first anchor at `vmaddr`, or -1. The anchors for the same address follow
+ *  it.
+ */
+HTOOL_PRIVATE int64_t
+_patchfind_find_anchor (patchfind_plan_t *plan, uint64_t vmaddr)
+{
+    uint32_t lo = 0, hi = plan->nanchors;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (plan->anchors[mid].vmaddr < vmaddr) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < plan->nanchors && plan->anchors[lo].vmaddr == vmaddr) ? (int64_t) lo : -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  The address an instruction branches to, loads from, stores to or builds. The
+ *  register-relative forms need the registers from before the instruction ran,
+ *  which a backward search doesn't have, so `regs` may be NULL.
+ */
+HTOOL_PRIVATE int
+_patchfind_operand_target (uint32_t opcode, uint64_t pc, const a64_regs_t *regs, uint64_t *value)
+{
+    uint64_t imm;
+    unsigned rd, rn;
+    a64_flow_t flow = a64_classify_flow (opcode, pc, value);
+
+    if (flow == A64_FLOW_BRANCH || flow == A64_FLOW_BRANCH_COND || flow == A64_FLOW_CALL) return 1;
+    if (a64_decode_adrp (opcode, pc, &rd, value) || a64_decode_adr (opcode, pc, &rd, value)) return 1;
+    if (a64_decode_ldr_literal (opcode, pc, &rd, value)) return 1;
+    if (!regs) return 0;
+
+    if (a64_decode_add_imm (opcode, &rd, &rn, &imm) || a64_decode_ldr_imm (opcode, &rd, &rn, &imm) ||
+        a64_decode_str_imm (opcode, &rd, &rn, &imm)) {
+        if (rn == 31 || !a64_regs_valid (regs, rn)) return 0;
+        *value = regs->x[rn] + imm;
+        return 1;
+    }
+    return 0;
+}
+
+HTOOL_PRIVATE int
+_patchfind_operand_imm (uint32_t opcode, uint64_t *value)
+{
+    unsigned rd;
+
+    /* ADD/SUB (immediate), W or X */
+    if ((opcode & 0x1f800000) == 0x11000000) {
+        *value = (uint64_t) ((opcode >> 10) & 0xfff) << ((opcode & 0x00400000) ? 12 : 0);
+        return 1;
+    }
+    /* Loads and stores of general registers (immediate, unsigned offset) */
+    if ((opcode & 0x3f000000) == 0x39000000) {
+        *value = (uint64_t) ((opcode >> 10) & 0xfff) << (opcode >> 30);
+        return 1;
+    }
+    return a64_decode_movz (opcode, &rd, value);
+}
+
+HTOOL_PRIVATE void
+_patchfind_emit (patchfind_chunk_t *chunk, uint32_t rule, uint64_t xref, uint32_t opcode, uint64_t pc,
+                 const a64_regs_t *regs)
+{
+    xnu_patchfind_rule_t *r = &chunk->plan->pf->rules[rule];
+    const htool_function_t *func;
+    uint64_t value = 0;
+
+    switch (r->extract) {
+        case XNU_PATCHFIND_EXTRACT_XREF:
+            value = xref;
+            break;
+        case XNU_PATCHFIND_EXTRACT_MATCH:
+            value = pc;
+            break;
+        case XNU_PATCHFIND_EXTRACT_TARGET:
+            if (!_patchfind_operand_target (opcode, pc, regs, &value)) return;
+            break;
+        case XNU_PATCHFIND_EXTRACT_IMM:
+            if (!_patchfind_operand_imm (opcode, &value)) return;
+            break;
+        case XNU_PATCHFIND_EXTRACT_FUNCTION:
+            if (!(func = htool_functions_find (chunk->plan->functions, xref))) return;
+            value = func->vmaddr;
+            break;
+    }
+
+    if (chunk->nhits == chunk->caphits) {
+        chunk->caphits = (chunk->caphits) ? chunk->caphits * 2 : 16;
+        chunk->hits = realloc (chunk->hits, chunk->caphits * sizeof (patchfind_hit_t));
+    }
+    chunk->hits[chunk->nhits++] = (patchfind_hit_t) { .xref = xref, .value = value, .rule = rule };
+}
+
+/**
+ *  A reference to an anchor at `pc`. Rules without a pattern resolve straight
+ *  away, backward searches look through the history, and forward searches are
+ *  armed to be checked against the instructions that follow.
+ */
+HTOOL_PRIVATE void
+_patchfind_on_xref (patchfind_chunk_t *chunk, int64_t anchor, uint64_t pc, uint32_t opcode,
+                    const a64_regs_t *regs, const uint32_t *ring, uint32_t nring,
+                    patchfind_armed_t **armed, uint32_t *narmed, uint32_t *caparmed)
+{
+    patchfind_plan_t *plan = chunk->plan;
+    uint64_t vmaddr = plan->anchors[anchor].vmaddr;
+
+    for (; anchor < plan->nanchors && plan->anchors[anchor].vmaddr == vmaddr; anchor++) {
+        uint32_t index = plan->anchors[anchor].rule;
+        xnu_patchfind_rule_t *rule = &plan->pf->rules[index];
+
+        chunk->nxrefs[index]++;
+        if (!rule->match_mask) {
+            _patchfind_emit (chunk, index, pc, opcode, pc, regs);
+
+        } else if (rule->backward) {
+            uint32_t seen = 0;
+            for (uint32_t k = 1; k <= MIN (rule->window, nring); k++) {
+                uint32_t prev = ring[(nring - k) % XNU_PATCHFIND_MAX_WINDOW];
+                if ((prev & rule->match_mask) == rule->match_value && ++seen == rule->nth) {
+                    _patchfind_emit (chunk, index, pc, prev, pc - k * 4, NULL);
+                    break;
+                }
+            }
+
+        } else {
+            if (*narmed == *caparmed) {
+                *caparmed = (*caparmed) ? *caparmed * 2 : 16;
+                *armed = realloc (*armed, *caparmed * sizeof (patchfind_armed_t));
+            }
+            (*armed)[(*narmed)++] = (patchfind_armed_t) { .xref = pc, .rule = index, .left = rule->window };
+        }
+    }
+}
+
+HTOOL_PRIVATE void
+_patchfind_sweep_worker (void *ctx, uint32_t index)
+{
+    patchfind_chunk_t *chunk = &((patchfind_chunk_t *) ctx)[index];
+    patchfind_plan_t *plan = chunk->plan;
+    xnu_patchfind_rule_t *rules = plan->pf->rules;
+    uint64_t lo = plan->anchors[0].vmaddr, hi = plan->anchors[plan->nanchors - 1].vmaddr;
+    uint64_t lead = XNU_PATCHFIND_MAX_WINDOW * 4, region_end = chunk->vmaddr + chunk->size;
+    uint64_t pc = (chunk->start - chunk->vmaddr > lead) ? chunk->start - lead : chunk->vmaddr;
+    uint32_t ring[XNU_PATCHFIND_MAX_WINDOW], nring = 0, narmed = 0, caparmed = 0;
+    patchfind_armed_t *armed = NULL;
+    a64_regs_t regs = { 0 };
+
+    for (; pc < region_end && (pc < chunk->end || narmed); pc += 4) {
+        uint32_t opcode = _patchfind_rd32 (chunk->data + (pc - chunk->vmaddr));
+        uint64_t value, target, built = 0;
+        unsigned rd, rn;
+        int has_built = 0;
+
+        /* Forward searches see each instruction before it changes the registers */
+        for (uint32_t i = 0; i < narmed;) {
+            patchfind_armed_t *a = &armed[i];
+            xnu_patchfind_rule_t *rule = &rules[a->rule];
+            int done = 0;
+
+            if ((opcode & rule->match_mask) == rule->match_value && ++a->seen == rule->nth) {
+                _patchfind_emit (chunk, a->rule, a->xref, opcode, pc, &regs);
+                done = 1;
+            }
+            if (done || !--a->left) armed[i] = armed[--narmed];
+            else i++;
+        }
+
+        if (a64_decode_adrp (opcode, pc, &rd, &value) || a64_decode_movz (opcode, &rd, &value)) {
+            a64_regs_set (&regs, rd, value);
+
+        } else if (a64_decode_adr (opcode, pc, &rd, &value)) {
+            a64_regs_set (&regs, rd, value);
+            built = value, has_built = 1;
+
+        } else if (a64_decode_add_imm (opcode, &rd, &rn, &value)) {
+            if (rn != 31 && a64_regs_valid (&regs, rn)) {
+                built = regs.x[rn] + value, has_built = 1;
+                a64_regs_set (&regs, rd, built);
+            } else {
+                a64_regs_clear (&regs, rd);
+            }
+
+        } else if (a64_decode_mov_reg (opcode, &rd, &rn)) {
+            if (rn != 31 && a64_regs_valid (&regs, rn)) a64_regs_set (&regs, rd, regs.x[rn]);
+            else a64_regs_clear (&regs, rd);
+
+        } else if (!a64_is_pac_in_place (opcode)) {
+            /* Nothing carries over a call, or into whatever follows a return or branch */
+            a64_regs_clobber (&regs, opcode, a64_classify_flow (opcode, pc, &target));
+        }
+
+        if (has_built && built >= lo && built <= hi && pc >= chunk->start && pc < chunk->end) {
+            int64_t anchor = _patchfind_find_anchor (plan, built);
+            if (anchor >= 0)
+                _patchfind_on_xref (chunk, anchor, pc, opcode, &regs, ring, nring, &armed, &narmed, &caparmed);
+        }
+
+        ring[nring++ % XNU_PATCHFIND_MAX_WINDOW] = opcode;
+    }
+
+    free (armed);
+}
+
+HTOOL_PRIVATE int
+_patchfind_hit_compare (const void *a, const void *b)
+{
+    const patchfind_hit_t *x = a, *y = b;
+    if (x->rule != y->rule) return (x->rule > y->rule) - (x->rule < y->rule);
+    return (x->xref > y->xref) - (x->xref < y->xref);
+}
+
+htool_return_t
+xnu_patchfind_run (xnu_t *xnu, xnu_patchfind_t *pf)
+{
+    patchfind_plan_t plan = { .pf = pf };
+    patchfind_chunk_t *chunks = NULL;
+    patchfind_hit_t *hits = NULL;
+    uint32_t nchunks = 0, capchunks = 0, nhits = 0, nsegs, nexec = 0;
+
+    for (uint32_t i = 0; i < pf->nrules; i++) {
+        xnu_patchfind_rule_t *rule = &pf->rules[i];
+        rule->status = XNU_PATCHFIND_STATUS_NO_ANCHOR;
+        rule->value = rule->xref = 0;
+        rule->nanchors = rule->nxrefs = rule->nresolved = 0;
+
+        if (rule->extract == XNU_PATCHFIND_EXTRACT_FUNCTION && !plan.functions)
+            plan.functions = htool_functions_fetch (xnu->macho);
+    }
+
+    _patchfind_compile (&plan, htool_string_index_fetch (xnu->macho));
+
+    /* Split every executable segment into chunks, and sweep them all at once */
+    nsegs = h_slist_length (xnu->macho->scmds);
+    for (uint32_t i = 0; i < nsegs; i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (xnu->macho->scmds, i);
+        mach_segment_command_64_t *seg = info->segcmd;
+        uint64_t size = MIN (seg->vmsize, seg->filesize) & ~UINT64_C(3);
+
+        if (!(seg->initprot & VM_PROT_EXECUTE_BIT) || !size) continue;
+        if (seg->fileoff + seg->filesize > xnu->macho->size) continue;
+        nexec++;
+
+        for (uint64_t off = 0; plan.nanchors && off < size; off += PATCHFIND_CHUNK_SIZE) {
+            if (nchunks == capchunks) {
+                capchunks = (capchunks) ? capchunks * 2 : 64;
+                chunks = realloc (chunks, capchunks * sizeof (patchfind_chunk_t));
+            }
+            chunks[nchunks++] = (patchfind_chunk_t) {
+                .plan = &plan,
+                .data = xnu->macho->data + seg->fileoff,
+                .vmaddr = seg->vmaddr,
+                .size = size,
+                .start = seg->vmaddr + off,
+                .end = seg->vmaddr + off + MIN (size - off, PATCHFIND_CHUNK_SIZE),
+                .nxrefs = calloc (pf->nrules, sizeof (uint32_t)),
+            };
+        }
+    }
+    if (!nexec) {
+        errorf ("Kernelcache has no executable segments to search\n");
+        free (plan.anchors);
+        return HTOOL_RETURN_FAILURE;
+    }
+    htool_parallel_for (nchunks, _patchfind_sweep_worker, chunks);
+
+    /* Gather the hits, and take each rule's value from its lowest reference */
+    for (uint32_t c = 0; c < nchunks; c++) {
+        for (uint32_t i = 0; i < pf->nrules; i++) pf->rules[i].nxrefs += chunks[c].nxrefs[i];
+        hits = realloc (hits, (nhits + chunks[c].nhits + 1) * sizeof (patchfind_hit_t));
+        if (chunks[c].nhits) memcpy (hits + nhits, chunks[c].hits, chunks[c].nhits * sizeof (patchfind_hit_t));
+        nhits += chunks[c].nhits;
+        free (chunks[c].hits);
+        free (chunks[c].nxrefs);
+    }
+    qsort (hits, nhits, sizeof (patchfind_hit_t), _patchfind_hit_compare);
+
+    for (uint32_t i = 0; i < pf->nrules; i++) {
+        xnu_patchfind_rule_t *rule = &pf->rules[i];
+        if (rule->nanchors) rule->status = (rule->nxrefs) ? XNU_PATCHFIND_STATUS_NO_MATCH : XNU_PATCHFIND_STATUS_NO_XREF;
+    }
+    for (uint32_t i = 0; i < nhits; i++) {
+        xnu_patchfind_rule_t *rule = &pf->rules[hits[i].rule];
+
+        if (!rule->nresolved++) {
+            rule->status = XNU_PATCHFIND_STATUS_RESOLVED;
+            rule->value = hits[i].value;
+            rule->xref = hits[i].xref;
+        } else if (hits[i].value != rule->value) {
+            rule->status = XNU_PATCHFIND_STATUS_AMBIGUOUS;
+        }
+    }
+
+    free (hits);
+    free (chunks);
+    free (plan.anchors);
+    return HTOOL_RETURN_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void
+xnu_patchfind_print (xnu_t *xnu, xnu_patchfind_t *pf)
+{
+    htool_vmmap_t *vmmap = htool_vmmap_fetch (xnu->macho);
+    uint32_t nresolved = 0, width = 4;
+
+    for (uint32_t i = 0; i < pf->nrules; i++) {
+        if (pf->rules[i].status >= XNU_PATCHFIND_STATUS_RESOLVED) nresolved++;
+        if (strlen (pf->rules[i].name) > width) width = (uint32_t) strlen (pf->rules[i].name);
+    }
+    printf (BOLD RED "[*] Patchfinder:" RESET DARK_GREY " %d of %d rules resolved\n" RESET, nresolved, pf->nrules);
+    printf (BOLD "  %-*s  %-18s  %-12s  %s\n" RESET, width, "Name", "Value", "Offset", "Reference");
+
+    for (uint32_t i = 0; i < pf->nrules; i++) {
+        xnu_patchfind_rule_t *rule = &pf->rules[i];
+        uint64_t offset;
+
+        switch (rule->status) {
+            case XNU_PATCHFIND_STATUS_NO_ANCHOR:
+                printf ("  %-*s  " RED "string not found" RESET "\n", width, rule->name);
+                continue;
+            case XNU_PATCHFIND_STATUS_NO_XREF:
+                printf ("  %-*s  " RED "no references to the string" RESET DARK_GREY " (%d found)\n" RESET,
+                        width, rule->name, rule->nanchors);
+                continue;
+            case XNU_PATCHFIND_STATUS_NO_MATCH:
+                printf ("  %-*s  " RED "no match" RESET DARK_GREY " (%d references)\n" RESET, width, rule->name, rule->nxrefs);
+                continue;
+            default:
+                break;
+        }
+
+        printf ("  %-*s  0x%016llx  ", width, rule->name, rule->value);
+        if (rule->extract != XNU_PATCHFIND_EXTRACT_IMM && htool_vmmap_vmaddr_to_offset (vmmap, rule->value, &offset))
+            printf ("0x%-10llx  ", offset);
+        else
+            printf ("%-12s  ", "-");
+        printf (DARK_GREY "0x%llx" RESET, rule->xref);
+
+        if (rule->status == XNU_PATCHFIND_STATUS_AMBIGUOUS)
+            printf (YELLOW " (ambiguous, %d references resolved to different values)" RESET, rule->nresolved);
+        printf ("\n");
+    }
+}
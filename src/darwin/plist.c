@@ -0,0 +1,900 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "htool.h"
+#include "darwin/plist.h"
+
+/* Anything nested deeper than this is treated as malformed */
+#define PLIST_XML_MAX_DEPTH         64
+
+/* A binary plist starts with the magic, and ends with a trailer locating its offset table */
+#define PLIST_BINARY_MAGIC          "bplist00"
+#define PLIST_BINARY_MAGIC_SIZE     8
+#define PLIST_BINARY_TRAILER_SIZE   32
+
+/**
+ *  What the walker does with the container it's currently in. Everything below
+ *  the containers the caller is interested in is walked with PLIST_ROLE_SKIP,
+ *  which only registers IDs.
+ */
+typedef enum plist_role_t
+{
+    PLIST_ROLE_SKIP = 0,
+    PLIST_ROLE_PRELINK_ROOT,        /* root dict, look for _PrelinkInfoDictionary */
+    PLIST_ROLE_PRELINK_KEXTS,       /* array of kext dicts */
+    PLIST_ROLE_COLLECT,             /* dict, add each entry to `target` */
+    PLIST_ROLE_ITERATE,             /* array, call `fn` for each element */
+} plist_role_t;
+
+typedef struct plist_xml_ctx_t
+{
+    const char         *p;
+    const char         *end;
+
+    /* Values with an ID. Once the first pass is done the table is frozen */
+    plist_t            *plist;
+    uint32_t            capids;
+    int                 frozen;
+
+    /* Output for the current role */
+    plist_dict_t       *target;
+    uint32_t            capkexts;
+    plist_array_fn_t    fn;
+    void               *fn_ctx;
+} plist_xml_ctx_t;
+
+typedef struct plist_xml_tag_t
+{
+    const char         *start;      /* the '<' */
+    const char         *name;
+    uint32_t            name_len;
+    int                 closing;
+    int                 empty;      /* <name/> */
+    int                 has_id;
+    uint32_t            id;
+    int                 has_idref;
+    uint32_t            idref;
+} plist_xml_tag_t;
+
+/**
+ *  The layout of a binary plist, from its trailer. Object `n` starts at the offset
+ *  stored in the `n`th entry of the offset table, and containers refer to their
+ *  elements by object number.
+ */
+typedef struct plist_binary_t
+{
+    const uint8_t      *data;
+    size_t              size;
+    const uint8_t      *offsets;
+    uint64_t            nobjects;
+    uint64_t            top;
+    uint8_t             offset_size;
+    uint8_t             ref_size;
+} plist_binary_t;
+
+HTOOL_PRIVATE int
+_plist_xml_walk (plist_xml_ctx_t *ctx, const plist_xml_tag_t *tag, plist_role_t role, int depth, plist_value_t *value);
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define PLIST_IS_SPACE(c)           ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+HTOOL_PRIVATE int
+_plist_xml_name_is (const plist_xml_tag_t *tag, const char *name)
+{
+    size_t len = strlen (name);
+    return tag->name_len == len && !memcmp (tag->name, name, len);
+}
+
+HTOOL_PRIVATE const char *
+_plist_xml_find (const char *p, const char *end, const char *str)
+{
+    size_t len = strlen (str);
+    while (p && (size_t) (end - p) >= len) {
+        if (!(p = memchr (p, str[0], (end - p) - len + 1))) return NULL;
+        if (!memcmp (p, str, len)) return p;
+        p++;
+    }
+    return NULL;
+}
+
+HTOOL_PRIVATE int
+_plist_xml_parse_uint32 (const char *p, const char *end, uint32_t *out)
+{
+    uint64_t v = 0;
+    if (p == end) return 0;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') return 0;
+        v = v * 10 + (*p - '0');
+        if (v > UINT32_MAX) return 0;
+    }
+    *out = (uint32_t) v;
+    return 1;
+}
+
+/**
+ *  Read the attributes of a tag. Only ID and IDREF mean anything, everything else
+ *  (e.g. `size="64"` on an integer) is skipped over.
+ */
+HTOOL_PRIVATE int
+_plist_xml_parse_attrs (const char *p, const char *end, plist_xml_tag_t *tag)
+{
+    while (p < end) {
+        const char *name, *val;
+        size_t name_len;
+
+        while (p < end && PLIST_IS_SPACE (*p)) p++;
+        if (p == end) break;
+
+        name = p;
+        while (p < end && *p != '=' && !PLIST_IS_SPACE (*p)) p++;
+        name_len = p - name;
+
+        while (p < end && PLIST_IS_SPACE (*p)) p++;
+        if (p == end || *p++ != '=') return 0;
+        while (p < end && PLIST_IS_SPACE (*p)) p++;
+        if (p == end || (*p != '"' && *p != '\'')) return 0;
+
+        val = p + 1;
+        if (!(p = memchr (val, *p, end - val))) return 0;
+
+        if (name_len == 5 && !memcmp (name, "IDREF", 5))
+            tag->has_idref = _plist_xml_parse_uint32 (val, p, &tag->idref);
+        else if (name_len == 2 && !memcmp (name, "ID", 2))
+            tag->has_id = _plist_xml_parse_uint32 (val, p, &tag->id);
+        p++;
+    }
+    return 1;
+}
+
+/**
+ *  Read the next element tag, skipping the XML declaration, DOCTYPE and any
+ *  comments. Leaves `ctx->p` just past the tag.
+ */
+HTOOL_PRIVATE int
+_plist_xml_next_tag (plist_xml_ctx_t *ctx, plist_xml_tag_t *tag)
+{
+    const char *p = ctx->p, *end = ctx->end, *close;
+
+    for (;;) {
+        if (!(p = memchr (p, '<', end - p)) || end - p < 2) return 0;
+
+        if (p[1] == '?') {
+            if (!(p = _plist_xml_find (p, end, "?>"))) return 0;
+            p += 2;
+        } else if (end - p >= 4 && !memcmp (p, "<!--", 4)) {
+            if (!(p = _plist_xml_find (p, end, "-->"))) return 0;
+            p += 3;
+        } else if (p[1] == '!') {
+            if (!(p = memchr (p, '>', end - p))) return 0;
+            p++;
+        } else {
+            break;
+        }
+    }
+
+    memset (tag, 0, sizeof (plist_xml_tag_t));
+    tag->start = p++;
+    if (*p == '/') {
+        tag->closing = 1;
+        p++;
+    }
+
+    if (!(close = memchr (p, '>', end - p))) return 0;
+    ctx->p = close + 1;
+    if (close > p && close[-1] == '/') {
+        tag->empty = 1;
+        close--;
+    }
+
+    tag->name = p;
+    while (p < close && !PLIST_IS_SPACE (*p)) p++;
+    tag->name_len = p - tag->name;
+
+    return tag->name_len && _plist_xml_parse_attrs (p, close, tag);
+}
+
+/**
+ *  Text content of a leaf element, up to its closing tag. XML doesn't allow a raw
+ *  '<' in text, so the content ends at the next one.
+ */
+HTOOL_PRIVATE int
+_plist_xml_leaf (plist_xml_ctx_t *ctx, const plist_xml_tag_t *open, const char **data, uint32_t *size)
+{
+    plist_xml_tag_t close;
+
+    if (open->empty) {
+        *data = ctx->p;
+        *size = 0;
+        return 1;
+    }
+
+    *data = ctx->p;
+    if (!(ctx->p = memchr (ctx->p, '<', ctx->end - ctx->p))) return 0;
+    *size = ctx->p - *data;
+
+    return _plist_xml_next_tag (ctx, &close) && close.closing &&
+           close.name_len == open->name_len && !memcmp (close.name, open->name, open->name_len);
+}
+
+HTOOL_PRIVATE uint64_t
+_plist_xml_parse_integer (const char *p, uint32_t size)
+{
+    const char *end = p + size;
+    uint64_t v = 0;
+    int neg = 0;
+
+    while (p < end && PLIST_IS_SPACE (*p)) p++;
+    if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        for (p += 2; p < end; p++) {
+            char c = *p;
+            if (c >= '0' && c <= '9') v = (v << 4) | (c - '0');
+            else if (c >= 'a' && c <= 'f') v = (v << 4) | (c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') v = (v << 4) | (c - 'A' + 10);
+            else break;
+        }
+    } else {
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+            v = v * 10 + (*p - '0');
+    }
+    return neg ? (uint64_t) -(int64_t) v : v;
+}
+
+HTOOL_PRIVATE void
+_plist_xml_register_id (plist_xml_ctx_t *ctx, uint32_t id, const plist_value_t *value)
+{
+    plist_t *plist = ctx->plist;
+
+    if (ctx->frozen) return;
+    if (id >= ctx->capids) {
+        uint32_t cap = ctx->capids ? ctx->capids : 256;
+        while (cap <= id) cap *= 2;
+
+        plist->ids = realloc (plist->ids, cap * sizeof (plist_value_t));
+        memset (plist->ids + ctx->capids, 0, (cap - ctx->capids) * sizeof (plist_value_t));
+        ctx->capids = cap;
+    }
+    plist->ids[id] = *value;
+    if (id >= plist->nids) plist->nids = id + 1;
+}
+
+HTOOL_PRIVATE plist_type_t
+_plist_xml_type (const plist_xml_tag_t *tag)
+{
+    switch (tag->name_len) {
+        case 4:
+            if (_plist_xml_name_is (tag, "dict")) return PLIST_TYPE_DICT;
+            if (_plist_xml_name_is (tag, "real")) return PLIST_TYPE_REAL;
+            if (_plist_xml_name_is (tag, "true")) return PLIST_TYPE_BOOL;
+            if (_plist_xml_name_is (tag, "date")) return PLIST_TYPE_DATE;
+            if (_plist_xml_name_is (tag, "data")) return PLIST_TYPE_DATA;
+            break;
+        case 5:
+            if (_plist_xml_name_is (tag, "array")) return PLIST_TYPE_ARRAY;
+            if (_plist_xml_name_is (tag, "false")) return PLIST_TYPE_BOOL;
+            break;
+        case 6:
+            if (_plist_xml_name_is (tag, "string")) return PLIST_TYPE_STRING;
+            break;
+        case 7:
+            if (_plist_xml_name_is (tag, "integer")) return PLIST_TYPE_INTEGER;
+            break;
+    }
+    return PLIST_TYPE_NONE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void
+_plist_dict_append (plist_dict_t *dict, const char *key, uint32_t key_len, const plist_value_t *value)
+{
+    if (dict->nentries == dict->capacity) {
+        dict->capacity = dict->capacity ? dict->capacity * 2 : 32;
+        dict->entries = realloc (dict->entries, dict->capacity * sizeof (plist_entry_t));
+    }
+    dict->entries[dict->nentries++] = (plist_entry_t) { .key = key, .key_len = key_len, .value = *value };
+}
+
+HTOOL_PRIVATE plist_dict_t *
+_plist_prelink_new_kext (plist_xml_ctx_t *ctx)
+{
+    plist_t *plist = ctx->plist;
+
+    if (plist->nkexts == ctx->capkexts) {
+        ctx->capkexts = ctx->capkexts ? ctx->capkexts * 2 : 256;
+        plist->kexts = realloc (plist->kexts, ctx->capkexts * sizeof (plist_dict_t));
+    }
+    memset (&plist->kexts[plist->nkexts], 0, sizeof (plist_dict_t));
+    return &plist->kexts[plist->nkexts++];
+}
+
+/**
+ *  Walk the children of a container. `role` is what to do with this container,
+ *  and decides what happens to each child.
+ */
+HTOOL_PRIVATE int
+_plist_xml_walk_children (plist_xml_ctx_t *ctx, const plist_xml_tag_t *open, plist_type_t type,
+                          plist_role_t role, int depth)
+{
+    plist_xml_tag_t tag;
+    plist_value_t child;
+
+    for (;;) {
+        const char *key = NULL;
+        uint32_t key_len = 0;
+        plist_role_t child_role = PLIST_ROLE_SKIP;
+
+        if (!_plist_xml_next_tag (ctx, &tag)) return 0;
+        if (tag.closing) return tag.name_len == open->name_len && !memcmp (tag.name, open->name, open->name_len);
+
+        if (type == PLIST_TYPE_DICT) {
+            /* Keys can't have IDs, so there's nothing to register here */
+            if (!_plist_xml_name_is (&tag, "key") || !_plist_xml_leaf (ctx, &tag, &key, &key_len)) return 0;
+            if (!_plist_xml_next_tag (ctx, &tag) || tag.closing) return 0;
+
+            if (role == PLIST_ROLE_PRELINK_ROOT && key_len == 22 && !memcmp (key, "_PrelinkInfoDictionary", 22))
+                child_role = PLIST_ROLE_PRELINK_KEXTS;
+        } else if (role == PLIST_ROLE_PRELINK_KEXTS) {
+            child_role = PLIST_ROLE_COLLECT;
+        }
+
+        /* Each kext dict collects into its own record */
+        plist_dict_t *saved = ctx->target;
+        if (child_role == PLIST_ROLE_COLLECT) ctx->target = _plist_prelink_new_kext (ctx);
+
+        if (!_plist_xml_walk (ctx, &tag, child_role, depth + 1, &child)) return 0;
+        ctx->target = saved;
+
+        if (role == PLIST_ROLE_COLLECT) _plist_dict_append (ctx->target, key, key_len, &child);
+        else if (role == PLIST_ROLE_ITERATE) ctx->fn (ctx->fn_ctx, &child);
+    }
+}
+
+/**
+ *  Parse the value whose opening tag is `tag` into `value`, registering any IDs
+ *  inside it on the way.
+ */
+HTOOL_PRIVATE int
+_plist_xml_walk (plist_xml_ctx_t *ctx, const plist_xml_tag_t *tag, plist_role_t role, int depth, plist_value_t *value)
+{
+    plist_type_t type = _plist_xml_type (tag);
+
+    if (type == PLIST_TYPE_NONE || depth > PLIST_XML_MAX_DEPTH) return 0;
+    memset (value, 0, sizeof (plist_value_t));
+    value->format = PLIST_FORMAT_XML;
+
+    /**
+     *  A reference repeats a value that's already been seen. If it's a container the
+     *  caller wants to look inside, walk the original's span again.
+     */
+    if (tag->has_idref) {
+        const char *data;
+        uint32_t size;
+
+        if (tag->idref >= ctx->plist->nids || ctx->plist->ids[tag->idref].type == PLIST_TYPE_NONE) return 0;
+        if (!_plist_xml_leaf (ctx, tag, &data, &size)) return 0;
+        *value = ctx->plist->ids[tag->idref];
+
+        if (role != PLIST_ROLE_SKIP && (value->type == PLIST_TYPE_DICT || value->type == PLIST_TYPE_ARRAY)) {
+            plist_xml_ctx_t sub = *ctx;
+            plist_xml_tag_t open;
+
+            sub.p = value->data;
+            sub.end = value->data + value->size;
+            sub.frozen = 1;
+            if (!_plist_xml_next_tag (&sub, &open)) return 0;
+            if (!open.empty && !_plist_xml_walk_children (&sub, &open, value->type, role, depth)) return 0;
+            ctx->capkexts = sub.capkexts;
+        }
+        return 1;
+    }
+
+    value->type = type;
+    if (type == PLIST_TYPE_DICT || type == PLIST_TYPE_ARRAY) {
+        if (!tag->empty && !_plist_xml_walk_children (ctx, tag, type, role, depth)) return 0;
+        value->data = tag->start;
+        value->size = ctx->p - tag->start;
+    } else {
+        if (!_plist_xml_leaf (ctx, tag, &value->data, &value->size)) return 0;
+        if (type == PLIST_TYPE_INTEGER) value->integer = _plist_xml_parse_integer (value->data, value->size);
+        else if (type == PLIST_TYPE_BOOL) value->integer = (tag->name_len == 4);
+    }
+
+    if (tag->has_id) _plist_xml_register_id (ctx, tag->id, value);
+    return 1;
+}
+
+/**
+ *  Walk a single container value that's already been parsed once, so the IDs
+ *  are all known.
+ */
+HTOOL_PRIVATE htool_return_t
+_plist_xml_rewalk (plist_xml_ctx_t *ctx, const plist_value_t *value, plist_type_t type, plist_role_t role)
+{
+    plist_xml_tag_t open;
+    plist_value_t tmp;
+
+    if (!value || value->type != type || value->format != PLIST_FORMAT_XML) return HTOOL_RETURN_FAILURE;
+
+    ctx->p = value->data;
+    ctx->end = value->data + value->size;
+    ctx->frozen = 1;
+
+    if (!_plist_xml_next_tag (ctx, &open) || !_plist_xml_walk (ctx, &open, role, 0, &tmp))
+        return HTOOL_RETURN_FAILURE;
+    return HTOOL_RETURN_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE uint64_t
+_plist_binary_read_uint (const uint8_t *p, uint32_t size)
+{
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < size; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+HTOOL_PRIVATE int
+_plist_binary_open (plist_binary_t *bin, const char *data, size_t size)
+{
+    const uint8_t *trailer;
+    uint64_t table;
+
+    if (size < PLIST_BINARY_MAGIC_SIZE + PLIST_BINARY_TRAILER_SIZE ||
+        memcmp (data, PLIST_BINARY_MAGIC, PLIST_BINARY_MAGIC_SIZE))
+        return 0;
+
+    bin->data = (const uint8_t *) data;
+    bin->size = size - PLIST_BINARY_TRAILER_SIZE;
+
+    trailer = bin->data + bin->size;
+    bin->offset_size = trailer[6];
+    bin->ref_size = trailer[7];
+    bin->nobjects = _plist_binary_read_uint (trailer + 8, 8);
+    bin->top = _plist_binary_read_uint (trailer + 16, 8);
+    table = _plist_binary_read_uint (trailer + 24, 8);
+
+    if (!bin->offset_size || bin->offset_size > 8 || !bin->ref_size || bin->ref_size > 8) return 0;
+    if (table > bin->size || bin->nobjects > (bin->size - table) / bin->offset_size) return 0;
+    if (bin->top >= bin->nobjects) return 0;
+
+    bin->offsets = bin->data + table;
+    return 1;
+}
+
+/**
+ *  The element count of an object, from the low nibble of its marker. A count of
+ *  15 or more is stored as an integer object straight after the marker.
+ */
+HTOOL_PRIVATE int
+_plist_binary_count (const plist_binary_t *bin, const uint8_t **p, uint8_t marker, uint64_t *count)
+{
+    const uint8_t *end = bin->data + bin->size;
+    uint32_t size;
+
+    if ((marker & 0xf) != 0xf) {
+        *count = marker & 0xf;
+        return 1;
+    }
+
+    if (*p >= end || (**p & 0xf0) != 0x10 || (**p & 0xf) > 3) return 0;
+    size = 1 << (**p & 0xf);
+    if ((size_t) (end - *p) < size + 1) return 0;
+
+    *count = _plist_binary_read_uint (*p + 1, size);
+    *p += size + 1;
+    return 1;
+}
+
+/**
+ *  Decode object `ref` into `value`, without looking inside it. Containers only
+ *  record where their object references are, so they're decoded when they're
+ *  parsed or iterated.
+ */
+HTOOL_PRIVATE int
+_plist_binary_value (const plist_binary_t *bin, uint64_t ref, plist_value_t *value)
+{
+    const uint8_t *p, *end = bin->data + bin->size;
+    uint64_t offset, count, size;
+    uint8_t marker;
+
+    if (ref >= bin->nobjects) return 0;
+    offset = _plist_binary_read_uint (bin->offsets + ref * bin->offset_size, bin->offset_size);
+    if (offset < PLIST_BINARY_MAGIC_SIZE || offset >= bin->size) return 0;
+
+    memset (value, 0, sizeof (plist_value_t));
+    value->format = PLIST_FORMAT_BINARY;
+
+    p = bin->data + offset;
+    marker = *p++;
+    switch (marker >> 4) {
+        case 0x0:
+            if (marker != 0x08 && marker != 0x09) return 0;
+            value->type = PLIST_TYPE_BOOL;
+            value->integer = (marker == 0x09);
+            value->data = (const char *) p;
+            return 1;
+
+        case 0x1:
+            /* 16-byte integers only show up for values that don't fit in 64 bits signed */
+            if ((marker & 0xf) > 4) return 0;
+            value->type = PLIST_TYPE_INTEGER;
+            size = 1 << (marker & 0xf);
+            break;
+
+        case 0x2:
+            if ((marker & 0xf) != 2 && (marker & 0xf) != 3) return 0;
+            value->type = PLIST_TYPE_REAL;
+            size = 1 << (marker & 0xf);
+            break;
+
+        case 0x3:
+            if (marker != 0x33) return 0;
+            value->type = PLIST_TYPE_DATE;
+            size = 8;
+            break;
+
+        case 0x4:
+            if (!_plist_binary_count (bin, &p, marker, &count)) return 0;
+            value->type = PLIST_TYPE_DATA;
+            size = count;
+            break;
+
+        case 0x5:
+        case 0x6:
+            if (!_plist_binary_count (bin, &p, marker, &count)) return 0;
+            value->type = PLIST_TYPE_STRING;
+            value->integer = (marker >> 4 == 0x6) ? 2 : 1;
+            size = count * value->integer;
+            break;
+
+        case 0x8:
+            /* UIDs only appear in keyed archives, treat them as plain integers */
+            value->type = PLIST_TYPE_INTEGER;
+            size = (marker & 0xf) + 1;
+            break;
+
+        case 0xa:
+            if (!_plist_binary_count (bin, &p, marker, &count)) return 0;
+            value->type = PLIST_TYPE_ARRAY;
+            size = count * bin->ref_size;
+            break;
+
+        case 0xd:
+            if (!_plist_binary_count (bin, &p, marker, &count)) return 0;
+            value->type = PLIST_TYPE_DICT;
+            size = count * 2 * bin->ref_size;
+            break;
+
+        default:
+            return 0;
+    }
+
+    if (size > (uint64_t) (end - p) || size > UINT32_MAX) return 0;
+    value->data = (const char *) p;
+    value->size = (uint32_t) size;
+
+    if (value->type == PLIST_TYPE_INTEGER)
+        value->integer = _plist_binary_read_uint (p + ((size > 8) ? size - 8 : 0), (size > 8) ? 8 : size);
+    return 1;
+}
+
+HTOOL_PRIVATE uint64_t
+_plist_binary_ref (const plist_binary_t *bin, const plist_value_t *container, uint64_t index)
+{
+    return _plist_binary_read_uint ((const uint8_t *) container->data + index * bin->ref_size, bin->ref_size);
+}
+
+/**
+ *  Add each entry of a dict to `dict`. Keys point straight at the string data,
+ *  so a key that isn't ASCII (there are none in a kernelcache) is skipped.
+ */
+HTOOL_PRIVATE int
+_plist_binary_collect (const plist_binary_t *bin, const plist_value_t *value, plist_dict_t *dict)
+{
+    uint64_t count = value->size / (2 * bin->ref_size);
+
+    for (uint64_t i = 0; i < count; i++) {
+        plist_value_t key, child;
+
+        if (!_plist_binary_value (bin, _plist_binary_ref (bin, value, i), &key) || key.type != PLIST_TYPE_STRING) return 0;
+        if (!_plist_binary_value (bin, _plist_binary_ref (bin, value, count + i), &child)) return 0;
+        if (key.integer == 1) _plist_dict_append (dict, key.data, key.size, &child);
+    }
+    return 1;
+}
+
+HTOOL_PRIVATE int
+_plist_binary_string_is (const plist_value_t *value, const char *str, size_t len)
+{
+    return value->type == PLIST_TYPE_STRING && value->integer == 1 && value->size == len &&
+           !memcmp (value->data, str, len);
+}
+
+/**
+ *  A binary plist is parsed by following object references from the top object,
+ *  so only the root dictionary, the kext array and the kext dictionaries are ever
+ *  decoded.
+ */
+HTOOL_PRIVATE int
+_plist_binary_parse_prelink_info (plist_t *plist)
+{
+    plist_binary_t bin;
+    plist_value_t root, kexts = { 0 };
+    uint64_t count;
+    uint32_t capkexts = 0;
+
+    if (!_plist_binary_open (&bin, plist->data, plist->size)) return 0;
+    if (!_plist_binary_value (&bin, bin.top, &root) || root.type != PLIST_TYPE_DICT) return 0;
+
+    count = root.size / (2 * bin.ref_size);
+    for (uint64_t i = 0; i < count; i++) {
+        plist_value_t key;
+        if (!_plist_binary_value (&bin, _plist_binary_ref (&bin, &root, i), &key)) return 0;
+        if (!_plist_binary_string_is (&key, "_PrelinkInfoDictionary", 22)) continue;
+        if (!_plist_binary_value (&bin, _plist_binary_ref (&bin, &root, count + i), &kexts)) return 0;
+        break;
+    }
+    if (kexts.type != PLIST_TYPE_ARRAY) return kexts.type == PLIST_TYPE_NONE;
+
+    /* Everything is sized up front, as the array says how many kexts there are */
+    capkexts = kexts.size / bin.ref_size;
+    plist->kexts = calloc (capkexts ? capkexts : 1, sizeof (plist_dict_t));
+    for (uint32_t i = 0; i < capkexts; i++) {
+        plist_value_t kext;
+        if (!_plist_binary_value (&bin, _plist_binary_ref (&bin, &kexts, i), &kext)) return 0;
+
+        plist->nkexts++;
+        if (kext.type == PLIST_TYPE_DICT && !_plist_binary_collect (&bin, &kext, &plist->kexts[i])) return 0;
+    }
+    return 1;
+}
+
+HTOOL_PRIVATE void
+_plist_binary_copy_utf16 (const plist_value_t *value, char *out)
+{
+    const uint8_t *p = (const uint8_t *) value->data, *end = p + value->size;
+
+    while (p < end) {
+        uint32_t c = (p[0] << 8) | p[1];
+        p += 2;
+
+        /* Join surrogate pairs */
+        if (c >= 0xd800 && c < 0xdc00 && p < end) {
+            uint32_t lo = (p[0] << 8) | p[1];
+            if (lo >= 0xdc00 && lo < 0xe000) {
+                c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+                p += 2;
+            }
+        }
+
+        if (c < 0x80) *out++ = (char) c;
+        else if (c < 0x800) {
+            *out++ = (char) (0xc0 | (c >> 6));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            *out++ = (char) (0xe0 | (c >> 12));
+            *out++ = (char) (0x80 | ((c >> 6) & 0x3f));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        } else {
+            *out++ = (char) (0xf0 | (c >> 18));
+            *out++ = (char) (0x80 | ((c >> 12) & 0x3f));
+            *out++ = (char) (0x80 | ((c >> 6) & 0x3f));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        }
+    }
+    *out = '\0';
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+plist_t *
+plist_parse_prelink_info (const char *data, size_t size)
+{
+    plist_xml_ctx_t ctx;
+    plist_xml_tag_t tag;
+    plist_value_t root;
+    plist_t *plist;
+
+    plist = calloc (1, sizeof (plist_t));
+    plist->format = PLIST_FORMAT_XML;
+    plist->data = data;
+    plist->size = size;
+
+    if (size >= PLIST_BINARY_MAGIC_SIZE && !memcmp (data, PLIST_BINARY_MAGIC, PLIST_BINARY_MAGIC_SIZE)) {
+        plist->format = PLIST_FORMAT_BINARY;
+        if (_plist_binary_parse_prelink_info (plist)) return plist;
+
+        errorf ("plist_parse_prelink_info: malformed binary plist\n");
+        plist_free (plist);
+        return NULL;
+    }
+
+    memset (&ctx, 0, sizeof (plist_xml_ctx_t));
+    ctx.p = data;
+    ctx.end = data + size;
+    ctx.plist = plist;
+
+    /* The <plist> element wraps the root dictionary */
+    if (!_plist_xml_next_tag (&ctx, &tag)) goto fail;
+    if (_plist_xml_name_is (&tag, "plist") && !_plist_xml_next_tag (&ctx, &tag)) goto fail;
+
+    if (_plist_xml_type (&tag) != PLIST_TYPE_DICT ||
+        !_plist_xml_walk (&ctx, &tag, PLIST_ROLE_PRELINK_ROOT, 0, &root))
+        goto fail;
+
+    return plist;
+
+fail:
+    errorf ("plist_parse_prelink_info: malformed plist at offset 0x%llx\n", (unsigned long long) (ctx.p - data));
+    plist_free (plist);
+    return NULL;
+}
+
+void
+plist_free (plist_t *plist)
+{
+    if (!plist) return;
+    for (uint32_t i = 0; i < plist->nkexts; i++)
+        plist_dict_free (&plist->kexts[i]);
+    free (plist->kexts);
+    free (plist->ids);
+    free (plist);
+}
+
+htool_return_t
+plist_value_parse_dict (const plist_t *plist, const plist_value_t *value, plist_dict_t *dict)
+{
+    plist_xml_ctx_t ctx;
+
+    memset (&ctx, 0, sizeof (plist_xml_ctx_t));
+    memset (dict, 0, sizeof (plist_dict_t));
+    ctx.plist = (plist_t *) plist;
+    ctx.target = dict;
+
+    if (value && value->format == PLIST_FORMAT_BINARY) {
+        plist_binary_t bin;
+
+        if (value->type == PLIST_TYPE_DICT && _plist_binary_open (&bin, plist->data, plist->size) &&
+            _plist_binary_collect (&bin, value, dict))
+            return HTOOL_RETURN_SUCCESS;
+
+        plist_dict_free (dict);
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    if (_plist_xml_rewalk (&ctx, value, PLIST_TYPE_DICT, PLIST_ROLE_COLLECT) != HTOOL_RETURN_SUCCESS) {
+        plist_dict_free (dict);
+        return HTOOL_RETURN_FAILURE;
+    }
+    return HTOOL_RETURN_SUCCESS;
+}
+
+htool_return_t
+plist_array_iterate (const plist_t *plist, const plist_value_t *value, plist_array_fn_t fn, void *ctx)
+{
+    plist_xml_ctx_t xml;
+
+    if (value && value->format == PLIST_FORMAT_BINARY) {
+        plist_binary_t bin;
+        plist_value_t elem;
+
+        if (value->type != PLIST_TYPE_ARRAY || !_plist_binary_open (&bin, plist->data, plist->size))
+            return HTOOL_RETURN_FAILURE;
+        for (uint32_t i = 0; i < value->size / bin.ref_size; i++) {
+            if (!_plist_binary_value (&bin, _plist_binary_ref (&bin, value, i), &elem)) return HTOOL_RETURN_FAILURE;
+            fn (ctx, &elem);
+        }
+        return HTOOL_RETURN_SUCCESS;
+    }
+
+    memset (&xml, 0, sizeof (plist_xml_ctx_t));
+    xml.plist = (plist_t *) plist;
+    xml.fn = fn;
+    xml.fn_ctx = ctx;
+
+    return _plist_xml_rewalk (&xml, value, PLIST_TYPE_ARRAY, PLIST_ROLE_ITERATE);
+}
+
+void
+plist_dict_free (plist_dict_t *dict)
+{
+    free (dict->entries);
+    memset (dict, 0, sizeof (plist_dict_t));
+}
+
+const plist_value_t *
+plist_dict_get (const plist_dict_t *dict, const char *key)
+{
+    size_t len = strlen (key);
+    for (uint32_t i = 0; i < dict->nentries; i++) {
+        const plist_entry_t *entry = &dict->entries[i];
+        if (entry->key_len == len && !memcmp (entry->key, key, len)) return &entry->value;
+    }
+    return NULL;
+}
+
+char *
+plist_value_copy_string (const plist_value_t *value)
+{
+    const char *p, *end;
+    char *str, *out;
+
+    if (!value || value->type != PLIST_TYPE_STRING) return NULL;
+
+    /* Binary strings are stored as-is, or as UTF-16 which can take up to 3 bytes per unit in UTF-8 */
+    if (value->format == PLIST_FORMAT_BINARY) {
+        str = malloc ((value->integer == 2) ? (value->size / 2) * 3 + 1 : value->size + 1);
+        if (value->integer == 2) {
+            _plist_binary_copy_utf16 (value, str);
+        } else {
+            memcpy (str, value->data, value->size);
+            str[value->size] = '\0';
+        }
+        return str;
+    }
+
+    str = out = malloc (value->size + 1);
+    p = value->data;
+    end = p + value->size;
+
+    while (p < end) {
+        const char *semi;
+        if (*p != '&' || !(semi = memchr (p, ';', end - p))) {
+            *out++ = *p++;
+            continue;
+        }
+
+        size_t len = semi - p - 1;
+        if (len == 2 && !memcmp (p + 1, "lt", 2)) *out++ = '<';
+        else if (len == 2 && !memcmp (p + 1, "gt", 2)) *out++ = '>';
+        else if (len == 3 && !memcmp (p + 1, "amp", 3)) *out++ = '&';
+        else if (len == 4 && !memcmp (p + 1, "quot", 4)) *out++ = '"';
+        else if (len == 4 && !memcmp (p + 1, "apos", 4)) *out++ = '\'';
+        else if (len > 1 && p[1] == '#') {
+            /* Numeric references, only ASCII ever shows up in a kernelcache */
+            int hex = (p[2] == 'x' || p[2] == 'X');
+            *out++ = (char) strtoul (p + 2 + hex, NULL, hex ? 16 : 10);
+        } else {
+            memcpy (out, p, len + 2);
+            out += len + 2;
+        }
+        p = semi + 1;
+    }
+    *out = '\0';
+    return str;
+}
+
+int
+plist_value_string_equals (const plist_value_t *value, const char *str)
+{
+    if (!value || value->type != PLIST_TYPE_STRING) return 0;
+
+    if (value->format == PLIST_FORMAT_BINARY ? value->integer == 1 : !memchr (value->data, '&', value->size)) {
+        size_t len = strlen (str);
+        return value->size == len && !memcmp (value->data, str, len);
+    }
+
+    char *copy = plist_value_copy_string (value);
+    int eq = !strcmp (copy, str);
+    free (copy);
+    return eq;
+}
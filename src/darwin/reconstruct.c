@@ -0,0 +1,372 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "htool.h"
+#include "darwin/reconstruct.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX                     1024
+#endif
+
+#define RECONSTRUCT_ALIGN(x)        (((x) + HTOOL_RECONSTRUCT_PAGE_SIZE - 1) & ~(uint64_t) (HTOOL_RECONSTRUCT_PAGE_SIZE - 1))
+
+/**
+ *  Partial dyld_info_command, libhelper doesn't define it. Only the offsets
+ *  matter here.
+ */
+typedef struct partial_dyld_info_command_t {
+    uint32_t        cmd;
+    uint32_t        cmdsize;
+    uint32_t        rebase_off;
+    uint32_t        rebase_size;
+    uint32_t        bind_off;
+    uint32_t        bind_size;
+    uint32_t        weak_bind_off;
+    uint32_t        weak_bind_size;
+    uint32_t        lazy_bind_off;
+    uint32_t        lazy_bind_size;
+    uint32_t        export_off;
+    uint32_t        export_size;
+} partial_dyld_info_command_t;
+
+/* Where a segment's bytes were in the cache, and where they go in the output */
+typedef struct reconstruct_segment_t
+{
+    uint64_t        old_off;
+    uint64_t        new_off;
+    uint64_t        size;
+} reconstruct_segment_t;
+
+typedef struct reconstruct_t
+{
+    const unsigned char     *cache;
+    uint64_t                 cache_size;
+
+    /* Copy of the header and load commands, which is what gets rewritten */
+    unsigned char           *header;
+    uint32_t                 header_size;
+
+    reconstruct_segment_t   *segments;
+    uint32_t                 nsegments;
+
+    /* Offsets that pointed outside of the kext's own segments */
+    uint32_t                 dropped;
+} reconstruct_t;
+
+/* Padding between segments is written from here */
+static const unsigned char _reconstruct_zero_page[HTOOL_RECONSTRUCT_PAGE_SIZE];
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Translate a file offset in the cache to one in the output. An offset at the
+ *  very end of a segment is allowed, as empty tables often point there.
+ */
+HTOOL_PRIVATE int
+_reconstruct_map (reconstruct_t *rc, uint64_t old_off, uint64_t *new_off)
+{
+    for (uint32_t i = 0; i < rc->nsegments; i++) {
+        reconstruct_segment_t *seg = &rc->segments[i];
+        if (old_off >= seg->old_off && old_off - seg->old_off <= seg->size) {
+            *new_off = seg->new_off + (old_off - seg->old_off);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ *  Rewrite a 32-bit offset field that's paired with a size or count. If there's
+ *  nothing there it's left alone; if it points somewhere the kext doesn't have,
+ *  both are cleared so tools don't read the wrong data.
+ */
+HTOOL_PRIVATE void
+_reconstruct_fix_off32 (reconstruct_t *rc, uint32_t *off, uint32_t *size)
+{
+    uint64_t new_off;
+
+    if (!*off || !*size) return;
+    if (_reconstruct_map (rc, *off, &new_off) && new_off <= UINT32_MAX) {
+        *off = (uint32_t) new_off;
+        return;
+    }
+    *off = 0;
+    *size = 0;
+    rc->dropped++;
+}
+
+/**
+ *  Plan the output layout from the segment commands. The segment that starts
+ *  with the Mach-O header goes first, so the header ends up at offset 0; if no
+ *  segment does, the header gets a page of its own.
+ */
+HTOOL_PRIVATE htool_return_t
+_reconstruct_layout (reconstruct_t *rc, uint64_t header_off)
+{
+    mach_header_t *hdr = (mach_header_t *) rc->header;
+    unsigned char *p = rc->header + sizeof (mach_header_t);
+    uint64_t cursor = 0;
+    int first = -1;
+
+    rc->segments = calloc (hdr->ncmds ? hdr->ncmds : 1, sizeof (reconstruct_segment_t));
+
+    /* Find the segment holding the header first */
+    for (uint32_t i = 0; i < hdr->ncmds; i++, p += ((mach_load_command_t *) p)->cmdsize) {
+        mach_segment_command_64_t *seg = (mach_segment_command_64_t *) p;
+        if (seg->cmd == LC_SEGMENT_64 && seg->filesize && seg->fileoff == header_off) first = i;
+    }
+    if (first < 0) cursor = RECONSTRUCT_ALIGN (rc->header_size);
+
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        p = rc->header + sizeof (mach_header_t);
+        for (uint32_t i = 0; i < hdr->ncmds; i++, p += ((mach_load_command_t *) p)->cmdsize) {
+            mach_segment_command_64_t *seg = (mach_segment_command_64_t *) p;
+            if (seg->cmd != LC_SEGMENT_64 || !seg->filesize) continue;
+
+            /* The header's segment on the first pass, the rest on the second */
+            if ((pass == 0) != ((int) i == first)) continue;
+
+            if (seg->fileoff > rc->cache_size || seg->filesize > rc->cache_size - seg->fileoff) {
+                errorf ("Segment %.16s lies outside of the kernelcache\n", seg->segname);
+                return HTOOL_RETURN_FAILURE;
+            }
+
+            reconstruct_segment_t *out = &rc->segments[rc->nsegments++];
+            out->old_off = seg->fileoff;
+            out->new_off = cursor;
+            out->size = seg->filesize;
+            cursor = RECONSTRUCT_ALIGN (cursor + seg->filesize);
+        }
+    }
+    return HTOOL_RETURN_SUCCESS;
+}
+
+/**
+ *  Rewrite every file offset in the copied load commands.
+ */
+HTOOL_PRIVATE void
+_reconstruct_rewrite_commands (reconstruct_t *rc)
+{
+    mach_header_t *hdr = (mach_header_t *) rc->header;
+    unsigned char *p = rc->header + sizeof (mach_header_t);
+
+    for (uint32_t i = 0; i < hdr->ncmds; i++, p += ((mach_load_command_t *) p)->cmdsize) {
+        mach_load_command_t *lc = (mach_load_command_t *) p;
+
+        switch (lc->cmd) {
+            case LC_SEGMENT_64: {
+                mach_segment_command_64_t *seg = (mach_segment_command_64_t *) p;
+                mach_section_64_t *sect = (mach_section_64_t *) (p + sizeof (mach_segment_command_64_t));
+                uint64_t new_off = 0;
+
+                if (seg->filesize) _reconstruct_map (rc, seg->fileoff, &new_off);
+                seg->fileoff = new_off;
+
+                for (uint32_t s = 0; s < seg->nsects; s++, sect++) {
+                    uint32_t present = 1;       /* zerofill sections have no offset */
+                    _reconstruct_fix_off32 (rc, &sect->offset, &present);
+                    _reconstruct_fix_off32 (rc, &sect->reloff, &sect->nreloc);
+                }
+                break;
+            }
+            case LC_SYMTAB: {
+                mach_symtab_command_t *symtab = (mach_symtab_command_t *) p;
+                _reconstruct_fix_off32 (rc, &symtab->symoff, &symtab->nsyms);
+                _reconstruct_fix_off32 (rc, &symtab->stroff, &symtab->strsize);
+                break;
+            }
+            case LC_DYSYMTAB: {
+                mach_dysymtab_command_t *dysymtab = (mach_dysymtab_command_t *) p;
+                _reconstruct_fix_off32 (rc, &dysymtab->tocoff, &dysymtab->ntoc);
+                _reconstruct_fix_off32 (rc, &dysymtab->modtaboff, &dysymtab->nmodtab);
+                _reconstruct_fix_off32 (rc, &dysymtab->extrefsymoff, &dysymtab->nextrefsyms);
+                _reconstruct_fix_off32 (rc, &dysymtab->indirectsymoff, &dysymtab->nindirectsyms);
+                _reconstruct_fix_off32 (rc, &dysymtab->extreloff, &dysymtab->nextrel);
+                _reconstruct_fix_off32 (rc, &dysymtab->locreloff, &dysymtab->nlocrel);
+                break;
+            }
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                partial_dyld_info_command_t *info = (partial_dyld_info_command_t *) p;
+                _reconstruct_fix_off32 (rc, &info->rebase_off, &info->rebase_size);
+                _reconstruct_fix_off32 (rc, &info->bind_off, &info->bind_size);
+                _reconstruct_fix_off32 (rc, &info->weak_bind_off, &info->weak_bind_size);
+                _reconstruct_fix_off32 (rc, &info->lazy_bind_off, &info->lazy_bind_size);
+                _reconstruct_fix_off32 (rc, &info->export_off, &info->export_size);
+                break;
+            }
+            case LC_CODE_SIGNATURE:
+            case LC_SEGMENT_SPLIT_INFO:
+            case LC_FUNCTION_STARTS:
+            case LC_DATA_IN_CODE:
+            case LC_DYLIB_CODE_SIGN_DRS:
+            case LC_LINKER_OPTIMIZATION_HINT:
+            case LC_DYLD_EXPORTS_TRIE:
+            case LC_DYLD_CHAINED_FIXUPS: {
+                mach_linkedit_data_command_t *data = (mach_linkedit_data_command_t *) p;
+                _reconstruct_fix_off32 (rc, &data->dataoff, &data->datasize);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Write all of `iov`, `IOV_MAX` at a time, picking up after short writes.
+ */
+HTOOL_PRIVATE htool_return_t
+_reconstruct_writev_all (int fd, struct iovec *iov, uint32_t iovcnt)
+{
+    while (iovcnt) {
+        ssize_t n = writev (fd, iov, (iovcnt > IOV_MAX) ? IOV_MAX : (int) iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            errorf ("writev: %s\n", strerror (errno));
+            return HTOOL_RETURN_FAILURE;
+        }
+
+        while (iovcnt && (size_t) n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt) {
+            iov->iov_base = (unsigned char *) iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return HTOOL_RETURN_SUCCESS;
+}
+
+HTOOL_PRIVATE htool_return_t
+_reconstruct_emit (reconstruct_t *rc, int fd)
+{
+    struct iovec *iov = calloc (rc->nsegments * 2 + 2, sizeof (struct iovec));
+    uint32_t iovcnt = 0;
+    uint64_t cursor = 0;
+    htool_return_t ret;
+
+    /* The header is always at offset 0, either at the start of its segment or alone */
+    iov[iovcnt++] = (struct iovec) { .iov_base = rc->header, .iov_len = rc->header_size };
+    cursor = rc->header_size;
+
+    for (uint32_t i = 0; i < rc->nsegments; i++) {
+        reconstruct_segment_t *seg = &rc->segments[i];
+        uint64_t skip = 0;
+
+        if (seg->new_off > cursor) {
+            iov[iovcnt++] = (struct iovec) { .iov_base = (void *) _reconstruct_zero_page, .iov_len = seg->new_off - cursor };
+            cursor = seg->new_off;
+        }
+
+        /* The header's own segment already has its first bytes written */
+        if (seg->new_off < cursor) skip = cursor - seg->new_off;
+        if (skip >= seg->size) continue;
+
+        iov[iovcnt++] = (struct iovec) { .iov_base = (void *) (rc->cache + seg->old_off + skip), .iov_len = seg->size - skip };
+        cursor = seg->new_off + seg->size;
+    }
+
+    ret = _reconstruct_writev_all (fd, iov, iovcnt);
+    free (iov);
+    return ret;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_return_t
+xnu_kext_reconstruct_write (xnu_t *xnu, kext_t *kext, int fd)
+{
+    reconstruct_t rc;
+    mach_header_t *hdr;
+    htool_return_t ret;
+
+    macho_t *source = xnu_kext_source_macho (xnu, kext);
+
+    memset (&rc, 0, sizeof (reconstruct_t));
+    rc.cache = (const unsigned char *) source->data;
+    rc.cache_size = source->size;
+
+    /* Check the header and its load commands are inside the cache */
+    if (kext->offset > rc.cache_size || rc.cache_size - kext->offset < sizeof (mach_header_t)) goto bad_header;
+    hdr = (mach_header_t *) (rc.cache + kext->offset);
+    if (hdr->magic != 0xfeedfacf || hdr->sizeofcmds > rc.cache_size - kext->offset - sizeof (mach_header_t))
+        goto bad_header;
+
+    rc.header_size = sizeof (mach_header_t) + hdr->sizeofcmds;
+    rc.header = malloc (rc.header_size);
+    memcpy (rc.header, hdr, rc.header_size);
+
+    /* Each command has to fit, otherwise the rewrite could run off the end */
+    unsigned char *p = rc.header + sizeof (mach_header_t);
+    for (uint32_t i = 0; i < hdr->ncmds; i++) {
+        mach_load_command_t *lc = (mach_load_command_t *) p;
+        if (p + sizeof (mach_load_command_t) > rc.header + rc.header_size || lc->cmdsize < sizeof (mach_load_command_t) ||
+            p + lc->cmdsize > rc.header + rc.header_size) {
+            free (rc.header);
+            goto bad_header;
+        }
+        if (lc->cmd == LC_SEGMENT_64 &&
+            lc->cmdsize < sizeof (mach_segment_command_64_t) + ((mach_segment_command_64_t *) p)->nsects * sizeof (mach_section_64_t)) {
+            free (rc.header);
+            goto bad_header;
+        }
+        p += lc->cmdsize;
+    }
+
+    if ((ret = _reconstruct_layout (&rc, kext->offset)) == HTOOL_RETURN_SUCCESS) {
+        _reconstruct_rewrite_commands (&rc);
+        if (rc.dropped)
+            warningf ("%s: %d load command offsets point outside of the kext and were cleared\n", kext->name, rc.dropped);
+
+        ret = _reconstruct_emit (&rc, fd);
+    }
+
+    free (rc.segments);
+    free (rc.header);
+    return ret;
+
+bad_header:
+    errorf ("%s: invalid Mach-O header at offset 0x%llx\n", kext->name, kext->offset);
+    return HTOOL_RETURN_FAILURE;
+}
+
+htool_return_t
+xnu_kext_reconstruct_to_file (xnu_t *xnu, kext_t *kext, const char *path)
+{
+    htool_return_t ret;
+    int fd;
+
+    if ((fd = open (path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        errorf ("Could not open %s for writing: %s\n", path, strerror (errno));
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    ret = xnu_kext_reconstruct_write (xnu, kext, fd);
+    close (fd);
+    return ret;
+}
@@ -0,0 +1,459 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "darwin/symbolicate.h"
+#include "disassembler/functions.h"
+#include "htool-parallel.h"
+
+/* Addresses are symbolicated in blocks of this many on the worker pool */
+#define SYMBOLICATE_BATCH_SIZE          (64 * 1024)
+
+typedef struct symbolicate_range_t
+{
+    uint64_t            start;
+    uint64_t            end;
+    uint32_t            kext;
+} symbolicate_range_t;
+
+typedef struct symbolicate_symbol_t
+{
+    uint64_t            addr;
+    const char         *name;
+} symbolicate_symbol_t;
+
+typedef struct symbolicate_list_t
+{
+    void               *items;
+    uint32_t            count;
+    uint32_t            cap;
+} symbolicate_list_t;
+
+typedef struct symbolicate_batch_t
+{
+    xnu_symbolicator_t     *sym;
+    const uint64_t         *addresses;
+    uint32_t                count;
+    uint64_t                slide;
+    xnu_symbolication_t    *out;
+} symbolicate_batch_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void *
+_symbolicate_push (symbolicate_list_t *list, size_t size)
+{
+    if (list->count == list->cap) {
+        list->cap = (list->cap) ? list->cap * 2 : 256;
+        list->items = realloc (list->items, list->cap * size);
+    }
+    return (char *) list->items + (size_t) list->count++ * size;
+}
+
+/**
+ *  Fill the tree in order, so slot k's children are 2k and 2k + 1 and an in-order
+ *  walk visits the keys in sorted order.
+ */
+HTOOL_PRIVATE uint32_t
+_symbolicate_eytzinger_fill (xnu_eytzinger_t *e, const uint64_t *sorted, uint32_t i, uint32_t k)
+{
+    if (k <= e->n) {
+        i = _symbolicate_eytzinger_fill (e, sorted, i, 2 * k);
+        e->keys[k] = sorted[i];
+        e->order[k] = i++;
+        i = _symbolicate_eytzinger_fill (e, sorted, i, 2 * k + 1);
+    }
+    return i;
+}
+
+HTOOL_PRIVATE void
+_symbolicate_eytzinger_build (xnu_eytzinger_t *e, const uint64_t *sorted, uint32_t n)
+{
+    e->n = n;
+    e->keys = malloc ((n + 1) * sizeof (uint64_t));
+    e->order = malloc ((n + 1) * sizeof (uint32_t));
+    _symbolicate_eytzinger_fill (e, sorted, 0, 1);
+}
+
+/**
+ *  Position, in sorted order, of the last key <= x. The descent goes right when
+ *  the key is <= x, so it ends below the first key > x, which is recovered by
+ *  dropping the trailing right turns (set bits) and the left turn before them.
+ */
+static inline uint32_t
+_symbolicate_eytzinger_predecessor (const xnu_eytzinger_t *e, uint64_t x)
+{
+    uint32_t k = 1, upper;
+
+    while (k <= e->n) {
+        __builtin_prefetch (e->keys + (size_t) k * 16);
+        k = 2 * k + (e->keys[k] <= x);
+    }
+    k >>= __builtin_ffs (~k);
+
+    upper = (k) ? e->order[k] : e->n;
+    return (upper) ? upper - 1 : XNU_SYMBOLICATE_NONE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE int
+_symbolicate_range_compare (const void *a, const void *b)
+{
+    const symbolicate_range_t *x = a, *y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+HTOOL_PRIVATE int
+_symbolicate_symbol_compare (const void *a, const void *b)
+{
+    const symbolicate_symbol_t *x = a, *y = b;
+    if (x->addr != y->addr) return (x->addr > y->addr) - (x->addr < y->addr);
+
+    /* Real names sort before the functions from the scan */
+    return (!x->name) - (!y->name);
+}
+
+HTOOL_PRIVATE int
+_symbolicate_skip_segment (const char *segname, int kernel)
+{
+    if (!strncmp (segname, "__LINKEDIT", 16)) return 1;
+
+    /* The kernel's own prelink segments only hold the kexts */
+    return kernel && (!strncmp (segname, "__PRELINK", 9) || !strncmp (segname, "__PLK", 5));
+}
+
+/**
+ *  Add the part of [start, end) that no kext covers to the kernel, given the kext
+ *  ranges sorted and made disjoint.
+ */
+HTOOL_PRIVATE void
+_symbolicate_add_kernel_range (symbolicate_list_t *list, const symbolicate_range_t *kexts, uint32_t nkexts,
+                               uint64_t start, uint64_t end)
+{
+    for (uint32_t i = 0; i < nkexts && start < end; i++) {
+        if (kexts[i].end <= start) continue;
+        if (kexts[i].start >= end) break;
+
+        if (kexts[i].start > start)
+            *(symbolicate_range_t *) _symbolicate_push (list, sizeof (symbolicate_range_t)) =
+                (symbolicate_range_t) { .start = start, .end = kexts[i].start, .kext = XNU_SYMBOLICATE_KERNEL };
+        start = kexts[i].end;
+    }
+    if (start < end)
+        *(symbolicate_range_t *) _symbolicate_push (list, sizeof (symbolicate_range_t)) =
+            (symbolicate_range_t) { .start = start, .end = end, .kext = XNU_SYMBOLICATE_KERNEL };
+}
+
+HTOOL_PRIVATE void
+_symbolicate_build_owners (xnu_symbolicator_t *sym, int fileset)
+{
+    xnu_t *xnu = sym->xnu;
+    symbolicate_list_t list = { 0 };
+    symbolicate_range_t *ranges;
+    uint64_t covered = 0;
+    uint32_t count = 0;
+
+    for (uint32_t k = 0; k < xnu->nkexts; k++) {
+        macho_t *macho = xnu_kext_macho (xnu, xnu->kext_array[k]);
+        if (!macho) continue;
+
+        for (uint32_t i = 0; i < h_slist_length (macho->scmds); i++) {
+            mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, i);
+            mach_segment_command_64_t *seg = info->segcmd;
+
+            if (!seg->vmsize || _symbolicate_skip_segment (seg->segname, 0)) continue;
+            *(symbolicate_range_t *) _symbolicate_push (&list, sizeof (symbolicate_range_t)) =
+                (symbolicate_range_t) { .start = seg->vmaddr, .end = seg->vmaddr + seg->vmsize, .kext = k };
+        }
+    }
+
+    /* Clip any overlap, so each address has one owner */
+    ranges = list.items;
+    qsort (ranges, list.count, sizeof (symbolicate_range_t), _symbolicate_range_compare);
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (ranges[i].start < covered) ranges[i].start = covered;
+        if (ranges[i].start >= ranges[i].end) continue;
+        covered = ranges[i].end;
+        ranges[count++] = ranges[i];
+    }
+    list.count = count;
+
+    /* In a fileset the kernel is an entry like any other, otherwise it owns the gaps */
+    if (!fileset) {
+        for (uint32_t i = 0; i < h_slist_length (xnu->macho->scmds); i++) {
+            mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (xnu->macho->scmds, i);
+            mach_segment_command_64_t *seg = info->segcmd;
+
+            if (!seg->vmsize || _symbolicate_skip_segment (seg->segname, 1)) continue;
+            _symbolicate_add_kernel_range (&list, list.items, count, seg->vmaddr, seg->vmaddr + seg->vmsize);
+        }
+        ranges = list.items;
+        qsort (ranges, list.count, sizeof (symbolicate_range_t), _symbolicate_range_compare);
+    }
+
+    sym->owner_start = malloc ((list.count + 1) * sizeof (uint64_t));
+    sym->owner_end = malloc ((list.count + 1) * sizeof (uint64_t));
+    sym->owner_kext = malloc ((list.count + 1) * sizeof (uint32_t));
+    for (uint32_t i = 0; i < list.count; i++) {
+        sym->owner_start[i] = ranges[i].start;
+        sym->owner_end[i] = ranges[i].end;
+        sym->owner_kext[i] = ranges[i].kext;
+    }
+    _symbolicate_eytzinger_build (&sym->owners, sym->owner_start, list.count);
+    free (list.items);
+}
+
+/* Add the defined symbols from an image's LC_SYMTAB, see xnu_symtab_read() */
+HTOOL_PRIVATE void
+_symbolicate_add_symtab (symbolicate_list_t *list, macho_t *macho, macho_t *source)
+{
+    uint32_t count;
+    kext_symbol_t *symbols = xnu_symtab_read (macho, source, &count);
+
+    for (uint32_t i = 0; i < count; i++)
+        *(symbolicate_symbol_t *) _symbolicate_push (list, sizeof (symbolicate_symbol_t)) =
+            (symbolicate_symbol_t) { .addr = symbols[i].vmaddr, .name = symbols[i].name };
+    free (symbols);
+}
+
+HTOOL_PRIVATE void
+_symbolicate_build_symbols (xnu_symbolicator_t *sym, int fileset)
+{
+    xnu_t *xnu = sym->xnu;
+    symbolicate_list_t list = { 0 };
+    symbolicate_symbol_t *syms;
+    htool_functions_t *functions;
+    uint32_t count = 0;
+
+    if (!fileset) _symbolicate_add_symtab (&list, xnu->macho, xnu->macho);
+    for (uint32_t k = 0; k < xnu->nkexts; k++) {
+        macho_t *macho = xnu_kext_macho (xnu, xnu->kext_array[k]);
+        if (macho && macho != xnu->macho)
+            _symbolicate_add_symtab (&list, macho, xnu_kext_source_macho (xnu, xnu->kext_array[k]));
+    }
+
+    if ((functions = htool_functions_fetch (xnu->macho))) {
+        for (uint32_t i = 0; i < functions->nfunctions; i++)
+            *(symbolicate_symbol_t *) _symbolicate_push (&list, sizeof (symbolicate_symbol_t)) =
+                (symbolicate_symbol_t) { .addr = functions->functions[i].vmaddr, .name = NULL };
+    }
+
+    /* One name per address, preferring a real one */
+    syms = list.items;
+    qsort (syms, list.count, sizeof (symbolicate_symbol_t), _symbolicate_symbol_compare);
+
+    sym->symbol_addr = malloc ((list.count + 1) * sizeof (uint64_t));
+    sym->symbol_name = malloc ((list.count + 1) * sizeof (const char *));
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (count && sym->symbol_addr[count - 1] == syms[i].addr) continue;
+        sym->symbol_addr[count] = syms[i].addr;
+        sym->symbol_name[count++] = syms[i].name;
+    }
+    _symbolicate_eytzinger_build (&sym->symbols, sym->symbol_addr, count);
+    free (list.items);
+}
+
+xnu_symbolicator_t *
+xnu_symbolicator_create (xnu_t *xnu)
+{
+    xnu_symbolicator_t *sym = calloc (1, sizeof (xnu_symbolicator_t));
+    int fileset = (xnu->macho->header->filetype == MACH_TYPE_FILESET);
+
+    sym->xnu = xnu;
+    _symbolicate_build_owners (sym, fileset);
+    _symbolicate_build_symbols (sym, fileset);
+    return sym;
+}
+
+void
+xnu_symbolicator_free (xnu_symbolicator_t *sym)
+{
+    if (!sym) return;
+    free (sym->owners.keys);
+    free (sym->owners.order);
+    free (sym->owner_start);
+    free (sym->owner_end);
+    free (sym->owner_kext);
+    free (sym->symbols.keys);
+    free (sym->symbols.order);
+    free (sym->symbol_addr);
+    free (sym->symbol_name);
+    free (sym);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void
+xnu_symbolicate (xnu_symbolicator_t *sym, uint64_t address, xnu_symbolication_t *out)
+{
+    uint32_t owner = _symbolicate_eytzinger_predecessor (&sym->owners, address), symbol;
+
+    out->address = address;
+    out->kext = out->symbol = XNU_SYMBOLICATE_NONE;
+    if (owner == XNU_SYMBOLICATE_NONE || address >= sym->owner_end[owner]) return;
+    out->kext = sym->owner_kext[owner];
+
+    /* A symbol below the start of the owner's range belongs to something else */
+    symbol = _symbolicate_eytzinger_predecessor (&sym->symbols, address);
+    if (symbol != XNU_SYMBOLICATE_NONE && sym->symbol_addr[symbol] >= sym->owner_start[owner])
+        out->symbol = symbol;
+}
+
+HTOOL_PRIVATE void
+_symbolicate_batch_worker (void *ctx, uint32_t index)
+{
+    symbolicate_batch_t *batch = (symbolicate_batch_t *) ctx;
+    uint32_t start = index * SYMBOLICATE_BATCH_SIZE;
+    uint32_t end = (batch->count - start > SYMBOLICATE_BATCH_SIZE) ? start + SYMBOLICATE_BATCH_SIZE : batch->count;
+
+    for (uint32_t i = start; i < end; i++)
+        xnu_symbolicate (batch->sym, batch->addresses[i] - batch->slide, &batch->out[i]);
+}
+
+void
+xnu_symbolicate_batch (xnu_symbolicator_t *sym, const uint64_t *addresses, uint32_t count, uint64_t slide,
+                       xnu_symbolication_t *out)
+{
+    symbolicate_batch_t batch = { .sym = sym, .addresses = addresses, .count = count, .slide = slide, .out = out };
+    htool_parallel_for ((count + SYMBOLICATE_BATCH_SIZE - 1) / SYMBOLICATE_BATCH_SIZE, _symbolicate_batch_worker, &batch);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE char *
+_symbolicate_read_file (const char *path)
+{
+    FILE *fp = fopen (path, "rb");
+    char *buf;
+    long size;
+
+    if (!fp) return NULL;
+    fseek (fp, 0, SEEK_END);
+    size = ftell (fp);
+    fseek (fp, 0, SEEK_SET);
+
+    buf = malloc ((size > 0 ? size : 0) + 1);
+    size = (size > 0) ? (long) fread (buf, 1, size, fp) : 0;
+    buf[size] = '\0';
+    fclose (fp);
+    return buf;
+}
+
+/**
+ *  Collect every 0x-prefixed hex number in the text, and any line that is just a
+ *  hex number, as in a plain list of addresses.
+ */
+HTOOL_PRIVATE uint64_t *
+_symbolicate_parse_addresses (const char *text, uint32_t *count)
+{
+    symbolicate_list_t list = { 0 };
+    const char *line = text;
+
+    while (*line) {
+        const char *eol = strchr (line, '\n'), *p, *end;
+        uint32_t before = list.count;
+        if (!eol) eol = line + strlen (line);
+
+        for (p = line; p + 2 < eol; p++) {
+            if (p[0] != '0' || (p[1] != 'x' && p[1] != 'X') || !isxdigit ((unsigned char) p[2])) continue;
+            if (p > line && isalnum ((unsigned char) p[-1])) continue;
+
+            for (end = p + 2; end < eol && isxdigit ((unsigned char) *end); end++);
+            if (end - p - 2 <= 16)
+                *(uint64_t *) _symbolicate_push (&list, sizeof (uint64_t)) = strtoull (p + 2, NULL, 16);
+            p = end - 1;
+        }
+
+        if (list.count == before) {
+            const char *rest;
+
+            for (p = line; p < eol && isspace ((unsigned char) *p); p++);
+            for (end = p; end < eol && isxdigit ((unsigned char) *end); end++);
+            for (rest = end; rest < eol && isspace ((unsigned char) *rest); rest++);
+            if (end > p && end - p <= 16 && rest == eol)
+                *(uint64_t *) _symbolicate_push (&list, sizeof (uint64_t)) = strtoull (p, NULL, 16);
+        }
+
+        line = (*eol) ? eol + 1 : eol;
+    }
+
+    *count = list.count;
+    return list.items;
+}
+
+htool_return_t
+xnu_symbolicate_file (xnu_t *xnu, const char *path, uint64_t slide, int has_slide)
+{
+    xnu_symbolicator_t *sym;
+    xnu_symbolication_t *results;
+    uint64_t *addresses;
+    uint32_t count, nresolved = 0, width = 6;
+    char *text, *p;
+
+    if (!(text = _symbolicate_read_file (path))) {
+        errorf ("Could not open file: %s\n", path);
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    /* A panic log says what the slide was */
+    if (!has_slide && (p = strstr (text, "Kernel slide:"))) slide = strtoull (p + strlen ("Kernel slide:"), NULL, 16);
+
+    addresses = _symbolicate_parse_addresses (text, &count);
+    free (text);
+
+    sym = xnu_symbolicator_create (xnu);
+    results = malloc ((count ? count : 1) * sizeof (xnu_symbolication_t));
+    xnu_symbolicate_batch (sym, addresses, count, slide, results);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (results[i].kext == XNU_SYMBOLICATE_NONE) continue;
+        nresolved++;
+        if (results[i].kext != XNU_SYMBOLICATE_KERNEL && strlen (xnu->kext_array[results[i].kext]->name) > width)
+            width = (uint32_t) strlen (xnu->kext_array[results[i].kext]->name);
+    }
+    printf (BOLD RED "[*] Symbolicated:" RESET DARK_GREY " %d of %d addresses (slide 0x%llx)\n" RESET, nresolved, count, slide);
+
+    /* Anything that isn't in the kernelcache, like a frame pointer, is left out */
+    for (uint32_t i = 0; i < count; i++) {
+        xnu_symbolication_t *r = &results[i];
+        const char *owner;
+
+        if (r->kext == XNU_SYMBOLICATE_NONE) continue;
+        owner = (r->kext == XNU_SYMBOLICATE_KERNEL) ? "kernel" : xnu->kext_array[r->kext]->name;
+
+        printf ("  0x%016llx  " DARK_GREY "0x%016llx" RESET "  %-*s  ", addresses[i], r->address, width, owner);
+        if (r->symbol == XNU_SYMBOLICATE_NONE) {
+            printf (DARK_GREY "?\n" RESET);
+        } else {
+            uint64_t base = sym->symbol_addr[r->symbol];
+            if (sym->symbol_name[r->symbol]) printf (BLUE "%s" RESET, sym->symbol_name[r->symbol]);
+            else printf (BLUE "sub_%llx" RESET, base);
+            printf (" + 0x%llx\n", r->address - base);
+        }
+    }
+
+    xnu_symbolicator_free (sym);
+    free (results);
+    free (addresses);
+    return HTOOL_RETURN_SUCCESS;
+}
@@ -0,0 +1,319 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <libarch.h>
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include <arm64/arm64-instructions.h>
+
+#include "disassembler/codemap.h"
+#include "disassembler/a64.h"
+#include "htool-cache.h"
+#include "htool-fileset.h"
+
+#define VM_PROT_EXECUTE_BIT         0x4
+
+#ifndef S_ATTR_PURE_INSTRUCTIONS
+#define S_ATTR_PURE_INSTRUCTIONS    0x80000000
+#endif
+#ifndef S_ATTR_SOME_INSTRUCTIONS
+#define S_ATTR_SOME_INSTRUCTIONS    0x00000400
+#endif
+
+/* n_sect is a single byte, with 0 meaning NO_SECT */
+#define CODEMAP_MAX_SECT            256
+
+#ifndef MIN
+#define MIN(a, b)                   (((a) < (b)) ? (a) : (b))
+#endif
+
+/**
+ *  \brief      Growable stack of addresses, used both to collect the seeds and
+ *              as the worklist while following branches.
+ */
+typedef struct addr_stack_t
+{
+    uint64_t    *items;
+    uint64_t     count;
+    uint64_t     cap;
+} addr_stack_t;
+
+HTOOL_PRIVATE void
+_addr_stack_push (addr_stack_t *s, uint64_t addr)
+{
+    if (s->count == s->cap) {
+        s->cap = (s->cap) ? s->cap * 2 : 4096;
+        s->items = realloc (s->items, s->cap * sizeof (uint64_t));
+    }
+    s->items[s->count++] = addr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE int
+_codemap_region_compare (const void *a, const void *b)
+{
+    const htool_code_region_t *ra = a, *rb = b;
+    return (ra->vmaddr > rb->vmaddr) - (ra->vmaddr < rb->vmaddr);
+}
+
+HTOOL_PRIVATE void
+_codemap_load_regions (htool_codemap_t *map, macho_t *macho)
+{
+    uint32_t nsegs = h_slist_length (macho->scmds);
+    map->regions = calloc (nsegs ? nsegs : 1, sizeof (htool_code_region_t));
+
+    for (int i = 0; i < nsegs; i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, i);
+        mach_segment_command_64_t *seg = info->segcmd;
+
+        if (!(seg->initprot & VM_PROT_EXECUTE_BIT) || !seg->filesize) continue;
+        if (seg->fileoff + seg->filesize > macho->size) continue;
+
+        htool_code_region_t *region = &map->regions[map->nregions++];
+        region->vmaddr = seg->vmaddr;
+        region->size = MIN (seg->vmsize, seg->filesize) & ~UINT64_C(3);
+        region->data = macho->data + seg->fileoff;
+        region->bitmap = calloc (((region->size >> 2) + 63) / 64, sizeof (uint64_t));
+    }
+
+    qsort (map->regions, map->nregions, sizeof (htool_code_region_t), _codemap_region_compare);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  The seeds are all read from `image`, but any file offsets in the load commands
+ *  are relative to `base`. They differ for Fileset entries, where the offsets are
+ *  relative to the start of the Fileset rather than the entry.
+ */
+HTOOL_PRIVATE uint64_t
+_codemap_image_text_vmaddr (macho_t *image)
+{
+    for (int i = 0; i < h_slist_length (image->scmds); i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (image->scmds, i);
+        if (!strcmp (info->segcmd->segname, "__TEXT")) return info->segcmd->vmaddr;
+    }
+    return 0;
+}
+
+/**
+ *  Symbols carry the 1-based ordinal of their section, counting every section of
+ *  every segment in load command order. Mark which of those ordinals hold code, so
+ *  symbols on data (__DATA, __const, ...) aren't followed as if they were functions.
+ */
+HTOOL_PRIVATE void
+_codemap_code_sections (macho_t *image, uint8_t *is_code)
+{
+    uint32_t ordinal = 1;
+
+    for (int i = 0; i < h_slist_length (image->scmds); i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (image->scmds, i);
+        int exec = (info->segcmd->initprot & VM_PROT_EXECUTE_BIT) != 0;
+
+        for (int j = 0; j < h_slist_length (info->sections) && ordinal < CODEMAP_MAX_SECT; j++, ordinal++) {
+            mach_section_64_t *sect = (mach_section_64_t *) h_slist_nth_data (info->sections, j);
+            is_code[ordinal] = exec || (sect->flags & (S_ATTR_PURE_INSTRUCTIONS | S_ATTR_SOME_INSTRUCTIONS));
+        }
+    }
+}
+
+HTOOL_PRIVATE void
+_codemap_collect_seeds (addr_stack_t *seeds, unsigned char *base, uint64_t base_size, macho_t *image)
+{
+    mach_load_command_info_t *info;
+    uint64_t text_vmaddr = _codemap_image_text_vmaddr (image);
+
+    /* Entry point, relative to the start of __TEXT */
+    if ((info = mach_load_command_find_command_by_type (image, LC_MAIN))) {
+        mach_entry_point_command_t *entry = (mach_entry_point_command_t *) info->lc;
+        _addr_stack_push (seeds, text_vmaddr + entry->entryoff);
+    }
+
+    /**
+     *  LC_FUNCTION_STARTS is a list of ULEB128 deltas, the first relative to the start
+     *  of __TEXT and each one after relative to the previous function, terminated by a
+     *  zero delta.
+     */
+    if ((info = mach_load_command_find_command_by_type (image, LC_FUNCTION_STARTS))) {
+        mach_linkedit_data_command_t *fs = (mach_linkedit_data_command_t *) info->lc;
+        unsigned char *p = base + fs->dataoff, *end = p + fs->datasize;
+        uint64_t addr = text_vmaddr;
+
+        if ((uint64_t) fs->dataoff + fs->datasize > base_size) end = p;
+        while (p < end) {
+            uint64_t delta = 0;
+            int shift = 0;
+            do {
+                delta |= (uint64_t) (*p & 0x7f) << shift;
+                shift += 7;
+            } while ((*p++ & 0x80) && p < end);
+
+            if (!delta) break;
+            addr += delta;
+            _addr_stack_push (seeds, addr);
+        }
+    }
+
+    /* Every defined symbol in a code section that isn't a debug symbol */
+    if ((info = mach_load_command_find_command_by_type (image, LC_SYMTAB))) {
+        mach_symtab_command_t *symtab = (mach_symtab_command_t *) info->lc;
+        nlist *syms = (nlist *) (base + symtab->symoff);
+        uint8_t is_code[CODEMAP_MAX_SECT] = { 0 };
+
+        if ((uint64_t) symtab->symoff + (uint64_t) symtab->nsyms * sizeof (nlist) > base_size) return;
+        _codemap_code_sections (image, is_code);
+
+        for (uint32_t i = 0; i < symtab->nsyms; i++) {
+            if (syms[i].n_type & N_STAB) continue;
+            if ((syms[i].n_type & N_TYPE) != N_SECT || !syms[i].n_value) continue;
+            if (!is_code[syms[i].n_sect]) continue;
+            _addr_stack_push (seeds, syms[i].n_value);
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Libarch marks anything it can't decode as ARM64_INSTRUCTION_UNK, which is the
+ *  best indication that we've walked off the end of a function into data.
+ */
+HTOOL_PRIVATE int
+_codemap_is_valid_instruction (uint32_t opcode, uint64_t addr)
+{
+    instruction_t *in = libarch_instruction_create (opcode, addr);
+    libarch_disass (&in);
+
+    int valid = (in->type != ARM64_INSTRUCTION_UNK);
+    free (in);
+    return valid;
+}
+
+HTOOL_PRIVATE void
+_codemap_follow (htool_codemap_t *map, addr_stack_t *work)
+{
+    while (work->count) {
+        uint64_t addr = work->items[--work->count];
+        htool_code_region_t *region = htool_codemap_find_region (map, addr);
+
+        if (!region || (addr & 3)) continue;
+
+        /* Linear decode from `addr` until control-flow stops */
+        for (; addr < region->vmaddr + region->size; addr += 4) {
+            uint64_t idx = (addr - region->vmaddr) >> 2;
+            uint64_t target = 0;
+
+            if (htool_code_region_is_code (region, addr)) break;
+
+            uint32_t opcode = *(uint32_t *) (region->data + (idx << 2));
+            a64_flow_t flow = a64_classify_flow (opcode, addr, &target);
+
+            if (flow == A64_FLOW_TRAP) break;
+            if (flow == A64_FLOW_NONE && !_codemap_is_valid_instruction (opcode, addr)) break;
+
+            region->bitmap[idx >> 6] |= UINT64_C(1) << (idx & 63);
+            map->ncode++;
+
+            if (flow == A64_FLOW_BRANCH || flow == A64_FLOW_BRANCH_COND || flow == A64_FLOW_CALL)
+                _addr_stack_push (work, target);
+
+            if (!a64_flow_falls_through (flow)) break;
+        }
+    }
+}
+
+HTOOL_PRIVATE void
+_codemap_free (htool_codemap_t *map)
+{
+    for (uint32_t i = 0; i < map->nregions; i++)
+        free (map->regions[i].bitmap);
+    free (map->regions);
+    free (map);
+}
+
+HTOOL_PRIVATE htool_codemap_t *
+_codemap_build (macho_t *macho)
+{
+    htool_codemap_t *map = calloc (1, sizeof (htool_codemap_t));
+    htool_fileset_index_t *fileset;
+    addr_stack_t work = { 0 };
+
+    _codemap_load_regions (map, macho);
+    if (!map->nregions) {
+        _codemap_free (map);
+        return NULL;
+    }
+
+    /**
+     *  Fileset Mach-O's don't have any symbols or function starts of their own, they
+     *  are all in the individual entries.
+     */
+    _codemap_collect_seeds (&work, macho->data, macho->size, macho);
+    if ((fileset = htool_fileset_index_fetch (macho))) {
+        for (uint32_t i = 0; i < fileset->nentries; i++) {
+            macho_t *entry = htool_fileset_entry_macho (fileset, &fileset->entries[i]);
+            if (entry) _codemap_collect_seeds (&work, macho->data, macho->size, entry);
+        }
+    }
+
+    map->nseeds = work.count;
+    _codemap_follow (map, &work);
+
+    free (work.items);
+    return map;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_codemap_t *
+htool_codemap_fetch (macho_t *macho)
+{
+    htool_codemap_t *map, *cached;
+
+    if ((map = htool_cache_fetch (macho, HTOOL_CACHE_KIND_CODEMAP)))
+        return map;
+
+    if (!(map = _codemap_build (macho)))
+        return NULL;
+
+    /* another pass may have beaten us to it */
+    if ((cached = htool_cache_store (macho, HTOOL_CACHE_KIND_CODEMAP, map)) != map)
+        _codemap_free (map);
+    return cached;
+}
+
+htool_code_region_t *
+htool_codemap_find_region (htool_codemap_t *map, uint64_t addr)
+{
+    uint32_t lo = 0, hi = map->nregions;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        htool_code_region_t *r = &map->regions[mid];
+
+        if (addr < r->vmaddr) hi = mid;
+        else if (addr >= r->vmaddr + r->size) lo = mid + 1;
+        else return r;
+    }
+    return NULL;
+}
+
+int
+htool_codemap_is_code (htool_codemap_t *map, uint64_t addr)
+{
+    htool_code_region_t *region = htool_codemap_find_region (map, addr);
+    return (region) ? htool_code_region_is_code (region, addr) : 0;
+}
@@ -14,6 +14,8 @@
 //===----------------------------------------------------------------------===//
 
 #include "htool.h"
+#include "htool-error.h"
+#include "htool-vmmap.h"
 
 #include <assert.h>
 #include <libarch.h>
@@ -33,45 +35,24 @@
 #include <register.h>
 
 #include "disassembler/parser.h"
+#include "disassembler/codemap.h"
+#include "disassembler/functions.h"
+#include "disassembler/records.h"
+#include "disassembler/symmap.h"
 #include "commands/disassembler.h"
 #include "commands/macho.h"
 #include "commands/macho.h"
 
-#include "hashmap.h"
-
-HTOOL_PRIVATE
-int
-hashmap_compare (const void *a, const void *b, const void *udata)
-{
-    const inline_symbol_t *aa = a;
-    const inline_symbol_t *bb = b;
-    return aa->virt_addr == bb->virt_addr;
-}
-
-HTOOL_PRIVATE
-uint64_t
-hashmap_hash (const void *item)
-{
-    const inline_symbol_t *sym = item;
-    uint8_t bytes[8];
-    *(uint64_t *) bytes = sym->virt_addr;
-    return SIP64 (bytes, sizeof (bytes), 0, 0);
-}
-
 ///////////////////////////////////////////////////////////////////////////////
 
 HTOOL_PRIVATE
 uint64_t
 find_offset_for_virtual_address (macho_t *macho, uint64_t vmaddr)
 {
-    for (int i = 0; i < h_slist_length (macho->scmds); i++) {
-        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, i);
-        mach_segment_command_64_t *seg = info->segcmd;
-
-        if (vmaddr >= seg->vmaddr && vmaddr < (seg->vmaddr + seg->vmsize))
-            return seg->fileoff + (vmaddr - seg->vmaddr);
-    }
-    return 0;
+    uint64_t offset;
+    if (!htool_vmmap_vmaddr_to_offset (htool_vmmap_fetch (macho), vmaddr, &offset))
+        return 0;
+    return offset;
 }
 
 HTOOL_PRIVATE
@@ -105,13 +86,42 @@ find_macho_executable_section (macho_t *macho)
     return NULL;
 }
 
+/* "sub_" and up to 16 hex digits */
+#define DISASS_FUNCTION_NAME_LEN        21
+
+/**
+ *  Whether there's a symbol for a function at `addr`, rather than just the start of
+ *  a section.
+ */
+HTOOL_PRIVATE int
+_disass_has_function_symbol (htool_symmap_t *map, uint64_t addr)
+{
+    for (const inline_symbol_t *sym = htool_symmap_lookup (map, addr); sym; sym = htool_symmap_next (map, sym))
+        if (strcmp (sym->type, "section")) return 1;
+    return 0;
+}
+
 HTOOL_PRIVATE
-struct hashmap *
-fetch_macho_inline_symbol_hashmap (macho_t *macho)
+htool_symmap_t *
+fetch_macho_inline_symbol_map (macho_t *macho, int name_functions)
 {
-    /* Create the hashmap */
-    struct hashmap *map = hashmap_new (sizeof (inline_symbol_t), 0, 0, 0,
-            hashmap_hash, hashmap_compare, NULL, NULL);
+    mach_symtab_command_t *table = NULL;
+    inline_symbol_t *syms;
+    uint32_t nsects = 0, count = 0;
+    htool_symmap_t *map;
+
+    /* Find the symbol table. Fileset-style kernels don't have symbols of their own */
+    if (macho->header->filetype != MACH_TYPE_FILESET) {
+        mach_load_command_info_t *info = mach_load_command_find_command_by_type (macho, LC_SYMTAB);
+        if (info) table = (mach_symtab_command_t *) info->lc;
+    }
+
+    /* Size everything up front, so the map is only built once */
+    for (int i = 0; i < h_slist_length (macho->scmds); i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, i);
+        nsects += h_slist_length (info->sections);
+    }
+    syms = malloc ((nsects + (table ? table->nsyms : 0) + 1) * sizeof (inline_symbol_t));
 
     /* Add all the sections first */
     for (int i = 0; i < h_slist_length (macho->scmds); i++) {
@@ -121,38 +131,58 @@ fetch_macho_inline_symbol_hashmap (macho_t *macho)
 
             uint32_t len = strlen (sect->segname) + strlen (sect->sectname) + 2;
             char *name = calloc (1, len);
-            snprintf (name, len, "%s.%s\0", sect->segname, sect->sectname);
+            snprintf (name, len, "%s.%s", sect->segname, sect->sectname);
 
-            hashmap_set (map, &(inline_symbol_t){ .name=name, .type="section", .virt_addr=sect->addr });
-            //printf ("name: %s\n", name);
+            syms[count++] = (inline_symbol_t){ .name=name, .type="section", .virt_addr=sect->addr };
         }
     }
 
-    /* Do not add symbols for Fileset-style kernels */
-    if (macho->header->filetype == MACH_TYPE_FILESET)
-        return map;
+    if (table) {
+        htool_vmmap_t *vmmap = htool_vmmap_fetch (macho);
+        uint32_t offset = table->symoff;
+        uint32_t nlist_size = sizeof (nlist);
 
-    /* Find the symbol table */
-    mach_load_command_info_t *info = mach_load_command_find_command_by_type (macho, LC_SYMTAB);
-    if (!info) return NULL;
+        for (int i = 0; i < table->nsyms; i++) {
 
-    mach_symtab_command_t *table = (mach_symtab_command_t *) info->lc;
+            /* Find the current symbols 'nlist' */
+            nlist *curr = (nlist *) macho_load_bytes (macho, nlist_size, offset);
+            char *name = mach_symbol_table_find_symbol_name (macho, curr, table);
 
-    assert (table);
+            /* Only add the symbols if it has a name, and is somewhere in the image */
+            if (strcmp (name, LIBHELPER_MACHO_SYMBOL_NO_NAME) && curr->n_value &&
+                htool_vmmap_find_vmaddr (vmmap, curr->n_value))
+                syms[count++] = (inline_symbol_t){ .name=name, .type="method", .virt_addr=curr->n_value };
 
-    uint32_t offset = table->symoff;
-    uint32_t nlist_size = sizeof (nlist);
-    for (int i = 0; i < table->nsyms; i++) {
+            offset += nlist_size;
+        }
+    }
 
-        /* Find the current symbols 'nlist' */
-        nlist *curr = (nlist *) macho_load_bytes (macho, nlist_size, offset);
-        char *name = mach_symbol_table_find_symbol_name (macho, curr, table);
-        
-        /* Only add the symbols if it has a name */
-        if (strcmp (name, LIBHELPER_MACHO_SYMBOL_NO_NAME) && curr->n_value)
-            hashmap_set (map, &(inline_symbol_t){ .name=name, .type="method", .virt_addr=curr->n_value });
+    map = htool_symmap_create (count);
+    htool_symmap_insert_bulk (map, syms, count);
+    free (syms);
 
-        offset += nlist_size;
+    /**
+     *  Name the functions found by scanning for prologues that don't already have a
+     *  symbol, which for a stripped kernel is all of them. The scan covers every
+     *  executable segment, so it's only worth doing when that's what is disassembled.
+     */
+    if (!name_functions) return map;
+    htool_functions_t *functions = htool_functions_fetch (macho);
+    if (functions && functions->nfunctions) {
+        char *names = malloc ((size_t) functions->nfunctions * DISASS_FUNCTION_NAME_LEN);
+        syms = malloc (functions->nfunctions * sizeof (inline_symbol_t));
+        count = 0;
+
+        for (uint32_t i = 0; i < functions->nfunctions; i++) {
+            uint64_t addr = functions->functions[i].vmaddr;
+            if (_disass_has_function_symbol (map, addr)) continue;
+
+            char *name = names + (size_t) count * DISASS_FUNCTION_NAME_LEN;
+            snprintf (name, DISASS_FUNCTION_NAME_LEN, "sub_%llx", addr);
+            syms[count++] = (inline_symbol_t){ .name=name, .type="function", .virt_addr=addr };
+        }
+        htool_symmap_insert_bulk (map, syms, count);
+        free (syms);
     }
 
     return map;
@@ -172,35 +202,72 @@ htool_disassemble (unsigned char *data, uint32_t size, uint64_t base_address)
 
         printf (GREEN "   0x%016llx    " RESET "%08x\t", in->addr, SWAP_INT (in->opcode));
         htool_disassembler_parse_instruction (in);
+        free (in);
 
         base_address += 4;
     }
+    return HTOOL_RETURN_SUCCESS;
 }
 
 htool_return_t
-htool_disassemble_with_symbols (unsigned char *data, uint32_t size, uint64_t base_address, struct hashmap *inline_symbols)
+htool_disassemble_with_symbols (unsigned char *data, uint32_t size, uint64_t base_address, htool_disass_annotator_t *ann)
 {
+    htool_symmap_t *inline_symbols = ann->symbols;
+
     for (int i = 0; i < size; i++) {
         /* Get the next opcode */
         uint32_t opcode = *(uint32_t *) (data + (i * 4));
         instruction_t *in = libarch_instruction_create (opcode, base_address);
         libarch_disass (&in);
 
-        /* Match a symbol */
-        size_t iter = 0;
-        void *item;
-        while (hashmap_iter (inline_symbols, &iter, &item)) {
-            const inline_symbol_t *func = item;
-            if (func->virt_addr == in->addr) {
-                printf (BLUE "   ;-- %s: %s:\n" RESET, func->type, func->name);
-            }
+        /* Print any symbols at this address */
+        const inline_symbol_t *func = (inline_symbols) ? htool_symmap_lookup (inline_symbols, in->addr) : NULL;
+        for (; func; func = htool_symmap_next (inline_symbols, func)) {
+            printf (BLUE "   ;-- %s: %s:\n" RESET, func->type, func->name);
+            htool_disass_annotator_reset (ann);
         }
 
         printf (GREEN "   0x%016llx    " RESET "%08x\t", in->addr, SWAP_INT (in->opcode));
-        htool_disassembler_parse_instruction (in);
+        htool_disassembler_parse_instruction_annotated (in, ann);
+        free (in);
 
         base_address += 4;
     }
+    return HTOOL_RETURN_SUCCESS;
+}
+
+/**
+ *  Open the records file for a disassembly, either the path given with --output,
+ *  or the input file with a `.records` extension.
+ */
+HTOOL_PRIVATE htool_records_writer_t *
+_disass_records_open (htool_client_t *client)
+{
+    htool_records_writer_t *writer;
+    char *path = client->output;
+
+    if (!path) {
+        path = calloc (1, strlen (client->filename) + strlen (".records") + 1);
+        sprintf (path, "%s.records", client->filename);
+    }
+
+    if ((writer = htool_records_open (path)))
+        printf (BOLD RED "Writing records:\t" RED BOLD RESET "%s\n", path);
+    if (path != client->output) free (path);
+    return writer;
+}
+
+HTOOL_PRIVATE void
+_disass_records_append_range (htool_records_writer_t *writer, unsigned char *data, uint64_t count, uint64_t base_address)
+{
+    for (uint64_t i = 0; i < count; i++) {
+        uint32_t opcode = *(uint32_t *) (data + (i * 4));
+        instruction_t *in = libarch_instruction_create (opcode, base_address + (i * 4));
+        libarch_disass (&in);
+
+        htool_records_append (writer, in);
+        free (in);
+    }
 }
 
 htool_return_t
@@ -257,7 +324,9 @@ htool_disassemble_binary_quick (htool_client_t *client)
              * 
              */
             base_addr = find_macho_entry_point_virtual_address (macho);
-            if (!base_addr) {
+            if (base_addr) {
+                data = macho->data + find_offset_for_virtual_address (macho, base_addr);
+            } else {
                 /* If that didn't work, look for the base of the __TEXT segment */
                 mach_section_64_t *sect = find_macho_executable_section (macho);
                 assert (sect);
@@ -289,6 +358,18 @@ htool_disassemble_binary_quick (htool_client_t *client)
     if (client->opts & HTOOL_CLIENT_DISASS_OPT_STOP_ADDRESS) size = ((client->stop_address - client->base_address) / 4) + 1;
     else if (client->opts & HTOOL_CLIENT_DISASS_OPT_COUNT) size = client->size;
 
+    /**
+     *  With --format=records, the decoded instructions are written straight to the
+     *  records file, none of the text output or annotations are needed.
+     */
+    if (client->opts & HTOOL_CLIENT_DISASS_OPT_FORMAT_RECORDS) {
+        htool_records_writer_t *writer = _disass_records_open (client);
+        if (!writer) return HTOOL_RETURN_FAILURE;
+
+        _disass_records_append_range (writer, data, size, base_addr);
+        return htool_records_close (writer);
+    }
+
     /**
      * Output a summary before disassembly.
      */
@@ -299,13 +380,174 @@ htool_disassemble_binary_quick (htool_client_t *client)
      *  Fetch a list of all inline functions and sections, so they can be printed when outputting
      *  the instructions.
      */
-    struct hashmap *inline_symbols;
     if (HTOOL_CLIENT_CHECK_FLAG(bin->flags, HTOOL_BINARY_FILETYPE_MACHO64)) {
-        inline_symbols = fetch_macho_inline_symbol_hashmap (macho);
-        htool_disassemble_with_symbols (data, size, base_addr, inline_symbols);
+        htool_disass_annotator_t ann = {
+            .strings = htool_string_index_fetch (macho),
+            .symbols = fetch_macho_inline_symbol_map (macho, 0),
+            .fixups = htool_fixups_fetch (macho),
+        };
+        htool_disassemble_with_symbols (data, size, base_addr, &ann);
     } else {
         htool_disassemble (data, size, base_addr);
     }
 
     return HTOOL_RETURN_SUCCESS;
-}
\ No newline at end of file
+}
+
+htool_return_t
+htool_disassemble_binary_full (htool_client_t *client)
+{
+    htool_binary_t *bin = client->bin;
+    htool_disass_annotator_t ann = { 0 };
+    htool_codemap_t *codemap;
+    macho_t *macho;
+
+    /**
+     *  A full disassembly needs to know which parts of the executable segments are
+     *  code, and which are data, so it's only possible with a Mach-O. Raw binaries
+     *  still need to be disassembled with -d.
+     */
+    if (!HTOOL_CLIENT_CHECK_FLAG(bin->flags, HTOOL_BINARY_FILETYPE_MACHO64) && !HTOOL_CLIENT_CHECK_FLAG(bin->flags, HTOOL_BINARY_FILETYPE_FAT)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "Full disassembly requires a Mach-O, use --disassemble instead");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    macho = (macho_t *) calloc (1, sizeof (macho_t));
+    htool_macho_select_arch (client, &macho);
+    assert (macho);
+
+    /**
+     *  Build (or fetch) the code/data map. This follows control-flow from every known
+     *  function start, so anything it doesn't reach is treated as data and skipped
+     *  rather than being decoded as garbage.
+     */
+    codemap = htool_codemap_fetch (macho);
+    if (!codemap) {
+        htool_error_throw (HTOOL_ERROR_GENERAL, "Mach-O has no executable segments");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    /* Records only need the code, so data runs are simply skipped */
+    if (client->opts & HTOOL_CLIENT_DISASS_OPT_FORMAT_RECORDS) {
+        htool_records_writer_t *writer = _disass_records_open (client);
+        if (!writer) return HTOOL_RETURN_FAILURE;
+
+        for (uint32_t r = 0; r < codemap->nregions; r++) {
+            htool_code_region_t *region = &codemap->regions[r];
+            for (uint64_t off = 0; off < region->size; off += 4) {
+                if (htool_code_region_is_code (region, region->vmaddr + off))
+                    _disass_records_append_range (writer, region->data + off, 1, region->vmaddr + off);
+            }
+        }
+        return htool_records_close (writer);
+    }
+
+    ann.strings = htool_string_index_fetch (macho);
+    ann.symbols = fetch_macho_inline_symbol_map (macho, 1);
+    ann.fixups = htool_fixups_fetch (macho);
+
+    for (uint32_t r = 0; r < codemap->nregions; r++) {
+        htool_code_region_t *region = &codemap->regions[r];
+        uint64_t data_start = 0, data_len = 0;
+
+        printf (BOLD RED "Disassembly:\t" RED BOLD RESET);
+        printf (BOLD DARK_GREY "0x%08llx → 0x%08llx (%llu bytes)\n" DARK_GREY BOLD RESET,
+            region->vmaddr, region->vmaddr + region->size, region->size);
+
+        for (uint64_t off = 0; off <= region->size; off += 4) {
+            uint64_t addr = region->vmaddr + off;
+            int is_code = (off < region->size) && htool_code_region_is_code (region, addr);
+
+            /* Collapse runs of data into a single line */
+            if (off < region->size && !is_code) {
+                if (!data_len) data_start = addr;
+                data_len += 4;
+                continue;
+            }
+            if (data_len) {
+                printf (DARK_GREY "   0x%016llx    ; data, %llu bytes\n" RESET, data_start, data_len);
+                htool_disass_annotator_reset (&ann);
+                data_len = 0;
+            }
+            if (off == region->size) break;
+
+            htool_disassemble_with_symbols (region->data + off, 1, addr, &ann);
+        }
+    }
+
+    return HTOOL_RETURN_SUCCESS;
+}
+
+/**
+ *  Work out the address given with --function, either the name of a symbol or a hex
+ *  address. Symbols are tried first, as names like `add` are valid hex too.
+ */
+HTOOL_PRIVATE int
+_disass_function_address (htool_symmap_t *symbols, const char *function, uint64_t *addr)
+{
+    char *end;
+
+    for (uint32_t i = 0; i < symbols->nsyms; i++) {
+        if (strcmp (symbols->syms[i].type, "section") && !strcmp (symbols->syms[i].name, function)) {
+            *addr = symbols->syms[i].virt_addr;
+            return 1;
+        }
+    }
+
+    *addr = strtoull (function, &end, 16);
+    return (*function && !*end);
+}
+
+htool_return_t
+htool_disassemble_function (htool_client_t *client)
+{
+    htool_binary_t *bin = client->bin;
+    htool_disass_annotator_t ann = { 0 };
+    htool_functions_t *functions;
+    const htool_function_t *func;
+    uint64_t addr, offset;
+    macho_t *macho;
+
+    if (!HTOOL_CLIENT_CHECK_FLAG(bin->flags, HTOOL_BINARY_FILETYPE_MACHO64) && !HTOOL_CLIENT_CHECK_FLAG(bin->flags, HTOOL_BINARY_FILETYPE_FAT)) {
+        htool_error_throw (HTOOL_ERROR_FILETYPE, "Function disassembly requires a Mach-O");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    macho = (macho_t *) calloc (1, sizeof (macho_t));
+    htool_macho_select_arch (client, &macho);
+    assert (macho);
+
+    if (!(functions = htool_functions_fetch (macho))) {
+        htool_error_throw (HTOOL_ERROR_GENERAL, "Mach-O has no executable segments");
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    ann.strings = htool_string_index_fetch (macho);
+    ann.symbols = fetch_macho_inline_symbol_map (macho, 1);
+    ann.fixups = htool_fixups_fetch (macho);
+
+    if (!_disass_function_address (ann.symbols, client->function, &addr)) {
+        htool_error_throw (HTOOL_ERROR_GENERAL, "Unknown function: %s", client->function);
+        return HTOOL_RETURN_FAILURE;
+    }
+    if (!(func = htool_functions_find (functions, addr)) ||
+        !htool_vmmap_vmaddr_to_offset (htool_vmmap_fetch (macho), func->vmaddr, &offset)) {
+        htool_error_throw (HTOOL_ERROR_GENERAL, "No function found at 0x%llx", addr);
+        return HTOOL_RETURN_FAILURE;
+    }
+
+    if (client->opts & HTOOL_CLIENT_DISASS_OPT_FORMAT_RECORDS) {
+        htool_records_writer_t *writer = _disass_records_open (client);
+        if (!writer) return HTOOL_RETURN_FAILURE;
+
+        _disass_records_append_range (writer, macho->data + offset, func->size / 4, func->vmaddr);
+        return htool_records_close (writer);
+    }
+
+    printf (BOLD RED "Function:\t" RED BOLD RESET);
+    printf (BOLD DARK_GREY "0x%08llx → 0x%08llx (%d bytes, hash %016llx)\n" DARK_GREY BOLD RESET,
+        func->vmaddr, func->vmaddr + func->size, func->size, func->hash);
+
+    htool_disassemble_with_symbols (macho->data + offset, func->size / 4, func->vmaddr, &ann);
+    return HTOOL_RETURN_SUCCESS;
+}
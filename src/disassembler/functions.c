@@ -0,0 +1,440 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "disassembler/functions.h"
+#include "disassembler/a64.h"
+#include "htool-cache.h"
+#include "htool-hash.h"
+#include "htool-parallel.h"
+
+#define VM_PROT_EXECUTE_BIT         0x4
+
+#ifndef MIN
+#define MIN(a, b)                   (((a) < (b)) ? (a) : (b))
+#endif
+
+/* Executable segments are split into chunks of this many bytes for the scan */
+#define FUNCTIONS_CHUNK_SIZE        (1024 * 1024)
+
+/* Instructions that can start a function, as (mask, value) pairs */
+#define A64_PACIBSP                 0xd503237f
+#define A64_STP_PRE_SP_MASK         0xffe003e0      /* STP Xt, Xt2, [SP, #-n]! */
+#define A64_STP_PRE_SP              0xa9a003e0
+#define A64_SUB_SP_SP_MASK          0xff8003ff      /* SUB SP, SP, #n */
+#define A64_SUB_SP_SP               0xd10003ff
+#define A64_BL_MASK                 0xfc000000
+#define A64_BL                      0x94000000
+
+typedef enum scan_hit_t
+{
+    SCAN_HIT_NONE = 0,
+    SCAN_HIT_PACIBSP,
+    SCAN_HIT_PROLOGUE,
+    SCAN_HIT_BL,
+} scan_hit_t;
+
+/**
+ *  One chunk of an executable segment. Each chunk collects its own candidates and
+ *  BL targets, so the chunks can be scanned in parallel without any locking.
+ */
+typedef struct scan_chunk_t
+{
+    const unsigned char    *data;
+    uint64_t                vmaddr;
+    uint64_t                size;
+
+    uint64_t               *candidates;
+    uint32_t                ncandidates;
+    uint32_t                capcandidates;
+
+    uint64_t               *calls;
+    uint32_t                ncalls;
+    uint32_t                capcalls;
+} scan_chunk_t;
+
+typedef struct scan_region_t
+{
+    const unsigned char    *data;
+    uint64_t                vmaddr;
+    uint64_t                size;
+} scan_region_t;
+
+typedef struct hash_job_t
+{
+    htool_functions_t      *functions;
+    scan_region_t          *regions;
+    uint32_t                nregions;
+} hash_job_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE uint32_t
+_functions_rd32 (const unsigned char *p)
+{
+    uint32_t v;
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+HTOOL_PRIVATE void
+_functions_push (uint64_t **items, uint32_t *count, uint32_t *cap, uint64_t value)
+{
+    if (*count == *cap) {
+        *cap = (*cap) ? *cap * 2 : 1024;
+        *items = realloc (*items, *cap * sizeof (uint64_t));
+    }
+    (*items)[(*count)++] = value;
+}
+
+HTOOL_PRIVATE int
+_functions_u64_compare (const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+HTOOL_PRIVATE scan_hit_t
+_functions_classify (uint32_t opcode)
+{
+    if (opcode == A64_PACIBSP) return SCAN_HIT_PACIBSP;
+    if ((opcode & A64_STP_PRE_SP_MASK) == A64_STP_PRE_SP) return SCAN_HIT_PROLOGUE;
+    if ((opcode & A64_SUB_SP_SP_MASK) == A64_SUB_SP_SP) return SCAN_HIT_PROLOGUE;
+    if ((opcode & A64_BL_MASK) == A64_BL) return SCAN_HIT_BL;
+    return SCAN_HIT_NONE;
+}
+
+/**
+ *  Check four opcodes at once against every pattern. Nearly every block has none
+ *  of them, so only the blocks that do are classified one opcode at a time.
+ */
+HTOOL_PRIVATE int
+_functions_block_has_hit (const unsigned char *p)
+{
+#if defined(__SSE2__)
+    __m128i w = _mm_loadu_si128 ((const __m128i *) p);
+    __m128i hit = _mm_cmpeq_epi32 (w, _mm_set1_epi32 ((int) A64_PACIBSP));
+    hit = _mm_or_si128 (hit, _mm_cmpeq_epi32 (_mm_and_si128 (w, _mm_set1_epi32 ((int) A64_STP_PRE_SP_MASK)), _mm_set1_epi32 ((int) A64_STP_PRE_SP)));
+    hit = _mm_or_si128 (hit, _mm_cmpeq_epi32 (_mm_and_si128 (w, _mm_set1_epi32 ((int) A64_SUB_SP_SP_MASK)), _mm_set1_epi32 ((int) A64_SUB_SP_SP)));
+    hit = _mm_or_si128 (hit, _mm_cmpeq_epi32 (_mm_and_si128 (w, _mm_set1_epi32 ((int) A64_BL_MASK)), _mm_set1_epi32 ((int) A64_BL)));
+    return _mm_movemask_epi8 (hit);
+#elif defined(__ARM_NEON)
+    uint32x4_t w = vld1q_u32 ((const uint32_t *) p);
+    uint32x4_t hit = vceqq_u32 (w, vdupq_n_u32 (A64_PACIBSP));
+    hit = vorrq_u32 (hit, vceqq_u32 (vandq_u32 (w, vdupq_n_u32 (A64_STP_PRE_SP_MASK)), vdupq_n_u32 (A64_STP_PRE_SP)));
+    hit = vorrq_u32 (hit, vceqq_u32 (vandq_u32 (w, vdupq_n_u32 (A64_SUB_SP_SP_MASK)), vdupq_n_u32 (A64_SUB_SP_SP)));
+    hit = vorrq_u32 (hit, vceqq_u32 (vandq_u32 (w, vdupq_n_u32 (A64_BL_MASK)), vdupq_n_u32 (A64_BL)));
+    return vmaxvq_u32 (hit) != 0;
+#else
+    for (int i = 0; i < 4; i++)
+        if (_functions_classify (_functions_rd32 (p + i * 4)) != SCAN_HIT_NONE) return 1;
+    return 0;
+#endif
+}
+
+HTOOL_PRIVATE void
+_functions_scan_chunk_worker (void *ctx, uint32_t index)
+{
+    scan_chunk_t *chunk = &((scan_chunk_t *) ctx)[index];
+    uint64_t off = 0;
+
+    for (; off < chunk->size; off += 16) {
+        uint32_t n = (chunk->size - off >= 16) ? 4 : (uint32_t) ((chunk->size - off) / 4);
+        if (n == 4 && !_functions_block_has_hit (chunk->data + off)) continue;
+
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t opcode = _functions_rd32 (chunk->data + off + i * 4);
+            uint64_t addr = chunk->vmaddr + off + i * 4, target;
+
+            switch (_functions_classify (opcode)) {
+                case SCAN_HIT_PACIBSP:
+                case SCAN_HIT_PROLOGUE:
+                    _functions_push (&chunk->candidates, &chunk->ncandidates, &chunk->capcandidates, addr);
+                    break;
+                case SCAN_HIT_BL:
+                    a64_classify_flow (opcode, addr, &target);
+                    _functions_push (&chunk->calls, &chunk->ncalls, &chunk->capcalls, target);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE scan_region_t *
+_functions_find_region (scan_region_t *regions, uint32_t nregions, uint64_t addr)
+{
+    uint32_t lo = 0, hi = nregions;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (addr < regions[mid].vmaddr) hi = mid;
+        else if (addr >= regions[mid].vmaddr + regions[mid].size) lo = mid + 1;
+        else return &regions[mid];
+    }
+    return NULL;
+}
+
+HTOOL_PRIVATE int
+_functions_region_compare (const void *a, const void *b)
+{
+    const scan_region_t *ra = a, *rb = b;
+    return (ra->vmaddr > rb->vmaddr) - (ra->vmaddr < rb->vmaddr);
+}
+
+HTOOL_PRIVATE uint32_t
+_functions_load_regions (macho_t *macho, scan_region_t **out)
+{
+    uint32_t nsegs = h_slist_length (macho->scmds), count = 0;
+    scan_region_t *regions = calloc (nsegs ? nsegs : 1, sizeof (scan_region_t));
+
+    for (uint32_t i = 0; i < nsegs; i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, i);
+        mach_segment_command_64_t *seg = info->segcmd;
+
+        if (!(seg->initprot & VM_PROT_EXECUTE_BIT) || !seg->filesize) continue;
+        if (seg->fileoff + seg->filesize > macho->size) continue;
+
+        regions[count++] = (scan_region_t) {
+            .data = macho->data + seg->fileoff,
+            .vmaddr = seg->vmaddr,
+            .size = MIN (seg->vmsize, seg->filesize) & ~UINT64_C(3),
+        };
+    }
+
+    qsort (regions, count, sizeof (scan_region_t), _functions_region_compare);
+    *out = regions;
+    return count;
+}
+
+/**
+ *  Whether the word before `addr` ends whatever came before it: a return, an
+ *  unconditional branch or a trap, or zero padding between functions. The start
+ *  of a segment counts too.
+ */
+HTOOL_PRIVATE int
+_functions_follows_end (scan_region_t *region, uint64_t addr)
+{
+    uint64_t target;
+    uint32_t prev;
+
+    if (addr == region->vmaddr) return 1;
+    prev = _functions_rd32 (region->data + (addr - region->vmaddr) - 4);
+    return !prev || !a64_flow_falls_through (a64_classify_flow (prev, addr - 4, &target));
+}
+
+/**
+ *  The number of BL instructions that call `addr`, from the sorted list of every
+ *  BL destination.
+ */
+HTOOL_PRIVATE uint32_t
+_functions_count_calls (const uint64_t *calls, uint64_t ncalls, uint64_t addr)
+{
+    uint64_t lo = 0, hi = ncalls, n = 0;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (calls[mid] < addr) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo + n < ncalls && calls[lo + n] == addr) n++;
+    return (uint32_t) n;
+}
+
+/**
+ *  Hash a function with the PC-relative immediates cleared, so the hash doesn't
+ *  change when the function, or whatever it refers to, moves.
+ */
+HTOOL_PRIVATE void
+_functions_hash_worker (void *ctx, uint32_t index)
+{
+    hash_job_t *job = (hash_job_t *) ctx;
+    htool_function_t *func = &job->functions->functions[index];
+    scan_region_t *region = _functions_find_region (job->regions, job->nregions, func->vmaddr);
+    const unsigned char *data = region->data + (func->vmaddr - region->vmaddr);
+    uint32_t *words = malloc (func->size ? func->size : 4);
+
+    for (uint32_t i = 0; i < func->size / 4; i++) {
+        uint32_t opcode = _functions_rd32 (data + i * 4);
+
+        if ((opcode & 0x7c000000) == 0x14000000) opcode &= 0xfc000000;          /* B, BL */
+        else if ((opcode & 0x1f000000) == 0x10000000) opcode &= 0x9f00001f;     /* ADR, ADRP */
+        words[i] = opcode;
+    }
+
+    func->hash = htool_hash64 (words, func->size, 0);
+    free (words);
+}
+
+HTOOL_PRIVATE htool_functions_t *
+_functions_build (macho_t *macho)
+{
+    htool_functions_t *functions;
+    scan_region_t *regions;
+    scan_chunk_t *chunks = NULL;
+    uint32_t nregions, nchunks = 0, capchunks = 0;
+    uint64_t *calls = NULL, *starts = NULL;
+    uint32_t ncalls = 0, capcalls = 0, nstarts = 0, capstarts = 0;
+
+    if (!(nregions = _functions_load_regions (macho, &regions))) {
+        free (regions);
+        return NULL;
+    }
+
+    /* Split every region into chunks, and scan them all at once */
+    for (uint32_t r = 0; r < nregions; r++) {
+        for (uint64_t off = 0; off < regions[r].size; off += FUNCTIONS_CHUNK_SIZE) {
+            if (nchunks == capchunks) {
+                capchunks = (capchunks) ? capchunks * 2 : 64;
+                chunks = realloc (chunks, capchunks * sizeof (scan_chunk_t));
+            }
+            chunks[nchunks++] = (scan_chunk_t) {
+                .data = regions[r].data + off,
+                .vmaddr = regions[r].vmaddr + off,
+                .size = MIN (regions[r].size - off, FUNCTIONS_CHUNK_SIZE),
+            };
+        }
+    }
+    htool_parallel_for (nchunks, _functions_scan_chunk_worker, chunks);
+
+    functions = calloc (1, sizeof (htool_functions_t));
+
+    /* Every BL destination, sorted, so candidates can be checked against them */
+    for (uint32_t c = 0; c < nchunks; c++) {
+        for (uint32_t i = 0; i < chunks[c].ncalls; i++)
+            if (_functions_find_region (regions, nregions, chunks[c].calls[i]))
+                _functions_push (&calls, &ncalls, &capcalls, chunks[c].calls[i]);
+        free (chunks[c].calls);
+    }
+    qsort (calls, ncalls, sizeof (uint64_t), _functions_u64_compare);
+    functions->ncalls = ncalls;
+
+    /**
+     *  Chunks are in address order, and so are the candidates within them, so the
+     *  starts come out sorted. A candidate straight after a PACIBSP or another
+     *  prologue instruction is part of that function's prologue.
+     */
+    for (uint32_t c = 0; c < nchunks; c++) {
+        for (uint32_t i = 0; i < chunks[c].ncandidates; i++) {
+            uint64_t addr = chunks[c].candidates[i];
+            scan_region_t *region = _functions_find_region (regions, nregions, addr);
+            uint32_t opcode = _functions_rd32 (region->data + (addr - region->vmaddr));
+
+            functions->ncandidates++;
+            if (opcode != A64_PACIBSP) {
+                scan_hit_t prev = (addr == region->vmaddr) ? SCAN_HIT_NONE :
+                                  _functions_classify (_functions_rd32 (region->data + (addr - region->vmaddr) - 4));
+
+                if (prev == SCAN_HIT_PACIBSP || prev == SCAN_HIT_PROLOGUE) continue;
+                if (!_functions_count_calls (calls, ncalls, addr) && !_functions_follows_end (region, addr))
+                    continue;
+            }
+            _functions_push (&starts, &nstarts, &capstarts, addr);
+        }
+        free (chunks[c].candidates);
+    }
+
+    /* Functions without a prologue, that are called from more than one place */
+    uint32_t nprologue = nstarts;
+    for (uint32_t i = 0; i < ncalls;) {
+        uint64_t addr = calls[i];
+        uint32_t n = _functions_count_calls (calls, ncalls, addr);
+        scan_region_t *region = _functions_find_region (regions, nregions, addr);
+
+        i += n;
+        if (n < 2 || (addr & 3) || !_functions_rd32 (region->data + (addr - region->vmaddr))) continue;
+        if (!_functions_follows_end (region, addr)) continue;
+        if (_functions_count_calls (starts, nprologue, addr)) continue;
+        _functions_push (&starts, &nstarts, &capstarts, addr);
+    }
+    if (nstarts != nprologue) qsort (starts, nstarts, sizeof (uint64_t), _functions_u64_compare);
+
+    /* Each function runs to the next one, or the end of its segment */
+    functions->functions = calloc (nstarts ? nstarts : 1, sizeof (htool_function_t));
+    for (uint32_t i = 0; i < nstarts; i++) {
+        scan_region_t *region = _functions_find_region (regions, nregions, starts[i]);
+        uint64_t end = region->vmaddr + region->size;
+        htool_function_t *func = &functions->functions[functions->nfunctions++];
+
+        if (i + 1 < nstarts && starts[i + 1] < end) end = starts[i + 1];
+        while (end > starts[i] + 4 && !_functions_rd32 (region->data + (end - region->vmaddr) - 4)) end -= 4;
+
+        func->vmaddr = starts[i];
+        func->size = (uint32_t) MIN (end - starts[i], UINT32_MAX & ~UINT32_C(3));
+
+        scan_hit_t hit = _functions_classify (_functions_rd32 (region->data + (starts[i] - region->vmaddr)));
+        if (hit == SCAN_HIT_PACIBSP) func->flags |= HTOOL_FUNCTION_FLAG_PAC | HTOOL_FUNCTION_FLAG_PROLOGUE;
+        if (hit == SCAN_HIT_PROLOGUE) func->flags |= HTOOL_FUNCTION_FLAG_PROLOGUE;
+        if (_functions_count_calls (calls, ncalls, starts[i])) func->flags |= HTOOL_FUNCTION_FLAG_CALLED;
+    }
+
+    hash_job_t job = { .functions = functions, .regions = regions, .nregions = nregions };
+    htool_parallel_for (functions->nfunctions, _functions_hash_worker, &job);
+
+    free (starts);
+    free (calls);
+    free (chunks);
+    free (regions);
+    return functions;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_functions_t *
+htool_functions_fetch (macho_t *macho)
+{
+    htool_functions_t *functions, *cached;
+
+    if ((functions = htool_cache_fetch (macho, HTOOL_CACHE_KIND_FUNCTIONS)))
+        return functions;
+
+    if (!(functions = _functions_build (macho)))
+        return NULL;
+
+    /* another pass may have beaten us to it */
+    if ((cached = htool_cache_store (macho, HTOOL_CACHE_KIND_FUNCTIONS, functions)) != functions) {
+        free (functions->functions);
+        free (functions);
+    }
+    return cached;
+}
+
+const htool_function_t *
+htool_functions_find (htool_functions_t *functions, uint64_t addr)
+{
+    uint32_t lo = 0, hi = (functions) ? functions->nfunctions : 0;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        const htool_function_t *func = &functions->functions[mid];
+
+        if (addr < func->vmaddr) hi = mid;
+        else if (addr >= func->vmaddr + func->size) lo = mid + 1;
+        else return func;
+    }
+    return NULL;
+}
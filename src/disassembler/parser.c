@@ -14,6 +14,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "disassembler/parser.h"
+#include "disassembler/a64.h"
 
 #include <arm64/arm64-common.h>
 #include <arm64/arm64-conditions.h>
@@ -26,8 +27,115 @@
 #include <arm64/arm64-vector-specifiers.h>
 #include <arm64/arm64-index-extend.h>
 
+/* Longest string printed in an annotation */
+#define ANNOTATION_MAX_STRING_LEN       64
+
+/**
+ *  Update the tracked register values with the effect of `instr`, and work out
+ *  whether it completes an address that can be annotated.
+ */
+HTOOL_PRIVATE int
+_annotator_update (htool_disass_annotator_t *ann, instruction_t *instr, uint64_t *target)
+{
+    a64_regs_t *regs = &ann->regs;
+    uint32_t opcode = instr->opcode;
+    uint64_t pc = instr->addr, value;
+    unsigned rd, rn;
+
+    if (a64_decode_adrp (opcode, pc, &rd, &value)) {
+        a64_regs_set (regs, rd, value);
+        return 0;
+    }
+
+    if (a64_decode_adr (opcode, pc, &rd, target)) {
+        a64_regs_set (regs, rd, *target);
+        return 1;
+    }
+
+    if (a64_decode_add_imm (opcode, &rd, &rn, &value)) {
+        if (rn != 31 && a64_regs_valid (regs, rn)) {
+            *target = regs->x[rn] + value;
+            a64_regs_set (regs, rd, *target);
+            return 1;
+        }
+        a64_regs_clear (regs, rd);
+        return 0;
+    }
+
+    if (a64_decode_ldr_imm (opcode, &rd, &rn, &value)) {
+        int resolved = (rn != 31 && a64_regs_valid (regs, rn));
+        if (resolved) *target = regs->x[rn] + value;
+        a64_regs_clear (regs, rd);
+        return resolved;
+    }
+
+    if (a64_decode_ldr_literal (opcode, pc, &rd, target)) {
+        a64_regs_clear (regs, rd);
+        return 1;
+    }
+
+    /* Anything else forgets whatever it might have written */
+    a64_regs_clobber (regs, opcode, a64_classify_flow (opcode, pc, &value));
+    return 0;
+}
+
+HTOOL_PRIVATE void
+_annotator_print (htool_disass_annotator_t *ann, uint64_t target)
+{
+    const char *str, *arrow = "";
+    uint32_t len;
+
+    /**
+     *  A pointer that's fixed up at load time is annotated with what it points to once
+     *  it's been fixed up: the import for a bind, or the target of a rebase.
+     */
+    const htool_fixup_t *fixup = htool_fixups_lookup (ann->fixups, target);
+    if (fixup) {
+        const htool_fixup_import_t *import = htool_fixups_import (ann->fixups, fixup);
+        if (import && import->name) {
+            printf (DARK_GREY "\t; -> %s" RESET, import->name);
+            return;
+        }
+        if (fixup->kind == HTOOL_FIXUP_REBASE || fixup->kind == HTOOL_FIXUP_AUTH_REBASE) {
+            target = fixup->target;
+            arrow = "-> ";
+        }
+    }
+
+    /* Strings first, they're the most useful */
+    if (ann->strings && (str = htool_string_index_lookup (ann->strings, target, &len))) {
+        printf (DARK_GREY "\t; %s\"", arrow);
+        for (uint32_t i = 0; i < len && i < ANNOTATION_MAX_STRING_LEN; i++) {
+            if (str[i] == '\n') printf ("\\n");
+            else if (str[i] == '\t') printf ("\\t");
+            else putchar (str[i]);
+        }
+        printf ("\"%s" RESET, (len > ANNOTATION_MAX_STRING_LEN) ? "..." : "");
+        return;
+    }
+
+    /* Then symbols and sections */
+    if (ann->symbols) {
+        const inline_symbol_t *sym = htool_symmap_lookup (ann->symbols, target);
+        if (sym) {
+            printf (DARK_GREY "\t; %s%s" RESET, arrow, sym->name);
+            return;
+        }
+    }
+
+    printf (DARK_GREY "\t; %s0x%llx" RESET, arrow, target);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 htool_return_t
 htool_disassembler_parse_instruction (instruction_t *instr)
+{
+    return htool_disassembler_parse_instruction_annotated (instr, NULL);
+}
+
+htool_return_t
+htool_disassembler_parse_instruction_annotated (instruction_t *instr, htool_disass_annotator_t *ann)
 {
     /* Handle Mnemonic */
     char *mnemonic = A64_INSTRUCTIONS_STR[instr->type];
@@ -175,6 +283,11 @@ check_comma:
         if (i < instr->operands_len - 1) printf (", ");
     }
 
+    /* Annotate any address the instruction completes */
+    uint64_t target;
+    if (ann && _annotator_update (ann, instr, &target))
+        _annotator_print (ann, target);
+
     printf ("\n");
     return HTOOL_RETURN_SUCCESS;
 }
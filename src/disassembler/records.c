@@ -0,0 +1,199 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libhelper.h>
+#include <libhelper-logger.h>
+
+#include <arm64/arm64-instructions.h>
+
+#include "disassembler/records.h"
+
+/* Records are buffered and written out in blocks of this many */
+#define RECORDS_BUFFER_LEN          4096
+
+struct htool_records_writer_t
+{
+    FILE               *fp;
+    int                 failed;
+
+    htool_record_t     *buffer;
+    uint32_t            nbuffered;
+    uint64_t            nrecords;
+
+    /* Which mnemonics have been used, indexed by instruction type */
+    uint8_t            *seen;
+    uint32_t            nseen;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void
+_records_flush (htool_records_writer_t *writer)
+{
+    if (!writer->nbuffered) return;
+    if (fwrite (writer->buffer, sizeof (htool_record_t), writer->nbuffered, writer->fp) != writer->nbuffered)
+        writer->failed = 1;
+    writer->nbuffered = 0;
+}
+
+HTOOL_PRIVATE void
+_records_mark_mnemonic (htool_records_writer_t *writer, uint32_t type)
+{
+    if (type >= writer->nseen) {
+        uint32_t n = (type + 64) & ~63u;
+        writer->seen = realloc (writer->seen, n);
+        memset (writer->seen + writer->nseen, 0, n - writer->nseen);
+        writer->nseen = n;
+    }
+    writer->seen[type] = 1;
+}
+
+HTOOL_PRIVATE void
+_records_fill_operand (htool_record_operand_t *rop, operand_t *op)
+{
+    memset (rop, 0, sizeof (htool_record_operand_t));
+    rop->type = (uint8_t) op->op_type;
+
+    switch (op->op_type) {
+        case ARM64_OPERAND_TYPE_REGISTER:
+            rop->subtype = (uint8_t) op->reg_type;
+            rop->size = (uint8_t) op->reg_size;
+            rop->reg = (uint32_t) op->reg;
+            break;
+        case ARM64_OPERAND_TYPE_IMMEDIATE:
+            rop->subtype = (uint8_t) op->imm_type;
+            rop->value = (uint64_t) op->imm_bits;
+            break;
+        case ARM64_OPERAND_TYPE_SHIFT:
+            rop->subtype = (uint8_t) op->shift_type;
+            rop->value = (uint64_t) op->shift;
+            break;
+        default:
+            rop->reg = (uint32_t) op->extra;
+            break;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_records_writer_t *
+htool_records_open (const char *path)
+{
+    htool_records_header_t header;
+    htool_records_writer_t *writer;
+    FILE *fp;
+
+    if (!(fp = fopen (path, "wb"))) {
+        errorf ("htool_records_open: could not create file: %s\n", path);
+        return NULL;
+    }
+
+    /* Reserve space for the header, it's written properly once everything else is */
+    memset (&header, 0, sizeof (header));
+    if (fwrite (&header, sizeof (header), 1, fp) != 1) {
+        errorf ("htool_records_open: could not write to file: %s\n", path);
+        fclose (fp);
+        return NULL;
+    }
+
+    writer = calloc (1, sizeof (htool_records_writer_t));
+    writer->fp = fp;
+    writer->buffer = malloc (RECORDS_BUFFER_LEN * sizeof (htool_record_t));
+    return writer;
+}
+
+void
+htool_records_append (htool_records_writer_t *writer, instruction_t *instr)
+{
+    htool_record_t *rec = &writer->buffer[writer->nbuffered++];
+    memset (rec, 0, sizeof (htool_record_t));
+
+    rec->addr = instr->addr;
+    rec->opcode = instr->opcode;
+    rec->mnemonic = (uint16_t) instr->type;
+    rec->cond = (int8_t) instr->cond;
+    rec->spec = (int8_t) instr->spec;
+
+    rec->noperands = (instr->operands_len > HTOOL_RECORD_MAX_OPERANDS) ? HTOOL_RECORD_MAX_OPERANDS : instr->operands_len;
+    if (instr->operands_len > HTOOL_RECORD_MAX_OPERANDS) rec->flags |= HTOOL_RECORD_FLAG_TRUNCATED;
+    for (int i = 0; i < rec->noperands; i++)
+        _records_fill_operand (&rec->operands[i], &instr->operands[i]);
+
+    _records_mark_mnemonic (writer, instr->type);
+
+    writer->nrecords++;
+    if (writer->nbuffered == RECORDS_BUFFER_LEN) _records_flush (writer);
+}
+
+htool_return_t
+htool_records_close (htool_records_writer_t *writer)
+{
+    htool_records_header_t header;
+    htool_return_t ret = HTOOL_RETURN_SUCCESS;
+    uint32_t *offsets, names_size = 0;
+
+    _records_flush (writer);
+
+    /**
+     *  The string table only holds the names of mnemonics that were used, so a
+     *  short disassembly doesn't carry the name of every instruction Libarch knows.
+     */
+    offsets = malloc ((writer->nseen ? writer->nseen : 1) * sizeof (uint32_t));
+    for (uint32_t i = 0; i < writer->nseen; i++) {
+        if (!writer->seen[i]) {
+            offsets[i] = HTOOL_RECORDS_STRTAB_UNUSED;
+            continue;
+        }
+        offsets[i] = names_size;
+        names_size += strlen (A64_INSTRUCTIONS_STR[i]) + 1;
+    }
+
+    if (fwrite (offsets, sizeof (uint32_t), writer->nseen, writer->fp) != writer->nseen)
+        writer->failed = 1;
+    for (uint32_t i = 0; i < writer->nseen; i++) {
+        if (!writer->seen[i]) continue;
+        const char *name = A64_INSTRUCTIONS_STR[i];
+        if (fwrite (name, strlen (name) + 1, 1, writer->fp) != 1) writer->failed = 1;
+    }
+
+    memset (&header, 0, sizeof (header));
+    header.magic = HTOOL_RECORDS_MAGIC;
+    header.version = HTOOL_RECORDS_VERSION;
+    header.record_size = sizeof (htool_record_t);
+    header.nrecords = writer->nrecords;
+    header.records_offset = sizeof (htool_records_header_t);
+    header.strtab_offset = header.records_offset + writer->nrecords * sizeof (htool_record_t);
+    header.strtab_size = writer->nseen * sizeof (uint32_t) + names_size;
+    header.nmnemonics = writer->nseen;
+
+    if (fseek (writer->fp, 0, SEEK_SET) || fwrite (&header, sizeof (header), 1, writer->fp) != 1)
+        writer->failed = 1;
+    if (fclose (writer->fp)) writer->failed = 1;
+
+    if (writer->failed) {
+        errorf ("htool_records_close: failed to write records file.\n");
+        ret = HTOOL_RETURN_FAILURE;
+    }
+
+    free (offsets);
+    free (writer->seen);
+    free (writer->buffer);
+    free (writer);
+    return ret;
+}
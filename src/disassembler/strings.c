@@ -0,0 +1,159 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "disassembler/strings.h"
+#include "htool-cache.h"
+#include "htool-fileset.h"
+
+/**
+ *  Sections that are indexed, and whether they can contain anything other than
+ *  strings. Pointers into __TEXT.__const need to be checked before they are
+ *  treated as a string.
+ */
+static const struct {
+    const char  *segname;
+    const char  *sectname;
+    int          strict;
+} string_sections[] = {
+    { "__TEXT",     "__cstring",    0 },
+    { "__TEXT",     "__os_log",     0 },
+    { "__TEXT",     "__const",      1 },
+};
+
+#define STRING_SECTIONS_LEN         (sizeof (string_sections) / sizeof (string_sections[0]))
+
+/* Minimum printable characters for something in a strict section to be a string */
+#define STRING_STRICT_MIN_LEN       4
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void
+_string_index_add_image (htool_string_index_t *index, uint32_t *cap, unsigned char *base, uint64_t base_size, macho_t *image)
+{
+    for (int i = 0; i < h_slist_length (image->scmds); i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (image->scmds, i);
+
+        for (int j = 0; j < h_slist_length (info->sections); j++) {
+            mach_section_64_t *sect = (mach_section_64_t *) h_slist_nth_data (info->sections, j);
+
+            for (int k = 0; k < STRING_SECTIONS_LEN; k++) {
+                if (strncmp (sect->segname, string_sections[k].segname, 16) ||
+                    strncmp (sect->sectname, string_sections[k].sectname, 16))
+                    continue;
+
+                if (!sect->size || (uint64_t) sect->offset + sect->size > base_size) break;
+
+                if (index->nranges == *cap) {
+                    *cap = (*cap) ? *cap * 2 : 16;
+                    index->ranges = realloc (index->ranges, *cap * sizeof (htool_string_range_t));
+                }
+
+                htool_string_range_t *range = &index->ranges[index->nranges++];
+                range->vmaddr = sect->addr;
+                range->size = sect->size;
+                range->data = base + sect->offset;
+                range->strict = string_sections[k].strict;
+                break;
+            }
+        }
+    }
+}
+
+HTOOL_PRIVATE int
+_string_range_compare (const void *a, const void *b)
+{
+    const htool_string_range_t *ra = a, *rb = b;
+    return (ra->vmaddr > rb->vmaddr) - (ra->vmaddr < rb->vmaddr);
+}
+
+HTOOL_PRIVATE htool_string_index_t *
+_string_index_build (macho_t *macho)
+{
+    htool_string_index_t *index = calloc (1, sizeof (htool_string_index_t));
+    htool_fileset_index_t *fileset;
+    uint32_t cap = 0;
+
+    /**
+     *  For Fileset Mach-O's, the section offsets of each entry are relative to the
+     *  start of the Fileset, not the entry.
+     */
+    _string_index_add_image (index, &cap, macho->data, macho->size, macho);
+    if ((fileset = htool_fileset_index_fetch (macho))) {
+        for (uint32_t i = 0; i < fileset->nentries; i++) {
+            macho_t *entry = htool_fileset_entry_macho (fileset, &fileset->entries[i]);
+            if (entry) _string_index_add_image (index, &cap, macho->data, macho->size, entry);
+        }
+    }
+
+    qsort (index->ranges, index->nranges, sizeof (htool_string_range_t), _string_range_compare);
+    return index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_string_index_t *
+htool_string_index_fetch (macho_t *macho)
+{
+    htool_string_index_t *index, *cached;
+
+    if ((index = htool_cache_fetch (macho, HTOOL_CACHE_KIND_STRINGS)))
+        return index;
+
+    index = _string_index_build (macho);
+    if ((cached = htool_cache_store (macho, HTOOL_CACHE_KIND_STRINGS, index)) != index) {
+        free (index->ranges);
+        free (index);
+    }
+    return cached;
+}
+
+const char *
+htool_string_index_lookup (htool_string_index_t *index, uint64_t addr, uint32_t *len)
+{
+    htool_string_range_t *range = NULL;
+    uint32_t lo = 0, hi = index->nranges;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        htool_string_range_t *r = &index->ranges[mid];
+
+        if (addr < r->vmaddr) hi = mid;
+        else if (addr >= r->vmaddr + r->size) lo = mid + 1;
+        else { range = r; break; }
+    }
+    if (!range) return NULL;
+
+    /* The string must be terminated within the section */
+    const char *str = (const char *) range->data + (addr - range->vmaddr);
+    uint64_t max = range->size - (addr - range->vmaddr);
+    const char *end = memchr (str, '\0', max);
+    if (!end) return NULL;
+
+    /**
+     *  Strict sections hold all sorts of constant data, so only accept something
+     *  that looks like text.
+     */
+    if (range->strict) {
+        if (end - str < STRING_STRICT_MIN_LEN) return NULL;
+        for (const char *c = str; c < end; c++)
+            if (!isprint ((unsigned char) *c) && *c != '\n' && *c != '\t') return NULL;
+    }
+
+    if (len) *len = (uint32_t) (end - str);
+    return str;
+}
@@ -0,0 +1,137 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "disassembler/symmap.h"
+
+/* Smallest table, 16 slots. Tables are kept at most half full. */
+#define SYMMAP_MIN_SLOTS_BITS       4
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void
+_symmap_alloc_slots (htool_symmap_t *map, uint32_t nkeys)
+{
+    uint32_t bits = SYMMAP_MIN_SLOTS_BITS;
+    while (bits < 31 && (UINT32_C(1) << bits) < nkeys * 2) bits++;
+
+    map->keys = calloc (UINT32_C(1) << bits, sizeof (uint64_t));
+    map->heads = malloc ((UINT32_C(1) << bits) * sizeof (uint32_t));
+    map->mask = (UINT32_C(1) << bits) - 1;
+    map->shift = 64 - bits;
+}
+
+HTOOL_PRIVATE void
+_symmap_reserve_syms (htool_symmap_t *map, uint32_t nsyms)
+{
+    if (nsyms <= map->capsyms) return;
+
+    map->capsyms = nsyms;
+    map->syms = realloc (map->syms, map->capsyms * sizeof (inline_symbol_t));
+    map->next = realloc (map->next, map->capsyms * sizeof (uint32_t));
+}
+
+/**
+ *  Place symbol `idx` in the table, either in a new slot or at the end of the
+ *  chain for its address.
+ */
+HTOOL_PRIVATE void
+_symmap_place (htool_symmap_t *map, uint32_t idx)
+{
+    uint64_t addr = map->syms[idx].virt_addr;
+
+    map->next[idx] = HTOOL_SYMMAP_NONE;
+    for (uint32_t i = htool_symmap_slot (map, addr);; i = (i + 1) & map->mask) {
+        if (!map->keys[i]) {
+            map->keys[i] = addr;
+            map->heads[i] = idx;
+            map->nkeys++;
+            return;
+        }
+        if (map->keys[i] == addr) {
+            uint32_t n = map->heads[i];
+            while (map->next[n] != HTOOL_SYMMAP_NONE) n = map->next[n];
+            map->next[n] = idx;
+            return;
+        }
+    }
+}
+
+/**
+ *  Make sure there are slots for `nkeys` addresses, rehashing every symbol
+ *  into a bigger table if there aren't.
+ */
+HTOOL_PRIVATE void
+_symmap_reserve_slots (htool_symmap_t *map, uint32_t nkeys)
+{
+    if ((uint64_t) nkeys * 2 <= (uint64_t) map->mask + 1) return;
+
+    free (map->keys);
+    free (map->heads);
+    _symmap_alloc_slots (map, nkeys);
+
+    map->nkeys = 0;
+    for (uint32_t i = 0; i < map->nsyms; i++)
+        _symmap_place (map, i);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_symmap_t *
+htool_symmap_create (uint32_t nsyms)
+{
+    htool_symmap_t *map = calloc (1, sizeof (htool_symmap_t));
+    _symmap_alloc_slots (map, nsyms);
+    _symmap_reserve_syms (map, nsyms ? nsyms : 1);
+    return map;
+}
+
+void
+htool_symmap_free (htool_symmap_t *map)
+{
+    if (!map) return;
+    free (map->keys);
+    free (map->heads);
+    free (map->syms);
+    free (map->next);
+    free (map);
+}
+
+void
+htool_symmap_insert (htool_symmap_t *map, uint64_t addr, char *name, char *type)
+{
+    if (!addr) return;
+
+    if (map->nsyms == map->capsyms) _symmap_reserve_syms (map, map->capsyms * 2);
+    _symmap_reserve_slots (map, map->nkeys + 1);
+
+    map->syms[map->nsyms] = (inline_symbol_t) { .virt_addr = addr, .name = name, .type = type };
+    _symmap_place (map, map->nsyms++);
+}
+
+void
+htool_symmap_insert_bulk (htool_symmap_t *map, const inline_symbol_t *syms, uint32_t count)
+{
+    _symmap_reserve_syms (map, map->nsyms + count);
+    _symmap_reserve_slots (map, map->nkeys + count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (!syms[i].virt_addr) continue;
+        map->syms[map->nsyms] = syms[i];
+        _symmap_place (map, map->nsyms++);
+    }
+}
@@ -0,0 +1,177 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "htool-fileset.h"
+#include "htool-cache.h"
+#include "htool-hash.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE uint32_t
+_fileset_hash (const char *entry_id)
+{
+    return (uint32_t) htool_hash64 (entry_id, strlen (entry_id), 0);
+}
+
+HTOOL_PRIVATE htool_fileset_entry_t *
+_fileset_entry_add (htool_fileset_index_t *index, uint32_t *cap)
+{
+    if (index->nentries == *cap) {
+        *cap = (*cap) ? *cap * 2 : 64;
+        index->entries = realloc (index->entries, *cap * sizeof (htool_fileset_entry_t));
+    }
+    htool_fileset_entry_t *entry = &index->entries[index->nentries++];
+    memset (entry, 0, sizeof (htool_fileset_entry_t));
+    return entry;
+}
+
+HTOOL_PRIVATE htool_fileset_index_t *
+_fileset_index_build (macho_t *macho)
+{
+    htool_fileset_index_t *index = calloc (1, sizeof (htool_fileset_index_t));
+    unsigned char *lc, *end;
+    uint32_t cap = 0, size = 16, e = 0;
+
+    index->fileset = macho;
+
+    /**
+     *  Walk the Fileset's load commands directly, rather than the entries libhelper
+     *  has already parsed, so the index has every entry even if libhelper skipped one.
+     */
+    lc = macho->data + sizeof (mach_header_t);
+    end = macho->data + macho->size;
+    if (macho->header->sizeofcmds < (uint64_t) (end - lc)) end = lc + macho->header->sizeofcmds;
+
+    for (uint32_t i = 0; i < macho->header->ncmds && (uint64_t) (end - lc) >= sizeof (mach_load_command_t); i++) {
+        mach_load_command_t *cmd = (mach_load_command_t *) lc;
+        if (cmd->cmdsize < sizeof (mach_load_command_t) || cmd->cmdsize > (uint64_t) (end - lc)) break;
+
+        if (cmd->cmd == LC_FILESET_ENTRY && cmd->cmdsize >= sizeof (mach_fileset_entry_command_t)) {
+            mach_fileset_entry_command_t *fs = (mach_fileset_entry_command_t *) lc;
+            htool_fileset_entry_t *entry = _fileset_entry_add (index, &cap);
+            uint32_t name = fs->entry_id.offset;
+
+            /* The ID has to be terminated inside the command */
+            if (name < cmd->cmdsize && memchr (lc + name, '\0', cmd->cmdsize - name))
+                entry->entry_id = (const char *) lc + name;
+            entry->vmaddr = fs->vmaddr;
+            entry->fileoff = fs->fileoff;
+            entry->cmd_offset = (uint32_t) (lc - macho->data);
+        }
+        lc += cmd->cmdsize;
+    }
+
+    /* The entries have stopped moving, so their locks can be set up */
+    for (uint32_t i = 0; i < index->nentries; i++)
+        pthread_mutex_init (&index->entries[i].lock, NULL);
+
+    /**
+     *  libhelper parses every entry it finds when it loads the Fileset, so use those
+     *  rather than parsing them again. Both lists are in load command order.
+     */
+    for (HSList *l = macho->fileset; l && e < index->nentries; l = l->next) {
+        mach_fileset_entry_info_t *info = (mach_fileset_entry_info_t *) l->data;
+        while (e < index->nentries && index->entries[e].cmd_offset < info->offset) e++;
+        if (e < index->nentries && index->entries[e].cmd_offset == info->offset)
+            index->entries[e].macho = info->macho;
+    }
+
+    /* Keep the table at most half full, so probe chains stay short */
+    while (size < index->nentries * 2) size <<= 1;
+    index->slots = calloc (size, sizeof (uint32_t));
+    index->mask = size - 1;
+
+    for (uint32_t i = 0; i < index->nentries; i++) {
+        const char *entry_id = index->entries[i].entry_id;
+        if (!entry_id) continue;
+
+        /* Where an ID appears twice, the first entry is kept */
+        uint32_t s = _fileset_hash (entry_id) & index->mask;
+        for (; index->slots[s]; s = (s + 1) & index->mask)
+            if (!strcmp (index->entries[index->slots[s] - 1].entry_id, entry_id)) break;
+        if (!index->slots[s]) index->slots[s] = i + 1;
+    }
+    return index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_fileset_index_t *
+htool_fileset_index_fetch (macho_t *macho)
+{
+    htool_fileset_index_t *index, *cached;
+
+    if (!macho || macho->header->filetype != MACH_TYPE_FILESET)
+        return NULL;
+
+    if ((index = htool_cache_fetch (macho, HTOOL_CACHE_KIND_FILESET)))
+        return index;
+
+    index = _fileset_index_build (macho);
+    if ((cached = htool_cache_store (macho, HTOOL_CACHE_KIND_FILESET, index)) != index) {
+        for (uint32_t i = 0; i < index->nentries; i++)
+            pthread_mutex_destroy (&index->entries[i].lock);
+        free (index->entries);
+        free (index->slots);
+        free (index);
+    }
+    return cached;
+}
+
+htool_fileset_entry_t *
+htool_fileset_index_find (htool_fileset_index_t *index, const char *entry_id)
+{
+    if (!index || !entry_id) return NULL;
+
+    for (uint32_t s = _fileset_hash (entry_id) & index->mask;; s = (s + 1) & index->mask) {
+        uint32_t slot = index->slots[s];
+        if (!slot) return NULL;
+        if (!strcmp (index->entries[slot - 1].entry_id, entry_id)) return &index->entries[slot - 1];
+    }
+}
+
+macho_t *
+htool_fileset_entry_macho (htool_fileset_index_t *index, htool_fileset_entry_t *entry)
+{
+    macho_t *macho;
+
+    if (!index || !entry) return NULL;
+
+    /* Entries libhelper has already parsed are filled in when the index is built */
+    if ((macho = __atomic_load_n (&entry->macho, __ATOMIC_ACQUIRE)))
+        return macho;
+
+    /* Only this entry is held while it's parsed, so other entries aren't held up */
+    pthread_mutex_lock (&entry->lock);
+    if (!entry->macho && !entry->failed) {
+        if (entry->fileoff + sizeof (mach_header_t) <= index->fileset->size)
+            macho = macho_64_create_from_buffer (index->fileset->data + entry->fileoff);
+        if (!macho) {
+            warningf ("Could not parse fileset entry %s\n", entry->entry_id ? entry->entry_id : "(unnamed)");
+            entry->failed = 1;
+        }
+        __atomic_store_n (&entry->macho, macho, __ATOMIC_RELEASE);
+    }
+    macho = entry->macho;
+    pthread_mutex_unlock (&entry->lock);
+
+    return macho;
+}
@@ -0,0 +1,558 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "htool-fixups.h"
+#include "htool-cache.h"
+#include "htool-parallel.h"
+
+/* dyld_chained_starts_in_segment page_start values */
+#define DYLD_CHAINED_PTR_START_NONE     0xffff
+#define DYLD_CHAINED_PTR_START_MULTI    0x8000
+#define DYLD_CHAINED_PTR_START_LAST     0x8000
+
+/* dyld_chained_fixups_header imports_format values */
+#define DYLD_CHAINED_IMPORT             1
+#define DYLD_CHAINED_IMPORT_ADDEND      2
+#define DYLD_CHAINED_IMPORT_ADDEND64    3
+
+/* Field offsets of dyld_chained_starts_in_segment, which isn't naturally aligned */
+#define STARTS_SEG_PAGE_SIZE            4
+#define STARTS_SEG_POINTER_FORMAT       6
+#define STARTS_SEG_SEGMENT_OFFSET       8
+#define STARTS_SEG_PAGE_COUNT           20
+#define STARTS_SEG_PAGE_START           22
+
+/**
+ *  A chain to walk: a chain start from either a page of LC_DYLD_CHAINED_FIXUPS, or
+ *  __thread_starts. Chains never run past `limit`.
+ */
+typedef struct fixup_chain_t
+{
+    uint64_t            vmaddr;
+    uint64_t            fileoff;
+    uint64_t            limit;
+    uint16_t            format;
+    uint16_t            stride;
+} fixup_chain_t;
+
+typedef struct fixups_job_t
+{
+    macho_t            *macho;
+    uint64_t            base;
+    fixup_chain_t      *chains;
+
+    /* One table for each chain */
+    htool_fixup_t     **out;
+    uint32_t           *nout;
+} fixups_job_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE uint16_t
+_fixups_rd16 (const unsigned char *p) { uint16_t v; memcpy (&v, p, sizeof (v)); return v; }
+
+HTOOL_PRIVATE uint32_t
+_fixups_rd32 (const unsigned char *p) { uint32_t v; memcpy (&v, p, sizeof (v)); return v; }
+
+HTOOL_PRIVATE uint64_t
+_fixups_rd64 (const unsigned char *p) { uint64_t v; memcpy (&v, p, sizeof (v)); return v; }
+
+HTOOL_PRIVATE int64_t
+_fixups_sign_extend (uint64_t value, unsigned bits)
+{
+    uint64_t m = UINT64_C(1) << (bits - 1);
+    value &= (m << 1) - 1;
+    return (int64_t) ((value ^ m) - m);
+}
+
+/**
+ *  Bytes between pointers in a chain, for each format. Zero for the formats that
+ *  aren't supported (the 32-bit ones).
+ */
+HTOOL_PRIVATE uint16_t
+_fixups_stride (uint16_t format)
+{
+    switch (format) {
+        case DYLD_CHAINED_PTR_ARM64E:
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+            return 8;
+        case DYLD_CHAINED_PTR_ARM64E_KERNEL:
+        case DYLD_CHAINED_PTR_ARM64E_FIRMWARE:
+        case DYLD_CHAINED_PTR_64:
+        case DYLD_CHAINED_PTR_64_OFFSET:
+        case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+            return 4;
+        case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ *  Decode one pointer. Returns the distance to the next pointer in the chain, in
+ *  units of the format's stride, or 0 at the end of the chain.
+ */
+HTOOL_PRIVATE uint32_t
+_fixups_decode (uint16_t format, uint64_t raw, uint64_t base, htool_fixup_t *fixup)
+{
+    int auth, bind;
+
+    switch (format) {
+        case DYLD_CHAINED_PTR_ARM64E:
+        case DYLD_CHAINED_PTR_ARM64E_KERNEL:
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND:
+        case DYLD_CHAINED_PTR_ARM64E_FIRMWARE:
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND24:
+            auth = (raw >> 63) & 1;
+            bind = (raw >> 62) & 1;
+
+            if (auth) {
+                fixup->diversity = (raw >> 32) & 0xffff;
+                fixup->addr_div = (raw >> 48) & 1;
+                fixup->key = (raw >> 49) & 3;
+            }
+
+            if (bind) {
+                fixup->kind = (auth) ? HTOOL_FIXUP_AUTH_BIND : HTOOL_FIXUP_BIND;
+                fixup->ordinal = (format == DYLD_CHAINED_PTR_ARM64E_USERLAND24) ? (raw & 0xffffff) : (raw & 0xffff);
+                fixup->target = (auth) ? 0 : (uint64_t) _fixups_sign_extend (raw >> 32, 19);
+            } else if (auth) {
+                fixup->kind = HTOOL_FIXUP_AUTH_REBASE;
+                fixup->target = base + (raw & 0xffffffff);
+            } else {
+                uint64_t target = raw & UINT64_C(0x7ffffffffff), high8 = (raw >> 43) & 0xff;
+
+                /**
+                 *  Plain arm64e (and firmware) rebases hold the address itself. Kernel
+                 *  addresses don't fit in 43 bits, so they're sign-extended, which is
+                 *  what the kernel does with __thread_starts. The other formats hold an
+                 *  offset from the base.
+                 */
+                fixup->kind = HTOOL_FIXUP_REBASE;
+                if (format == DYLD_CHAINED_PTR_ARM64E || format == DYLD_CHAINED_PTR_ARM64E_FIRMWARE)
+                    fixup->target = (uint64_t) _fixups_sign_extend (target, 43) | (high8 << 56);
+                else
+                    fixup->target = (base + target) | (high8 << 56);
+            }
+            return (raw >> 51) & 0x7ff;
+
+        case DYLD_CHAINED_PTR_64:
+        case DYLD_CHAINED_PTR_64_OFFSET:
+            if ((raw >> 63) & 1) {
+                fixup->kind = HTOOL_FIXUP_BIND;
+                fixup->ordinal = raw & 0xffffff;
+                fixup->target = (raw >> 24) & 0xff;
+            } else {
+                uint64_t target = raw & UINT64_C(0xfffffffff), high8 = (raw >> 36) & 0xff;
+
+                fixup->kind = HTOOL_FIXUP_REBASE;
+                fixup->target = ((format == DYLD_CHAINED_PTR_64) ? target : base + target) | (high8 << 56);
+            }
+            return (raw >> 51) & 0xfff;
+
+        case DYLD_CHAINED_PTR_64_KERNEL_CACHE:
+        case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:
+            /* Kernel collections only rebase, always relative to the collection's base */
+            auth = (raw >> 63) & 1;
+            fixup->kind = (auth) ? HTOOL_FIXUP_AUTH_REBASE : HTOOL_FIXUP_REBASE;
+            fixup->target = base + (raw & 0x3fffffff);
+            fixup->diversity = (raw >> 32) & 0xffff;
+            fixup->addr_div = (raw >> 48) & 1;
+            fixup->key = (raw >> 49) & 3;
+            return (raw >> 51) & 0xfff;
+
+        default:
+            return 0;
+    }
+}
+
+HTOOL_PRIVATE void
+_fixups_walk_chain_worker (void *ctx, uint32_t index)
+{
+    fixups_job_t *job = (fixups_job_t *) ctx;
+    fixup_chain_t *chain = &job->chains[index];
+    uint64_t vmaddr = chain->vmaddr, fileoff = chain->fileoff;
+    htool_fixup_t *out = NULL;
+    uint32_t n = 0, cap = 0, next;
+
+    do {
+        if (fileoff >= chain->limit || fileoff + sizeof (uint64_t) > job->macho->size) break;
+
+        if (n == cap) {
+            cap = (cap) ? cap * 2 : 64;
+            out = realloc (out, cap * sizeof (htool_fixup_t));
+        }
+        htool_fixup_t *fixup = &out[n++];
+        memset (fixup, 0, sizeof (htool_fixup_t));
+        fixup->vmaddr = vmaddr;
+
+        next = _fixups_decode (chain->format, _fixups_rd64 (job->macho->data + fileoff), job->base, fixup);
+        vmaddr += (uint64_t) next * chain->stride;
+        fileoff += (uint64_t) next * chain->stride;
+    } while (next);
+
+    job->out[index] = out;
+    job->nout[index] = n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE mach_segment_command_64_t *
+_fixups_segment (macho_t *macho, uint32_t index)
+{
+    mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (macho->scmds, index);
+    return (info) ? info->segcmd : NULL;
+}
+
+/**
+ *  The address the image expects to be loaded at, which rebase offsets are relative
+ *  to. That's the segment holding the Mach-O header, i.e. __TEXT.
+ */
+HTOOL_PRIVATE uint64_t
+_fixups_image_base (macho_t *macho)
+{
+    for (int i = 0; i < h_slist_length (macho->scmds); i++) {
+        mach_segment_command_64_t *seg = _fixups_segment (macho, i);
+        if (seg && seg->fileoff == 0 && seg->filesize) return seg->vmaddr;
+    }
+    return 0;
+}
+
+HTOOL_PRIVATE void
+_fixups_add_chain (fixup_chain_t **chains, uint32_t *count, uint32_t *cap, fixup_chain_t *chain)
+{
+    if (*count == *cap) {
+        *cap = (*cap) ? *cap * 2 : 256;
+        *chains = realloc (*chains, *cap * sizeof (fixup_chain_t));
+    }
+    (*chains)[(*count)++] = *chain;
+}
+
+HTOOL_PRIVATE void
+_fixups_load_imports (htool_fixups_t *fixups, const unsigned char *hdr, uint32_t size)
+{
+    uint32_t imports_offset = _fixups_rd32 (hdr + 8), symbols_offset = _fixups_rd32 (hdr + 12);
+    uint32_t count = _fixups_rd32 (hdr + 16), format = _fixups_rd32 (hdr + 20), symbols_format = _fixups_rd32 (hdr + 24);
+    uint32_t entsize = (format == DYLD_CHAINED_IMPORT_ADDEND64) ? 16 : (format == DYLD_CHAINED_IMPORT_ADDEND) ? 8 : 4;
+
+    if (!count) return;
+    if (symbols_format != 0 || format < DYLD_CHAINED_IMPORT || format > DYLD_CHAINED_IMPORT_ADDEND64 ||
+        imports_offset > size || (uint64_t) count * entsize > size - imports_offset || symbols_offset > size) {
+        warningf ("Unsupported chained fixups imports (format %d, symbols format %d)\n", format, symbols_format);
+        return;
+    }
+
+    fixups->imports = calloc (count, sizeof (htool_fixup_import_t));
+    fixups->nimports = count;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const unsigned char *p = hdr + imports_offset + (uint64_t) i * entsize;
+        htool_fixup_import_t *import = &fixups->imports[i];
+        uint64_t name;
+
+        if (format == DYLD_CHAINED_IMPORT_ADDEND64) {
+            uint64_t v = _fixups_rd64 (p);
+            import->lib_ordinal = (int32_t) _fixups_sign_extend (v, 16);
+            import->weak = (v >> 16) & 1;
+            name = v >> 32;
+            import->addend = (int64_t) _fixups_rd64 (p + 8);
+        } else {
+            uint32_t v = _fixups_rd32 (p);
+            import->lib_ordinal = (int32_t) _fixups_sign_extend (v, 8);
+            import->weak = (v >> 8) & 1;
+            name = v >> 9;
+            if (format == DYLD_CHAINED_IMPORT_ADDEND) import->addend = (int32_t) _fixups_rd32 (p + 4);
+        }
+
+        /* The name has to be terminated inside the fixups data */
+        if (symbols_offset + name < size && memchr (hdr + symbols_offset + name, '\0', size - symbols_offset - name))
+            import->name = (const char *) hdr + symbols_offset + name;
+    }
+}
+
+/**
+ *  LC_DYLD_CHAINED_FIXUPS: a dyld_chained_fixups_header, then the starts for each
+ *  segment, with a chain start for each page.
+ */
+HTOOL_PRIVATE void
+_fixups_collect_chained (htool_fixups_t *fixups, macho_t *macho, mach_linkedit_data_command_t *lc,
+                         fixup_chain_t **chains, uint32_t *count, uint32_t *cap)
+{
+    const unsigned char *hdr, *image;
+    uint32_t size = lc->datasize, starts_offset, seg_count;
+
+    if ((uint64_t) lc->dataoff + size > macho->size || size < 28) {
+        warningf ("Chained fixups are outside the file\n");
+        return;
+    }
+    hdr = macho->data + lc->dataoff;
+
+    fixups->source = HTOOL_FIXUPS_SOURCE_CHAINED;
+    fixups->version = _fixups_rd32 (hdr);
+    starts_offset = _fixups_rd32 (hdr + 4);
+    _fixups_load_imports (fixups, hdr, size);
+
+    if (starts_offset > size - 4) return;
+    image = hdr + starts_offset;
+    seg_count = _fixups_rd32 (image);
+    if ((uint64_t) seg_count * 4 > size - starts_offset - 4) return;
+
+    for (uint32_t s = 0; s < seg_count; s++) {
+        uint32_t seg_info_offset = _fixups_rd32 (image + 4 + s * 4);
+        mach_segment_command_64_t *seg;
+        const unsigned char *starts;
+        uint16_t page_size, format, page_count, stride;
+        uint64_t segment_offset;
+
+        /* Segments without fixups have no starts */
+        if (!seg_info_offset) continue;
+        if ((uint64_t) starts_offset + seg_info_offset + STARTS_SEG_PAGE_START > size) continue;
+        if (!(seg = _fixups_segment (macho, s))) continue;
+
+        starts = image + seg_info_offset;
+        page_size = _fixups_rd16 (starts + STARTS_SEG_PAGE_SIZE);
+        format = _fixups_rd16 (starts + STARTS_SEG_POINTER_FORMAT);
+        segment_offset = _fixups_rd64 (starts + STARTS_SEG_SEGMENT_OFFSET);
+        page_count = _fixups_rd16 (starts + STARTS_SEG_PAGE_COUNT);
+
+        if (!(stride = _fixups_stride (format))) {
+            warningf ("Unsupported chained pointer format %d in %.16s\n", format, seg->segname);
+            continue;
+        }
+        if (!fixups->format) fixups->format = format;
+        if ((uint64_t) starts_offset + seg_info_offset + STARTS_SEG_PAGE_START + page_count * 2u > size) continue;
+
+        for (uint32_t p = 0; p < page_count; p++) {
+            uint16_t start = _fixups_rd16 (starts + STARTS_SEG_PAGE_START + p * 2);
+            uint64_t page = (uint64_t) p * page_size;
+            uint64_t limit = seg->fileoff + ((page + page_size < seg->filesize) ? page + page_size : seg->filesize);
+
+            if (start == DYLD_CHAINED_PTR_START_NONE) continue;
+
+            /**
+             *  A page with more than one chain (only the 32-bit formats do this) has
+             *  an index into the overflow list of starts instead, ending at START_LAST.
+             */
+            const unsigned char *multi = NULL;
+            if (start & DYLD_CHAINED_PTR_START_MULTI) {
+                uint32_t idx = start & ~DYLD_CHAINED_PTR_START_MULTI;
+                multi = starts + STARTS_SEG_PAGE_START + (page_count + idx) * 2;
+                if (multi + 2 > hdr + size) continue;
+                start = _fixups_rd16 (multi);
+            }
+
+            for (;;) {
+                fixup_chain_t chain = {
+                    .vmaddr = fixups->base + segment_offset + page + (start & ~DYLD_CHAINED_PTR_START_LAST),
+                    .fileoff = seg->fileoff + page + (start & ~DYLD_CHAINED_PTR_START_LAST),
+                    .limit = limit,
+                    .format = format,
+                    .stride = stride,
+                };
+                _fixups_add_chain (chains, count, cap, &chain);
+
+                if (!multi || (start & DYLD_CHAINED_PTR_START_LAST)) break;
+                multi += 2;
+                if (multi + 2 > hdr + size) break;
+                start = _fixups_rd16 (multi);
+            }
+        }
+    }
+}
+
+/**
+ *  __TEXT.__thread_starts: a flags word, whose low bit says whether the chains have a
+ *  stride of 8 or 4, followed by the offset of each chain from the kernel's base, up
+ *  to the first 0xffffffff. The pointers use the arm64e format.
+ */
+HTOOL_PRIVATE void
+_fixups_collect_thread_starts (htool_fixups_t *fixups, macho_t *macho, mach_section_64_t *sect,
+                               fixup_chain_t **chains, uint32_t *count, uint32_t *cap)
+{
+    const unsigned char *data;
+    uint16_t stride;
+
+    if ((uint64_t) sect->offset + sect->size > macho->size || sect->size < 4) return;
+    data = macho->data + sect->offset;
+
+    fixups->source = HTOOL_FIXUPS_SOURCE_THREAD_STARTS;
+    fixups->format = DYLD_CHAINED_PTR_ARM64E;
+    stride = (_fixups_rd32 (data) & 1) ? 8 : 4;
+
+    for (uint64_t off = 4; off + 4 <= sect->size; off += 4) {
+        uint32_t start = _fixups_rd32 (data + off);
+        if (start == 0xffffffff) break;
+
+        /* Find the segment the chain is in, chains don't cross segments */
+        uint64_t vmaddr = fixups->base + start;
+        for (int i = 0; i < h_slist_length (macho->scmds); i++) {
+            mach_segment_command_64_t *seg = _fixups_segment (macho, i);
+            if (!seg || vmaddr < seg->vmaddr || vmaddr - seg->vmaddr >= seg->filesize) continue;
+
+            fixup_chain_t chain = {
+                .vmaddr = vmaddr,
+                .fileoff = seg->fileoff + (vmaddr - seg->vmaddr),
+                .limit = seg->fileoff + seg->filesize,
+                .format = DYLD_CHAINED_PTR_ARM64E,
+                .stride = stride,
+            };
+            _fixups_add_chain (chains, count, cap, &chain);
+            break;
+        }
+    }
+}
+
+HTOOL_PRIVATE int
+_fixups_compare (const void *a, const void *b)
+{
+    const htool_fixup_t *fa = a, *fb = b;
+    return (fa->vmaddr > fb->vmaddr) - (fa->vmaddr < fb->vmaddr);
+}
+
+HTOOL_PRIVATE htool_fixups_t *
+_fixups_build (macho_t *macho)
+{
+    htool_fixups_t *fixups = calloc (1, sizeof (htool_fixups_t));
+    mach_load_command_info_t *info;
+    mach_section_64_t *sect;
+    fixup_chain_t *chains = NULL;
+    uint32_t count = 0, cap = 0;
+    int sorted = 1;
+
+    fixups->base = _fixups_image_base (macho);
+
+    if ((info = mach_load_command_find_command_by_type (macho, LC_DYLD_CHAINED_FIXUPS)))
+        _fixups_collect_chained (fixups, macho, (mach_linkedit_data_command_t *) info->lc, &chains, &count, &cap);
+    else if ((sect = mach_section_64_search (macho->scmds, "__TEXT", "__thread_starts")))
+        _fixups_collect_thread_starts (fixups, macho, sect, &chains, &count, &cap);
+
+    if (!count) {
+        free (chains);
+        return fixups;
+    }
+
+    /* Every chain is independent, so they're all decoded at once on the worker pool */
+    fixups_job_t job = {
+        .macho = macho,
+        .base = fixups->base,
+        .chains = chains,
+        .out = calloc (count, sizeof (htool_fixup_t *)),
+        .nout = calloc (count, sizeof (uint32_t)),
+    };
+    htool_parallel_for (count, _fixups_walk_chain_worker, &job);
+
+    for (uint32_t i = 0; i < count; i++) fixups->nfixups += job.nout[i];
+    fixups->fixups = malloc ((fixups->nfixups ? fixups->nfixups : 1) * sizeof (htool_fixup_t));
+
+    /* Chains come out in address order almost always, so only sort if they didn't */
+    uint64_t n = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (job.nout[i] && n && job.out[i][0].vmaddr < fixups->fixups[n - 1].vmaddr) sorted = 0;
+        memcpy (&fixups->fixups[n], job.out[i], job.nout[i] * sizeof (htool_fixup_t));
+        n += job.nout[i];
+        free (job.out[i]);
+    }
+    if (!sorted) qsort (fixups->fixups, fixups->nfixups, sizeof (htool_fixup_t), _fixups_compare);
+
+    for (uint64_t i = 0; i < fixups->nfixups; i++) {
+        if (fixups->fixups[i].kind == HTOOL_FIXUP_BIND || fixups->fixups[i].kind == HTOOL_FIXUP_AUTH_BIND) fixups->nbinds++;
+        else fixups->nrebases++;
+    }
+
+    free (job.out);
+    free (job.nout);
+    free (chains);
+    return fixups;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_fixups_t *
+htool_fixups_fetch (macho_t *macho)
+{
+    htool_fixups_t *fixups, *cached;
+
+    if ((fixups = htool_cache_fetch (macho, HTOOL_CACHE_KIND_FIXUPS)))
+        return fixups;
+
+    fixups = _fixups_build (macho);
+    if ((cached = htool_cache_store (macho, HTOOL_CACHE_KIND_FIXUPS, fixups)) != fixups) {
+        free (fixups->fixups);
+        free (fixups->imports);
+        free (fixups);
+    }
+    return cached;
+}
+
+const htool_fixup_t *
+htool_fixups_lookup (htool_fixups_t *fixups, uint64_t vmaddr)
+{
+    uint64_t lo = 0, hi = (fixups) ? fixups->nfixups : 0;
+
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        const htool_fixup_t *fixup = &fixups->fixups[mid];
+
+        if (vmaddr < fixup->vmaddr) hi = mid;
+        else if (vmaddr > fixup->vmaddr) lo = mid + 1;
+        else return fixup;
+    }
+    return NULL;
+}
+
+uint64_t
+htool_fixups_resolve (htool_fixups_t *fixups, uint64_t vmaddr, uint64_t raw)
+{
+    const htool_fixup_t *fixup = htool_fixups_lookup (fixups, vmaddr);
+
+    if (fixup && (fixup->kind == HTOOL_FIXUP_REBASE || fixup->kind == HTOOL_FIXUP_AUTH_REBASE))
+        return fixup->target;
+    return raw;
+}
+
+const htool_fixup_import_t *
+htool_fixups_import (htool_fixups_t *fixups, const htool_fixup_t *fixup)
+{
+    if (!fixup || (fixup->kind != HTOOL_FIXUP_BIND && fixup->kind != HTOOL_FIXUP_AUTH_BIND)) return NULL;
+    return (fixup->ordinal < fixups->nimports) ? &fixups->imports[fixup->ordinal] : NULL;
+}
+
+const char *
+htool_fixups_format_string (uint16_t format)
+{
+    switch (format) {
+        case DYLD_CHAINED_PTR_ARM64E:                   return "ARM64E";
+        case DYLD_CHAINED_PTR_64:                       return "PTR_64";
+        case DYLD_CHAINED_PTR_32:                       return "PTR_32";
+        case DYLD_CHAINED_PTR_32_CACHE:                 return "PTR_32_CACHE";
+        case DYLD_CHAINED_PTR_32_FIRMWARE:              return "PTR_32_FIRMWARE";
+        case DYLD_CHAINED_PTR_64_OFFSET:                return "PTR_64_OFFSET";
+        case DYLD_CHAINED_PTR_ARM64E_KERNEL:            return "ARM64E_KERNEL";
+        case DYLD_CHAINED_PTR_64_KERNEL_CACHE:          return "PTR_64_KERNEL_CACHE";
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND:          return "ARM64E_USERLAND";
+        case DYLD_CHAINED_PTR_ARM64E_FIRMWARE:          return "ARM64E_FIRMWARE";
+        case DYLD_CHAINED_PTR_X86_64_KERNEL_CACHE:      return "X86_64_KERNEL_CACHE";
+        case DYLD_CHAINED_PTR_ARM64E_USERLAND24:        return "ARM64E_USERLAND24";
+        default:                                        return "Unknown";
+    }
+}
@@ -0,0 +1,173 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "htool-hash.h"
+#include "htool-parallel.h"
+
+#define XXH_PRIME64_1               UINT64_C(0x9E3779B185EBCA87)
+#define XXH_PRIME64_2               UINT64_C(0xC2B2AE3D27D4EB4F)
+#define XXH_PRIME64_3               UINT64_C(0x165667B19E3779F9)
+#define XXH_PRIME64_4               UINT64_C(0x85EBCA77C2B2AE63)
+#define XXH_PRIME64_5               UINT64_C(0x27D4EB2F165667C5)
+
+#define XXH_ROTL64(x, r)            (((x) << (r)) | ((x) >> (64 - (r))))
+
+///////////////////////////////////////////////////////////////////////////////
+
+/* Unaligned little-endian loads; memcpy compiles down to a single load */
+HTOOL_PRIVATE inline uint64_t
+_hash_read64 (const unsigned char *p)
+{
+    uint64_t v;
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+HTOOL_PRIVATE inline uint32_t
+_hash_read32 (const unsigned char *p)
+{
+    uint32_t v;
+    memcpy (&v, p, sizeof (v));
+    return v;
+}
+
+HTOOL_PRIVATE inline uint64_t
+_hash_round (uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = XXH_ROTL64 (acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+HTOOL_PRIVATE inline uint64_t
+_hash_merge_round (uint64_t acc, uint64_t val)
+{
+    acc ^= _hash_round (0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t
+htool_hash64 (const void *data, size_t len, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *) data;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        do {
+            v1 = _hash_round (v1, _hash_read64 (p));
+            v2 = _hash_round (v2, _hash_read64 (p + 8));
+            v3 = _hash_round (v3, _hash_read64 (p + 16));
+            v4 = _hash_round (v4, _hash_read64 (p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = XXH_ROTL64 (v1, 1) + XXH_ROTL64 (v2, 7) + XXH_ROTL64 (v3, 12) + XXH_ROTL64 (v4, 18);
+        h = _hash_merge_round (h, v1);
+        h = _hash_merge_round (h, v2);
+        h = _hash_merge_round (h, v3);
+        h = _hash_merge_round (h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+
+    h += (uint64_t) len;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= _hash_round (0, _hash_read64 (p));
+        h = XXH_ROTL64 (h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t) _hash_read32 (p) * XXH_PRIME64_1;
+        h = XXH_ROTL64 (h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = XXH_ROTL64 (h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct hash_chunk_t
+{
+    const unsigned char    *data;
+    uint64_t                size;
+} hash_chunk_t;
+
+typedef struct hash_job_t
+{
+    hash_chunk_t           *chunks;
+    uint64_t               *hashes;
+} hash_job_t;
+
+HTOOL_PRIVATE void
+_hash_chunk_worker (void *ctx, uint32_t index)
+{
+    hash_job_t *job = (hash_job_t *) ctx;
+    job->hashes[index] = htool_hash64 (job->chunks[index].data, job->chunks[index].size, 0);
+}
+
+void
+htool_hash_ranges (htool_hash_range_t *ranges, uint32_t count)
+{
+    uint64_t nchunks = 0, c = 0;
+    hash_job_t job;
+
+    for (uint32_t i = 0; i < count; i++)
+        nchunks += (ranges[i].size + HTOOL_HASH_CHUNK_SIZE - 1) / HTOOL_HASH_CHUNK_SIZE;
+
+    job.chunks = malloc ((nchunks ? nchunks : 1) * sizeof (hash_chunk_t));
+    job.hashes = malloc ((nchunks ? nchunks : 1) * sizeof (uint64_t));
+
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint64_t off = 0; off < ranges[i].size; off += HTOOL_HASH_CHUNK_SIZE) {
+            uint64_t left = ranges[i].size - off;
+            job.chunks[c++] = (hash_chunk_t) {
+                .data = ranges[i].data + off,
+                .size = (left < HTOOL_HASH_CHUNK_SIZE) ? left : HTOOL_HASH_CHUNK_SIZE,
+            };
+        }
+    }
+    htool_parallel_for ((uint32_t) nchunks, _hash_chunk_worker, &job);
+
+    /* Each range's hash is the hash of its chunk hashes, seeded with its size */
+    c = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t n = (ranges[i].size + HTOOL_HASH_CHUNK_SIZE - 1) / HTOOL_HASH_CHUNK_SIZE;
+        ranges[i].hash = htool_hash64 (job.hashes + c, n * sizeof (uint64_t), ranges[i].size);
+        c += n;
+    }
+
+    free (job.chunks);
+    free (job.hashes);
+}
@@ -23,6 +23,7 @@
 
 #include "htool-error.h"
 #include "commands/macho.h"
+#include "htool-fixups.h"
 
 /* libhelper doesn't implement support for arm thread state */
 #if defined(__APPLE__) && defined(__MACH__)
@@ -270,10 +271,14 @@ htool_print_load_commands (htool_client_t *client)
                 case LC_DYLIB_CODE_SIGN_DRS:
                 case LC_LINKER_OPTIMIZATION_HINT:
                 case LC_DYLD_EXPORTS_TRIE:
-                case LC_DYLD_CHAINED_FIXUPS:
                     htool_print_linkedit_data_command (rawlc);
                     break;
 
+                /* Chained Fixups Command */
+                case LC_DYLD_CHAINED_FIXUPS:
+                    htool_print_chained_fixups_command (macho, rawlc);
+                    break;
+
                 /* Dynamic Linker Info */
                 case LC_DYLD_INFO:
                 case LC_DYLD_INFO_ONLY:
@@ -511,6 +516,22 @@ htool_print_linkedit_data_command (void *cmd)
             "Offset:", lc->dataoff, lc->datasize);
 }
 
+void
+htool_print_chained_fixups_command (macho_t *macho, void *cmd)
+{
+    htool_fixups_t *fixups = htool_fixups_fetch (macho);
+
+    htool_print_linkedit_data_command (cmd);
+    if (fixups->source != HTOOL_FIXUPS_SOURCE_CHAINED) return;
+
+    printf (BOLD DARK_WHITE "%-29s%-20s" RESET DARK_GREY "%s (%d)\n" RESET, "",
+            "Pointer Format:", htool_fixups_format_string (fixups->format), fixups->format);
+    printf (BOLD DARK_WHITE "%-29s%-20s" RESET DARK_GREY "%d\n" RESET, "", "Version:", fixups->version);
+    printf (BOLD DARK_WHITE "%-29s%-20s" RESET DARK_GREY "%llu (%llu rebases, %llu binds)\n" RESET, "", "Fixups:",
+            (unsigned long long) fixups->nfixups, (unsigned long long) fixups->nrebases, (unsigned long long) fixups->nbinds);
+    printf (BOLD DARK_WHITE "%-29s%-20s" RESET DARK_GREY "%d\n" RESET, "", "Imports:", fixups->nimports);
+}
+
 void
 htool_print_dylid_info_command (void *cmd)
 {
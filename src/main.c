@@ -94,6 +94,15 @@ static struct option analyse_cmd_opts[] = {
     { "analyse",    no_argument,        NULL,   'a' },
     { "list-all",   no_argument,        NULL,   'l' },
     { "extract",    required_argument,  NULL,   'e' },
+    { "extract-all", required_argument, NULL,   'x' },
+    { "diff",       required_argument,  NULL,   'd' },
+    { "iokit-classes", no_argument,     NULL,   'k' },
+    { "patchfind",  required_argument,  NULL,   'p' },
+    { "symbolicate", required_argument, NULL,   's' },
+    { "slide",      required_argument,  NULL,   'S' },
+    { "deps",       required_argument,  NULL,   'g' },
+    { "deps-root",  required_argument,  NULL,   'r' },
+    { "kext-symbols", required_argument, NULL,  'y' },
     { NULL,         0,                  NULL,   0   }
 };
 
@@ -108,11 +117,15 @@ static struct option disass_cmd_opts[] = {
 
     { "disassemble",        no_argument,        NULL,   'd' },
     { "disassemble-all",    no_argument,        NULL,   'D' },
+    { "function",           required_argument,  NULL,   'F' },
 
     { "base-address",       required_argument,  NULL,   'b' },
     { "stop-address",       required_argument,  NULL,   's' },
     { "count",              required_argument,  NULL,   'c' },
 
+    { "format",             required_argument,  NULL,   'f' },
+    { "output",             required_argument,  NULL,   'o' },
+
     { NULL,                 0,                  NULL,    0  },
 };
 
@@ -294,7 +307,7 @@ static htool_return_t handle_command_analyse (htool_client_t *client)
 
     /* parse the `file` options */
     int opt = 0, optindex = 2;
-    while ((opt = getopt_long (client->argc, client->argv, "e:alhA", analyse_cmd_opts, &optindex)) > 0) {
+    while ((opt = getopt_long (client->argc, client->argv, "e:x:d:p:s:S:g:r:y:aklhA", analyse_cmd_opts, &optindex)) > 0) {
         switch (opt) {
 
             /* -a, --analyse */
@@ -307,10 +320,70 @@ static htool_return_t handle_command_analyse (htool_client_t *client)
                 client->opts |= HTOOL_CLIENT_ANALYSE_OPT_LIST_ALL;
                 break;
 
-            /* -e, --extract */
+            /* -e, --extract, can be given more than once */
             case 'e':
                 client->opts |= HTOOL_CLIENT_ANALYSE_OPT_EXTRACT;
-                client->extract = strdup ((const char *) optarg);
+                if (client->extract) {
+                    size_t len = strlen (client->extract) + strlen (optarg) + 2;
+                    char *list = malloc (len);
+                    snprintf (list, len, "%s,%s", client->extract, optarg);
+                    free (client->extract);
+                    client->extract = list;
+                } else {
+                    client->extract = strdup ((const char *) optarg);
+                }
+                break;
+
+            /* -x, --extract-all */
+            case 'x':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_EXTRACT_ALL;
+                client->extract_dir = strdup ((const char *) optarg);
+                break;
+
+            /* -d, --diff */
+            case 'd':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_DIFF;
+                client->diff = strdup ((const char *) optarg);
+                break;
+
+            /* -k, --iokit-classes */
+            case 'k':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_IOKIT_CLASSES;
+                break;
+
+            /* -p, --patchfind */
+            case 'p':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_PATCHFIND;
+                client->patchfind = strdup ((const char *) optarg);
+                break;
+
+            /* -s, --symbolicate */
+            case 's':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_SYMBOLICATE;
+                client->symbolicate = strdup ((const char *) optarg);
+                break;
+
+            /* -S, --slide */
+            case 'S':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_SLIDE;
+                client->slide = strtoull (optarg, NULL, 16);
+                break;
+
+            /* -g, --deps */
+            case 'g':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_DEPS;
+                client->deps = strdup ((const char *) optarg);
+                break;
+
+            /* -r, --deps-root */
+            case 'r':
+                client->deps_root = strdup ((const char *) optarg);
+                break;
+
+            /* -y, --kext-symbols */
+            case 'y':
+                client->opts |= HTOOL_CLIENT_ANALYSE_OPT_KEXT_SYMBOLS;
+                client->kext_symbols = strdup ((const char *) optarg);
                 break;
 
             /* default, print usage */
@@ -321,6 +394,12 @@ static htool_return_t handle_command_analyse (htool_client_t *client)
         }
     }
 
+    /* -r, --deps-root on its own lists the dependencies as text */
+    if (client->deps_root && !(client->opts & HTOOL_CLIENT_ANALYSE_OPT_DEPS)) {
+        client->opts |= HTOOL_CLIENT_ANALYSE_OPT_DEPS;
+        client->deps = strdup ("text");
+    }
+
     /**
      *  Load the file into client->bin, if the file is not valid exit with an error
      *  message.
@@ -348,14 +427,66 @@ static htool_return_t handle_command_analyse (htool_client_t *client)
 
     /**
      *  Option:             -e, --extract
-     *  Description:        Extract an embedded firmware that matches the given
-     *                      name.
+     *  Description:        Extract every embedded firmware that matches the given
+     *                      names or patterns.
      */
     if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_EXTRACT) {
         res = htool_analyse_extract (client);
         if (res) printf (ANSI_COLOR_GREEN "[*] Extracted %s\n" RESET, client->extract);
     }
 
+    /**
+     *  Option:             -x, --extract-all
+     *  Description:        Extract every kext in a kernelcache into a directory.
+     */
+    if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_EXTRACT_ALL)
+        res = htool_analyse_extract_all (client);
+
+    /**
+     *  Option:             -d, --diff
+     *  Description:        Compare the kernelcache against another one.
+     */
+    if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_DIFF)
+        res = htool_analyse_diff (client);
+
+    /**
+     *  Option:             -k, --iokit-classes
+     *  Description:        Recover the IOKit class hierarchy from every kext.
+     */
+    if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_IOKIT_CLASSES)
+        res = htool_analyse_iokit_classes (client);
+
+    /**
+     *  Option:             -p, --patchfind
+     *  Description:        Resolve the rules in a patchfinder rules file.
+     */
+    if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_PATCHFIND)
+        res = htool_analyse_patchfind (client);
+
+    /**
+     *  Option:             -s, --symbolicate
+     *  Description:        Symbolicate a panic log or list of addresses, with the
+     *                      slide from -S, --slide or the log itself.
+     */
+    if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_SYMBOLICATE)
+        res = htool_analyse_symbolicate (client);
+
+    /**
+     *  Option:             -g, --deps
+     *  Description:        Print the KEXT dependency graph, or only the KEXTs that
+     *                      -r, --deps-root needs, as text, DOT or JSON.
+     */
+    if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_DEPS)
+        res = htool_analyse_dependencies (client);
+
+    /**
+     *  Option:             -y, --kext-symbols
+     *  Description:        List the symbols of a merged-style KEXT, recovered from
+     *                      the kernel's symbol table.
+     */
+    if (client->opts & HTOOL_CLIENT_ANALYSE_OPT_KEXT_SYMBOLS)
+        res = htool_analyse_kext_symbols (client);
+
     return HTOOL_RETURN_SUCCESS;
 }
 
@@ -374,7 +505,7 @@ static htool_return_t handle_command_disass (htool_client_t *client)
 
     /* parse the `disass` options */
     int opt = 0, optindex = 2;
-    while ((opt = getopt_long (client->argc, client->argv, "Ddb:c:s:hA", disass_cmd_opts, &optindex)) > 0) {
+    while ((opt = getopt_long (client->argc, client->argv, "DdF:b:c:s:f:o:hA", disass_cmd_opts, &optindex)) > 0) {
         switch (opt) {
 
             /* -D, --disassemble-all */
@@ -387,6 +518,12 @@ static htool_return_t handle_command_disass (htool_client_t *client)
                 client->opts |= HTOOL_CLIENT_DISASS_OPT_DISASSEMBLE_QUICK;
                 break;
 
+            /* -F, --function */
+            case 'F':
+                client->opts |= HTOOL_CLIENT_DISASS_OPT_FUNCTION;
+                client->function = optarg;
+                break;
+
             /* -b, --base-address */
             case 'b':
                 client->opts |= HTOOL_CLIENT_DISASS_OPT_BASE_ADDRESS;
@@ -405,6 +542,20 @@ static htool_return_t handle_command_disass (htool_client_t *client)
                 client->size = strtoull (optarg, NULL, 10);
                 break;
 
+            /* -f, --format */
+            case 'f':
+                if (!strcmp (optarg, "records")) {
+                    client->opts |= HTOOL_CLIENT_DISASS_OPT_FORMAT_RECORDS;
+                } else if (strcmp (optarg, "text")) {
+                    htool_error_throw (HTOOL_ERROR_GENERAL, "Unknown output format: %s", optarg);
+                    return HTOOL_RETURN_FAILURE;
+                }
+                break;
+
+            /* -o, --output */
+            case 'o':
+                client->output = optarg;
+                break;
 
             /* default, print usage */
             case 'h':
@@ -429,6 +580,20 @@ static htool_return_t handle_command_disass (htool_client_t *client)
      */
     if (client->opts & HTOOL_CLIENT_DISASS_OPT_DISASSEMBLE_QUICK)
         htool_disassemble_binary_quick (client);
+
+    /**
+     *  Option:             -D, --disassemble-all
+     *  Description:        Disassemble all reachable code in a binary, skipping data.
+     */
+    if (client->opts & HTOOL_CLIENT_DISASS_OPT_DISASSEMBLE_FULL)
+        htool_disassemble_binary_full (client);
+
+    /**
+     *  Option:             -F, --function
+     *  Description:        Disassemble a single function, by address or symbol name.
+     */
+    if (client->opts & HTOOL_CLIENT_DISASS_OPT_FUNCTION)
+        htool_disassemble_function (client);
     
     return HTOOL_RETURN_SUCCESS;
 }
@@ -0,0 +1,85 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "htool-parallel.h"
+
+/* Upper limit, in case HTOOL_THREADS is set to something silly */
+#define PARALLEL_MAX_THREADS        256
+
+typedef struct parallel_job_t
+{
+    htool_parallel_fn_t      fn;
+    void                    *ctx;
+    uint32_t                 count;
+    uint32_t                 next;      /* next index to hand out, atomic */
+} parallel_job_t;
+
+HTOOL_PRIVATE void *
+_parallel_worker (void *arg)
+{
+    parallel_job_t *job = (parallel_job_t *) arg;
+    uint32_t i;
+
+    while ((i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+        job->fn (job->ctx, i);
+
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t
+htool_parallel_nthreads ()
+{
+    const char *env = getenv ("HTOOL_THREADS");
+    long n = 0;
+
+    if (env) n = strtol (env, NULL, 10);
+    if (n <= 0) n = sysconf (_SC_NPROCESSORS_ONLN);
+    if (n <= 0) n = 1;
+    if (n > PARALLEL_MAX_THREADS) n = PARALLEL_MAX_THREADS;
+
+    return (uint32_t) n;
+}
+
+void
+htool_parallel_for (uint32_t count, htool_parallel_fn_t fn, void *ctx)
+{
+    parallel_job_t job = { .fn = fn, .ctx = ctx, .count = count, .next = 0 };
+    uint32_t nthreads = htool_parallel_nthreads ();
+    pthread_t *threads;
+    uint32_t started = 0;
+
+    if (nthreads > count) nthreads = count;
+    if (nthreads <= 1) {
+        _parallel_worker (&job);
+        return;
+    }
+
+    /* The calling thread is one of the workers */
+    threads = calloc (nthreads - 1, sizeof (pthread_t));
+    for (uint32_t i = 0; i < nthreads - 1; i++)
+        if (!pthread_create (&threads[started], NULL, _parallel_worker, &job)) started++;
+
+    _parallel_worker (&job);
+
+    for (uint32_t i = 0; i < started; i++)
+        pthread_join (threads[i], NULL);
+    free (threads);
+}
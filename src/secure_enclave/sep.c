@@ -16,6 +16,7 @@
 #include <libhelper.h>
 
 #include "secure_enclave/sep.h"
+#include "htool-vmmap.h"
 
 #define IS64(image) (*(uint8_t *)(image) & 1)
 
@@ -25,27 +26,15 @@
 static uint32_t
 _sep_macho_calc_size (unsigned char *data, uint32_t size)
 {
-    mach_header_32_t *hdr = (mach_header_32_t *) data;
-    unsigned char *base = data + sizeof (mach_header_32_t);
-    size_t end, tsize = 0;
+    htool_vmmap_t *map;
+    uint32_t tsize;
 
     if (size < 1024) return 0;
-    if (!MACHO(data)) return 0;
-    if (IS64(data)) base += 4;
+    if (!(map = htool_vmmap_create_from_header (data, size))) return 0;
 
-    for (int i = 0; i < hdr->ncmds; i++) {
-        mach_load_command_t *lc = (mach_load_command_t *) base;
-        if (lc->cmd == LC_SEGMENT) {
-            mach_segment_command_32_t *seg = (mach_segment_command_32_t *) base;
-            end = seg->fileoff + seg->filesize;
-            if (tsize < end) tsize = end;
-        } else if (lc->cmd == LC_SEGMENT_64) {
-            mach_segment_command_64_t *seg = (mach_segment_command_64_t *) base;
-            end = seg->fileoff + seg->filesize;
-            if (tsize < end) tsize = end;
-        }
-        base = base + lc->cmdsize;
-    }
+    /* The image ends with whichever segment reaches furthest into the file */
+    tsize = map->file_end;
+    htool_vmmap_free (map);
     return tsize;
 }
 
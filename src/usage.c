@@ -84,7 +84,28 @@ void analyse_subcommand_usage (int argc, char *argv[], int err)
     "Commands:\n" \
     "  -a, --analyse    Analyse the given Firmware File..\n" \
     "  -l, --list-all   Print all embedded payloads (SEP, iBoot, KEXTs).\n" \
-    "  -e, --extract    Extract an embedded binary with a specified Bundle ID.\n" \
+    "  -e, --extract    Extract embedded binaries by Bundle ID. Takes a comma-separated\n" \
+    "                   list, and KEXTs can be matched with a glob (e.g. 'com.apple.iokit.*').\n" \
+    "  -x, --extract-all DIR\n" \
+    "                   Extract every KEXT in a Kernelcache into DIR, with a manifest.json.\n" \
+    "  -d, --diff OTHER Compare the Kernelcache against OTHER, listing added, removed and\n" \
+    "                   changed KEXTs and the segments that changed.\n" \
+    "  -k, --iokit-classes\n" \
+    "                   Recover the IOKit class tree, with sizes, vtables and metaclass vtables, from every KEXT.\n" \
+    "  -p, --patchfind RULES\n" \
+    "                   Resolve every rule in the RULES file (string, reference, instruction)\n" \
+    "                   in a single pass over the Kernelcache, and print a table of the results.\n" \
+    "  -s, --symbolicate FILE\n" \
+    "                   Map every address in a panic log or address list to its KEXT and the\n" \
+    "                   nearest symbol.\n" \
+    "  -S, --slide SLIDE\n" \
+    "                   KASLR slide for --symbolicate. Taken from the panic log if not given.\n" \
+    "  -g, --deps FORMAT\n" \
+    "                   Print the KEXT dependency graph in load order, as 'text', 'dot' or 'json'.\n" \
+    "  -r, --deps-root BUNDLE\n" \
+    "                   Limit --deps to BUNDLE and every KEXT it needs to load. Implies --deps text.\n" \
+    "  -y, --kext-symbols BUNDLE\n" \
+    "                   List the symbols in a merged KEXT's __TEXT_EXEC, from the kernel's symbol table.\n" \
     "\n"\
     "Options:\n" \
     "  --verbose        Print more in-depth verbose information\n" \
@@ -103,12 +124,15 @@ void disass_subcommand_usage (int argc, char *argv[], int err)
     "\n" \
     "Commands:\n" \
     "  -d, --disassemble        Quick disassemble of a binary.\n" \
-    "  -D, --disassemble-all    Full disassemble of a binary.\n" \
+    "  -D, --disassemble-all    Disassemble all reachable code, skipping data.\n" \
+    "  -F, --function           Disassemble a function, by address or symbol name.\n" \
     "  -b, --base-address       Virtual address to disassemble from.\n" \
     "  -s, --stop-address       Virtual address to disassemble to.\n" \
     "  -c, --count              Number of bytes to disassemble.\n" \
     "\n" \
     "Options:\n" \
+    "  --format=FORMAT  Output format, either `text` (default) or `records`\n" \
+    "  --output=PATH    Where to write `records` output (default: PATH.records)\n" \
     "  --verbose        Print more in-depth verbose information\n" \
     "  --arch=ARCH      Specify architecture (e.g. arm64e, arm64, x86_64, ...)\n" \
     "  --help           HTool Usage info.\n" \
@@ -0,0 +1,260 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libhelper.h>
+#include <libhelper-macho.h>
+
+#include "htool-vmmap.h"
+#include "htool-cache.h"
+#include "htool-fileset.h"
+
+#define VMMAP_MACHO(p)              ((*(uint32_t *)(p) & ~1) == 0xfeedface)
+#define VMMAP_IS64(p)               (*(uint8_t *)(p) & 1)
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void
+_vm_table_add (htool_vm_table_t *table, uint32_t *cap, const char *segname,
+               uint64_t vmaddr, uint64_t vmsize, uint64_t fileoff, uint64_t filesize, macho_t *image)
+{
+    /* Nothing can be found in an empty segment, and they'd only upset the search */
+    if (!vmsize) return;
+
+    if (table->nsegments == *cap) {
+        *cap = (*cap) ? *cap * 2 : 16;
+        table->segments = realloc (table->segments, *cap * sizeof (htool_vm_segment_t));
+    }
+
+    htool_vm_segment_t *seg = &table->segments[table->nsegments++];
+    memset (seg, 0, sizeof (htool_vm_segment_t));
+    seg->vmaddr = vmaddr;
+    seg->vmsize = vmsize;
+    seg->fileoff = fileoff;
+    seg->filesize = (filesize > vmsize) ? vmsize : filesize;
+    seg->image = image;
+    strncpy (seg->segname, segname, 16);
+}
+
+HTOOL_PRIVATE void
+_vm_table_add_image (htool_vm_table_t *table, uint32_t *cap, macho_t *image)
+{
+    for (int i = 0; i < h_slist_length (image->scmds); i++) {
+        mach_segment_info_t *info = (mach_segment_info_t *) h_slist_nth_data (image->scmds, i);
+        mach_segment_command_64_t *seg = info->segcmd;
+
+        _vm_table_add (table, cap, seg->segname, seg->vmaddr, seg->vmsize, seg->fileoff, seg->filesize, image);
+    }
+}
+
+typedef struct vm_fileoff_key_t
+{
+    uint64_t        fileoff;
+    uint32_t        index;
+} vm_fileoff_key_t;
+
+HTOOL_PRIVATE int
+_vm_segment_compare (const void *a, const void *b)
+{
+    const htool_vm_segment_t *sa = a, *sb = b;
+    return (sa->vmaddr > sb->vmaddr) - (sa->vmaddr < sb->vmaddr);
+}
+
+HTOOL_PRIVATE int
+_vm_fileoff_compare (const void *a, const void *b)
+{
+    const vm_fileoff_key_t *ka = a, *kb = b;
+    return (ka->fileoff > kb->fileoff) - (ka->fileoff < kb->fileoff);
+}
+
+/**
+ *  Sort the table both ways, and work out how far into the file the segments
+ *  reach.
+ */
+HTOOL_PRIVATE void
+_vm_table_finalise (htool_vm_table_t *table, uint64_t *file_end)
+{
+    vm_fileoff_key_t *keys;
+
+    qsort (table->segments, table->nsegments, sizeof (htool_vm_segment_t), _vm_segment_compare);
+
+    keys = malloc ((table->nsegments ? table->nsegments : 1) * sizeof (vm_fileoff_key_t));
+    for (uint32_t i = 0; i < table->nsegments; i++) {
+        htool_vm_segment_t *seg = &table->segments[i];
+        if (!seg->filesize) continue;
+
+        keys[table->nfile].fileoff = seg->fileoff;
+        keys[table->nfile++].index = i;
+        if (seg->fileoff + seg->filesize > *file_end) *file_end = seg->fileoff + seg->filesize;
+    }
+    qsort (keys, table->nfile, sizeof (vm_fileoff_key_t), _vm_fileoff_compare);
+
+    table->by_fileoff = malloc ((table->nfile ? table->nfile : 1) * sizeof (uint32_t));
+    for (uint32_t i = 0; i < table->nfile; i++)
+        table->by_fileoff[i] = keys[i].index;
+    free (keys);
+}
+
+HTOOL_PRIVATE htool_vmmap_t *
+_vmmap_build (macho_t *macho)
+{
+    htool_vmmap_t *map = calloc (1, sizeof (htool_vmmap_t));
+    htool_fileset_index_t *fileset;
+    uint32_t image_cap = 0, entries_cap = 0;
+
+    _vm_table_add_image (&map->image, &image_cap, macho);
+    if ((fileset = htool_fileset_index_fetch (macho))) {
+        for (uint32_t i = 0; i < fileset->nentries; i++) {
+            macho_t *entry = htool_fileset_entry_macho (fileset, &fileset->entries[i]);
+            if (entry) _vm_table_add_image (&map->entries, &entries_cap, entry);
+        }
+    }
+
+    _vm_table_finalise (&map->image, &map->file_end);
+    _vm_table_finalise (&map->entries, &map->file_end);
+    return map;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE const htool_vm_segment_t *
+_vm_table_find_vmaddr (htool_vm_table_t *table, uint64_t vmaddr)
+{
+    uint32_t lo = 0, hi = table->nsegments;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        htool_vm_segment_t *seg = &table->segments[mid];
+
+        if (vmaddr < seg->vmaddr) hi = mid;
+        else if (vmaddr - seg->vmaddr >= seg->vmsize) lo = mid + 1;
+        else return seg;
+    }
+    return NULL;
+}
+
+HTOOL_PRIVATE const htool_vm_segment_t *
+_vm_table_find_offset (htool_vm_table_t *table, uint64_t offset)
+{
+    uint32_t lo = 0, hi = table->nfile;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        htool_vm_segment_t *seg = &table->segments[table->by_fileoff[mid]];
+
+        if (offset < seg->fileoff) hi = mid;
+        else if (offset - seg->fileoff >= seg->filesize) lo = mid + 1;
+        else return seg;
+    }
+    return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+htool_vmmap_t *
+htool_vmmap_fetch (macho_t *macho)
+{
+    htool_vmmap_t *map, *cached;
+
+    if ((map = htool_cache_fetch (macho, HTOOL_CACHE_KIND_VMMAP)))
+        return map;
+
+    map = _vmmap_build (macho);
+    if ((cached = htool_cache_store (macho, HTOOL_CACHE_KIND_VMMAP, map)) != map)
+        htool_vmmap_free (map);
+    return cached;
+}
+
+htool_vmmap_t *
+htool_vmmap_create_from_header (unsigned char *data, uint64_t size)
+{
+    mach_header_32_t *hdr = (mach_header_32_t *) data;
+    unsigned char *base, *end = data + size;
+    htool_vmmap_t *map;
+    uint32_t cap = 0;
+
+    if (size < sizeof (mach_header_t) || !VMMAP_MACHO (data)) return NULL;
+
+    map = calloc (1, sizeof (htool_vmmap_t));
+    base = data + (VMMAP_IS64 (data) ? sizeof (mach_header_t) : sizeof (mach_header_32_t));
+
+    for (uint32_t i = 0; i < hdr->ncmds; i++) {
+        mach_load_command_t *lc = (mach_load_command_t *) base;
+        if (base + sizeof (mach_load_command_t) > end || lc->cmdsize < sizeof (mach_load_command_t) ||
+            base + lc->cmdsize > end)
+            break;
+
+        if (lc->cmd == LC_SEGMENT) {
+            mach_segment_command_32_t *seg = (mach_segment_command_32_t *) base;
+            _vm_table_add (&map->image, &cap, seg->segname, seg->vmaddr, seg->vmsize, seg->fileoff, seg->filesize, NULL);
+        } else if (lc->cmd == LC_SEGMENT_64) {
+            mach_segment_command_64_t *seg = (mach_segment_command_64_t *) base;
+            _vm_table_add (&map->image, &cap, seg->segname, seg->vmaddr, seg->vmsize, seg->fileoff, seg->filesize, NULL);
+        }
+        base += lc->cmdsize;
+    }
+
+    _vm_table_finalise (&map->image, &map->file_end);
+    return map;
+}
+
+void
+htool_vmmap_free (htool_vmmap_t *map)
+{
+    if (!map) return;
+    free (map->image.segments);
+    free (map->image.by_fileoff);
+    free (map->entries.segments);
+    free (map->entries.by_fileoff);
+    free (map);
+}
+
+const htool_vm_segment_t *
+htool_vmmap_find_vmaddr (htool_vmmap_t *map, uint64_t vmaddr)
+{
+    const htool_vm_segment_t *seg;
+    if ((seg = _vm_table_find_vmaddr (&map->entries, vmaddr))) return seg;
+    return _vm_table_find_vmaddr (&map->image, vmaddr);
+}
+
+const htool_vm_segment_t *
+htool_vmmap_find_offset (htool_vmmap_t *map, uint64_t offset)
+{
+    const htool_vm_segment_t *seg;
+    if ((seg = _vm_table_find_offset (&map->entries, offset))) return seg;
+    return _vm_table_find_offset (&map->image, offset);
+}
+
+int
+htool_vmmap_vmaddr_to_offset (htool_vmmap_t *map, uint64_t vmaddr, uint64_t *offset)
+{
+    const htool_vm_segment_t *seg = htool_vmmap_find_vmaddr (map, vmaddr);
+    if (!seg || vmaddr - seg->vmaddr >= seg->filesize) return 0;
+
+    *offset = seg->fileoff + (vmaddr - seg->vmaddr);
+    return 1;
+}
+
+int
+htool_vmmap_offset_to_vmaddr (htool_vmmap_t *map, uint64_t offset, uint64_t *vmaddr)
+{
+    const htool_vm_segment_t *seg = htool_vmmap_find_offset (map, offset);
+    if (!seg) return 0;
+
+    *vmaddr = seg->vmaddr + (offset - seg->fileoff);
+    return 1;
+}
@@ -0,0 +1,420 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ *  NOTE:   htool-bench measures the throughput of the disassembler over synthetic
+ *          arm64 corpora, so changes to the decoder, formatter or annotations can
+ *          be compared between builds. Three stages are measured:
+ *
+ *              decode      libarch_disass only.
+ *              format      htool_disassemble, output sent to /dev/null.
+ *              annotate    htool_disassemble_with_symbols, with a symbol every
+ *                          function and a string table for ADRP/ADD targets.
+ *
+ *          Each measurement is repeated and the fastest run is reported. Results
+ *          are written as JSON, the layout of which should only change along
+ *          with BENCH_FORMAT_VERSION.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include <libarch.h>
+#include <arm64/arm64-instructions.h>
+
+#include "htool.h"
+#include "commands/disassembler.h"
+#include "disassembler/parser.h"
+#include "disassembler/strings.h"
+#include "disassembler/symmap.h"
+
+#define BENCH_FORMAT_VERSION            1
+
+#define BENCH_DEFAULT_COUNT             (1 << 16)
+#define BENCH_DEFAULT_RUNS              5
+#define BENCH_DEFAULT_SEED              0x68746f6f6cULL
+
+/* Where the synthetic code and strings are "mapped" */
+#define BENCH_CODE_BASE                 0xfffffff007a04000ULL
+#define BENCH_STRINGS_BASE              0xfffffff007004000ULL
+#define BENCH_STRINGS_SIZE              0x10000
+
+/* Instructions between symbols in the random corpus, roughly a kernel's function density */
+#define BENCH_RANDOM_SYMBOL_STRIDE      64
+
+typedef struct bench_corpus_t
+{
+    const char          *name;
+    uint32_t            *opcodes;
+    uint32_t             count;
+
+    /* Function starts, used to build the symbol map */
+    uint64_t            *funcs;
+    uint32_t             nfuncs;
+} bench_corpus_t;
+
+typedef enum bench_mode_t
+{
+    BENCH_MODE_DECODE = 0,
+    BENCH_MODE_FORMAT,
+    BENCH_MODE_ANNOTATE,
+
+    BENCH_MODE_MAX
+} bench_mode_t;
+
+static const char *bench_mode_names[BENCH_MODE_MAX] = { "decode", "format", "annotate" };
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  xorshift64*, so corpora are identical between runs and machines for the
+ *  same seed.
+ */
+HTOOL_PRIVATE uint64_t
+_bench_rand (uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+HTOOL_PRIVATE uint64_t
+_bench_time_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+HTOOL_PRIVATE void
+_bench_corpus_add_func (bench_corpus_t *corpus, uint64_t addr, uint32_t *cap)
+{
+    if (corpus->nfuncs == *cap) {
+        *cap = (*cap) ? *cap * 2 : 256;
+        corpus->funcs = realloc (corpus->funcs, *cap * sizeof (uint64_t));
+    }
+    corpus->funcs[corpus->nfuncs++] = addr;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  Random words that Libarch accepts as an instruction. This covers the whole
+ *  encoding space, so it's the worst case for the decoder.
+ */
+HTOOL_PRIVATE void
+_bench_corpus_random (bench_corpus_t *corpus, uint32_t count, uint64_t seed)
+{
+    uint64_t state = seed;
+    uint32_t cap = 0;
+
+    corpus->name = "random";
+    corpus->opcodes = malloc (count * sizeof (uint32_t));
+    corpus->count = 0;
+
+    while (corpus->count < count) {
+        uint32_t opcode = (uint32_t) (_bench_rand (&state) >> 32);
+        uint64_t addr = BENCH_CODE_BASE + corpus->count * 4;
+
+        instruction_t *in = libarch_instruction_create (opcode, addr);
+        libarch_disass (&in);
+        int valid = (in->type != ARM64_INSTRUCTION_UNK);
+        free (in);
+        if (!valid) continue;
+
+        if (corpus->count % BENCH_RANDOM_SYMBOL_STRIDE == 0)
+            _bench_corpus_add_func (corpus, addr, &cap);
+        corpus->opcodes[corpus->count++] = opcode;
+    }
+}
+
+/**
+ *  Functions shaped like compiled kernel code: a frame record, a body that is
+ *  mostly loads, stores, moves and compares, with ADRP/ADD pairs into the string
+ *  table, conditional branches and calls, then the epilogue.
+ */
+HTOOL_PRIVATE void
+_bench_corpus_kernel (bench_corpus_t *corpus, uint32_t count, uint64_t seed)
+{
+    uint64_t state = seed ^ 0x6b65726e656cULL;
+    uint32_t cap = 0, n = 0;
+
+    corpus->name = "kernel";
+    corpus->opcodes = malloc (count * sizeof (uint32_t));
+
+    while (n < count) {
+        uint32_t body = 8 + (_bench_rand (&state) % 56);
+        uint64_t func = BENCH_CODE_BASE + n * 4;
+
+        _bench_corpus_add_func (corpus, func, &cap);
+
+        /* stp x29, x30, [sp, #-0x10]!; mov x29, sp */
+        if (n < count) corpus->opcodes[n++] = 0xa9bf7bfd;
+        if (n < count) corpus->opcodes[n++] = 0x910003fd;
+
+        for (uint32_t i = 0; i < body && n < count; i++) {
+            uint64_t r = _bench_rand (&state);
+            uint32_t rd = r % 19, rn = (r >> 8) % 19, imm = (r >> 16) & 0xfff;
+            uint32_t pick = (r >> 40) % 100;
+            uint64_t pc = BENCH_CODE_BASE + n * 4;
+
+            if (pick < 20) {
+                /* ldr xd, [xn, #imm] */
+                corpus->opcodes[n++] = 0xf9400000 | ((imm & 0x1ff) << 10) | (rn << 5) | rd;
+            } else if (pick < 32) {
+                /* str xd, [xn, #imm] */
+                corpus->opcodes[n++] = 0xf9000000 | ((imm & 0x1ff) << 10) | (rn << 5) | rd;
+            } else if (pick < 44) {
+                /* mov xd, xn */
+                corpus->opcodes[n++] = 0xaa0003e0 | (rn << 16) | rd;
+            } else if (pick < 52) {
+                /* cmp xn, #imm; b.cond */
+                corpus->opcodes[n++] = 0xf100001f | ((imm & 0xff) << 10) | (rn << 5);
+                if (n < count) corpus->opcodes[n++] = 0x54000000 | ((((r >> 48) & 0x1f) + 2) << 5) | ((r >> 56) & 0xd);
+            } else if (pick < 60) {
+                /* cbz xd, ... */
+                corpus->opcodes[n++] = 0xb4000000 | ((((r >> 48) & 0x1f) + 2) << 5) | rd;
+            } else if (pick < 72) {
+                /* adrp xd, string@PAGE; add xd, xd, string@PAGEOFF */
+                uint64_t str = BENCH_STRINGS_BASE + ((r >> 24) % (BENCH_STRINGS_SIZE / 16)) * 16;
+                int64_t pages = (int64_t) ((str >> 12) - (pc >> 12));
+                uint32_t immlo = pages & 0x3, immhi = (pages >> 2) & 0x7ffff;
+
+                corpus->opcodes[n++] = 0x90000000 | (immlo << 29) | (immhi << 5) | rd;
+                if (n < count) corpus->opcodes[n++] = 0x91000000 | ((str & 0xfff) << 10) | (rd << 5) | rd;
+            } else if (pick < 82) {
+                /* bl to an earlier function */
+                uint64_t target = corpus->funcs[(r >> 24) % corpus->nfuncs];
+                int64_t delta = ((int64_t) target - (int64_t) pc) >> 2;
+                corpus->opcodes[n++] = 0x94000000 | (delta & 0x3ffffff);
+            } else if (pick < 92) {
+                /* movz xd, #imm */
+                corpus->opcodes[n++] = 0xd2800000 | (((r >> 24) & 0xffff) << 5) | rd;
+            } else if (pick < 96) {
+                /* add xd, xn, #imm */
+                corpus->opcodes[n++] = 0x91000000 | (imm << 10) | (rn << 5) | rd;
+            } else {
+                /* blr xn */
+                corpus->opcodes[n++] = 0xd63f0000 | (rn << 5);
+            }
+        }
+
+        /* ldp x29, x30, [sp], #0x10; ret */
+        if (n < count) corpus->opcodes[n++] = 0xa8c17bfd;
+        if (n < count) corpus->opcodes[n++] = 0xd65f03c0;
+    }
+    corpus->count = n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE htool_symmap_t *
+_bench_symbol_map (bench_corpus_t *corpus)
+{
+    htool_symmap_t *map = htool_symmap_create (corpus->nfuncs);
+
+    for (uint32_t i = 0; i < corpus->nfuncs; i++) {
+        char *name = calloc (1, 32);
+        snprintf (name, 32, "_func_%u", i);
+        htool_symmap_insert (map, corpus->funcs[i], name, "method");
+    }
+    return map;
+}
+
+HTOOL_PRIVATE htool_string_index_t *
+_bench_string_index (unsigned char **buffer)
+{
+    htool_string_index_t *index = calloc (1, sizeof (htool_string_index_t));
+    unsigned char *data = calloc (1, BENCH_STRINGS_SIZE);
+
+    /* A string every 16 bytes, matching the targets of the generated ADRP/ADDs */
+    for (uint32_t off = 0; off < BENCH_STRINGS_SIZE; off += 16)
+        snprintf ((char *) data + off, 16, "str_%05x", off);
+
+    index->ranges = calloc (1, sizeof (htool_string_range_t));
+    index->nranges = 1;
+    index->ranges[0].vmaddr = BENCH_STRINGS_BASE;
+    index->ranges[0].size = BENCH_STRINGS_SIZE;
+    index->ranges[0].data = data;
+    index->ranges[0].strict = 0;
+
+    *buffer = data;
+    return index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void
+_bench_run_once (bench_corpus_t *corpus, bench_mode_t mode, htool_disass_annotator_t *ann)
+{
+    unsigned char *data = (unsigned char *) corpus->opcodes;
+
+    switch (mode) {
+        case BENCH_MODE_DECODE:
+            for (uint32_t i = 0; i < corpus->count; i++) {
+                instruction_t *in = libarch_instruction_create (corpus->opcodes[i], BENCH_CODE_BASE + i * 4);
+                libarch_disass (&in);
+                free (in);
+            }
+            break;
+        case BENCH_MODE_FORMAT:
+            htool_disassemble (data, corpus->count, BENCH_CODE_BASE);
+            break;
+        case BENCH_MODE_ANNOTATE:
+            htool_disass_annotator_reset (ann);
+            htool_disassemble_with_symbols (data, corpus->count, BENCH_CODE_BASE, ann);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ *  Run a measurement `runs` times, with stdout redirected to /dev/null so the
+ *  terminal isn't part of what's measured, and return the fastest run.
+ */
+HTOOL_PRIVATE uint64_t
+_bench_measure (bench_corpus_t *corpus, bench_mode_t mode, htool_disass_annotator_t *ann, int runs)
+{
+    uint64_t best = UINT64_MAX;
+    int saved, null;
+
+    fflush (stdout);
+    saved = dup (STDOUT_FILENO);
+    null = open ("/dev/null", O_WRONLY);
+    dup2 (null, STDOUT_FILENO);
+
+    for (int r = 0; r < runs; r++) {
+        uint64_t start = _bench_time_ns ();
+        _bench_run_once (corpus, mode, ann);
+        fflush (stdout);
+        uint64_t elapsed = _bench_time_ns () - start;
+
+        if (elapsed < best) best = elapsed;
+    }
+
+    dup2 (saved, STDOUT_FILENO);
+    close (saved);
+    close (null);
+    return best;
+}
+
+HTOOL_PRIVATE void
+_bench_usage (const char *name)
+{
+    fprintf (stderr,
+    "Usage: %s [OPTIONS]\n" \
+    "\n" \
+    "Options:\n" \
+    "  -n, --count=N        Instructions per corpus (default: %d)\n" \
+    "  -r, --runs=N         Runs per measurement, the fastest is reported (default: %d)\n" \
+    "  -s, --seed=N         Seed for the synthetic corpora\n" \
+    "  -o, --output=PATH    Write results to PATH rather than stdout\n" \
+    "  -h, --help           Print this message\n" \
+    "\n",
+    name, BENCH_DEFAULT_COUNT, BENCH_DEFAULT_RUNS);
+}
+
+static struct option bench_opts[] = {
+    { "count",      required_argument,  NULL,   'n' },
+    { "runs",       required_argument,  NULL,   'r' },
+    { "seed",       required_argument,  NULL,   's' },
+    { "output",     required_argument,  NULL,   'o' },
+    { "help",       no_argument,        NULL,   'h' },
+    { NULL,         0,                  NULL,    0  },
+};
+
+int
+main (int argc, char *argv[])
+{
+    uint32_t count = BENCH_DEFAULT_COUNT;
+    uint64_t seed = BENCH_DEFAULT_SEED;
+    int runs = BENCH_DEFAULT_RUNS, opt;
+    char *output = NULL;
+    FILE *out = stdout;
+
+    while ((opt = getopt_long (argc, argv, "n:r:s:o:h", bench_opts, NULL)) > 0) {
+        switch (opt) {
+            case 'n': count = strtoul (optarg, NULL, 0); break;
+            case 'r': runs = atoi (optarg); break;
+            case 's': seed = strtoull (optarg, NULL, 0); break;
+            case 'o': output = optarg; break;
+            case 'h':
+            default:
+                _bench_usage (argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (!count || runs < 1 || !seed) {
+        _bench_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* Formatted output goes to /dev/null, so buffer it like a pipe would be */
+    setvbuf (stdout, NULL, _IOFBF, 1 << 16);
+
+    bench_corpus_t corpora[2] = { 0 };
+    _bench_corpus_random (&corpora[0], count, seed);
+    _bench_corpus_kernel (&corpora[1], count, seed);
+
+    unsigned char *strings_data;
+    htool_string_index_t *strings = _bench_string_index (&strings_data);
+
+    if (output && !(out = fopen (output, "w"))) {
+        fprintf (stderr, "htool-bench: could not open %s\n", output);
+        return EXIT_FAILURE;
+    }
+
+    fprintf (out, "{\n");
+    fprintf (out, "  \"benchmark\": \"htool-disass\",\n");
+    fprintf (out, "  \"format_version\": %d,\n", BENCH_FORMAT_VERSION);
+    fprintf (out, "  \"instructions\": %u,\n", count);
+    fprintf (out, "  \"runs\": %d,\n", runs);
+    fprintf (out, "  \"seed\": %llu,\n", (unsigned long long) seed);
+    fprintf (out, "  \"results\": [\n");
+
+    for (int c = 0; c < 2; c++) {
+        bench_corpus_t *corpus = &corpora[c];
+        htool_disass_annotator_t ann = {
+            .strings = strings,
+            .symbols = _bench_symbol_map (corpus),
+        };
+
+        for (int m = 0; m < BENCH_MODE_MAX; m++) {
+            uint64_t ns = _bench_measure (corpus, m, &ann, runs);
+            double secs = (double) ns / 1e9;
+
+            fprintf (out, "    { \"corpus\": \"%s\", \"mode\": \"%s\", \"instructions\": %u, \"symbols\": %u, "
+                          "\"seconds\": %.6f, \"instructions_per_second\": %.0f, \"ns_per_instruction\": %.2f }%s\n",
+                corpus->name, bench_mode_names[m], corpus->count, corpus->nfuncs,
+                secs, (double) corpus->count / secs, (double) ns / corpus->count,
+                (c == 1 && m == BENCH_MODE_MAX - 1) ? "" : ",");
+        }
+        htool_symmap_free (ann.symbols);
+    }
+
+    fprintf (out, "  ]\n}\n");
+    fflush (out);
+    if (out != stdout) fclose (out);
+    return EXIT_SUCCESS;
+}
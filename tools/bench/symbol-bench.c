@@ -0,0 +1,357 @@
+//===----------------------------------------------------------------------===//
+//
+//                         === The HTool Project ===
+//
+//  This  document  is the property of "Is This On?" It is considered to be
+//  confidential and proprietary and may not be, in any form, reproduced or
+//  transmitted, in whole or in part, without express permission of Is This
+//  On?.
+//
+//  Copyright (C) 2023, Harry Moulton - Is This On? Holdings Ltd
+//
+//  Harry Moulton <me@h3adsh0tzz.com>
+//
+//===----------------------------------------------------------------------===//
+
+/**
+ *  NOTE:   htool-symbol-bench compares symbol map implementations on the work the
+ *          disassembler actually gives them:
+ *
+ *              build       Insert every symbol of a kernel-sized symbol table.
+ *              hit         Look up the address of every symbol, in random order.
+ *              scan        Look up every instruction address across the text,
+ *                          in order, as a disassembly does. Almost all of these
+ *                          miss.
+ *
+ *          Each implementation is run on the same addresses. Results are reported
+ *          in the same JSON layout as htool-bench.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include "htool.h"
+#include "disassembler/symmap.h"
+#include "disassembler/hashmap.h"
+
+#define BENCH_FORMAT_VERSION            1
+
+/* Roughly the symbol count and text size of an arm64 kernelcache with its kexts */
+#define BENCH_DEFAULT_SYMBOLS           300000
+#define BENCH_DEFAULT_TEXT_SIZE         (48 * 1024 * 1024)
+#define BENCH_DEFAULT_RUNS              5
+#define BENCH_DEFAULT_SEED              0x68746f6f6cULL
+
+#define BENCH_TEXT_BASE                 0xfffffff007a04000ULL
+
+typedef struct bench_workload_t
+{
+    inline_symbol_t     *syms;          /* sorted by address */
+    uint64_t            *shuffled;      /* the same addresses, shuffled */
+    uint32_t             nsyms;
+    uint64_t             text_size;
+} bench_workload_t;
+
+typedef struct bench_impl_t
+{
+    const char      *name;
+    void           *(*build) (bench_workload_t *w);
+    uint64_t        (*hit) (void *map, bench_workload_t *w);
+    uint64_t        (*scan) (void *map, bench_workload_t *w);
+    void            (*destroy) (void *map);
+} bench_impl_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE uint64_t
+_bench_rand (uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+HTOOL_PRIVATE uint64_t
+_bench_time_ns ()
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ *  Functions are spread through the text with sizes from 16 bytes up, like a
+ *  real kernel. Every 512th symbol also has a section starting at the same
+ *  address.
+ */
+HTOOL_PRIVATE void
+_bench_workload_create (bench_workload_t *w, uint32_t nsyms, uint64_t text_size, uint64_t seed)
+{
+    uint64_t state = seed, addr = BENCH_TEXT_BASE;
+    uint64_t avg = text_size / nsyms;
+
+    w->syms = malloc (nsyms * sizeof (inline_symbol_t));
+    w->shuffled = malloc (nsyms * sizeof (uint64_t));
+    w->text_size = text_size;
+    w->nsyms = 0;
+
+    for (uint32_t i = 0; i < nsyms; i++) {
+        int section = (i % 512 == 0) && i;
+
+        w->syms[w->nsyms++] = (inline_symbol_t) { .virt_addr = addr, .name = "_func", .type = "method" };
+        if (section && w->nsyms < nsyms) {
+            w->syms[w->nsyms++] = (inline_symbol_t) { .virt_addr = addr, .name = "__TEXT_EXEC.__text", .type = "section" };
+            i++;
+        }
+        addr += 16 + ((_bench_rand (&state) % (avg * 2)) & ~UINT64_C(3));
+    }
+    w->text_size = addr - BENCH_TEXT_BASE;
+
+    for (uint32_t i = 0; i < w->nsyms; i++) w->shuffled[i] = w->syms[i].virt_addr;
+    for (uint32_t i = w->nsyms - 1; i > 0; i--) {
+        uint32_t j = _bench_rand (&state) % (i + 1);
+        uint64_t t = w->shuffled[i];
+        w->shuffled[i] = w->shuffled[j];
+        w->shuffled[j] = t;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+/**
+ *  The generic hashmap, set up the way the disassembler used it: the whole
+ *  inline_symbol_t is the item, hashed on the address with SipHash. It only
+ *  holds one item per address.
+ */
+HTOOL_PRIVATE uint64_t
+_hashmap_hash (const void *item, uint64_t seed0, uint64_t seed1)
+{
+    const inline_symbol_t *sym = item;
+    return hashmap_sip (&sym->virt_addr, sizeof (sym->virt_addr), seed0, seed1);
+}
+
+HTOOL_PRIVATE int
+_hashmap_compare (const void *a, const void *b, void *udata)
+{
+    const inline_symbol_t *aa = a, *bb = b;
+    return (aa->virt_addr > bb->virt_addr) - (aa->virt_addr < bb->virt_addr);
+}
+
+HTOOL_PRIVATE void *
+_hashmap_build (bench_workload_t *w)
+{
+    struct hashmap *map = hashmap_new (sizeof (inline_symbol_t), 0, 0, 0, _hashmap_hash, _hashmap_compare, NULL, NULL);
+    for (uint32_t i = 0; i < w->nsyms; i++) hashmap_set (map, &w->syms[i]);
+    return map;
+}
+
+HTOOL_PRIVATE void *
+_hashmap_build_cap (bench_workload_t *w)
+{
+    struct hashmap *map = hashmap_new (sizeof (inline_symbol_t), w->nsyms, 0, 0, _hashmap_hash, _hashmap_compare, NULL, NULL);
+    for (uint32_t i = 0; i < w->nsyms; i++) hashmap_set (map, &w->syms[i]);
+    return map;
+}
+
+HTOOL_PRIVATE uint64_t
+_hashmap_hit (void *map, bench_workload_t *w)
+{
+    uint64_t found = 0;
+    for (uint32_t i = 0; i < w->nsyms; i++)
+        found += (hashmap_get (map, &(inline_symbol_t) { .virt_addr = w->shuffled[i] }) != NULL);
+    return found;
+}
+
+HTOOL_PRIVATE uint64_t
+_hashmap_scan (void *map, bench_workload_t *w)
+{
+    uint64_t found = 0;
+    for (uint64_t off = 0; off < w->text_size; off += 4)
+        found += (hashmap_get (map, &(inline_symbol_t) { .virt_addr = BENCH_TEXT_BASE + off }) != NULL);
+    return found;
+}
+
+HTOOL_PRIVATE void
+_hashmap_destroy (void *map)
+{
+    hashmap_free (map);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void *
+_symmap_build (bench_workload_t *w)
+{
+    htool_symmap_t *map = htool_symmap_create (0);
+    for (uint32_t i = 0; i < w->nsyms; i++)
+        htool_symmap_insert (map, w->syms[i].virt_addr, w->syms[i].name, w->syms[i].type);
+    return map;
+}
+
+HTOOL_PRIVATE void *
+_symmap_build_bulk (bench_workload_t *w)
+{
+    htool_symmap_t *map = htool_symmap_create (w->nsyms);
+    htool_symmap_insert_bulk (map, w->syms, w->nsyms);
+    return map;
+}
+
+HTOOL_PRIVATE uint64_t
+_symmap_hit (void *map, bench_workload_t *w)
+{
+    uint64_t found = 0;
+    for (uint32_t i = 0; i < w->nsyms; i++)
+        found += (htool_symmap_lookup (map, w->shuffled[i]) != NULL);
+    return found;
+}
+
+HTOOL_PRIVATE uint64_t
+_symmap_scan (void *map, bench_workload_t *w)
+{
+    uint64_t found = 0;
+    for (uint64_t off = 0; off < w->text_size; off += 4)
+        found += (htool_symmap_lookup (map, BENCH_TEXT_BASE + off) != NULL);
+    return found;
+}
+
+HTOOL_PRIVATE void
+_symmap_destroy (void *map)
+{
+    htool_symmap_free (map);
+}
+
+static const bench_impl_t bench_impls[] = {
+    { "hashmap",            _hashmap_build,         _hashmap_hit,   _hashmap_scan,  _hashmap_destroy },
+    { "hashmap-cap",        _hashmap_build_cap,     _hashmap_hit,   _hashmap_scan,  _hashmap_destroy },
+    { "symmap",             _symmap_build,          _symmap_hit,    _symmap_scan,   _symmap_destroy },
+    { "symmap-bulk",        _symmap_build_bulk,     _symmap_hit,    _symmap_scan,   _symmap_destroy },
+};
+
+#define BENCH_IMPLS_LEN     (sizeof (bench_impls) / sizeof (bench_impls[0]))
+
+///////////////////////////////////////////////////////////////////////////////
+
+HTOOL_PRIVATE void
+_bench_print_result (FILE *out, const char *impl, const char *op, uint64_t ops, uint64_t ns, uint64_t found, int last)
+{
+    double secs = (double) ns / 1e9;
+    fprintf (out, "    { \"impl\": \"%s\", \"op\": \"%s\", \"ops\": %llu, \"found\": %llu, "
+                  "\"seconds\": %.6f, \"ops_per_second\": %.0f, \"ns_per_op\": %.2f }%s\n",
+        impl, op, (unsigned long long) ops, (unsigned long long) found,
+        secs, (double) ops / secs, (double) ns / ops, last ? "" : ",");
+}
+
+HTOOL_PRIVATE void
+_bench_usage (const char *name)
+{
+    fprintf (stderr,
+    "Usage: %s [OPTIONS]\n" \
+    "\n" \
+    "Options:\n" \
+    "  -n, --symbols=N      Symbols in the table (default: %d)\n" \
+    "  -t, --text-size=N    Approximate bytes of text to scan (default: %d)\n" \
+    "  -r, --runs=N         Runs per measurement, the fastest is reported (default: %d)\n" \
+    "  -s, --seed=N         Seed for the synthetic symbol table\n" \
+    "  -o, --output=PATH    Write results to PATH rather than stdout\n" \
+    "  -h, --help           Print this message\n" \
+    "\n",
+    name, BENCH_DEFAULT_SYMBOLS, BENCH_DEFAULT_TEXT_SIZE, BENCH_DEFAULT_RUNS);
+}
+
+static struct option bench_opts[] = {
+    { "symbols",    required_argument,  NULL,   'n' },
+    { "text-size",  required_argument,  NULL,   't' },
+    { "runs",       required_argument,  NULL,   'r' },
+    { "seed",       required_argument,  NULL,   's' },
+    { "output",     required_argument,  NULL,   'o' },
+    { "help",       no_argument,        NULL,   'h' },
+    { NULL,         0,                  NULL,    0  },
+};
+
+int
+main (int argc, char *argv[])
+{
+    uint32_t nsyms = BENCH_DEFAULT_SYMBOLS;
+    uint64_t text_size = BENCH_DEFAULT_TEXT_SIZE;
+    uint64_t seed = BENCH_DEFAULT_SEED;
+    int runs = BENCH_DEFAULT_RUNS, opt;
+    char *output = NULL;
+    FILE *out = stdout;
+    bench_workload_t w;
+
+    while ((opt = getopt_long (argc, argv, "n:t:r:s:o:h", bench_opts, NULL)) > 0) {
+        switch (opt) {
+            case 'n': nsyms = strtoul (optarg, NULL, 0); break;
+            case 't': text_size = strtoull (optarg, NULL, 0); break;
+            case 'r': runs = atoi (optarg); break;
+            case 's': seed = strtoull (optarg, NULL, 0); break;
+            case 'o': output = optarg; break;
+            case 'h':
+            default:
+                _bench_usage (argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (nsyms < 2 || text_size < nsyms * 16ULL || runs < 1 || !seed) {
+        _bench_usage (argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    _bench_workload_create (&w, nsyms, text_size, seed);
+
+    if (output && !(out = fopen (output, "w"))) {
+        fprintf (stderr, "htool-symbol-bench: could not open %s\n", output);
+        return EXIT_FAILURE;
+    }
+
+    fprintf (out, "{\n");
+    fprintf (out, "  \"benchmark\": \"htool-symbols\",\n");
+    fprintf (out, "  \"format_version\": %d,\n", BENCH_FORMAT_VERSION);
+    fprintf (out, "  \"symbols\": %u,\n", w.nsyms);
+    fprintf (out, "  \"text_size\": %llu,\n", (unsigned long long) w.text_size);
+    fprintf (out, "  \"runs\": %d,\n", runs);
+    fprintf (out, "  \"seed\": %llu,\n", (unsigned long long) seed);
+    fprintf (out, "  \"results\": [\n");
+
+    for (uint32_t i = 0; i < BENCH_IMPLS_LEN; i++) {
+        const bench_impl_t *impl = &bench_impls[i];
+        uint64_t best_build = UINT64_MAX, best_hit = UINT64_MAX, best_scan = UINT64_MAX;
+        uint64_t hits = 0, scanned = 0;
+
+        for (int r = 0; r < runs; r++) {
+            uint64_t start = _bench_time_ns ();
+            void *map = impl->build (&w);
+            uint64_t t_build = _bench_time_ns () - start;
+
+            start = _bench_time_ns ();
+            hits = impl->hit (map, &w);
+            uint64_t t_hit = _bench_time_ns () - start;
+
+            start = _bench_time_ns ();
+            scanned = impl->scan (map, &w);
+            uint64_t t_scan = _bench_time_ns () - start;
+
+            impl->destroy (map);
+
+            if (t_build < best_build) best_build = t_build;
+            if (t_hit < best_hit) best_hit = t_hit;
+            if (t_scan < best_scan) best_scan = t_scan;
+        }
+
+        int last = (i == BENCH_IMPLS_LEN - 1);
+        _bench_print_result (out, impl->name, "build", w.nsyms, best_build, w.nsyms, 0);
+        _bench_print_result (out, impl->name, "hit", w.nsyms, best_hit, hits, 0);
+        _bench_print_result (out, impl->name, "scan", w.text_size / 4, best_scan, scanned, last);
+    }
+
+    fprintf (out, "  ]\n}\n");
+    fflush (out);
+    if (out != stdout) fclose (out);
+    return EXIT_SUCCESS;
+}